@@ -0,0 +1,67 @@
+#include "arena.h"
+#include "utils.h"
+#include <stdlib.h>
+
+// Alignment of every allocation; matches ArenaBlock.data
+#define ARENA_ALIGN 16
+
+// Prepares an empty arena; blocks are allocated on first use
+void arena_init(Arena *arena, size_t block_size) {
+    arena->first = NULL;
+    arena->current = NULL;
+    arena->block_size = block_size ? block_size : ARENA_BLOCK_SIZE;
+}
+
+// Returns size bytes from the arena, or NULL if memory runs out
+void *arena_alloc(Arena *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    ArenaBlock *block = arena->current;
+    // Move on to blocks kept from before the last reset when this one is full
+    while (block && block->size - block->used < size) {
+        block = block->next;
+    }
+    if (!block) {
+        size_t block_size = size > arena->block_size ? size : arena->block_size;
+        block = malloc(sizeof(ArenaBlock) + block_size);
+        if (!block) {
+            report_error("Failed to allocate arena block", 0);
+            return NULL;
+        }
+        block->size = block_size;
+        block->used = 0;
+        block->next = NULL;
+        // Append so reused blocks keep their order after a reset
+        if (!arena->first) {
+            arena->first = block;
+        } else {
+            ArenaBlock *last = arena->current ? arena->current : arena->first;
+            while (last->next) {
+                last = last->next;
+            }
+            last->next = block;
+        }
+    }
+    arena->current = block;
+    void *result = block->data + block->used;
+    block->used += size;
+    return result;
+}
+
+// Releases every allocation at once while keeping the blocks
+void arena_reset(Arena *arena) {
+    for (ArenaBlock *block = arena->first; block; block = block->next) {
+        block->used = 0;
+    }
+    arena->current = arena->first;
+}
+
+// Returns all blocks to the system
+void arena_free(Arena *arena) {
+    ArenaBlock *block = arena->first;
+    while (block) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->first = arena->current = NULL;
+}
@@ -0,0 +1,31 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Default size of each arena block
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t size;                // Usable bytes in data[]
+    size_t used;
+    _Alignas(16) uint8_t data[];
+} ArenaBlock;
+
+// Bump allocator for short-lived per-page data. Nothing is freed on its
+// own; arena_reset() rewinds every block for reuse, so a steady workload
+// stops calling malloc once the arena has grown to its working size.
+typedef struct {
+    ArenaBlock* first;
+    ArenaBlock* current;
+    size_t block_size;
+} Arena;
+
+void arena_init(Arena* arena, size_t block_size);
+void* arena_alloc(Arena* arena, size_t size);
+void arena_reset(Arena* arena);
+void arena_free(Arena* arena);
+
+#endif
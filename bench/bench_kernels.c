@@ -0,0 +1,401 @@
+#include "kernel_harness.h"
+#include "wal_gen.h"
+#include "../arena.h"
+#include "../output_sink.h"
+#include "../page_analyzer.h"
+#include "../record_view.h"
+#include "../utils.h"
+#include "../wal_checksum.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define USAGE "Usage: bench_kernels [--filter TEXT] [--samples N] [--warmup MS] [--cpu N]\n" \
+              "                     [--baseline FILE] [--save FILE] [--threshold PERCENT]"
+
+#define VARINT_COUNT 4096
+#define CHECKSUM_FRAMES 16
+#define RECORD_PAGE_SIZE 4096
+#define RECORD_COLUMNS 8
+#define MAX_RECORD_CELLS 128
+#define ENDIAN_BYTES (16 * 1024)
+#define DEFAULT_THRESHOLD 10.0
+
+static uint64_t random_state = 0x9e3779b97f4a7c15ull;
+
+// Varints in the proportions record headers and cell prefixes produce
+static uint8_t varints[VARINT_COUNT * 9];
+static size_t varints_size;
+
+static uint8_t checksum_pages[CHECKSUM_FRAMES][RECORD_PAGE_SIZE];
+
+// A table leaf full of typical rows, with every cell parsed once up front
+// for the column kernels
+static uint8_t record_page[RECORD_PAGE_SIZE];
+static uint16_t record_offsets[MAX_RECORD_CELLS];
+static uint32_t record_cells;
+static uint32_t record_bytes;
+static CellInfo cells[MAX_RECORD_CELLS];
+static RecordView views[MAX_RECORD_CELLS];
+static int64_t serial_types[MAX_RECORD_CELLS * RECORD_COLUMNS];
+static Arena kernel_arena;
+static OutputSink column_sink;
+
+static uint8_t endian_data[ENDIAN_BYTES];
+
+static uint32_t next_random(void) {
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+    return (uint32_t)((random_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static void fill_random(uint8_t *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        data[i] = (uint8_t)next_random();
+    }
+}
+
+// Picks a varint length: mostly one byte, as for serial types and small
+// rowids, thinning out towards the full nine bytes
+static uint64_t skewed_varint_value(void) {
+    static const uint8_t lengths[] = { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 4, 9 };
+    uint32_t length = lengths[next_random() % sizeof(lengths)];
+    if (length == 9) {
+        return ((uint64_t)next_random() << 32 | next_random()) | (1ull << 63);
+    }
+    uint64_t low = length == 1 ? 0 : 1ull << (7 * (length - 1));
+    uint64_t span = (1ull << (7 * length)) - low;
+    return low + ((uint64_t)next_random() << 32 | next_random()) % span;
+}
+
+static void setup_varints(void) {
+    varints_size = 0;
+    for (uint32_t i = 0; i < VARINT_COUNT; i++) {
+        varints_size += wal_gen_put_varint(varints + varints_size, skewed_varint_value());
+    }
+}
+
+// Appends one column to a record being built; returns the body bytes written
+static uint32_t put_column(uint8_t **header, uint8_t *body, int64_t serial_type, const char *text) {
+    *header += wal_gen_put_varint(*header, (uint64_t)serial_type);
+    uint32_t length = serial_type_length(serial_type);
+    if (text) {
+        memcpy(body, text, length);
+    } else {
+        fill_random(body, length);
+    }
+    return length;
+}
+
+// Builds a row shaped like an application table: id, email, name, age,
+// balance, created timestamp, an often-NULL note, an active flag
+static uint32_t build_record(uint8_t *out, uint32_t row) {
+    static const char *names[] = { "alice", "bob", "carol", "dave", "erin", "frank", "grace", "heidi" };
+    static const char note[] = "customer asked for a callback after the renewal";
+    char email[48];
+    const char *name = names[row % 8];
+    int email_length = snprintf(email, sizeof(email), "%s.%u@example.com", name, row);
+
+    uint8_t header[32];
+    uint8_t body[256];
+    uint8_t *cursor = header + 1;
+    uint32_t body_size = 0;
+    body_size += put_column(&cursor, body + body_size, row % 5 ? 1 : 2, NULL);
+    body_size += put_column(&cursor, body + body_size, 13 + 2 * email_length, email);
+    body_size += put_column(&cursor, body + body_size, 13 + 2 * (int64_t)strlen(name), name);
+    body_size += put_column(&cursor, body + body_size, 1, NULL);
+    body_size += put_column(&cursor, body + body_size, 7, NULL);
+    body_size += put_column(&cursor, body + body_size, 5, NULL);
+    body_size += row % 4 ? put_column(&cursor, body + body_size, 0, NULL)
+                         : put_column(&cursor, body + body_size, 13 + 2 * (int64_t)(sizeof(note) - 1), note);
+    body_size += put_column(&cursor, body + body_size, row % 3 ? 9 : 8, NULL);
+    header[0] = (uint8_t)(cursor - header);
+    memcpy(out, header, header[0]);
+    memcpy(out + header[0], body, body_size);
+    return header[0] + body_size;
+}
+
+// Fills a table leaf with rows from the end of the page until it is full
+static int setup_records(void) {
+    memset(record_page, 0, sizeof(record_page));
+    record_page[0] = 0x0D;
+    uint32_t content = RECORD_PAGE_SIZE;
+    record_cells = 0;
+    while (record_cells < MAX_RECORD_CELLS) {
+        uint8_t record[288];
+        uint32_t record_length = build_record(record, record_cells);
+        uint8_t prefix[18];
+        int prefix_length = wal_gen_put_varint(prefix, record_length);
+        prefix_length += wal_gen_put_varint(prefix + prefix_length, 1000 + record_cells);
+        uint32_t length = (uint32_t)prefix_length + record_length;
+        if (content < 8 + 2 * (record_cells + 1) + length) {
+            break;
+        }
+        content -= length;
+        memcpy(record_page + content, prefix, prefix_length);
+        memcpy(record_page + content + prefix_length, record, record_length);
+        record_offsets[record_cells] = (uint16_t)content;
+        record_page[8 + 2 * record_cells] = (uint8_t)(content >> 8);
+        record_page[9 + 2 * record_cells] = (uint8_t)content;
+        record_cells++;
+    }
+    record_page[3] = (uint8_t)(record_cells >> 8);
+    record_page[4] = (uint8_t)record_cells;
+    record_page[5] = (uint8_t)(content >> 8);
+    record_page[6] = (uint8_t)content;
+    record_bytes = RECORD_PAGE_SIZE - content;
+
+    arena_init(&kernel_arena, ARENA_BLOCK_SIZE);
+    for (uint32_t i = 0; i < record_cells; i++) {
+        if (parse_cell(&cells[i], record_page, record_offsets[i], RECORD_PAGE_SIZE, NULL) != 0 ||
+            record_view_init(&views[i], &cells[i], record_page, RECORD_PAGE_SIZE, NULL, NULL) != 0) {
+            report_error("Failed to parse benchmark record", 0);
+            return -1;
+        }
+        memcpy(serial_types + i * RECORD_COLUMNS, cells[i].serial_types, RECORD_COLUMNS * sizeof(int64_t));
+    }
+    return sink_init(&column_sink, -1, OUTPUT_TEXT);
+}
+
+static void free_records(void) {
+    for (uint32_t i = 0; i < record_cells; i++) {
+        record_view_free(&views[i]);
+        free_cell_info(&cells[i]);
+    }
+    arena_free(&kernel_arena);
+    sink_free(&column_sink);
+}
+
+KERNEL(kernel_parse_varint) {
+    uint64_t sum = 0;
+    size_t pos = 0;
+    int bytes_read;
+    while (pos < varints_size) {
+        sum += (uint64_t)parse_varint(varints, &pos, varints_size, &bytes_read);
+    }
+    return sum;
+}
+
+KERNEL(kernel_decode_varint_batch) {
+    int64_t values[256];
+    uint64_t sum = 0;
+    size_t pos = 0;
+    while (pos < varints_size) {
+        size_t consumed = 0;
+        uint32_t count = decode_varint_batch(varints + pos, varints_size - pos, values, 256, &consumed);
+        if (count == 0) {
+            break;
+        }
+        sum += (uint64_t)values[count - 1];
+        pos += consumed;
+    }
+    return sum;
+}
+
+// Chains the checksum through consecutive frames, as wal_verify_frames does
+KERNEL(kernel_checksum) {
+    uint32_t checksum1 = 0, checksum2 = 0;
+    for (uint32_t i = 0; i < CHECKSUM_FRAMES; i++) {
+        compute_wal_checksum(checksum_pages[i], RECORD_PAGE_SIZE, 0, &checksum1, &checksum2);
+    }
+    return checksum1 ^ checksum2;
+}
+
+KERNEL(kernel_parse_cell) {
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < record_cells; i++) {
+        CellInfo cell;
+        if (parse_cell(&cell, record_page, record_offsets[i], RECORD_PAGE_SIZE, &kernel_arena) == 0) {
+            sum += cell.column_count + (uint64_t)cell.header_size;
+            free_cell_info(&cell);
+        }
+    }
+    arena_reset(&kernel_arena);
+    return sum;
+}
+
+KERNEL(kernel_parse_serial_type) {
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < record_cells * RECORD_COLUMNS; i++) {
+        const char *type_name;
+        uint32_t length;
+        if (parse_serial_type(serial_types[i], &type_name, &length) == 0) {
+            sum += length + (uint8_t)type_name[0];
+        }
+    }
+    return sum;
+}
+
+KERNEL(kernel_print_column_value) {
+    column_sink.size = 0;
+    for (uint32_t i = 0; i < record_cells; i++) {
+        for (uint32_t column = 0; column < RECORD_COLUMNS; column++) {
+            print_column_value(&column_sink, &views[i], column);
+        }
+    }
+    return column_sink.size;
+}
+
+KERNEL(kernel_to_host16) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < ENDIAN_BYTES; i += 2) {
+        uint16_t value;
+        memcpy(&value, endian_data + i, sizeof(value));
+        sum += to_host16(value);
+    }
+    return sum;
+}
+
+KERNEL(kernel_to_host32) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < ENDIAN_BYTES; i += 4) {
+        uint32_t value;
+        memcpy(&value, endian_data + i, sizeof(value));
+        sum += to_host32(value);
+    }
+    return sum;
+}
+
+KERNEL(kernel_to_host64) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < ENDIAN_BYTES; i += 8) {
+        uint64_t value;
+        memcpy(&value, endian_data + i, sizeof(value));
+        sum += to_host64(value);
+    }
+    return sum;
+}
+
+// Times every checksum kernel this CPU supports, then restores the default
+static void run_checksum_kernels(void) {
+    static const char *kernels[] = { "scalar", "sse4.1", "avx2", "avx512" };
+    static const char *names[] = { "checksum/scalar", "checksum/sse4.1", "checksum/avx2", "checksum/avx512" };
+    const char *selected = wal_checksum_kernel_name();
+    for (int i = 0; i < 4; i++) {
+        if (wal_checksum_set_kernel(kernels[i]) == 0) {
+            run_kernel(names[i], kernel_checksum, CHECKSUM_FRAMES, (uint64_t)CHECKSUM_FRAMES * RECORD_PAGE_SIZE);
+        }
+    }
+    wal_checksum_set_kernel(selected);
+}
+
+static void run_all_kernels(void) {
+    run_kernel("parse_varint", kernel_parse_varint, VARINT_COUNT, varints_size);
+    run_kernel("decode_varint_batch", kernel_decode_varint_batch, VARINT_COUNT, varints_size);
+    run_checksum_kernels();
+    run_kernel("parse_cell", kernel_parse_cell, record_cells, record_bytes);
+    run_kernel("parse_serial_type", kernel_parse_serial_type, record_cells * RECORD_COLUMNS, 0);
+    run_kernel("print_column_value", kernel_print_column_value, record_cells * RECORD_COLUMNS, record_bytes);
+    run_kernel("to_host16", kernel_to_host16, ENDIAN_BYTES / 2, ENDIAN_BYTES);
+    run_kernel("to_host32", kernel_to_host32, ENDIAN_BYTES / 4, ENDIAN_BYTES);
+    run_kernel("to_host64", kernel_to_host64, ENDIAN_BYTES / 8, ENDIAN_BYTES);
+}
+
+// Writes one "kernel p50_ns" line per result
+static int save_baseline(const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        return report_error("Failed to write baseline file", 1);
+    }
+    uint32_t count;
+    const KernelResult *results = kernel_results(&count);
+    fprintf(file, "# kernel p50_ns_per_op\n");
+    for (uint32_t i = 0; i < count; i++) {
+        fprintf(file, "%s %.3f\n", results[i].name, results[i].ns_p50);
+    }
+    return fclose(file) == 0 ? 0 : report_error("Failed to write baseline file", 1);
+}
+
+// Compares median ns/op with the baseline; returns the number of kernels
+// that got slower by more than threshold percent, or -1 on error
+static int compare_baseline(const char *filename, double threshold) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        return report_error("Failed to open baseline file", 1);
+    }
+    uint32_t count;
+    const KernelResult *results = kernel_results(&count);
+    printf("\n%-24s %12s %12s %8s\n", "kernel", "baseline ns", "p50 ns", "change");
+    int regressions = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        char name[64];
+        double baseline_ns;
+        if (line[0] == '#' || sscanf(line, "%63s %lf", name, &baseline_ns) != 2 || baseline_ns <= 0) {
+            continue;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            if (strcmp(results[i].name, name) != 0) {
+                continue;
+            }
+            double change = (results[i].ns_p50 / baseline_ns - 1) * 100;
+            int regressed = change > threshold;
+            regressions += regressed;
+            printf("%-24s %12.3f %12.3f %+7.1f%%%s\n", name, baseline_ns, results[i].ns_p50, change,
+                   regressed ? "  REGRESSION" : "");
+        }
+    }
+    fclose(file);
+    return regressions;
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option options[] = {
+        {"filter", required_argument, NULL, 'f'},
+        {"samples", required_argument, NULL, 'n'},
+        {"warmup", required_argument, NULL, 'u'},
+        {"cpu", required_argument, NULL, 'c'},
+        {"baseline", required_argument, NULL, 'b'},
+        {"save", required_argument, NULL, 'w'},
+        {"threshold", required_argument, NULL, 't'},
+        {NULL, 0, NULL, 0}
+    };
+    KernelOptions kernel_options;
+    kernel_options_defaults(&kernel_options);
+    const char *baseline = NULL;
+    const char *save = NULL;
+    double threshold = DEFAULT_THRESHOLD;
+    int option;
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 'f': kernel_options.filter = optarg; break;
+            case 'n': kernel_options.samples = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'u': kernel_options.warmup_ms = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'c': kernel_options.cpu = atoi(optarg); break;
+            case 'b': baseline = optarg; break;
+            case 'w': save = optarg; break;
+            case 't': threshold = atof(optarg); break;
+            default:
+                fprintf(stderr, "%s\n", USAGE);
+                return 1;
+        }
+    }
+    if (optind != argc) {
+        fprintf(stderr, "%s\n", USAGE);
+        return 1;
+    }
+
+    setup_varints();
+    fill_random(&checksum_pages[0][0], sizeof(checksum_pages));
+    fill_random(endian_data, sizeof(endian_data));
+    if (setup_records() != 0 || kernel_harness_init(&kernel_options) != 0) {
+        return 1;
+    }
+    run_all_kernels();
+
+    int status = 0;
+    if (save && save_baseline(save) != 0) {
+        status = 1;
+    }
+    if (baseline) {
+        int regressions = compare_baseline(baseline, threshold);
+        if (regressions != 0) {
+            status = 1;
+        }
+    }
+    kernel_harness_free();
+    free_records();
+    return status;
+}
@@ -0,0 +1,431 @@
+#include "wal_gen.h"
+#include "../arena.h"
+#include "../frame_decoder.h"
+#include "../frame_output.h"
+#include "../output_sink.h"
+#include "../page_analyzer.h"
+#include "../page_owner.h"
+#include "../record_view.h"
+#include "../utils.h"
+#include "../wal_checksum.h"
+#include "../wal_parser.h"
+#include "../wal_reader.h"
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define USAGE "Usage: bench_wal [--scenario NAME] [--format text|json|binary] [--repeat N]\n" \
+              "                 [--baseline FILE] [--save FILE] [--threshold PERCENT]\n" \
+              "       bench_wal --generate DB [--page-size N] [--frames N] [--pages N] [--leaf PERCENT]\n" \
+              "                 [--cells N] [--overflow PERCENT] [--commit N] [--seed N]"
+
+// Header opens timed per run; one is too short to measure
+#define HEADER_ITERATIONS 100
+#define DEFAULT_REPEATS 3
+#define DEFAULT_THRESHOLD 10.0
+
+typedef struct {
+    const char *name;
+    WalGenConfig config;
+} Scenario;
+
+// Shapes we track: the everyday 4 KiB mix, many tiny autocommit frames,
+// huge pages, and overflow-heavy rows
+static const Scenario scenarios[] = {
+    { "mixed-4k", { 4096, 10000, 256, 80, 20, 5, 10, 1 } },
+    { "small-512", { 512, 40000, 64, 90, 4, 2, 1, 2 } },
+    { "large-64k", { 65536, 600, 128, 70, 200, 10, 50, 3 } },
+    { "overflow-1k", { 1024, 20000, 64, 100, 8, 50, 5, 4 } },
+};
+
+// Best-of-repeats timings of one scenario; stage times cover the whole WAL
+typedef struct {
+    const char *name;
+    uint32_t page_size;
+    uint32_t frames;
+    uint64_t wal_bytes;
+    double header_us;           // One open: map the file and verify the header
+    double checksum_ms;
+    double lookup_ms;           // Ownership map build plus one lookup per frame
+    double decode_ms;           // Cells and record columns of every table leaf
+    double output_ms;           // Formatting every frame into the sink
+    double total_ms;            // print_wal_info end to end
+    double frames_per_second;
+    double mb_per_second;
+} BenchResult;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static double min_time(double a, double b) {
+    return a < b ? a : b;
+}
+
+// Opens a sink that discards its output, so only formatting is measured
+static int open_null_sink(OutputSink *sink, OutputFormat format) {
+    int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return report_error("Failed to open /dev/null", 1);
+    }
+    if (sink_init(sink, fd, format) != 0) {
+        close(fd);
+        return -1;
+    }
+    return 0;
+}
+
+static void close_null_sink(OutputSink *sink) {
+    int fd = sink->fd;
+    sink_free(sink);
+    close(fd);
+}
+
+static double time_header(const char *wal_filename) {
+    double start = now_ms();
+    for (int i = 0; i < HEADER_ITERATIONS; i++) {
+        WalReader reader;
+        if (wal_reader_open(&reader, wal_filename) != 0) {
+            return -1;
+        }
+        verify_wal_header_checksum(reader.map, &reader.header);
+        wal_reader_close(&reader);
+    }
+    return (now_ms() - start) * 1e3 / HEADER_ITERATIONS;
+}
+
+static double time_checksum(const WalReader *reader) {
+    uint32_t checksum1 = reader->header.checksum1;
+    uint32_t checksum2 = reader->header.checksum2;
+    double start = now_ms();
+    uint32_t broken = wal_verify_frames(reader, 1, reader->frame_count, &checksum1, &checksum2);
+    double elapsed = now_ms() - start;
+    if (broken) {
+        fprintf(stderr, "Checksum chain broken at frame %u\n", broken);
+    }
+    return elapsed;
+}
+
+static double time_lookup(const WalReader *reader, const char *db_filename) {
+    double start = now_ms();
+    PageOwnerMap owners;
+    if (page_owner_open(&owners, db_filename) != 0) {
+        return -1;
+    }
+    uint32_t known = 0;
+    WalFrameView frame;
+    for (uint32_t n = 1; n <= reader->frame_count && wal_reader_frame(reader, n, &frame) == 0; n++) {
+        page_owner_apply_frame(&owners, reader, &frame);
+        known += page_owner_lookup(&owners, frame.header.page_number) != NULL;
+    }
+    page_owner_close(&owners);
+    double elapsed = now_ms() - start;
+    if (known != reader->frame_count) {
+        fprintf(stderr, "Only %u of %u frames resolved to a table\n", known, reader->frame_count);
+    }
+    return elapsed;
+}
+
+// Parses every table leaf cell and touches every column, without output
+static double time_decode(const WalReader *reader) {
+    Arena arena;
+    arena_init(&arena, ARENA_BLOCK_SIZE);
+    volatile int64_t checksum = 0;
+    uint32_t page_size = reader->page_size;
+    double start = now_ms();
+    WalFrameView frame;
+    for (uint32_t n = 1; n <= reader->frame_count && wal_reader_frame(reader, n, &frame) == 0; n++) {
+        const uint8_t *page = frame.page_data;
+        if (page[0] != 0x0D) {
+            continue;
+        }
+        uint16_t cell_count = to_host16(*(const uint16_t *)(page + 3));
+        for (uint16_t i = 0; i < cell_count; i++) {
+            uint16_t offset = to_host16(*(const uint16_t *)(page + 8 + 2 * i));
+            CellInfo cell;
+            RecordView view;
+            if (parse_cell(&cell, page, offset, page_size, &arena) != 0 ||
+                record_view_init(&view, &cell, page, page_size, NULL, &arena) != 0) {
+                continue;
+            }
+            for (uint32_t column = 0; column < view.column_count; column++) {
+                int64_t value;
+                const uint8_t *data;
+                uint32_t length;
+                if (record_column_int64(&view, column, &value) == 0) {
+                    checksum += value;
+                } else if (record_column_bytes(&view, column, &data, &length) == 0) {
+                    checksum += length;
+                }
+            }
+            record_view_free(&view);
+        }
+        arena_reset(&arena);
+    }
+    double elapsed = now_ms() - start;
+    arena_free(&arena);
+    return elapsed;
+}
+
+static double time_output(const WalReader *reader, OutputFormat format) {
+    uint32_t frame_count = 0;
+    FrameCheck *checks = check_wal_frames(reader, NULL, NULL, &frame_count);
+    OutputSink sink;
+    if (!checks || open_null_sink(&sink, format) != 0) {
+        free(checks);
+        return -1;
+    }
+    double start = now_ms();
+    WalFrameView frame;
+    for (uint32_t n = 1; n <= frame_count && wal_reader_frame(reader, n, &frame) == 0; n++) {
+        emit_frame(&sink, &frame, reader->page_size, &checks[n - 1], NULL);
+    }
+    sink_flush(&sink);
+    double elapsed = now_ms() - start;
+    close_null_sink(&sink);
+    free(checks);
+    return elapsed;
+}
+
+static double time_total(const char *wal_filename, OutputFormat format) {
+    OutputSink sink;
+    if (open_null_sink(&sink, format) != 0) {
+        return -1;
+    }
+    double start = now_ms();
+    int status = print_wal_info(&sink, wal_filename, 1, 0, NULL);
+    sink_flush(&sink);
+    double elapsed = now_ms() - start;
+    close_null_sink(&sink);
+    return status == 0 ? elapsed : -1;
+}
+
+// Generates a scenario's files, times every stage repeats times and keeps
+// the fastest run of each
+static int run_scenario(const Scenario *scenario, OutputFormat format, int repeats, BenchResult *result) {
+    const char *tmp = getenv("TMPDIR");
+    char db_filename[512], wal_filename[520];
+    snprintf(db_filename, sizeof(db_filename), "%s/walpulse_bench_%d_%s.db", tmp ? tmp : "/tmp",
+             (int)getpid(), scenario->name);
+    snprintf(wal_filename, sizeof(wal_filename), "%s-wal", db_filename);
+
+    WalGenStats stats;
+    if (wal_gen_write(&scenario->config, db_filename, &stats) != 0) {
+        return -1;
+    }
+    memset(result, 0, sizeof(*result));
+    result->name = scenario->name;
+    result->page_size = scenario->config.page_size;
+    result->frames = stats.frames;
+    result->wal_bytes = stats.wal_bytes;
+
+    int status = 0;
+    WalReader reader;
+    if (wal_reader_open(&reader, wal_filename) != 0) {
+        status = -1;
+    }
+    for (int run = 0; run < repeats && status == 0; run++) {
+        double header = time_header(wal_filename);
+        double checksum = time_checksum(&reader);
+        double lookup = time_lookup(&reader, db_filename);
+        double decode = time_decode(&reader);
+        double output = time_output(&reader, format);
+        double total = time_total(wal_filename, format);
+        if (header < 0 || lookup < 0 || output < 0 || total < 0) {
+            status = -1;
+            break;
+        }
+        result->header_us = run ? min_time(result->header_us, header) : header;
+        result->checksum_ms = run ? min_time(result->checksum_ms, checksum) : checksum;
+        result->lookup_ms = run ? min_time(result->lookup_ms, lookup) : lookup;
+        result->decode_ms = run ? min_time(result->decode_ms, decode) : decode;
+        result->output_ms = run ? min_time(result->output_ms, output) : output;
+        result->total_ms = run ? min_time(result->total_ms, total) : total;
+    }
+    if (status == 0) {
+        wal_reader_close(&reader);
+        result->frames_per_second = result->frames / (result->total_ms / 1e3);
+        result->mb_per_second = result->wal_bytes / 1e6 / (result->total_ms / 1e3);
+    }
+    release_frame_arena();
+    unlink(wal_filename);
+    unlink(db_filename);
+    return status;
+}
+
+static void print_result_header(void) {
+    printf("%-12s %6s %7s %8s %9s %10s %8s | %9s %11s %9s %9s %9s\n", "scenario", "page", "frames", "MB",
+           "total ms", "frames/s", "MB/s", "header us", "checksum ms", "lookup ms", "decode ms", "output ms");
+}
+
+static void print_result(const BenchResult *result) {
+    printf("%-12s %6u %7u %8.1f %9.1f %10.0f %8.1f | %9.1f %11.2f %9.2f %9.2f %9.2f\n", result->name,
+           result->page_size, result->frames, result->wal_bytes / 1e6, result->total_ms, result->frames_per_second,
+           result->mb_per_second, result->header_us, result->checksum_ms, result->lookup_ms, result->decode_ms,
+           result->output_ms);
+}
+
+static const char *format_name(OutputFormat format) {
+    return format == OUTPUT_JSON ? "json" : format == OUTPUT_BINARY ? "binary" : "text";
+}
+
+// Writes one "scenario format frames/s MB/s" line per result
+static int save_baseline(const char *filename, const BenchResult *results, int count, OutputFormat format) {
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        return report_error("Failed to write baseline file", 1);
+    }
+    fprintf(file, "# scenario format frames_per_second mb_per_second\n");
+    for (int i = 0; i < count; i++) {
+        fprintf(file, "%s %s %.0f %.1f\n", results[i].name, format_name(format), results[i].frames_per_second,
+                results[i].mb_per_second);
+    }
+    return fclose(file) == 0 ? 0 : report_error("Failed to write baseline file", 1);
+}
+
+// Compares frames/s with the baseline; returns the number of scenarios
+// that got slower by more than threshold percent, or -1 on error
+static int compare_baseline(const char *filename, const BenchResult *results, int count, OutputFormat format,
+                            double threshold) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        return report_error("Failed to open baseline file", 1);
+    }
+    printf("\n%-12s %12s %12s %8s\n", "scenario", "baseline/s", "frames/s", "change");
+    int regressions = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        char name[64], baseline_format[16];
+        double frames_per_second, mb_per_second;
+        if (line[0] == '#' || sscanf(line, "%63s %15s %lf %lf", name, baseline_format, &frames_per_second,
+                                     &mb_per_second) != 4 || strcmp(baseline_format, format_name(format)) != 0) {
+            continue;
+        }
+        for (int i = 0; i < count; i++) {
+            if (strcmp(results[i].name, name) != 0) {
+                continue;
+            }
+            double change = (results[i].frames_per_second / frames_per_second - 1) * 100;
+            int regressed = change < -threshold;
+            regressions += regressed;
+            printf("%-12s %12.0f %12.0f %+7.1f%%%s\n", name, frames_per_second, results[i].frames_per_second,
+                   change, regressed ? "  REGRESSION" : "");
+        }
+    }
+    fclose(file);
+    return regressions;
+}
+
+// Writes one database and WAL from command-line settings
+static int generate(const char *db_filename, const WalGenConfig *config) {
+    WalGenStats stats;
+    if (wal_gen_write(config, db_filename, &stats) != 0) {
+        return 1;
+    }
+    printf("%s-wal: %u frames (%u commits, %u table leaves, %u index leaves, %u overflow pages), "
+           "%llu cells, %llu bytes; database %u pages\n", db_filename, stats.frames, stats.commits,
+           stats.table_leaf_frames, stats.index_leaf_frames, stats.overflow_frames,
+           (unsigned long long)stats.cells, (unsigned long long)stats.wal_bytes, stats.database_pages);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option options[] = {
+        {"scenario", required_argument, NULL, 's'},
+        {"format", required_argument, NULL, 'o'},
+        {"repeat", required_argument, NULL, 'r'},
+        {"baseline", required_argument, NULL, 'b'},
+        {"save", required_argument, NULL, 'w'},
+        {"threshold", required_argument, NULL, 't'},
+        {"generate", required_argument, NULL, 'g'},
+        {"page-size", required_argument, NULL, 'P'},
+        {"frames", required_argument, NULL, 'F'},
+        {"pages", required_argument, NULL, 'N'},
+        {"leaf", required_argument, NULL, 'L'},
+        {"cells", required_argument, NULL, 'C'},
+        {"overflow", required_argument, NULL, 'V'},
+        {"commit", required_argument, NULL, 'M'},
+        {"seed", required_argument, NULL, 'S'},
+        {NULL, 0, NULL, 0}
+    };
+    const char *only = NULL;
+    const char *baseline = NULL;
+    const char *save = NULL;
+    const char *generate_path = NULL;
+    double threshold = DEFAULT_THRESHOLD;
+    int repeats = DEFAULT_REPEATS;
+    OutputFormat format = OUTPUT_TEXT;
+    WalGenConfig config;
+    wal_gen_defaults(&config);
+    int option;
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 's': only = optarg; break;
+            case 'r': repeats = atoi(optarg) > 0 ? atoi(optarg) : 1; break;
+            case 'b': baseline = optarg; break;
+            case 'w': save = optarg; break;
+            case 't': threshold = atof(optarg); break;
+            case 'g': generate_path = optarg; break;
+            case 'P': config.page_size = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'F': config.frames = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'N': config.pages = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'L': config.leaf_percent = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'C': config.cells_per_page = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'V': config.overflow_percent = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'M': config.commit_every = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'S': config.seed = strtoull(optarg, NULL, 10); break;
+            case 'o':
+                if (sink_parse_format(optarg, &format) == 0) {
+                    break;
+                }
+                /* fall through */
+            default:
+                fprintf(stderr, "%s\n", USAGE);
+                return 1;
+        }
+    }
+    if (optind != argc) {
+        fprintf(stderr, "%s\n", USAGE);
+        return 1;
+    }
+    if (generate_path) {
+        return generate(generate_path, &config);
+    }
+
+    int scenario_count = (int)(sizeof(scenarios) / sizeof(scenarios[0]));
+    BenchResult results[sizeof(scenarios) / sizeof(scenarios[0])];
+    int count = 0;
+    printf("checksum kernel: %s, format: %s, best of %d\n\n", wal_checksum_kernel_name(), format_name(format),
+           repeats);
+    print_result_header();
+    for (int i = 0; i < scenario_count; i++) {
+        if (only && strcmp(only, scenarios[i].name) != 0) {
+            continue;
+        }
+        if (run_scenario(&scenarios[i], format, repeats, &results[count]) != 0) {
+            fprintf(stderr, "Scenario %s failed\n", scenarios[i].name);
+            return 1;
+        }
+        print_result(&results[count]);
+        fflush(stdout);
+        count++;
+    }
+
+    int status = 0;
+    if (baseline && access(baseline, F_OK) == 0) {
+        int regressions = compare_baseline(baseline, results, count, format, threshold);
+        if (regressions != 0) {
+            status = 1;
+        }
+    }
+    if (save && save_baseline(save, results, count, format) != 0) {
+        status = 1;
+    }
+    return status;
+}
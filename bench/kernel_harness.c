@@ -0,0 +1,142 @@
+#define _GNU_SOURCE
+#include "kernel_harness.h"
+#include "../utils.h"
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#else
+#define HAVE_TSC 0
+#endif
+
+// How long the TSC is timed against the monotonic clock
+#define TSC_CALIBRATION_NS 100000000ull
+
+static KernelOptions harness_options;
+static double tsc_per_ns = 0;
+static KernelResult *results = NULL;
+static uint32_t result_count = 0;
+static volatile uint64_t kernel_sink = 0;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t read_tsc(void) {
+#if HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Nearest-rank percentile of sorted values
+static double percentile(const double *sorted, uint32_t count, uint32_t percent) {
+    uint32_t rank = (count * percent + 99) / 100;
+    return sorted[rank ? rank - 1 : 0];
+}
+
+void kernel_options_defaults(KernelOptions *options) {
+    options->filter = NULL;
+    options->samples = 1000;
+    options->warmup_ms = 50;
+    options->cpu = -1;
+}
+
+// Pins the process to one CPU, so samples are not split across cores with
+// different caches and clocks, and measures the TSC rate against wall time
+int kernel_harness_init(const KernelOptions *options) {
+    harness_options = *options;
+    if (harness_options.samples == 0) {
+        harness_options.samples = 1;
+    }
+    int cpu = options->cpu >= 0 ? options->cpu : sched_getcpu();
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu < 0 ? 0 : cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        return report_error("Failed to pin benchmark to CPU", 1);
+    }
+
+    if (HAVE_TSC) {
+        uint64_t start = now_ns(), start_tsc = read_tsc();
+        while (now_ns() - start < TSC_CALIBRATION_NS) {
+        }
+        uint64_t elapsed = now_ns() - start;
+        tsc_per_ns = (double)(read_tsc() - start_tsc) / elapsed;
+    }
+    printf("cpu %d, tsc %.2f GHz, %u samples, %u ms warm-up\n\n", cpu, tsc_per_ns, harness_options.samples,
+           harness_options.warmup_ms);
+    printf("%-24s %9s %9s %9s %9s %9s %10s %11s\n", "kernel", "ops/batch", "min ns", "p50 ns", "p90 ns",
+           "p99 ns", "cycles/op", "bytes/cycle");
+    return 0;
+}
+
+// Warms a kernel up, then times samples batches and prints their spread
+void run_kernel(const char *name, kernel_func func, uint32_t ops_per_batch, uint64_t bytes_per_batch) {
+    if (harness_options.filter && !strstr(name, harness_options.filter)) {
+        return;
+    }
+    uint32_t samples = harness_options.samples;
+    double *ns = malloc(samples * sizeof(double));
+    double *cycles = malloc(samples * sizeof(double));
+    KernelResult *grown = realloc(results, (result_count + 1) * sizeof(KernelResult));
+    if (!ns || !cycles || !grown) {
+        free(ns);
+        free(cycles);
+        report_error("Failed to allocate benchmark samples", 1);
+        return;
+    }
+    results = grown;
+
+    uint64_t warmup_end = now_ns() + harness_options.warmup_ms * 1000000ull;
+    while (now_ns() < warmup_end) {
+        kernel_sink += func();
+    }
+    for (uint32_t i = 0; i < samples; i++) {
+        uint64_t start = now_ns(), start_tsc = read_tsc();
+        kernel_sink += func();
+        uint64_t end_tsc = read_tsc(), end = now_ns();
+        ns[i] = (double)(end - start) / ops_per_batch;
+        cycles[i] = (double)(end_tsc - start_tsc) / ops_per_batch;
+    }
+    qsort(ns, samples, sizeof(double), compare_doubles);
+    qsort(cycles, samples, sizeof(double), compare_doubles);
+
+    KernelResult *result = &results[result_count++];
+    result->name = name;
+    result->ns_min = ns[0];
+    result->ns_p50 = percentile(ns, samples, 50);
+    result->ns_p90 = percentile(ns, samples, 90);
+    result->ns_p99 = percentile(ns, samples, 99);
+    result->cycles_per_op = HAVE_TSC ? percentile(cycles, samples, 50) : 0;
+    result->bytes_per_cycle = result->cycles_per_op > 0 && bytes_per_batch
+                                  ? (double)bytes_per_batch / ops_per_batch / result->cycles_per_op : 0;
+    printf("%-24s %9u %9.2f %9.2f %9.2f %9.2f %10.2f %11.2f\n", name, ops_per_batch, result->ns_min,
+           result->ns_p50, result->ns_p90, result->ns_p99, result->cycles_per_op, result->bytes_per_cycle);
+    fflush(stdout);
+    free(ns);
+    free(cycles);
+}
+
+const KernelResult *kernel_results(uint32_t *count) {
+    *count = result_count;
+    return results;
+}
+
+void kernel_harness_free(void) {
+    free(results);
+    results = NULL;
+    result_count = 0;
+}
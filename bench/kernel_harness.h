@@ -0,0 +1,36 @@
+#ifndef KERNEL_HARNESS_H
+#define KERNEL_HARNESS_H
+
+#include <stdint.h>
+
+// A kernel runs one batch of operations over its prepared input and returns
+// a value derived from the results, so the compiler cannot drop the work
+#define KERNEL(name) static uint64_t name(void)
+
+typedef uint64_t (*kernel_func)(void);
+
+typedef struct {
+    const char* filter;         // Only kernels whose name contains this run
+    uint32_t samples;           // Timed batches per kernel
+    uint32_t warmup_ms;         // Untimed running before the first sample
+    int cpu;                    // CPU to pin to, -1 for the current one
+} KernelOptions;
+
+// Per-kernel figures; percentiles are over the per-batch ns/op
+typedef struct {
+    const char* name;
+    double ns_min;
+    double ns_p50;
+    double ns_p90;
+    double ns_p99;
+    double cycles_per_op;       // Median batch, in TSC cycles
+    double bytes_per_cycle;     // 0 for kernels without a byte count
+} KernelResult;
+
+void kernel_options_defaults(KernelOptions* options);
+int kernel_harness_init(const KernelOptions* options);
+void run_kernel(const char* name, kernel_func func, uint32_t ops_per_batch, uint64_t bytes_per_batch);
+const KernelResult* kernel_results(uint32_t* count);
+void kernel_harness_free(void);
+
+#endif
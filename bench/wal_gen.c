@@ -0,0 +1,489 @@
+#include "wal_gen.h"
+#include "../page_analyzer.h"
+#include "../utils.h"
+#include "../wal_checksum.h"
+#include "../wal_format.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Rowids of leaf slot s are s * ROWID_STRIDE + 1 and up
+#define ROWID_STRIDE 65536
+#define TABLE_ROOT_PAGE 2
+#define INDEX_ROOT_PAGE 3
+#define FIRST_LEAF_PAGE 4
+#define WAL_FORMAT_VERSION 3007000
+#define SQLITE_VERSION_NUMBER_WRITTEN 3045000
+
+static const char table_sql[] = "CREATE TABLE bench(id INTEGER, body TEXT)";
+static const char index_sql[] = "CREATE INDEX bench_id ON bench(id)";
+
+// Lays out cells from the end of a page towards its pointer array
+typedef struct {
+    uint8_t *page;
+    uint32_t header;            // 100 on page 1, else 0
+    uint32_t content;           // Start of the cell content area
+    uint16_t count;
+    uint8_t interior;
+} PageBuilder;
+
+// Mutable generator state shared by the page writers
+typedef struct {
+    const WalGenConfig *config;
+    FILE *wal;
+    uint64_t random;
+    int big_endian;
+    uint32_t salt1;
+    uint32_t salt2;
+    uint32_t checksum1;
+    uint32_t checksum2;
+    uint32_t table_pages;
+    uint32_t index_pages;
+    uint32_t first_index_leaf;
+    uint32_t first_overflow;
+    uint32_t overflow_pages;
+    uint32_t next_overflow;
+    uint8_t *frame;             // Frame header followed by the page
+    uint8_t *overflow_frames;   // Overflow pages of the leaf being built, as frames
+    uint32_t *overflow_numbers;
+    uint32_t overflow_count;
+    uint32_t overflow_capacity; // Most overflow cells one leaf can hold
+    uint8_t *payload;
+    WalGenStats *stats;
+} Generator;
+
+// xorshift64*; deterministic for a given seed on every platform
+static uint32_t next_random(Generator *gen) {
+    gen->random ^= gen->random >> 12;
+    gen->random ^= gen->random << 25;
+    gen->random ^= gen->random >> 27;
+    return (uint32_t)((gen->random * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static void put_be16(uint8_t *out, uint16_t value) {
+    out[0] = (uint8_t)(value >> 8);
+    out[1] = (uint8_t)value;
+}
+
+static void put_be32(uint8_t *out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out[i] = (uint8_t)(value >> (24 - 8 * i));
+    }
+}
+
+// Encodes a SQLite varint; returns its length
+int wal_gen_put_varint(uint8_t *out, uint64_t value) {
+    if (value > 0x00ffffffffffffffULL) {
+        out[8] = (uint8_t)value;
+        value >>= 8;
+        for (int i = 7; i >= 0; i--) {
+            out[i] = (uint8_t)((value & 0x7f) | 0x80);
+            value >>= 7;
+        }
+        return 9;
+    }
+    uint8_t reversed[9];
+    int length = 0;
+    do {
+        reversed[length++] = (uint8_t)((value & 0x7f) | 0x80);
+        value >>= 7;
+    } while (value);
+    reversed[0] &= 0x7f;
+    for (int i = 0; i < length; i++) {
+        out[i] = reversed[length - 1 - i];
+    }
+    return length;
+}
+
+static int varint_length(uint64_t value) {
+    uint8_t scratch[9];
+    return wal_gen_put_varint(scratch, value);
+}
+
+// Starts an empty b-tree page of the given type
+static void page_begin(PageBuilder *builder, uint8_t *page, uint32_t page_number, uint32_t page_size, uint8_t type) {
+    builder->page = page;
+    builder->header = page_number == 1 ? 100 : 0;
+    memset(page + builder->header, 0, page_size - builder->header);
+    page[builder->header] = type;
+    builder->interior = type == 0x02 || type == 0x05;
+    builder->content = page_size;
+    builder->count = 0;
+}
+
+// Reserves length bytes for a new cell; NULL once the page is full
+static uint8_t *page_add_cell(PageBuilder *builder, uint32_t length) {
+    uint32_t pointers = builder->header + (builder->interior ? 12 : 8);
+    uint32_t needed = pointers + 2u * (builder->count + 1u) + length;
+    if (builder->content < needed) {
+        return NULL;
+    }
+    builder->content -= length;
+    put_be16(builder->page + pointers + 2u * builder->count, (uint16_t)builder->content);
+    builder->count++;
+    return builder->page + builder->content;
+}
+
+// Writes the cell count, content start and, for interior pages, the rightmost child
+static void page_end(PageBuilder *builder, uint32_t rightmost) {
+    uint8_t *header = builder->page + builder->header;
+    put_be16(header + 3, builder->count);
+    put_be16(header + 5, (uint16_t)builder->content);  // 65536 wraps to 0 as the format wants
+    if (builder->interior) {
+        put_be32(header + 8, rightmost);
+    }
+}
+
+// Builds a record of TEXT columns around one integer column; returns its length
+static uint32_t schema_record(uint8_t *out, const char *type, const char *name, uint32_t root, const char *sql) {
+    const char *texts[] = { type, name, "bench", sql };
+    uint8_t *header = out + 1;
+    for (int i = 0; i < 3; i++) {
+        header += wal_gen_put_varint(header, 13 + 2 * strlen(texts[i]));
+    }
+    *header++ = 4;
+    header += wal_gen_put_varint(header, 13 + 2 * strlen(sql));
+    out[0] = (uint8_t)(header - out);
+    uint8_t *body = header;
+    for (int i = 0; i < 3; i++) {
+        memcpy(body, texts[i], strlen(texts[i]));
+        body += strlen(texts[i]);
+    }
+    put_be32(body, root);
+    body += 4;
+    memcpy(body, sql, strlen(sql));
+    body += strlen(sql);
+    return (uint32_t)(body - out);
+}
+
+// Adds a table leaf cell holding payload to a page
+static int add_leaf_row(PageBuilder *builder, int64_t rowid, const uint8_t *payload, uint32_t length) {
+    uint8_t prefix[18];
+    int prefix_length = wal_gen_put_varint(prefix, length);
+    prefix_length += wal_gen_put_varint(prefix + prefix_length, (uint64_t)rowid);
+    uint8_t *cell = page_add_cell(builder, (uint32_t)prefix_length + length);
+    if (!cell) {
+        return -1;
+    }
+    memcpy(cell, prefix, prefix_length);
+    memcpy(cell + prefix_length, payload, length);
+    return 0;
+}
+
+// Writes the main database: the schema on page 1, both b-tree roots with
+// every leaf slot as a child, empty leaves, then the overflow pool
+static int write_database(const Generator *gen, const char *db_filename, uint32_t database_pages) {
+    uint32_t page_size = gen->config->page_size;
+    uint8_t *page = calloc(1, page_size);
+    FILE *db = fopen(db_filename, "wb");
+    if (!page || !db) {
+        free(page);
+        if (db) {
+            fclose(db);
+        }
+        return report_error("Failed to create benchmark database", 1);
+    }
+
+    memcpy(page, "SQLite format 3", 16);
+    put_be16(page + 16, page_size == 65536 ? 1 : (uint16_t)page_size);
+    page[18] = 2;                               // WAL mode
+    page[19] = 2;
+    page[21] = 64;
+    page[22] = 32;
+    page[23] = 32;
+    put_be32(page + 24, 1);                     // Change counter
+    put_be32(page + 28, database_pages);
+    put_be32(page + 40, 1);                     // Schema cookie
+    put_be32(page + 44, 4);                     // Schema format
+    put_be32(page + 56, 1);                     // UTF-8
+    put_be32(page + 92, 1);
+    put_be32(page + 96, SQLITE_VERSION_NUMBER_WRITTEN);
+
+    PageBuilder builder;
+    uint8_t record[256];
+    page_begin(&builder, page, 1, page_size, 0x0D);
+    uint32_t length = schema_record(record, "table", "bench", TABLE_ROOT_PAGE, table_sql);
+    add_leaf_row(&builder, 1, record, length);
+    length = schema_record(record, "index", "bench_id", INDEX_ROOT_PAGE, index_sql);
+    add_leaf_row(&builder, 2, record, length);
+    page_end(&builder, 0);
+    fwrite(page, page_size, 1, db);
+
+    // Table root: every slot but the last is a (child, max rowid) cell
+    page_begin(&builder, page, TABLE_ROOT_PAGE, page_size, 0x05);
+    for (uint32_t slot = 0; slot + 1 < gen->table_pages; slot++) {
+        uint8_t cell[13];
+        put_be32(cell, FIRST_LEAF_PAGE + slot);
+        int key_length = wal_gen_put_varint(cell + 4, (uint64_t)slot * ROWID_STRIDE + ROWID_STRIDE - 1);
+        memcpy(page_add_cell(&builder, 4 + key_length), cell, 4 + key_length);
+    }
+    page_end(&builder, FIRST_LEAF_PAGE + gen->table_pages - 1);
+    fwrite(page, page_size, 1, db);
+
+    // Index root: (child, key record) cells with a 4-byte integer key
+    page_begin(&builder, page, INDEX_ROOT_PAGE, page_size, 0x02);
+    for (uint32_t slot = 0; slot + 1 < gen->index_pages; slot++) {
+        uint8_t *cell = page_add_cell(&builder, 11);
+        put_be32(cell, gen->first_index_leaf + slot);
+        cell[4] = 6;                            // Payload size
+        cell[5] = 2;                            // Record header size
+        cell[6] = 4;                            // 4-byte integer
+        put_be32(cell + 7, (slot + 1) * ROWID_STRIDE);
+    }
+    page_end(&builder, gen->first_index_leaf + gen->index_pages - 1);
+    fwrite(page, page_size, 1, db);
+
+    for (uint32_t n = FIRST_LEAF_PAGE; n <= database_pages; n++) {
+        uint8_t type = n < gen->first_index_leaf ? 0x0D : n < gen->first_overflow ? 0x0A : 0;
+        page_begin(&builder, page, n, page_size, type);
+        if (type) {
+            page_end(&builder, 0);
+        }
+        fwrite(page, page_size, 1, db);
+    }
+    int failed = ferror(db);
+    failed |= fclose(db) != 0;
+    free(page);
+    return failed ? report_error("Failed to write benchmark database", 1) : 0;
+}
+
+// Appends one frame, chaining its checksum from the previous one
+static void write_frame(Generator *gen, uint8_t *frame, uint32_t page_number, uint32_t commit_size) {
+    uint32_t page_size = gen->config->page_size;
+    put_be32(frame, page_number);
+    put_be32(frame + 4, commit_size);
+    put_be32(frame + 8, gen->salt1);
+    put_be32(frame + 12, gen->salt2);
+    compute_wal_checksum(frame, 8, gen->big_endian, &gen->checksum1, &gen->checksum2);
+    compute_wal_checksum(frame + WAL_FRAME_HEADER_SIZE, page_size, gen->big_endian,
+                         &gen->checksum1, &gen->checksum2);
+    put_be32(frame + 16, gen->checksum1);
+    put_be32(frame + 20, gen->checksum2);
+    fwrite(frame, WAL_FRAME_HEADER_SIZE + page_size, 1, gen->wal);
+    gen->stats->frames++;
+    if (commit_size) {
+        gen->stats->commits++;
+    }
+}
+
+// Fills length bytes with lowercase letters
+static void fill_text(Generator *gen, uint8_t *out, uint32_t length) {
+    for (uint32_t i = 0; i < length; i++) {
+        out[i] = (uint8_t)('a' + next_random(gen) % 26);
+    }
+}
+
+// Builds an (id, body) record with a body of text_length bytes; returns its length
+static uint32_t row_record(Generator *gen, uint8_t *out, int64_t id, uint32_t text_length) {
+    uint64_t text_serial = 13 + 2 * (uint64_t)text_length;
+    uint32_t header_length = 2 + (uint32_t)varint_length(text_serial);
+    out[0] = (uint8_t)header_length;
+    out[1] = 4;
+    wal_gen_put_varint(out + 2, text_serial);
+    put_be32(out + header_length, (uint32_t)id);
+    fill_text(gen, out + header_length + 4, text_length);
+    return header_length + 4 + text_length;
+}
+
+// Text length that makes a row record exactly payload_size bytes long
+static uint32_t text_for_payload(uint32_t payload_size) {
+    uint32_t text_length = payload_size - 6;
+    while (2 + varint_length(13 + 2 * (uint64_t)text_length) + 4 + text_length > payload_size) {
+        text_length--;
+    }
+    return text_length;
+}
+
+// Builds a table leaf for a random slot. Cells chosen to overflow get a
+// payload that leaves the minimum on the page and exactly one overflow
+// page, queued to be written after the leaf: SQLite writes dirty pages in
+// page number order and the overflow pool sits above the leaves.
+static uint32_t write_table_leaf(Generator *gen, uint8_t *page) {
+    const WalGenConfig *config = gen->config;
+    uint32_t usable = config->page_size;
+    uint32_t slot = next_random(gen) % gen->table_pages;
+    uint32_t page_number = FIRST_LEAF_PAGE + slot;
+    uint32_t min_local = (usable - 12) * 32 / 255 - 23;
+    uint32_t overflow_payload = min_local + (usable - 4);
+
+    PageBuilder builder;
+    page_begin(&builder, page, page_number, usable, 0x0D);
+    gen->overflow_count = 0;
+    for (uint32_t i = 0; i < config->cells_per_page; i++) {
+        int64_t rowid = (int64_t)slot * ROWID_STRIDE + i + 1;
+        // Leave room for the leaf frame itself and the queued overflow frames
+        int overflow = next_random(gen) % 100 < config->overflow_percent &&
+                       gen->overflow_count < gen->overflow_capacity &&
+                       gen->stats->frames + gen->overflow_count + 2 <= config->frames;
+        uint32_t text_length = overflow ? text_for_payload(overflow_payload) : 8 + next_random(gen) % 48;
+        uint32_t length = row_record(gen, gen->payload, rowid, text_length);
+        uint32_t local = btree_local_payload(0x0D, length, usable);
+        if (local >= length) {
+            if (add_leaf_row(&builder, rowid, gen->payload, length) != 0) {
+                break;
+            }
+            gen->stats->cells++;
+            continue;
+        }
+
+        uint8_t prefix[18];
+        int prefix_length = wal_gen_put_varint(prefix, length);
+        prefix_length += wal_gen_put_varint(prefix + prefix_length, (uint64_t)rowid);
+        uint8_t *cell = page_add_cell(&builder, (uint32_t)prefix_length + local + 4);
+        if (!cell) {
+            break;
+        }
+        uint32_t overflow_page = gen->first_overflow + gen->next_overflow++ % gen->overflow_pages;
+        memcpy(cell, prefix, prefix_length);
+        memcpy(cell + prefix_length, gen->payload, local);
+        put_be32(cell + prefix_length + local, overflow_page);
+
+        uint8_t *spill = gen->overflow_frames + (size_t)gen->overflow_count * (WAL_FRAME_HEADER_SIZE + usable) +
+                         WAL_FRAME_HEADER_SIZE;
+        memset(spill, 0, usable);
+        memcpy(spill + 4, gen->payload + local, length - local);
+        gen->overflow_numbers[gen->overflow_count++] = overflow_page;
+        gen->stats->cells++;
+    }
+    page_end(&builder, 0);
+    gen->stats->table_leaf_frames++;
+    return page_number;
+}
+
+// Writes an index leaf of (id, rowid) keys for a random slot
+static uint32_t write_index_leaf(Generator *gen, uint8_t *page) {
+    uint32_t page_number = gen->first_index_leaf + next_random(gen) % gen->index_pages;
+    PageBuilder builder;
+    page_begin(&builder, page, page_number, gen->config->page_size, 0x0A);
+    for (uint32_t i = 0; i < gen->config->cells_per_page; i++) {
+        uint8_t *cell = page_add_cell(&builder, 12);
+        if (!cell) {
+            break;
+        }
+        cell[0] = 11;                           // Payload size
+        cell[1] = 3;                            // Record header size
+        cell[2] = 4;
+        cell[3] = 4;
+        put_be32(cell + 4, next_random(gen));
+        put_be32(cell + 8, next_random(gen));
+        gen->stats->cells++;
+    }
+    page_end(&builder, 0);
+    gen->stats->index_leaf_frames++;
+    return page_number;
+}
+
+// Fills in the default benchmark shape: 4 KiB pages, mostly table leaves
+void wal_gen_defaults(WalGenConfig *config) {
+    config->page_size = 4096;
+    config->frames = 10000;
+    config->pages = 256;
+    config->leaf_percent = 80;
+    config->cells_per_page = 20;
+    config->overflow_percent = 5;
+    config->commit_every = 10;
+    config->seed = 1;
+}
+
+// Writes db_filename and db_filename-wal. Leaf slots are capped at what
+// one root page can address, so small pages get fewer distinct pages.
+int wal_gen_write(const WalGenConfig *config, const char *db_filename, WalGenStats *stats) {
+    uint32_t page_size = config->page_size;
+    if (page_size < 512 || page_size > 65536 || (page_size & (page_size - 1)) != 0 || config->frames == 0 ||
+        config->cells_per_page == 0 || config->commit_every == 0) {
+        report_error("Invalid WAL generator configuration", 0);
+        return -1;
+    }
+    memset(stats, 0, sizeof(*stats));
+
+    Generator gen = {
+        .config = config,
+        .random = config->seed ? config->seed : 1,
+        .big_endian = wal_checksum_big_endian(WAL_MAGIC_LE),
+        .stats = stats
+    };
+    uint32_t table_capacity = (page_size - 12) / 10 + 1;
+    uint32_t index_capacity = (page_size - 12) / 13 + 1;
+    uint32_t leaf_percent = config->leaf_percent > 100 ? 100 : config->leaf_percent;
+    gen.table_pages = (uint32_t)((uint64_t)config->pages * leaf_percent / 100);
+    gen.table_pages = gen.table_pages < 1 ? 1 : gen.table_pages > table_capacity ? table_capacity : gen.table_pages;
+    gen.index_pages = config->pages > gen.table_pages ? config->pages - gen.table_pages : 1;
+    gen.index_pages = gen.index_pages > index_capacity ? index_capacity : gen.index_pages;
+    gen.first_index_leaf = FIRST_LEAF_PAGE + gen.table_pages;
+    gen.first_overflow = gen.first_index_leaf + gen.index_pages;
+    gen.overflow_pages = 64 + config->cells_per_page;
+    stats->database_pages = gen.first_overflow + gen.overflow_pages - 1;
+
+    if (write_database(&gen, db_filename, stats->database_pages) != 0) {
+        return -1;
+    }
+
+    size_t name_length = strlen(db_filename);
+    char *wal_filename = malloc(name_length + 5);
+    gen.frame = malloc(WAL_FRAME_HEADER_SIZE + page_size);
+    // Each overflow cell keeps at least min_local bytes on the leaf
+    gen.overflow_capacity = page_size / ((page_size - 12) * 32 / 255 - 23) + 1;
+    gen.overflow_frames = malloc((size_t)gen.overflow_capacity * (WAL_FRAME_HEADER_SIZE + page_size));
+    gen.overflow_numbers = malloc(gen.overflow_capacity * sizeof(uint32_t));
+    gen.payload = malloc(2 * (size_t)page_size);
+    if (!wal_filename || !gen.frame || !gen.overflow_frames || !gen.overflow_numbers || !gen.payload) {
+        free(wal_filename);
+        free(gen.frame);
+        free(gen.overflow_frames);
+        free(gen.overflow_numbers);
+        free(gen.payload);
+        return report_error("Failed to allocate WAL generator buffers", 1);
+    }
+    memcpy(wal_filename, db_filename, name_length);
+    strcpy(wal_filename + name_length, "-wal");
+    gen.wal = fopen(wal_filename, "wb");
+    free(wal_filename);
+    if (!gen.wal) {
+        free(gen.frame);
+        free(gen.overflow_frames);
+        free(gen.overflow_numbers);
+        free(gen.payload);
+        return report_error("Failed to create benchmark WAL", 1);
+    }
+
+    uint8_t header[WAL_HEADER_SIZE];
+    gen.salt1 = next_random(&gen);
+    gen.salt2 = next_random(&gen);
+    put_be32(header, WAL_MAGIC_LE);
+    put_be32(header + 4, WAL_FORMAT_VERSION);
+    put_be32(header + 8, page_size);
+    put_be32(header + 12, 0);
+    put_be32(header + 16, gen.salt1);
+    put_be32(header + 20, gen.salt2);
+    compute_wal_checksum(header, 24, gen.big_endian, &gen.checksum1, &gen.checksum2);
+    put_be32(header + 24, gen.checksum1);
+    put_be32(header + 28, gen.checksum2);
+    fwrite(header, sizeof(header), 1, gen.wal);
+
+    uint32_t writes = 0;
+    while (stats->frames < config->frames) {
+        uint8_t *page = gen.frame + WAL_FRAME_HEADER_SIZE;
+        gen.overflow_count = 0;
+        uint32_t page_number = next_random(&gen) % 100 < leaf_percent ? write_table_leaf(&gen, page)
+                                                                      : write_index_leaf(&gen, page);
+        // The last frame of every commit_every-th page write commits
+        int commit = ++writes % config->commit_every == 0 ||
+                     stats->frames + 1 + gen.overflow_count == config->frames;
+        uint32_t commit_size = commit ? stats->database_pages : 0;
+        write_frame(&gen, gen.frame, page_number, gen.overflow_count ? 0 : commit_size);
+        for (uint32_t i = 0; i < gen.overflow_count; i++) {
+            uint8_t *frame = gen.overflow_frames + (size_t)i * (WAL_FRAME_HEADER_SIZE + page_size);
+            write_frame(&gen, frame, gen.overflow_numbers[i], i + 1 == gen.overflow_count ? commit_size : 0);
+            stats->overflow_frames++;
+        }
+    }
+    stats->wal_bytes = WAL_HEADER_SIZE + (uint64_t)stats->frames * (WAL_FRAME_HEADER_SIZE + page_size);
+
+    int failed = ferror(gen.wal);
+    failed |= fclose(gen.wal) != 0;
+    free(gen.frame);
+    free(gen.overflow_frames);
+    free(gen.overflow_numbers);
+    free(gen.payload);
+    return failed ? report_error("Failed to write benchmark WAL", 1) : 0;
+}
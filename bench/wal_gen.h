@@ -0,0 +1,35 @@
+#ifndef WAL_GEN_H
+#define WAL_GEN_H
+
+#include <stdint.h>
+
+// Shape of a synthetic database and WAL. The same configuration and seed
+// always produce byte-identical files.
+typedef struct {
+    uint32_t page_size;         // 512-65536, a power of two
+    uint32_t frames;            // Exact number of WAL frames to write
+    uint32_t pages;             // Distinct leaf pages the frames are spread over
+    uint32_t leaf_percent;      // Page writes that are table leaves; the rest are index leaves
+    uint32_t cells_per_page;    // Cells per leaf, fewer if the page fills up
+    uint32_t overflow_percent;  // Table cells whose payload spills onto an overflow page
+    uint32_t commit_every;      // Page writes per transaction
+    uint64_t seed;
+} WalGenConfig;
+
+typedef struct {
+    uint32_t frames;
+    uint32_t commits;
+    uint32_t table_leaf_frames;
+    uint32_t index_leaf_frames;
+    uint32_t overflow_frames;
+    uint64_t cells;
+    uint32_t database_pages;
+    uint64_t wal_bytes;
+} WalGenStats;
+
+void wal_gen_defaults(WalGenConfig* config);
+int wal_gen_write(const WalGenConfig* config, const char* db_filename, WalGenStats* stats);
+// Encodes a SQLite varint into out (9 bytes at most); returns its length
+int wal_gen_put_varint(uint8_t* out, uint64_t value);
+
+#endif
@@ -0,0 +1,761 @@
+#include "changelog.h"
+#include "utils.h"
+#include "wal_checksum.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Segment header: magic, version (u16), reserved (u16), sequence (u32), reserved (u32)
+#define SEGMENT_SUFFIX ".changelog"
+#define SEGMENT_NAME_DIGITS 10
+#define SEGMENT_PATH_EXTRA (1 + SEGMENT_NAME_DIGITS + sizeof(SEGMENT_SUFFIX))
+// Offsets are u32; a segment stops taking blocks well before that
+#define SEGMENT_MAX_BYTES (1u << 31)
+#define INDEX_HEADER_SIZE 8
+
+static void put_u32(uint8_t *out, uint32_t value) {
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+    out[2] = (uint8_t)(value >> 16);
+    out[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t get_u32(const uint8_t *in) {
+    return (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+static uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+// Computes a block's checksum over its length and type word and its body
+static void block_checksum(const uint8_t *block, uint32_t length, uint32_t *checksum1, uint32_t *checksum2) {
+    *checksum1 = 0;
+    *checksum2 = 0;
+    compute_wal_checksum(block, 8, 0, checksum1, checksum2);
+    compute_wal_checksum(block + CHANGELOG_BLOCK_HEADER_SIZE, length, 0, checksum1, checksum2);
+}
+
+// Returns 1 for a segment file name, NNNNNNNNNN.changelog
+static int is_segment_name(const char *name) {
+    if (strlen(name) != SEGMENT_NAME_DIGITS + sizeof(SEGMENT_SUFFIX) - 1 ||
+        strcmp(name + SEGMENT_NAME_DIGITS, SEGMENT_SUFFIX) != 0) {
+        return 0;
+    }
+    for (int i = 0; i < SEGMENT_NAME_DIGITS; i++) {
+        if (name[i] < '0' || name[i] > '9') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int segment_filter(const struct dirent *entry) {
+    return is_segment_name(entry->d_name);
+}
+
+// Returns the paths of a change log's segments, oldest first; free them
+// with changelog_free_segments(). A missing directory has no segments.
+char **changelog_list_segments(const char *directory, uint32_t *count) {
+    *count = 0;
+    struct dirent **entries;
+    int found = scandir(directory, &entries, segment_filter, alphasort);
+    if (found < 0) {
+        if (errno == ENOENT) {
+            return calloc(1, sizeof(char *));
+        }
+        report_error("Failed to list change log directory", 1);
+        return NULL;
+    }
+    char **paths = calloc((size_t)found + 1, sizeof(char *));
+    size_t length = strlen(directory);
+    for (int i = 0; i < found; i++) {
+        char *path = paths ? malloc(length + SEGMENT_PATH_EXTRA) : NULL;
+        if (path) {
+            snprintf(path, length + SEGMENT_PATH_EXTRA, "%s/%s", directory, entries[i]->d_name);
+            paths[(*count)++] = path;
+        } else if (paths) {
+            changelog_free_segments(paths, *count);
+            paths = NULL;
+        }
+        free(entries[i]);
+    }
+    free(entries);
+    if (!paths) {
+        report_error("Failed to allocate memory for change log segments", 1);
+    }
+    return paths;
+}
+
+// Frees what changelog_list_segments() returned
+void changelog_free_segments(char **paths, uint32_t count) {
+    if (!paths) {
+        return;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        free(paths[i]);
+    }
+    free(paths);
+}
+
+// Makes room for extra more bytes in the block buffer
+static int reserve_block(ChangeLogWriter *writer, size_t extra) {
+    if (writer->block_size + extra <= writer->block_capacity) {
+        return 0;
+    }
+    size_t capacity = writer->block_capacity ? writer->block_capacity : 4096;
+    while (capacity < writer->block_size + extra) {
+        capacity *= 2;
+    }
+    uint8_t *grown = realloc(writer->block, capacity);
+    if (!grown) {
+        report_error("Failed to allocate memory for change log block", 1);
+        return -1;
+    }
+    writer->block = grown;
+    writer->block_capacity = capacity;
+    return 0;
+}
+
+// Appends a u32 to a slot array, growing it as needed
+static int push_offset(uint32_t **array, uint32_t *count, uint32_t *capacity, uint32_t value) {
+    if (*count == *capacity) {
+        uint32_t grown_capacity = *capacity ? *capacity * 2 : 256;
+        uint32_t *grown = realloc(*array, grown_capacity * sizeof(uint32_t));
+        if (!grown) {
+            report_error("Failed to allocate memory for change log index", 1);
+            return -1;
+        }
+        *array = grown;
+        *capacity = grown_capacity;
+    }
+    (*array)[(*count)++] = value;
+    return 0;
+}
+
+// Starts a block at the end of the buffer; returns its start
+static size_t begin_block(ChangeLogWriter *writer, uint8_t type) {
+    size_t start = writer->block_size;
+    if (reserve_block(writer, CHANGELOG_BLOCK_HEADER_SIZE) != 0) {
+        return (size_t)-1;
+    }
+    memset(writer->block + start, 0, CHANGELOG_BLOCK_HEADER_SIZE);
+    writer->block[start + 4] = type;
+    writer->block_size += CHANGELOG_BLOCK_HEADER_SIZE;
+    return start;
+}
+
+static int put_varint(ChangeLogWriter *writer, uint64_t value) {
+    if (reserve_block(writer, 9) != 0) {
+        return -1;
+    }
+    writer->block_size += (size_t)encode_varint(value, writer->block + writer->block_size);
+    return 0;
+}
+
+// Pads the block started at start to 8 bytes and fills in its header
+static int end_block(ChangeLogWriter *writer, size_t start) {
+    size_t padding = (8 - writer->block_size % 8) % 8;
+    if (reserve_block(writer, padding) != 0) {
+        return -1;
+    }
+    memset(writer->block + writer->block_size, 0, padding);
+    writer->block_size += padding;
+    uint8_t *block = writer->block + start;
+    uint32_t length = (uint32_t)(writer->block_size - start - CHANGELOG_BLOCK_HEADER_SIZE);
+    put_u32(block, length);
+    uint32_t checksum1, checksum2;
+    block_checksum(block, length, &checksum1, &checksum2);
+    put_u32(block + 8, checksum1);
+    put_u32(block + 12, checksum2);
+    return 0;
+}
+
+// Builds the path of segment sequence; free it
+static char *segment_path(const char *directory, uint32_t sequence) {
+    size_t size = strlen(directory) + SEGMENT_PATH_EXTRA;
+    char *path = malloc(size);
+    if (!path) {
+        report_error("Failed to allocate memory for change log segment name", 1);
+        return NULL;
+    }
+    snprintf(path, size, "%s/%0*u%s", directory, SEGMENT_NAME_DIGITS, sequence, SEGMENT_SUFFIX);
+    return path;
+}
+
+// Creates the next segment and writes its header
+static int start_segment(ChangeLogWriter *writer) {
+    char *path = segment_path(writer->directory, writer->sequence + 1);
+    if (!path) {
+        return -1;
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    free(path);
+    if (fd < 0) {
+        report_error("Failed to create change log segment", 1);
+        return -1;
+    }
+    uint8_t header[CHANGELOG_HEADER_SIZE] = {0};
+    memcpy(header, CHANGELOG_MAGIC, 4);
+    header[4] = CHANGELOG_VERSION;
+    put_u32(header + 8, writer->sequence + 1);
+    if (write_fully(fd, header, sizeof(header)) != 0) {
+        report_error("Failed to write change log segment header", 1);
+        close(fd);
+        return -1;
+    }
+    writer->fd = fd;
+    writer->sequence++;
+    writer->size = CHANGELOG_HEADER_SIZE;
+    return 0;
+}
+
+// Writes the index block and trailer and closes the open segment. The
+// next block starts a new segment with its own table ids.
+static int seal_segment(ChangeLogWriter *writer) {
+    writer->block_size = 0;
+    size_t start = begin_block(writer, CHANGELOG_BLOCK_INDEX);
+    size_t index_size = INDEX_HEADER_SIZE + 4 * ((size_t)writer->block_count + writer->table_count);
+    int status = start == (size_t)-1 || reserve_block(writer, index_size + CHANGELOG_TRAILER_SIZE) != 0 ? -1 : 0;
+    if (status == 0) {
+        uint8_t *index = writer->block + writer->block_size;
+        put_u32(index, writer->block_count);
+        put_u32(index + 4, writer->table_count);
+        index += INDEX_HEADER_SIZE;
+        for (uint32_t i = 0; i < writer->block_count; i++, index += 4) {
+            put_u32(index, writer->offsets[i]);
+        }
+        for (uint32_t i = 0; i < writer->table_count; i++, index += 4) {
+            put_u32(index, writer->name_offsets[i]);
+        }
+        writer->block_size += index_size;
+        status = end_block(writer, start);
+    }
+    if (status == 0) {
+        uint8_t *trailer = writer->block + writer->block_size;
+        put_u32(trailer, (uint32_t)writer->size);
+        memcpy(trailer + 4, CHANGELOG_END_MAGIC, 4);
+        writer->block_size += CHANGELOG_TRAILER_SIZE;
+        // Sealed segments are final, so they are the one thing worth syncing
+        if (write_fully(writer->fd, writer->block, writer->block_size) != 0 || fdatasync(writer->fd) != 0) {
+            report_error("Failed to seal change log segment", 1);
+            status = -1;
+        }
+    }
+    close(writer->fd);
+    writer->fd = -1;
+    writer->size = 0;
+    writer->block_size = 0;
+    writer->block_count = 0;
+    writer->table_count = 0;
+    if (writer->table_ids) {
+        memset(writer->table_ids, 0, writer->table_id_capacity * sizeof(uint32_t));
+    }
+    return status;
+}
+
+// Re-reads a segment a writer never sealed, drops everything from the
+// first block that is torn or fails its checksum, and seals the rest
+static int recover_segment(ChangeLogWriter *writer, const char *path) {
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        report_error("Failed to open change log segment", 1);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    uint8_t *data = size ? mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0) : NULL;
+    if (data == MAP_FAILED) {
+        report_error("Failed to map change log segment", 1);
+        close(fd);
+        return -1;
+    }
+    // A crash before the header was written leaves nothing worth keeping
+    if (size < CHANGELOG_HEADER_SIZE) {
+        if (data) {
+            munmap(data, size);
+        }
+        close(fd);
+        writer->sequence--;
+        return unlink(path) == 0 ? 0 : report_error("Failed to remove empty change log segment", 1);
+    }
+    if (memcmp(data, CHANGELOG_MAGIC, 4) != 0 || data[4] != CHANGELOG_VERSION) {
+        munmap(data, size);
+        close(fd);
+        report_error("Not a change log segment", 0);
+        return -1;
+    }
+
+    writer->fd = fd;
+    writer->size = CHANGELOG_HEADER_SIZE;
+    int status = 0;
+    while (status == 0 && writer->size + CHANGELOG_BLOCK_HEADER_SIZE <= size) {
+        const uint8_t *block = data + writer->size;
+        uint32_t length = get_u32(block);
+        uint8_t type = block[4];
+        uint32_t checksum1, checksum2;
+        if (type < CHANGELOG_BLOCK_TABLES || type > CHANGELOG_BLOCK_GENERATION || length % 8 ||
+            length > size - writer->size - CHANGELOG_BLOCK_HEADER_SIZE) {
+            break;
+        }
+        block_checksum(block, length, &checksum1, &checksum2);
+        if (checksum1 != get_u32(block + 8) || checksum2 != get_u32(block + 12)) {
+            break;
+        }
+        status = push_offset(&writer->offsets, &writer->block_count, &writer->offset_capacity,
+                             (uint32_t)writer->size);
+        if (type == CHANGELOG_BLOCK_TABLES) {
+            // Names follow the first id and count, each as length, bytes and NUL
+            const uint8_t *body = block + CHANGELOG_BLOCK_HEADER_SIZE;
+            size_t pos = 0;
+            int bytes_read;
+            parse_varint(body, &pos, length, &bytes_read);
+            int64_t names = parse_varint(body, &pos, length, &bytes_read);
+            for (int64_t i = 0; status == 0 && i < names; i++) {
+                int64_t name_length = parse_varint(body, &pos, length, &bytes_read);
+                if (name_length < 0 || (uint64_t)name_length >= length - pos) {
+                    break;
+                }
+                status = push_offset(&writer->name_offsets, &writer->table_count, &writer->name_capacity,
+                                     (uint32_t)(writer->size + CHANGELOG_BLOCK_HEADER_SIZE + pos));
+                pos += (size_t)name_length + 1;
+            }
+        }
+        writer->size += CHANGELOG_BLOCK_HEADER_SIZE + length;
+    }
+    munmap(data, size);
+    if (status == 0 && (ftruncate(fd, (off_t)writer->size) != 0 || lseek(fd, 0, SEEK_END) < 0)) {
+        status = report_error("Failed to truncate change log segment", 1);
+    }
+    if (status != 0) {
+        close(fd);
+        writer->fd = -1;
+        return -1;
+    }
+    return seal_segment(writer);
+}
+
+// Returns 1 when a segment ends in a trailer; the one a writer has open does not
+int changelog_segment_sealed(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    uint8_t trailer[CHANGELOG_TRAILER_SIZE];
+    off_t end = lseek(fd, 0, SEEK_END);
+    int sealed = end >= CHANGELOG_HEADER_SIZE + CHANGELOG_TRAILER_SIZE &&
+                 pread(fd, trailer, sizeof(trailer), end - CHANGELOG_TRAILER_SIZE) == (ssize_t)sizeof(trailer) &&
+                 memcmp(trailer + 4, CHANGELOG_END_MAGIC, 4) == 0;
+    close(fd);
+    return sealed;
+}
+
+// Opens a change log for appending, creating the directory if needed. New
+// blocks go to a segment after the existing ones; the last existing
+// segment is sealed first if a writer crashed before sealing it.
+// segment_bytes of 0 means CHANGELOG_SEGMENT_BYTES.
+int changelog_writer_open(ChangeLogWriter *writer, const char *directory, size_t segment_bytes) {
+    memset(writer, 0, sizeof(*writer));
+    writer->fd = -1;
+    writer->segment_bytes = segment_bytes ? segment_bytes : CHANGELOG_SEGMENT_BYTES;
+    if (writer->segment_bytes > SEGMENT_MAX_BYTES) {
+        writer->segment_bytes = SEGMENT_MAX_BYTES;
+    }
+    if (mkdir(directory, 0755) != 0 && errno != EEXIST) {
+        report_error("Failed to create change log directory", 1);
+        return -1;
+    }
+    writer->directory = strdup(directory);
+    if (!writer->directory) {
+        report_error("Failed to allocate memory for change log directory", 1);
+        return -1;
+    }
+    uint32_t count;
+    char **paths = changelog_list_segments(directory, &count);
+    if (!paths) {
+        changelog_writer_close(writer);
+        return -1;
+    }
+    int status = 0;
+    if (count) {
+        const char *last = paths[count - 1];
+        writer->sequence = (uint32_t)strtoul(strrchr(last, '/') + 1, NULL, 10);
+        if (!changelog_segment_sealed(last)) {
+            status = recover_segment(writer, last);
+        }
+    }
+    changelog_free_segments(paths, count);
+    if (status != 0) {
+        changelog_writer_close(writer);
+        return -1;
+    }
+    return 0;
+}
+
+// Seals the open segment once it has passed segment_bytes and opens a
+// segment if none is open. A segment may therefore run over by one batch.
+static int prepare_segment(ChangeLogWriter *writer) {
+    if (writer->fd >= 0 && writer->size >= writer->segment_bytes && seal_segment(writer) != 0) {
+        return -1;
+    }
+    return writer->fd >= 0 ? 0 : start_segment(writer);
+}
+
+// Forgets the blocks and tables a failed batch added
+static void forget_batch(ChangeLogWriter *writer, uint32_t block_count, uint32_t table_count) {
+    writer->block_size = 0;
+    writer->block_count = block_count;
+    for (uint32_t i = 0; i < writer->table_id_capacity; i++) {
+        if (writer->table_ids[i] > table_count) {
+            writer->table_ids[i] = 0;
+        }
+    }
+    writer->table_count = table_count;
+}
+
+// Writes the blocks in the buffer as one write. On failure the segment is
+// cut back so that it still ends at a block boundary.
+static int flush_blocks(ChangeLogWriter *writer, uint32_t block_count, uint32_t table_count) {
+    if (write_fully(writer->fd, writer->block, writer->block_size) == 0) {
+        writer->size += writer->block_size;
+        writer->block_size = 0;
+        return 0;
+    }
+    report_error("Failed to write change log block", 1);
+    if (ftruncate(writer->fd, (off_t)writer->size) != 0 || lseek(writer->fd, (off_t)writer->size, SEEK_SET) < 0) {
+        report_error("Failed to truncate change log segment", 1);
+    }
+    forget_batch(writer, block_count, table_count);
+    return -1;
+}
+
+// Ends a block and records where it will land in the segment
+static int finish_block(ChangeLogWriter *writer, size_t start) {
+    if (end_block(writer, start) != 0) {
+        return -1;
+    }
+    return push_offset(&writer->offsets, &writer->block_count, &writer->offset_capacity,
+                       (uint32_t)(writer->size + start));
+}
+
+// Adds a table block naming every b-tree the changes use that the segment
+// has not defined yet, in b-tree order
+static int define_tables(ChangeLogWriter *writer, const RowChange *changes, uint32_t count,
+                         const PageOwnerMap *owners) {
+    if (writer->table_id_capacity < owners->btree_count) {
+        uint32_t *grown = realloc(writer->table_ids, owners->btree_count * sizeof(uint32_t));
+        if (!grown) {
+            report_error("Failed to allocate memory for change log tables", 1);
+            return -1;
+        }
+        memset(grown + writer->table_id_capacity, 0,
+               (owners->btree_count - writer->table_id_capacity) * sizeof(uint32_t));
+        writer->table_ids = grown;
+        writer->table_id_capacity = owners->btree_count;
+    }
+    uint32_t undefined = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        int32_t table = changes[i].table;
+        if (table >= 0 && (uint32_t)table < owners->btree_count && writer->table_ids[table] == 0) {
+            writer->table_ids[table] = UINT32_MAX;
+            undefined++;
+        }
+    }
+    if (!undefined) {
+        return 0;
+    }
+    size_t start = begin_block(writer, CHANGELOG_BLOCK_TABLES);
+    if (start == (size_t)-1 || put_varint(writer, writer->table_count) != 0 || put_varint(writer, undefined) != 0) {
+        return -1;
+    }
+    for (uint32_t b = 0; b < owners->btree_count; b++) {
+        if (writer->table_ids[b] != UINT32_MAX) {
+            continue;
+        }
+        const char *name = owners->btrees[b].name ? owners->btrees[b].name : "";
+        size_t length = strlen(name);
+        if (put_varint(writer, length) != 0 || reserve_block(writer, length + 1) != 0 ||
+            push_offset(&writer->name_offsets, &writer->table_count, &writer->name_capacity,
+                        (uint32_t)(writer->size + writer->block_size)) != 0) {
+            return -1;
+        }
+        memcpy(writer->block + writer->block_size, name, length + 1);
+        writer->block_size += length + 1;
+        writer->table_ids[b] = writer->table_count;
+    }
+    return finish_block(writer, start);
+}
+
+// Appends one committed transaction and its row changes, as collected by
+// collect_row_changes(). Table names come from owners, which may be NULL.
+int changelog_write_transaction(ChangeLogWriter *writer, const WalTransaction *transaction,
+                                const RowChange *changes, uint32_t count, const PageOwnerMap *owners) {
+    if (prepare_segment(writer) != 0) {
+        return -1;
+    }
+    uint32_t block_count = writer->block_count;
+    uint32_t table_count = writer->table_count;
+    int status = owners ? define_tables(writer, changes, count, owners) : 0;
+    size_t start = status == 0 ? begin_block(writer, CHANGELOG_BLOCK_TRANSACTION) : (size_t)-1;
+    status = start == (size_t)-1 || put_varint(writer, transaction->first_frame) != 0 ||
+             put_varint(writer, transaction->commit_frame) != 0 ||
+             put_varint(writer, transaction->database_size) != 0 || put_varint(writer, count) != 0 ||
+             reserve_block(writer, (size_t)count * 3 * 9) != 0 ? -1 : 0;
+    int64_t rowid = 0;
+    uint32_t page_number = 0;
+    for (uint32_t i = 0; i < count && status == 0; i++) {
+        const RowChange *change = &changes[i];
+        uint32_t table = owners && change->table >= 0 && (uint32_t)change->table < owners->btree_count
+                             ? writer->table_ids[change->table] : 0;
+        // Room for all three varints was reserved above
+        uint8_t *out = writer->block + writer->block_size;
+        out += encode_varint((uint64_t)table << 2 | change->type, out);
+        out += encode_varint(zigzag((int64_t)((uint64_t)change->rowid - (uint64_t)rowid)), out);
+        out += encode_varint(zigzag((int64_t)change->page_number - page_number), out);
+        writer->block_size = (size_t)(out - writer->block);
+        rowid = change->rowid;
+        page_number = change->page_number;
+    }
+    if (status == 0) {
+        status = finish_block(writer, start);
+    }
+    if (status != 0) {
+        forget_batch(writer, block_count, table_count);
+        return -1;
+    }
+    return flush_blocks(writer, block_count, table_count);
+}
+
+// Appends the start of a new WAL generation, so that replay can tell
+// where commit frame numbers start over
+int changelog_write_generation(ChangeLogWriter *writer, const WalHeader *header) {
+    if (prepare_segment(writer) != 0) {
+        return -1;
+    }
+    uint32_t block_count = writer->block_count;
+    size_t start = begin_block(writer, CHANGELOG_BLOCK_GENERATION);
+    if (start == (size_t)-1 || put_varint(writer, header->checkpoint) != 0 || put_varint(writer, header->salt1) != 0 ||
+        put_varint(writer, header->salt2) != 0 || finish_block(writer, start) != 0) {
+        forget_batch(writer, block_count, writer->table_count);
+        return -1;
+    }
+    return flush_blocks(writer, block_count, writer->table_count);
+}
+
+// Seals the open segment, if any, and frees the writer
+int changelog_writer_close(ChangeLogWriter *writer) {
+    int status = writer->fd >= 0 ? seal_segment(writer) : 0;
+    free(writer->directory);
+    free(writer->block);
+    free(writer->offsets);
+    free(writer->name_offsets);
+    free(writer->table_ids);
+    memset(writer, 0, sizeof(*writer));
+    writer->fd = -1;
+    return status;
+}
+
+// Maps a sealed segment and checks its header, index and table names.
+// Blocks are checked as a cursor reaches them.
+int changelog_segment_open(ChangeLogSegment *segment, const char *path) {
+    memset(segment, 0, sizeof(*segment));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        report_error("Failed to open change log segment", 1);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    if (size < CHANGELOG_HEADER_SIZE + CHANGELOG_BLOCK_HEADER_SIZE + INDEX_HEADER_SIZE + CHANGELOG_TRAILER_SIZE) {
+        close(fd);
+        report_error("Change log segment is truncated or unsealed", 0);
+        return -1;
+    }
+    uint8_t *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        report_error("Failed to map change log segment", 1);
+        return -1;
+    }
+    // Replay reads the segment front to back
+    madvise(data, size, MADV_SEQUENTIAL);
+    segment->data = data;
+    segment->size = size;
+
+    const uint8_t *trailer = data + size - CHANGELOG_TRAILER_SIZE;
+    uint32_t index_offset = get_u32(trailer);
+    const uint8_t *block = data + index_offset;
+    uint32_t length = index_offset % 8 == 0 && index_offset >= CHANGELOG_HEADER_SIZE &&
+                      index_offset <= size - CHANGELOG_TRAILER_SIZE - CHANGELOG_BLOCK_HEADER_SIZE
+                          ? get_u32(block) : UINT32_MAX;
+    uint32_t checksum1 = 0, checksum2 = 0;
+    int valid = memcmp(data, CHANGELOG_MAGIC, 4) == 0 && data[4] == CHANGELOG_VERSION &&
+                memcmp(trailer + 4, CHANGELOG_END_MAGIC, 4) == 0 &&
+                length == size - CHANGELOG_TRAILER_SIZE - CHANGELOG_BLOCK_HEADER_SIZE - index_offset &&
+                length >= INDEX_HEADER_SIZE && block[4] == CHANGELOG_BLOCK_INDEX;
+    if (valid) {
+        block_checksum(block, length, &checksum1, &checksum2);
+        segment->index = block + CHANGELOG_BLOCK_HEADER_SIZE + INDEX_HEADER_SIZE;
+        segment->block_count = get_u32(block + CHANGELOG_BLOCK_HEADER_SIZE);
+        segment->table_count = get_u32(block + CHANGELOG_BLOCK_HEADER_SIZE + 4);
+        valid = checksum1 == get_u32(block + 8) && checksum2 == get_u32(block + 12) &&
+                ((uint64_t)segment->block_count + segment->table_count) * 4 <= length - INDEX_HEADER_SIZE;
+    }
+    // Names are handed out as C strings, so each must end before the index
+    for (uint32_t i = 0; valid && i < segment->table_count; i++) {
+        uint32_t offset = get_u32(segment->index + 4 * ((size_t)segment->block_count + i));
+        valid = offset >= CHANGELOG_HEADER_SIZE && offset < index_offset &&
+                memchr(data + offset, 0, index_offset - offset) != NULL;
+    }
+    if (!valid) {
+        changelog_segment_close(segment);
+        report_error("Change log segment is damaged or unsealed", 0);
+        return -1;
+    }
+    segment->sequence = get_u32(data + 8);
+    return 0;
+}
+
+// Returns the name of a segment's table id, or NULL for -1 and unknown ids
+const char *changelog_table_name(const ChangeLogSegment *segment, int32_t table) {
+    if (table < 0 || (uint32_t)table >= segment->table_count) {
+        return NULL;
+    }
+    return (const char *)segment->data + get_u32(segment->index + 4 * ((size_t)segment->block_count + table));
+}
+
+// Unmaps a segment
+void changelog_segment_close(ChangeLogSegment *segment) {
+    if (segment->data) {
+        munmap((void *)segment->data, segment->size);
+    }
+    memset(segment, 0, sizeof(*segment));
+}
+
+// Starts a cursor at the first block of a segment
+void changelog_cursor_init(ChangeLogCursor *cursor, const ChangeLogSegment *segment) {
+    memset(cursor, 0, sizeof(*cursor));
+    cursor->segment = segment;
+}
+
+// Reads one varint of the current block; single-byte values skip the call
+static int read_varint(ChangeLogCursor *cursor, uint64_t *value) {
+    if (cursor->pos < cursor->end && *cursor->pos < 0x80) {
+        *value = *cursor->pos++;
+        return 0;
+    }
+    int used = decode_varint(cursor->pos, (size_t)(cursor->end - cursor->pos), value);
+    cursor->pos += used;
+    return used ? 0 : -1;
+}
+
+// Moves to the next transaction or generation block, verifying its
+// checksum; table blocks are checked and skipped. Changes of the previous
+// transaction that were not read are skipped too. Returns 1 with the
+// block filled in, 0 after the last block, -1 if the block is damaged.
+int changelog_next_block(ChangeLogCursor *cursor, ChangeLogBlock *block) {
+    const ChangeLogSegment *segment = cursor->segment;
+    size_t index_offset = (size_t)(segment->index - INDEX_HEADER_SIZE - CHANGELOG_BLOCK_HEADER_SIZE - segment->data);
+    while (cursor->block < segment->block_count) {
+        uint32_t offset = get_u32(segment->index + 4 * (size_t)cursor->block++);
+        if (offset < CHANGELOG_HEADER_SIZE || offset % 8 || offset > index_offset - CHANGELOG_BLOCK_HEADER_SIZE) {
+            return -1;
+        }
+        const uint8_t *header = segment->data + offset;
+        uint32_t length = get_u32(header);
+        if (length > index_offset - offset - CHANGELOG_BLOCK_HEADER_SIZE) {
+            return -1;
+        }
+        uint32_t checksum1, checksum2;
+        block_checksum(header, length, &checksum1, &checksum2);
+        if (checksum1 != get_u32(header + 8) || checksum2 != get_u32(header + 12)) {
+            return -1;
+        }
+        cursor->pos = header + CHANGELOG_BLOCK_HEADER_SIZE;
+        cursor->end = cursor->pos + length;
+        cursor->remaining = 0;
+        uint64_t values[4];
+        memset(block, 0, sizeof(*block));
+        block->type = header[4];
+        if (block->type == CHANGELOG_BLOCK_TABLES) {
+            continue;
+        }
+        int fields = block->type == CHANGELOG_BLOCK_TRANSACTION ? 4 : block->type == CHANGELOG_BLOCK_GENERATION ? 3 : 0;
+        if (!fields) {
+            return -1;
+        }
+        for (int i = 0; i < fields; i++) {
+            if (read_varint(cursor, &values[i]) != 0 || values[i] > UINT32_MAX) {
+                return -1;
+            }
+        }
+        if (block->type == CHANGELOG_BLOCK_GENERATION) {
+            block->checkpoint = (uint32_t)values[0];
+            block->salt1 = (uint32_t)values[1];
+            block->salt2 = (uint32_t)values[2];
+            return 1;
+        }
+        block->transaction.first_frame = (uint32_t)values[0];
+        block->transaction.commit_frame = (uint32_t)values[1];
+        block->transaction.database_size = (uint32_t)values[2];
+        block->change_count = (uint32_t)values[3];
+        cursor->remaining = block->change_count;
+        cursor->rowid = 0;
+        cursor->page_number = 0;
+        return 1;
+    }
+    return 0;
+}
+
+// Decodes the next change of the current transaction into change. Only
+// rowid, page_number, table (a segment table id, see
+// changelog_table_name()) and type are stored; digests, cells and page
+// images are cleared. Returns 1, 0 after the last change, -1 if damaged.
+int changelog_next_change(ChangeLogCursor *cursor, RowChange *change) {
+    if (!cursor->remaining) {
+        return 0;
+    }
+    uint64_t tag, rowid_delta, page_delta;
+    const uint8_t *pos = cursor->pos;
+    // Sequential rowids on the same page make three single-byte varints
+    if (cursor->end - pos >= 3 && ((pos[0] | pos[1] | pos[2]) & 0x80) == 0) {
+        tag = pos[0];
+        rowid_delta = pos[1];
+        page_delta = pos[2];
+        cursor->pos += 3;
+    } else if (read_varint(cursor, &tag) != 0 || read_varint(cursor, &rowid_delta) != 0 ||
+               read_varint(cursor, &page_delta) != 0) {
+        cursor->remaining = 0;
+        return -1;
+    }
+    if ((tag & 3) > ROW_DELETE || (tag >> 2) > cursor->segment->table_count) {
+        cursor->remaining = 0;
+        return -1;
+    }
+    cursor->remaining--;
+    cursor->rowid = (int64_t)((uint64_t)cursor->rowid + (uint64_t)unzigzag(rowid_delta));
+    cursor->page_number += (uint32_t)unzigzag(page_delta);
+    *change = (RowChange){
+        .rowid = cursor->rowid,
+        .page_number = cursor->page_number,
+        .table = (int32_t)(tag >> 2) - 1,
+        .type = (uint8_t)(tag & 3)
+    };
+    return 1;
+}
@@ -0,0 +1,109 @@
+#ifndef CHANGELOG_H
+#define CHANGELOG_H
+
+#include "page_owner.h"
+#include "row_diff.h"
+#include "wal_format.h"
+#include "wal_transaction.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// A change log is a directory of numbered segment files, NNNNNNNNNN.changelog.
+// Each segment is a 16-byte header, a run of blocks, an index block and an
+// 8-byte trailer. Every block is a 16-byte header (body length, type, and
+// the SQLite WAL checksum of the header's first 8 bytes and the body)
+// followed by a body padded to 8 bytes. Integers in headers, the index and
+// the trailer are little-endian; everything in a block body is a SQLite
+// varint. A transaction block holds its frame range, database size and
+// changes; each change is (table id + 1) << 2 | type, then the rowid and
+// page as zigzag deltas from the change before. Table ids number the
+// segment's table blocks, which define each table the first time the
+// segment uses it; the index lists every block and every table name.
+#define CHANGELOG_MAGIC "WPCL"
+#define CHANGELOG_END_MAGIC "WEND"
+#define CHANGELOG_VERSION 1
+#define CHANGELOG_HEADER_SIZE 16
+#define CHANGELOG_BLOCK_HEADER_SIZE 16
+#define CHANGELOG_TRAILER_SIZE 8
+#define CHANGELOG_SEGMENT_BYTES (64u << 20)  // Segments are sealed once they pass this
+
+typedef enum {
+    CHANGELOG_BLOCK_TABLES = 1,     // first id, count, then each name (length, bytes, NUL)
+    CHANGELOG_BLOCK_TRANSACTION,    // first frame, commit frame, database size, count, changes
+    CHANGELOG_BLOCK_GENERATION,     // checkpoint, salt-1, salt-2 of a new WAL generation
+    CHANGELOG_BLOCK_INDEX           // u32 block and table counts, block offsets, name offsets
+} ChangeLogBlockType;
+
+// Appends row changes to a change log. Segments are created on the first
+// block and sealed, with their index, when they fill up and on close; a
+// segment a crashed writer left unsealed is sealed at the last intact
+// block when the directory is opened again. Table ids are cached per
+// owner b-tree, so one writer serves one PageOwnerMap.
+typedef struct {
+    char* directory;
+    size_t segment_bytes;
+    int fd;                     // Open segment, -1 until the next block
+    uint32_t sequence;          // Number of the open (or last) segment
+    uint64_t size;              // Bytes written to the open segment
+    uint8_t* block;             // Block being encoded, header included
+    size_t block_size;
+    size_t block_capacity;
+    uint32_t* offsets;          // Offset of each block in the open segment
+    uint32_t block_count;
+    uint32_t offset_capacity;
+    uint32_t* name_offsets;     // Offset of each table name in the open segment
+    uint32_t table_count;
+    uint32_t name_capacity;
+    uint32_t* table_ids;        // Table id + 1 of each owner b-tree in the open segment, 0 if undefined
+    uint32_t table_id_capacity;
+} ChangeLogWriter;
+
+int changelog_writer_open(ChangeLogWriter* writer, const char* directory, size_t segment_bytes);
+int changelog_write_transaction(ChangeLogWriter* writer, const WalTransaction* transaction,
+                                const RowChange* changes, uint32_t count, const PageOwnerMap* owners);
+int changelog_write_generation(ChangeLogWriter* writer, const WalHeader* header);
+int changelog_writer_close(ChangeLogWriter* writer);
+
+// One sealed segment, mapped read-only
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+    uint32_t sequence;
+    const uint8_t* index;       // Block offsets, then name offsets
+    uint32_t block_count;
+    uint32_t table_count;
+} ChangeLogSegment;
+
+// A block as the cursor found it
+typedef struct {
+    uint8_t type;               // CHANGELOG_BLOCK_TRANSACTION or CHANGELOG_BLOCK_GENERATION
+    WalTransaction transaction;
+    uint32_t change_count;
+    uint32_t checkpoint;
+    uint32_t salt1;
+    uint32_t salt2;
+} ChangeLogBlock;
+
+// Walks the blocks of a segment and the changes of each transaction
+// straight from the mapping, without allocating
+typedef struct {
+    const ChangeLogSegment* segment;
+    uint32_t block;             // Next entry of the index
+    const uint8_t* pos;         // Next change of the current transaction
+    const uint8_t* end;
+    uint32_t remaining;
+    int64_t rowid;              // Previous change, the base of the next delta
+    uint32_t page_number;
+} ChangeLogCursor;
+
+char** changelog_list_segments(const char* directory, uint32_t* count);
+void changelog_free_segments(char** paths, uint32_t count);
+int changelog_segment_sealed(const char* path);
+int changelog_segment_open(ChangeLogSegment* segment, const char* path);
+const char* changelog_table_name(const ChangeLogSegment* segment, int32_t table);
+void changelog_segment_close(ChangeLogSegment* segment);
+void changelog_cursor_init(ChangeLogCursor* cursor, const ChangeLogSegment* segment);
+int changelog_next_block(ChangeLogCursor* cursor, ChangeLogBlock* block);
+int changelog_next_change(ChangeLogCursor* cursor, RowChange* change);
+
+#endif
@@ -1,49 +1,66 @@
+#include "db_utils.h"
+#include "frame_index.h"
+#include "page_owner.h"
 #include "utils.h"
-#include <sqlite3.h>
+#include "wal_reader.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
+// Applies the committed frames of the database's WAL, if it has one, so
+// that pages written since the last checkpoint resolve to their current
+// owner. The reader must stay open while the map is used.
+static int apply_committed_wal(PageOwnerMap *map, WalReader *reader, const char *db_filename) {
+    size_t length = strlen(db_filename);
+    char *wal_filename = malloc(length + 5);
+    if (!wal_filename) {
+        return report_error("Failed to allocate memory for WAL filename", 0);
+    }
+    memcpy(wal_filename, db_filename, length);
+    memcpy(wal_filename + length, "-wal", 5);
+    int is_open = access(wal_filename, F_OK) == 0 && wal_reader_open(reader, wal_filename) == 0;
+    free(wal_filename);
+    if (!is_open) {
+        return 0;
+    }
+    FrameIndex index;
+    frame_index_init(&index);
+    frame_index_build(&index, reader);
+    uint32_t last_commit = frame_index_last_commit(&index);
+    WalFrameView frame;
+    for (uint32_t n = 1; n <= last_commit && wal_reader_frame(reader, n, &frame) == 0; n++) {
+        page_owner_apply_frame(map, reader, &frame);
+    }
+    frame_index_free(&index);
+    return 1;
+}
+
+// One-off lookup that builds a throwaway ownership map, brought up to the
+// WAL's last commit the way the frame loops keep theirs. Callers resolving
+// many pages should keep a PageOwnerMap open instead.
 char *get_table_name_from_page(const char *db_filename, uint32_t page_number) {
-    sqlite3 *db;
-    sqlite3_stmt *stmt;
+    PageOwnerMap map;
     char *table_name = NULL;
-    int rc;
 
-    // Open the database
-    rc = sqlite3_open(db_filename, &db);
-    if (rc != SQLITE_OK) {
+    if (page_owner_open(&map, db_filename) != 0) {
         report_error("Cannot open database", 0);
-        sqlite3_close(db);
         return NULL;
     }
+    WalReader reader;
+    int wal_open = apply_committed_wal(&map, &reader, db_filename) > 0;
 
-    // Prepare the SQL query
-    const char *sql = "SELECT name FROM dbstat WHERE pageno = ?";
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        report_error("Failed to prepare SQL statement", 0);
-        sqlite3_close(db);
-        return NULL;
-    }
-
-    // Bind the page number parameter
-    sqlite3_bind_int(stmt, 1, page_number);
-
-    // Execute the query and fetch the result
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        const char *name = (const char *)sqlite3_column_text(stmt, 0);
-        if (name) {
-            table_name = strdup(name); // Allocate and copy the table name
-            if (!table_name) {
-                report_error("Failed to allocate memory for table name", 0);
-            }
+    const char *name = page_owner_lookup(&map, page_number);
+    if (name) {
+        table_name = strdup(name); // Allocate and copy the table name
+        if (!table_name) {
+            report_error("Failed to allocate memory for table name", 0);
         }
     }
 
-    // Clean up
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
-
+    if (wal_open) {
+        wal_reader_close(&reader);
+    }
+    page_owner_close(&map);
     return table_name;
 }
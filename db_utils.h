@@ -3,7 +3,8 @@
 
 #include <stdint.h>
 
-// Returns the table name for a given page number, or NULL if not found or on error
+// Returns the table name for a given page number, as of the WAL's last
+// commit, or NULL if not found or on error
 char *get_table_name_from_page(const char *db_filename, uint32_t page_number);
 
 #endif
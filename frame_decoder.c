@@ -0,0 +1,535 @@
+#include "frame_decoder.h"
+#include "ring.h"
+#include "wal_parser.h"
+#include "wal_checksum.h"
+#include "page_analyzer.h"
+#include "utils.h"
+#include "frame_output.h"
+#include "wal_stats.h"
+#include "wal_transaction.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Formatted chunks a decoder may hold before the writer takes them. Each
+// is a memory sink, so this bounds the output buffered per decoder. A
+// power of two, as ring capacities are.
+#define FRAME_PIPELINE_DEPTH 8
+// Chunks queued for each decoder. An entry is one integer, so the checking
+// stage can run far ahead while the output is stalled.
+#define FRAME_PIPELINE_BACKLOG 1024
+// Queued chunks a decoder takes in one batch
+#define FRAME_PIPELINE_BATCH 8
+
+// Order-dependent state carried from one frame to the next
+typedef struct {
+    const WalReader *reader;
+    PageOwnerMap *owners;
+    const Subscription *subscription;
+    FrameCheck *checks;
+    uint32_t chain1;            // Checksum seed for the next frame
+    uint32_t chain2;
+    uint32_t transaction_start; // First frame of the open transaction
+    uint32_t settled;           // Frames whose FrameCheck is final
+} FrameChecker;
+
+struct FramePipeline;
+
+// One decoding stage: chunks come in through input, are formatted into
+// sinks[] and go out through output as the index of their sink
+typedef struct {
+    Ring input;                 // chunk number << 32 | last frame of the chunk
+    Ring output;                // Index into sinks, in chunk order
+    OutputSink sinks[FRAME_PIPELINE_DEPTH];
+    struct FramePipeline *pipeline;
+    pthread_t thread;
+} FrameDecoder;
+
+// A pass split into stages joined by lock-free rings: one thread checks
+// frames in order and deals the settled chunks round-robin to the
+// decoders; the calling thread writes their output back in the same
+// round-robin order, so it matches a sequential run byte for byte. Every
+// ring is bounded, and a stage that finds the next one's ring full waits,
+// so nothing is dropped and memory stays fixed.
+typedef struct FramePipeline {
+    const WalReader *reader;
+    FrameCheck *checks;
+    const PageSource *source;
+    FrameChecker checker;
+    int check;                  // checks still need filling in
+    int committed_only;
+    uint32_t frame_count;       // Frames to check, or already checked
+    FrameDecoder *decoders;
+    unsigned decoder_count;
+    uint32_t decode_count;      // Set by the checking stage once it is done
+    uint64_t dropped;
+} FramePipeline;
+
+// Checks one frame chained from the given seed without printing anything
+int check_frame(const WalFrameView *frame, const WalHeader *header,
+                uint32_t initial_checksum1, uint32_t initial_checksum2, FrameCheck *check) {
+    check->checksum1 = initial_checksum1;
+    check->checksum2 = initial_checksum2;
+    check->table_name = NULL;
+    check->filter = NULL;
+    check->skipped = 0;
+    if (wal_frame_checksum_matches(frame, header, &check->checksum1, &check->checksum2)) {
+        check->status = FRAME_VALID;
+        return 1;
+    }
+    if (frame->header.salt1 != header->salt1 || frame->header.salt2 != header->salt2) {
+        check->status = FRAME_SALT_MISMATCH;
+    } else {
+        check->status = FRAME_CHECKSUM_MISMATCH;
+    }
+    return 0;
+}
+
+// Settles which frames of one transaction a subscription keeps. A page can
+// join a watched b-tree through a parent written later in the same
+// transaction, so frames are judged against ownership as of the commit.
+static void select_subscribed(const WalReader *reader, const PageOwnerMap *owners, const Subscription *subscription,
+                              FrameCheck *checks, uint32_t first, uint32_t last) {
+    WalFrameView frame;
+    for (uint32_t n = first; n <= last && wal_reader_frame(reader, n, &frame) == 0; n++) {
+        FrameCheck *check = &checks[n - 1];
+        uint32_t page_number = frame.header.page_number;
+        check->skipped = !page_owner_watched(owners, page_number);
+        if (!check->skipped) {
+            check->table_name = page_owner_lookup(owners, page_number);
+            check->filter = subscription_find(subscription, check->table_name);
+        }
+    }
+}
+
+// Starts the order-dependent pass at the first frame
+static void checker_init(FrameChecker *checker, const WalReader *reader, PageOwnerMap *owners,
+                         const Subscription *subscription, FrameCheck *checks) {
+    checker->reader = reader;
+    checker->owners = owners;
+    checker->subscription = subscription;
+    checker->checks = checks;
+    checker->chain1 = reader->header.checksum1;
+    checker->chain2 = reader->header.checksum2;
+    checker->transaction_start = 1;
+    checker->settled = 0;
+}
+
+// Checks the frame after the last one checked and updates page ownership.
+// Each frame is checked against its predecessor's stored checksum so a
+// single damaged frame does not flag every frame after it. Returns 1 if
+// the frame is valid.
+static int checker_next(FrameChecker *checker, const WalFrameView *frame) {
+    const WalReader *reader = checker->reader;
+    uint32_t n = frame->frame_number;
+    FrameCheck *check = &checker->checks[n - 1];
+    uint64_t start = stats_clock();
+    int valid = check_frame(frame, &reader->header, checker->chain1, checker->chain2, check);
+    stats_record(STATS_CHECKSUM, start);
+    stats_add(STATS_FRAMES, 1);
+    stats_add(STATS_WAL_BYTES, WAL_FRAME_HEADER_SIZE + reader->page_size);
+    if (!valid) {
+        stats_add(STATS_CHECKSUM_FAILURES, 1);
+    }
+    checker->chain1 = frame->header.checksum1;
+    checker->chain2 = frame->header.checksum2;
+    start = stats_clock();
+    if (checker->owners && valid) {
+        page_owner_apply_frame(checker->owners, reader, frame);
+    }
+    if (checker->subscription) {
+        if (valid && frame->header.commit_size) {
+            select_subscribed(reader, checker->owners, checker->subscription, checker->checks,
+                              checker->transaction_start, n);
+            checker->transaction_start = n + 1;
+            checker->settled = n;
+        }
+    } else {
+        // Names are only freed when the map closes, so the pointer outlives the pass
+        check->table_name = page_owner_lookup(checker->owners, frame->header.page_number);
+        checker->settled = n;
+    }
+    stats_record(STATS_LOOKUP, start);
+    return valid;
+}
+
+// Settles the frames of a transaction left open at the end of the pass
+static void checker_finish(FrameChecker *checker, uint32_t last) {
+    if (checker->subscription) {
+        select_subscribed(checker->reader, checker->owners, checker->subscription, checker->checks,
+                          checker->transaction_start, last);
+    }
+    checker->settled = last;
+}
+
+// Runs the order-dependent work for every frame: checksum chaining and page
+// ownership updates. Returns one FrameCheck per frame, or NULL on failure.
+// With a subscription, owners must be watching its tables; frames of other
+// pages are marked skipped, and ownership is only followed for the
+// watched b-trees.
+FrameCheck *check_wal_frames(const WalReader *reader, PageOwnerMap *owners, const Subscription *subscription,
+                             uint32_t *frame_count) {
+    *frame_count = reader->frame_count;
+    FrameCheck *checks = malloc(((size_t)reader->frame_count + 1) * sizeof(FrameCheck));
+    if (!checks) {
+        report_error("Failed to allocate memory for frame checks", 1);
+        return NULL;
+    }
+    FrameChecker checker;
+    checker_init(&checker, reader, owners, subscription, checks);
+    uint32_t n = 1;
+    WalFrameView frame;
+    for (; n <= reader->frame_count && wal_reader_frame(reader, n, &frame) == 0; n++) {
+        checker_next(&checker, &frame);
+    }
+    checker_finish(&checker, n - 1);
+    return checks;
+}
+
+// Prints the outcome of a frame's checksum check
+void print_frame_check(OutputSink *out, const WalFrameView *frame, const FrameCheck *check) {
+    if (check->status == FRAME_VALID) {
+        sink_puts(out, "Checksum verified successfully.\n");
+    } else if (check->status == FRAME_SALT_MISMATCH) {
+        sink_puts(out, "Salt mismatch for frame! Frame belongs to an earlier WAL generation.\n");
+    } else {
+        sink_printf(out, "Checksum mismatch for frame! Expected: 0x%08x 0x%08x, Computed: 0x%08x 0x%08x\n",
+               frame->header.checksum1, frame->header.checksum2, check->checksum1, check->checksum2);
+    }
+}
+
+// Prints a whole frame using the results of the pre-pass
+void print_frame(OutputSink *out, const WalFrameView *frame, uint32_t page_size, const FrameCheck *check,
+                 const PageSource *source) {
+    print_frame_header(out, frame);
+    print_frame_check(out, frame, check);
+    print_page_header_named(out, frame->page_data, frame->header.page_number, page_size, check->table_name,
+                            check->filter, source);
+    print_hex_dump(out, frame->page_data, page_size, 32);
+    sink_putc(out, '\n');
+}
+
+// Returns the number of online CPUs, the default worker count
+unsigned default_decode_jobs(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (unsigned)cpus : 1;
+}
+
+// Emits frames [first, last] to a sink, each seeing other pages as of the
+// end of its own transaction
+static void emit_frame_range(OutputSink *out, const WalReader *reader, const FrameCheck *checks,
+                             const PageSource *source, uint32_t first, uint32_t last) {
+    WalFrameView frame;
+    for (uint32_t n = first; n <= last && wal_reader_frame(reader, n, &frame) == 0; n++) {
+        const FrameCheck *check = &checks[n - 1];
+        if (check->skipped || (check->filter && !subscription_page_matches(check->filter, frame.page_data,
+                                                                           frame.header.page_number,
+                                                                           reader->page_size))) {
+            continue;
+        }
+        uint64_t start = stats_clock();
+        if (source) {
+            PageSource scoped = page_source_at_frame(source, n);
+            emit_frame(out, &frame, reader->page_size, check, &scoped);
+        } else {
+            emit_frame(out, &frame, reader->page_size, check, NULL);
+        }
+        stats_record(STATS_DECODE, start);
+    }
+}
+
+
+// Formats frames [first, last] into a decoder's sink
+static void format_chunk(const FramePipeline *pipeline, OutputSink *sink, uint32_t first, uint32_t last) {
+    // Keep non-fatal errors next to the frame that raised them
+    set_error_sink(sink);
+    emit_frame_range(sink, pipeline->reader, pipeline->checks, pipeline->source, first, last);
+    set_error_sink(NULL);
+}
+
+// Waits for room in a full ring, counting one backpressure wait per stall
+static void wait_for_room(uint32_t *spins) {
+    if (*spins == 0) {
+        stats_add(STATS_BACKPRESSURE_WAITS, 1);
+    }
+    ring_backoff(spins);
+}
+
+// Queues a chunk for its decoder, waiting while that decoder is behind
+static void deal_chunk(FramePipeline *pipeline, uint32_t chunk, uint32_t last) {
+    FrameDecoder *decoder = &pipeline->decoders[chunk % pipeline->decoder_count];
+    uint64_t item = (uint64_t)chunk << 32 | last;
+    uint32_t spins = 0;
+    while (ring_push(&decoder->input, &item, 1) == 0) {
+        wait_for_room(&spins);
+    }
+    stats_gauge_add(STATS_DECODE_QUEUE, 1);
+}
+
+// The checking stage. Checks frames in order, unless that was done
+// beforehand, and deals out each chunk as soon as all of its frames are
+// settled; with committed_only, frames past the last commit are held back
+// and never dealt.
+static void *check_stage(void *arg) {
+    FramePipeline *pipeline = arg;
+    const WalReader *reader = pipeline->reader;
+    TransactionBatcher batcher;
+    transaction_batcher_init(&batcher, &reader->header);
+    uint32_t last_commit = 0, dealt = 0, chunk = 0;
+    uint32_t n = 1;
+    WalFrameView frame;
+    for (; n <= pipeline->frame_count && wal_reader_frame(reader, n, &frame) == 0; n++) {
+        int valid = pipeline->check ? checker_next(&pipeline->checker, &frame)
+                                    : pipeline->checks[n - 1].status == FRAME_VALID;
+        uint32_t settled = pipeline->check ? pipeline->checker.settled : n;
+        if (pipeline->committed_only) {
+            WalTransaction transaction;
+            if (transaction_batcher_add(&batcher, &frame, valid, &transaction) == BATCH_COMMITTED) {
+                last_commit = transaction.commit_frame;
+            }
+            settled = settled < last_commit ? settled : last_commit;
+        }
+        while (settled - dealt >= FRAME_DECODER_CHUNK) {
+            dealt += FRAME_DECODER_CHUNK;
+            deal_chunk(pipeline, chunk++, dealt);
+        }
+    }
+    if (pipeline->check) {
+        checker_finish(&pipeline->checker, n - 1);
+    }
+    transaction_batcher_abandon(&batcher);
+    pipeline->decode_count = pipeline->frame_count;
+    if (pipeline->committed_only) {
+        pipeline->decode_count = last_commit;
+        pipeline->dropped = batcher.dropped;
+    }
+    while (dealt < pipeline->decode_count) {
+        uint32_t last = pipeline->decode_count - dealt > FRAME_DECODER_CHUNK ? dealt + FRAME_DECODER_CHUNK
+                                                                            : pipeline->decode_count;
+        deal_chunk(pipeline, chunk++, last);
+        dealt = last;
+    }
+    for (unsigned i = 0; i < pipeline->decoder_count; i++) {
+        ring_close(&pipeline->decoders[i].input);
+    }
+    release_thread_stats();
+    return NULL;
+}
+
+// A decoding stage. Takes chunks in batches and formats each into the sink
+// behind the next output slot, once the writer has released that slot.
+static void *decode_stage(void *arg) {
+    FrameDecoder *decoder = arg;
+    uint64_t items[FRAME_PIPELINE_BATCH];
+    uint32_t spins = 0;
+    for (;;) {
+        uint32_t count = ring_pop(&decoder->input, items, FRAME_PIPELINE_BATCH);
+        if (count == 0) {
+            if (ring_finished(&decoder->input)) {
+                break;
+            }
+            ring_backoff(&spins);
+            continue;
+        }
+        spins = 0;
+        stats_gauge_add(STATS_DECODE_QUEUE, -(int64_t)count);
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t room = 0;
+            while (ring_space(&decoder->output) == 0) {
+                wait_for_room(&room);
+            }
+            uint32_t chunk = (uint32_t)(items[i] >> 32);
+            uint64_t slot = decoder->output.head & decoder->output.mask;
+            format_chunk(decoder->pipeline, &decoder->sinks[slot], chunk * FRAME_DECODER_CHUNK + 1,
+                         (uint32_t)items[i]);
+            ring_push(&decoder->output, &slot, 1);
+            stats_gauge_add(STATS_DECODE_BACKLOG, 1);
+        }
+    }
+    ring_close(&decoder->output);
+    release_frame_arena();
+    release_thread_stats();
+    return NULL;
+}
+
+// The writing stage, on the calling thread. Chunks were dealt round-robin,
+// so taking one from each decoder in turn restores frame order; the first
+// decoder to run dry at its turn marks the end.
+static int write_stage(FramePipeline *pipeline, OutputSink *out) {
+    int failed = 0;
+    for (uint32_t chunk = 0;; chunk++) {
+        FrameDecoder *decoder = &pipeline->decoders[chunk % pipeline->decoder_count];
+        uint64_t slot;
+        uint32_t spins = 0;
+        while (ring_peek(&decoder->output, &slot, 1) == 0) {
+            if (ring_finished(&decoder->output)) {
+                return failed;
+            }
+            ring_backoff(&spins);
+        }
+        // The slot stays claimed until it is released, so it is safe to drain in place
+        failed |= decoder->sinks[slot].failed;
+        sink_append(out, &decoder->sinks[slot]);
+        ring_release(&decoder->output, 1);
+        stats_gauge_add(STATS_DECODE_BACKLOG, -1);
+    }
+}
+
+// Releases the decoders' rings and sinks
+static void free_decoders(FrameDecoder *decoders, unsigned count) {
+    for (unsigned i = 0; i < count; i++) {
+        ring_free(&decoders[i].input);
+        ring_free(&decoders[i].output);
+        for (uint32_t s = 0; s < FRAME_PIPELINE_DEPTH; s++) {
+            sink_free(&decoders[i].sinks[s]);
+        }
+    }
+    free(decoders);
+}
+
+// Runs a pass through the staged pipeline with up to jobs decoders.
+// Returns 1 without having done anything if the threads could not be
+// started, otherwise 0, or -1 if the output failed.
+static int run_pipeline(FramePipeline *pipeline, OutputSink *out, unsigned jobs) {
+    FrameDecoder *decoders = aligned_alloc(RING_CACHE_LINE, jobs * sizeof(FrameDecoder));
+    if (!decoders) {
+        return 1;
+    }
+    memset(decoders, 0, jobs * sizeof(FrameDecoder));
+    int status = 0;
+    for (unsigned i = 0; i < jobs; i++) {
+        decoders[i].pipeline = pipeline;
+        // Sink buffers are reused for every chunk that passes through the slot
+        for (uint32_t s = 0; s < FRAME_PIPELINE_DEPTH; s++) {
+            sink_init(&decoders[i].sinks[s], -1, out->format);
+        }
+        if (ring_init(&decoders[i].input, FRAME_PIPELINE_BACKLOG) != 0 ||
+            ring_init(&decoders[i].output, FRAME_PIPELINE_DEPTH) != 0) {
+            status = 1;
+        }
+    }
+    unsigned started = 0;
+    while (status == 0 && started < jobs &&
+           pthread_create(&decoders[started].thread, NULL, decode_stage, &decoders[started]) == 0) {
+        started++;
+    }
+    pipeline->decoders = decoders;
+    pipeline->decoder_count = started;
+    pthread_t checker;
+    if (started == 0 || pthread_create(&checker, NULL, check_stage, pipeline) != 0) {
+        for (unsigned i = 0; i < started; i++) {
+            ring_close(&decoders[i].input);
+            pthread_join(decoders[i].thread, NULL);
+        }
+        free_decoders(decoders, jobs);
+        return 1;
+    }
+
+    int failed = write_stage(pipeline, out);
+    pthread_join(checker, NULL);
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(decoders[i].thread, NULL);
+    }
+    free_decoders(decoders, jobs);
+    return failed || out->failed ? -1 : 0;
+}
+
+// Groups the checked frames into transactions and returns the last commit
+// frame. The log ends at the first frame that fails, so every frame up to
+// that commit belongs to a committed transaction; *dropped counts the rest.
+static uint32_t committed_frame_count(const WalReader *reader, const FrameCheck *checks, uint32_t frame_count,
+                                      uint64_t *dropped) {
+    TransactionBatcher batcher;
+    transaction_batcher_init(&batcher, &reader->header);
+    uint32_t last_commit = 0;
+    WalTransaction transaction;
+    WalFrameView frame;
+    for (uint32_t n = 1; n <= frame_count && wal_reader_frame(reader, n, &frame) == 0; n++) {
+        if (transaction_batcher_add(&batcher, &frame, checks[n - 1].status == FRAME_VALID,
+                                    &transaction) == BATCH_COMMITTED) {
+            last_commit = transaction.commit_frame;
+        }
+    }
+    transaction_batcher_abandon(&batcher);
+    *dropped = batcher.dropped;
+    return last_commit;
+}
+
+// Decodes frames on up to jobs threads and writes them to out in frame
+// order. checks must come from check_wal_frames on the same reader; source
+// may be NULL, and its page cache is shared by every worker.
+int decode_wal_frames(OutputSink *out, const WalReader *reader, const FrameCheck *checks,
+                      uint32_t frame_count, const PageSource *source, unsigned jobs) {
+    uint32_t chunk_count = (frame_count + FRAME_DECODER_CHUNK - 1) / FRAME_DECODER_CHUNK;
+    if (jobs > chunk_count) {
+        jobs = chunk_count;
+    }
+    FramePipeline pipeline = {
+        .reader = reader,
+        .checks = (FrameCheck *)checks,
+        .source = source,
+        .frame_count = frame_count,
+    };
+    int status = jobs > 1 ? run_pipeline(&pipeline, out, jobs) : 1;
+    // Without threads, decode here instead
+    if (status == 1) {
+        emit_frame_range(out, reader, checks, source, 1, frame_count);
+        status = out->failed ? -1 : 0;
+    }
+    return status;
+}
+
+// Checks, decodes and writes every frame of a WAL. With jobs above 1 the
+// three run as pipeline stages, so checking carries on while the output is
+// stalled and decoding starts before the last frame is checked; otherwise
+// frames are checked first and decoded on the calling thread. With
+// committed_only, frames that no valid commit covers are left out. With a
+// subscription, owners must be watching its tables, and only their frames
+// are decoded.
+int pipeline_wal_frames(OutputSink *out, const WalReader *reader, PageOwnerMap *owners,
+                        const Subscription *subscription, int committed_only, const PageSource *source,
+                        unsigned jobs, PipelineSummary *summary) {
+    memset(summary, 0, sizeof(*summary));
+    uint32_t frame_count = reader->frame_count;
+    FrameCheck *checks = malloc(((size_t)frame_count + 1) * sizeof(FrameCheck));
+    if (!checks) {
+        return report_error("Failed to allocate memory for frame checks", 1);
+    }
+    uint32_t chunk_count = (frame_count + FRAME_DECODER_CHUNK - 1) / FRAME_DECODER_CHUNK;
+    if (jobs > chunk_count) {
+        jobs = chunk_count;
+    }
+    FramePipeline pipeline = {
+        .reader = reader,
+        .checks = checks,
+        .source = source,
+        .check = 1,
+        .committed_only = committed_only,
+        .frame_count = frame_count,
+    };
+    checker_init(&pipeline.checker, reader, owners, subscription, checks);
+    int status = jobs > 1 ? run_pipeline(&pipeline, out, jobs) : 1;
+    if (status == 1) {
+        uint32_t n = 1;
+        WalFrameView frame;
+        for (; n <= frame_count && wal_reader_frame(reader, n, &frame) == 0; n++) {
+            checker_next(&pipeline.checker, &frame);
+        }
+        checker_finish(&pipeline.checker, n - 1);
+        pipeline.decode_count = frame_count;
+        if (committed_only) {
+            pipeline.decode_count = committed_frame_count(reader, checks, frame_count, &pipeline.dropped);
+        }
+        emit_frame_range(out, reader, checks, source, 1, pipeline.decode_count);
+        status = out->failed ? -1 : 0;
+    }
+    summary->frame_count = frame_count;
+    summary->decode_count = pipeline.decode_count;
+    summary->dropped = pipeline.dropped;
+    for (uint32_t n = 0; n < pipeline.decode_count; n++) {
+        summary->skipped += checks[n].skipped;
+    }
+    free(checks);
+    return status;
+}
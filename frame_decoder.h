@@ -0,0 +1,55 @@
+#ifndef FRAME_DECODER_H
+#define FRAME_DECODER_H
+
+#include "output_sink.h"
+#include "page_owner.h"
+#include "page_source.h"
+#include "subscription.h"
+#include "wal_reader.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// Frames a worker formats per claim; big enough to amortise the hand-off
+#define FRAME_DECODER_CHUNK 64
+
+typedef enum {
+    FRAME_VALID = 0,
+    FRAME_SALT_MISMATCH,
+    FRAME_CHECKSUM_MISMATCH
+} FrameStatus;
+
+// Everything about a frame that depends on the frames before it. Filled in
+// by the sequential pre-pass so the frames themselves can be decoded in any
+// order.
+typedef struct {
+    uint8_t status;             // FrameStatus
+    uint32_t checksum1;         // Computed from the previous frame's stored checksum
+    uint32_t checksum2;
+    const char* table_name;     // Owner of the page once this frame is applied, NULL if unknown
+    const SubscribedTable* filter;  // Rows and columns to show, NULL for all
+    uint8_t skipped;            // No subscribed table owns the page; only its checksum was chained
+} FrameCheck;
+
+// What a pipelined pass went through
+typedef struct {
+    uint32_t frame_count;       // Frames in the WAL
+    uint32_t decode_count;      // Frames passed to the decoders: all, or up to the last commit
+    uint64_t dropped;           // Frames no commit covers, with committed_only
+    uint32_t skipped;           // Decoded frames outside the subscribed tables
+} PipelineSummary;
+
+int check_frame(const WalFrameView* frame, const WalHeader* header,
+                uint32_t initial_checksum1, uint32_t initial_checksum2, FrameCheck* check);
+FrameCheck* check_wal_frames(const WalReader* reader, PageOwnerMap* owners, const Subscription* subscription,
+                             uint32_t* frame_count);
+void print_frame_check(OutputSink* out, const WalFrameView* frame, const FrameCheck* check);
+void print_frame(OutputSink* out, const WalFrameView* frame, uint32_t page_size, const FrameCheck* check,
+                 const PageSource* source);
+unsigned default_decode_jobs(void);
+int decode_wal_frames(OutputSink* out, const WalReader* reader, const FrameCheck* checks,
+                      uint32_t frame_count, const PageSource* source, unsigned jobs);
+int pipeline_wal_frames(OutputSink* out, const WalReader* reader, PageOwnerMap* owners,
+                        const Subscription* subscription, int committed_only, const PageSource* source,
+                        unsigned jobs, PipelineSummary* summary);
+
+#endif
@@ -0,0 +1,181 @@
+#include "frame_index.h"
+#include "utils.h"
+#include "wal_checksum.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Prepares an empty index
+void frame_index_init(FrameIndex *index) {
+    memset(index, 0, sizeof(*index));
+}
+
+// Grows the per-page table so page_number is a valid index
+static int ensure_page_capacity(FrameIndex *index, uint32_t page_number) {
+    if (page_number < index->page_capacity) {
+        return 0;
+    }
+    uint32_t capacity = index->page_capacity ? index->page_capacity : 64;
+    while (capacity <= page_number) {
+        capacity *= 2;
+    }
+    PageFrames *pages = realloc(index->pages, capacity * sizeof(PageFrames));
+    if (!pages) {
+        report_error("Failed to grow frame index", 0);
+        return -1;
+    }
+    memset(pages + index->page_capacity, 0, (capacity - index->page_capacity) * sizeof(PageFrames));
+    index->pages = pages;
+    index->page_capacity = capacity;
+    return 0;
+}
+
+// Records the next frame of the WAL; frames must be added in order
+int frame_index_add(FrameIndex *index, uint32_t frame_number, uint32_t page_number, uint32_t commit_size) {
+    if (ensure_page_capacity(index, page_number) != 0) {
+        return -1;
+    }
+    PageFrames *list = &index->pages[page_number];
+    if (list->count == list->capacity) {
+        uint32_t capacity = list->capacity ? list->capacity * 2 : 4;
+        uint32_t *frames = realloc(list->frames, capacity * sizeof(uint32_t));
+        if (!frames) {
+            report_error("Failed to grow frame list", 0);
+            return -1;
+        }
+        list->frames = frames;
+        list->capacity = capacity;
+    }
+    list->frames[list->count++] = frame_number;
+    index->last_frame = frame_number;
+
+    if (commit_size != 0) {
+        if (index->commit_count == index->commit_capacity) {
+            uint32_t capacity = index->commit_capacity ? index->commit_capacity * 2 : 64;
+            uint32_t *commits = realloc(index->commit_frames, capacity * sizeof(uint32_t));
+            if (!commits) {
+                report_error("Failed to grow commit list", 0);
+                return -1;
+            }
+            index->commit_frames = commits;
+            index->commit_capacity = capacity;
+        }
+        index->commit_frames[index->commit_count++] = frame_number;
+    }
+    return 0;
+}
+
+// Indexes every frame of the reader's current generation in one pass. Only
+// frames whose salts and checksum chain match the header are included.
+// Returns the number of frames indexed.
+int frame_index_build(FrameIndex *index, const WalReader *reader) {
+    frame_index_reset(index);
+    index->salt1 = reader->header.salt1;
+    index->salt2 = reader->header.salt2;
+
+    uint32_t checksum1 = reader->header.checksum1;
+    uint32_t checksum2 = reader->header.checksum2;
+    WalFrameView frame;
+    uint32_t n;
+    for (n = 1; wal_reader_frame(reader, n, &frame) == 0; n++) {
+        if (!wal_frame_checksum_matches(&frame, &reader->header, &checksum1, &checksum2)) {
+            break;
+        }
+        if (frame_index_add(index, n, frame.header.page_number, frame.header.commit_size) != 0) {
+            return -1;
+        }
+    }
+    return (int)(n - 1);
+}
+
+// Returns the newest committed frame for a page at or before max_frame, or 0
+uint32_t frame_index_lookup(const FrameIndex *index, uint32_t page_number, uint32_t max_frame) {
+    uint32_t last_commit = frame_index_last_commit(index);
+    if (max_frame > last_commit) {
+        max_frame = last_commit;
+    }
+    return frame_index_find(index, page_number, max_frame);
+}
+
+// Returns the newest frame for a page at or before max_frame, committed or
+// not, or 0. For reading pages written by the same transaction as a frame.
+uint32_t frame_index_find(const FrameIndex *index, uint32_t page_number, uint32_t max_frame) {
+    if (page_number >= index->page_capacity) {
+        return 0;
+    }
+    const PageFrames *list = &index->pages[page_number];
+    // Binary search for the last entry <= max_frame
+    uint32_t low = 0, high = list->count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (list->frames[mid] <= max_frame) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low == 0 ? 0 : list->frames[low - 1];
+}
+
+// Returns the newest committed frame for a page, or 0. Only uncommitted
+// frames at the tail of the page's list are skipped, so this is O(1) in
+// the common case.
+uint32_t frame_index_latest(const FrameIndex *index, uint32_t page_number) {
+    if (page_number >= index->page_capacity) {
+        return 0;
+    }
+    uint32_t last_commit = frame_index_last_commit(index);
+    const PageFrames *list = &index->pages[page_number];
+    for (uint32_t i = list->count; i > 0; i--) {
+        if (list->frames[i - 1] <= last_commit) {
+            return list->frames[i - 1];
+        }
+    }
+    return 0;
+}
+
+// Returns the frame that completed the given 1-based commit, or 0
+uint32_t frame_index_commit_frame(const FrameIndex *index, uint32_t commit) {
+    if (commit == 0 || commit > index->commit_count) {
+        return 0;
+    }
+    return index->commit_frames[commit - 1];
+}
+
+// Returns the frame of the first commit at or after frame_number, 0 if no
+// later commit exists
+uint32_t frame_index_commit_covering(const FrameIndex *index, uint32_t frame_number) {
+    uint32_t low = 0, high = index->commit_count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (index->commit_frames[mid] < frame_number) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low < index->commit_count ? index->commit_frames[low] : 0;
+}
+
+// Returns the last commit frame, or 0 when nothing has committed yet
+uint32_t frame_index_last_commit(const FrameIndex *index) {
+    return index->commit_count ? index->commit_frames[index->commit_count - 1] : 0;
+}
+
+// Forgets all frames but keeps allocations for reuse (e.g. after a WAL reset)
+void frame_index_reset(FrameIndex *index) {
+    for (uint32_t i = 0; i < index->page_capacity; i++) {
+        index->pages[i].count = 0;
+    }
+    index->commit_count = 0;
+    index->last_frame = 0;
+}
+
+// Releases all memory held by the index
+void frame_index_free(FrameIndex *index) {
+    for (uint32_t i = 0; i < index->page_capacity; i++) {
+        free(index->pages[i].frames);
+    }
+    free(index->pages);
+    free(index->commit_frames);
+    frame_index_init(index);
+}
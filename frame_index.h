@@ -0,0 +1,39 @@
+#ifndef FRAME_INDEX_H
+#define FRAME_INDEX_H
+
+#include "wal_reader.h"
+#include <stdint.h>
+
+typedef struct {
+    uint32_t* frames;           // Frame numbers for one page, ascending
+    uint32_t count;
+    uint32_t capacity;
+} PageFrames;
+
+// Page number -> WAL frames holding a copy of that page, for one salt
+// generation. Frames after the last commit frame are kept but never
+// returned by lookups until a later commit covers them.
+typedef struct {
+    PageFrames* pages;          // Indexed by page number
+    uint32_t page_capacity;
+    uint32_t* commit_frames;    // Frame number of each commit, ascending
+    uint32_t commit_count;
+    uint32_t commit_capacity;
+    uint32_t last_frame;        // Last frame added (committed or not)
+    uint32_t salt1;
+    uint32_t salt2;
+} FrameIndex;
+
+void frame_index_init(FrameIndex* index);
+int frame_index_add(FrameIndex* index, uint32_t frame_number, uint32_t page_number, uint32_t commit_size);
+int frame_index_build(FrameIndex* index, const WalReader* reader);
+uint32_t frame_index_lookup(const FrameIndex* index, uint32_t page_number, uint32_t max_frame);
+uint32_t frame_index_find(const FrameIndex* index, uint32_t page_number, uint32_t max_frame);
+uint32_t frame_index_latest(const FrameIndex* index, uint32_t page_number);
+uint32_t frame_index_commit_frame(const FrameIndex* index, uint32_t commit);
+uint32_t frame_index_last_commit(const FrameIndex* index);
+uint32_t frame_index_commit_covering(const FrameIndex* index, uint32_t frame_number);
+void frame_index_reset(FrameIndex* index);
+void frame_index_free(FrameIndex* index);
+
+#endif
@@ -0,0 +1,367 @@
+#include "frame_output.h"
+#include "wal_parser.h"
+#include "wal_checksum.h"
+#include "page_analyzer.h"
+#include "utils.h"
+#include "wal_stats.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// Bytes of each page echoed as a hex preview
+#define PAGE_PREVIEW_BYTES 32
+
+static const char *status_names[] = { "valid", "salt_mismatch", "checksum_mismatch" };
+
+// Decoded b-tree page header; page 1 keeps its header after the 100-byte file header
+typedef struct {
+    uint32_t header_offset;
+    uint8_t page_type;
+    uint16_t first_freeblock;
+    uint16_t cell_count;
+    uint16_t content_start;
+    uint8_t fragmented_bytes;
+    uint32_t rightmost_child;   // Interior pages only
+    uint32_t pointer_offset;    // Start of the cell pointer array
+} BtreePageHeader;
+
+// Reads the b-tree header of a page; returns 0 if the page is a b-tree page
+static int read_btree_header(const uint8_t *page, uint32_t page_number, uint32_t page_size, BtreePageHeader *header) {
+    memset(header, 0, sizeof(*header));
+    header->header_offset = page_number == 1 ? 100 : 0;
+    if (header->header_offset + 12 > page_size) {
+        return -1;
+    }
+    const uint8_t *start = page + header->header_offset;
+    header->page_type = start[0];
+    if (header->page_type != 0x02 && header->page_type != 0x05 &&
+        header->page_type != 0x0A && header->page_type != 0x0D) {
+        return -1;
+    }
+    header->first_freeblock = (uint16_t)(start[1] << 8 | start[2]);
+    header->cell_count = (uint16_t)(start[3] << 8 | start[4]);
+    header->content_start = (uint16_t)(start[5] << 8 | start[6]);
+    header->fragmented_bytes = start[7];
+    header->pointer_offset = header->header_offset + 8;
+    if (header->page_type == 0x02 || header->page_type == 0x05) {
+        header->rightmost_child = to_host32(*(const uint32_t *)(start + 8));
+        header->pointer_offset += 4;
+    }
+    return 0;
+}
+
+// Returns the offset of cell i, or 0 if the pointer array or pointer is out of bounds
+static uint32_t cell_pointer(const uint8_t *page, uint32_t page_size, const BtreePageHeader *header, uint16_t i) {
+    uint32_t slot = header->pointer_offset + 2u * i;
+    if (slot + 2 > page_size) {
+        return 0;
+    }
+    uint32_t offset = (uint32_t)(page[slot] << 8 | page[slot + 1]);
+    return offset < page_size ? offset : 0;
+}
+
+// Short machine-friendly name of a page type
+static const char *page_type_name(uint8_t page_type) {
+    switch (page_type) {
+        case 0x02: return "index_interior";
+        case 0x05: return "table_interior";
+        case 0x0A: return "index_leaf";
+        case 0x0D: return "table_leaf";
+        case 0x00: return "free";
+        default: return "unknown";
+    }
+}
+
+// Emits the WAL header in the sink's format
+void emit_wal_header(OutputSink *out, const char *filename, const WalReader *reader) {
+    const WalHeader *header = &reader->header;
+    int verified = verify_wal_header_checksum(reader->map, header);
+    if (out->format == OUTPUT_TEXT) {
+        print_wal_header(out, filename, reader);
+    } else if (out->format == OUTPUT_JSON) {
+        sink_puts(out, "{\"type\":\"wal_header\",\"file\":");
+        sink_json_string(out, filename, strlen(filename));
+        sink_printf(out, ",\"magic\":%u,\"format\":%u,\"page_size\":%u,\"checkpoint\":%u,"
+                    "\"salt1\":%u,\"salt2\":%u,\"checksum1\":%u,\"checksum2\":%u,\"header_checksum\":\"%s\"}\n",
+                    header->magic, header->format, header->page_size, header->checkpoint,
+                    header->salt1, header->salt2, header->checksum1, header->checksum2,
+                    verified ? "verified" : "mismatch");
+    } else {
+        size_t name_length = strlen(filename);
+        sink_record_begin(out, RECORD_WAL_HEADER);
+        sink_u32(out, header->magic);
+        sink_u32(out, header->format);
+        sink_u32(out, header->page_size);
+        sink_u32(out, header->checkpoint);
+        sink_u32(out, header->salt1);
+        sink_u32(out, header->salt2);
+        sink_u32(out, header->checksum1);
+        sink_u32(out, header->checksum2);
+        sink_u8(out, (uint8_t)verified);
+        sink_u16(out, (uint16_t)name_length);
+        sink_write(out, filename, (uint16_t)name_length);
+        sink_record_end(out);
+    }
+}
+
+// Emits one frame as a JSON object on a single line
+static void emit_frame_json(OutputSink *out, const WalFrameView *frame, uint32_t page_size, const FrameCheck *check) {
+    const FrameHeader *fh = &frame->header;
+    sink_printf(out, "{\"type\":\"frame\",\"frame\":%u,\"page\":%u,\"commit_size\":%u,\"salt1\":%u,\"salt2\":%u,"
+                "\"checksum1\":%u,\"checksum2\":%u,\"status\":\"%s\"",
+                frame->frame_number, fh->page_number, fh->commit_size, fh->salt1, fh->salt2,
+                fh->checksum1, fh->checksum2, status_names[check->status]);
+    if (check->status != FRAME_VALID) {
+        sink_printf(out, ",\"computed_checksum1\":%u,\"computed_checksum2\":%u", check->checksum1, check->checksum2);
+    }
+    sink_puts(out, ",\"table\":");
+    if (check->table_name) {
+        sink_json_string(out, check->table_name, strlen(check->table_name));
+    } else {
+        sink_puts(out, "null");
+    }
+
+    BtreePageHeader header;
+    if (read_btree_header(frame->page_data, fh->page_number, page_size, &header) == 0) {
+        sink_printf(out, ",\"page_type\":\"%s\",\"cell_count\":%u,\"first_freeblock\":%u,\"content_start\":%u,"
+                    "\"fragmented_bytes\":%u", page_type_name(header.page_type), header.cell_count,
+                    header.first_freeblock, header.content_start, header.fragmented_bytes);
+        if (header.page_type == 0x02 || header.page_type == 0x05) {
+            sink_printf(out, ",\"rightmost_child\":%u", header.rightmost_child);
+        }
+        if (header.page_type == 0x0D) {
+            sink_puts(out, ",\"cells\":[");
+            Arena *arena = frame_arena();
+            if (arena) {
+                arena_reset(arena);
+            }
+            uint64_t start = stats_clock();
+            CellInfo cell;
+            int first = 1;
+            uint32_t decoded = 0;
+            for (uint16_t i = 0; i < header.cell_count; i++) {
+                uint32_t offset = cell_pointer(frame->page_data, page_size, &header, i);
+                if (offset == 0) {
+                    break;
+                }
+                if (parse_cell(&cell, frame->page_data, offset, page_size, arena) == 0) {
+                    if (!check->filter || subscription_rowid_matches(check->filter, cell.rowid)) {
+                        sink_printf(out, "%s{\"offset\":%u,\"payload_size\":%lld,\"rowid\":%lld,\"columns\":%u}",
+                                    first ? "" : ",", cell.offset, (long long)cell.payload_size,
+                                    (long long)cell.rowid, cell.column_count);
+                        first = 0;
+                    }
+                    decoded++;
+                }
+                free_cell_info(&cell);
+            }
+            stats_record(STATS_CELLS_PAGE, start);
+            stats_add(STATS_CELLS, decoded);
+            sink_putc(out, ']');
+        }
+    } else {
+        sink_printf(out, ",\"page_type\":\"%s\"", page_type_name(frame->page_data[0]));
+    }
+
+    sink_puts(out, ",\"head\":\"");
+    sink_hex(out, frame->page_data, page_size < PAGE_PREVIEW_BYTES ? page_size : PAGE_PREVIEW_BYTES);
+    sink_puts(out, "\"}\n");
+}
+
+// Emits one frame as a binary record; see the README for the layout
+static void emit_frame_binary(OutputSink *out, const WalFrameView *frame, uint32_t page_size, const FrameCheck *check) {
+    const FrameHeader *fh = &frame->header;
+    sink_record_begin(out, RECORD_FRAME);
+    sink_u32(out, frame->frame_number);
+    sink_u32(out, fh->page_number);
+    sink_u32(out, fh->commit_size);
+    sink_u32(out, fh->salt1);
+    sink_u32(out, fh->salt2);
+    sink_u32(out, fh->checksum1);
+    sink_u32(out, fh->checksum2);
+    sink_u8(out, check->status);
+    sink_u32(out, check->checksum1);
+    sink_u32(out, check->checksum2);
+    uint16_t name_length = check->table_name ? (uint16_t)strlen(check->table_name) : 0;
+    sink_u16(out, name_length);
+    if (name_length) {
+        sink_write(out, check->table_name, name_length);
+    }
+
+    BtreePageHeader header;
+    if (read_btree_header(frame->page_data, fh->page_number, page_size, &header) != 0) {
+        sink_u8(out, frame->page_data[0]);
+        sink_u16(out, 0);
+        sink_u32(out, 0);
+        sink_u16(out, 0);
+        sink_record_end(out);
+        return;
+    }
+    sink_u8(out, header.page_type);
+    sink_u16(out, header.cell_count);
+    sink_u32(out, header.rightmost_child);
+
+    // The decoded cell count is patched once the cells have been parsed
+    sink_u16(out, 0);
+    size_t count_offset = out->size - 2;
+    uint16_t decoded = 0, written = 0;
+    Arena *arena = frame_arena();
+    if (arena) {
+        arena_reset(arena);
+    }
+    uint64_t start = header.page_type == 0x0D ? stats_clock() : 0;
+    CellInfo cell;
+    for (uint16_t i = 0; header.page_type == 0x0D && i < header.cell_count; i++) {
+        uint32_t offset = cell_pointer(frame->page_data, page_size, &header, i);
+        if (offset == 0) {
+            break;
+        }
+        if (parse_cell(&cell, frame->page_data, offset, page_size, arena) == 0) {
+            if (!check->filter || subscription_rowid_matches(check->filter, cell.rowid)) {
+                sink_u16(out, (uint16_t)cell.offset);
+                sink_i64(out, cell.payload_size);
+                sink_i64(out, cell.rowid);
+                sink_u16(out, (uint16_t)cell.column_count);
+                written++;
+            }
+            decoded++;
+        }
+        free_cell_info(&cell);
+    }
+    stats_record(STATS_CELLS_PAGE, start);
+    stats_add(STATS_CELLS, decoded);
+    if (!out->failed) {
+        out->data[count_offset] = (char)written;
+        out->data[count_offset + 1] = (char)(written >> 8);
+    }
+    sink_record_end(out);
+}
+
+// Emits a frame in the sink's format using the results of the pre-pass.
+// source, which may be NULL, supplies overflow pages for column values.
+void emit_frame(OutputSink *out, const WalFrameView *frame, uint32_t page_size, const FrameCheck *check,
+                const PageSource *source) {
+    if (out->format == OUTPUT_TEXT) {
+        print_frame(out, frame, page_size, check, source);
+    } else if (out->format == OUTPUT_JSON) {
+        emit_frame_json(out, frame, page_size, check);
+    } else {
+        emit_frame_binary(out, frame, page_size, check);
+    }
+}
+
+// Emits the marker that closes a committed transaction's frames. database
+// names the source when several databases share one output, else NULL.
+void emit_transaction(OutputSink *out, const WalTransaction *transaction, const char *database) {
+    uint32_t frames = transaction->commit_frame - transaction->first_frame + 1;
+    if (out->format == OUTPUT_TEXT) {
+        if (database) {
+            sink_printf(out, "%s: ", database);
+        }
+        sink_printf(out, "Transaction committed: frames %u-%u (%u pages), database size %u pages\n",
+                    transaction->first_frame, transaction->commit_frame, frames, transaction->database_size);
+        // Multi-database output is one line per event
+        if (!database) {
+            sink_putc(out, '\n');
+        }
+    } else if (out->format == OUTPUT_JSON) {
+        sink_puts(out, "{\"type\":\"transaction\",");
+        if (database) {
+            sink_puts(out, "\"database\":");
+            sink_json_string(out, database, strlen(database));
+            sink_putc(out, ',');
+        }
+        sink_printf(out, "\"first_frame\":%u,\"commit_frame\":%u,\"database_size\":%u}\n",
+                    transaction->first_frame, transaction->commit_frame, transaction->database_size);
+    } else {
+        uint16_t name_length = database ? (uint16_t)strlen(database) : 0;
+        sink_record_begin(out, RECORD_TRANSACTION);
+        sink_u32(out, transaction->first_frame);
+        sink_u32(out, transaction->commit_frame);
+        sink_u32(out, transaction->database_size);
+        sink_u16(out, name_length);
+        if (name_length) {
+            sink_write(out, database, name_length);
+        }
+        sink_record_end(out);
+    }
+}
+
+// Emits one row-level change
+void emit_row_change(OutputSink *out, const RowChange *change, const char *table_name) {
+    if (out->format == OUTPUT_TEXT) {
+        sink_printf(out, "%s %s rowid %lld (page %u)\n", row_change_name(change->type),
+                    table_name ? table_name : "(unknown)", (long long)change->rowid, change->page_number);
+    } else if (out->format == OUTPUT_JSON) {
+        sink_printf(out, "{\"type\":\"row\",\"change\":\"%s\",\"table\":", row_change_name(change->type));
+        if (table_name) {
+            sink_json_string(out, table_name, strlen(table_name));
+        } else {
+            sink_puts(out, "null");
+        }
+        sink_printf(out, ",\"rowid\":%lld,\"page\":%u}\n", (long long)change->rowid, change->page_number);
+    } else {
+        uint16_t name_length = table_name ? (uint16_t)strlen(table_name) : 0;
+        sink_record_begin(out, RECORD_ROW);
+        sink_u8(out, change->type);
+        sink_i64(out, change->rowid);
+        sink_u32(out, change->page_number);
+        sink_u16(out, name_length);
+        if (name_length) {
+            sink_write(out, table_name, name_length);
+        }
+        sink_record_end(out);
+    }
+}
+
+// Emits the closing frame count and whether a partial frame trails the WAL
+void emit_summary(OutputSink *out, uint32_t frame_count, int partial_frame) {
+    if (out->format == OUTPUT_TEXT) {
+        // A trailing partial frame means the writer has not finished it yet
+        if (partial_frame) {
+            sink_printf(out, "Warning: Incomplete frame data for frame %u\n", frame_count + 1);
+        }
+        if (frame_count == 0) {
+            sink_puts(out, "No frames found in the WAL file.\n");
+        } else {
+            sink_printf(out, "Total frames: %u\n", frame_count);
+        }
+    } else if (out->format == OUTPUT_JSON) {
+        sink_printf(out, "{\"type\":\"summary\",\"frames\":%u,\"partial_frame\":%s}\n",
+                    frame_count, partial_frame ? "true" : "false");
+    } else {
+        sink_record_begin(out, RECORD_SUMMARY);
+        sink_u32(out, frame_count);
+        sink_u8(out, (uint8_t)(partial_frame != 0));
+        sink_record_end(out);
+    }
+}
+
+// Emits a one-line status message
+void emit_message(OutputSink *out, const char *format, ...) {
+    char text[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (length < 0) {
+        return;
+    }
+    if ((size_t)length >= sizeof(text)) {
+        length = sizeof(text) - 1;
+    }
+
+    if (out->format == OUTPUT_TEXT) {
+        sink_write(out, text, (size_t)length);
+        sink_putc(out, '\n');
+    } else if (out->format == OUTPUT_JSON) {
+        sink_puts(out, "{\"type\":\"message\",\"text\":");
+        sink_json_string(out, text, (size_t)length);
+        sink_puts(out, "}\n");
+    } else {
+        sink_record_begin(out, RECORD_MESSAGE);
+        sink_u16(out, (uint16_t)length);
+        sink_write(out, text, (size_t)length);
+        sink_record_end(out);
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef FRAME_OUTPUT_H
+#define FRAME_OUTPUT_H
+
+#include "frame_decoder.h"
+#include "output_sink.h"
+#include "page_source.h"
+#include "row_diff.h"
+#include "wal_reader.h"
+#include "wal_transaction.h"
+#include <stdint.h>
+
+void emit_wal_header(OutputSink* out, const char* filename, const WalReader* reader);
+void emit_frame(OutputSink* out, const WalFrameView* frame, uint32_t page_size, const FrameCheck* check,
+                const PageSource* source);
+void emit_transaction(OutputSink* out, const WalTransaction* transaction, const char* database);
+void emit_row_change(OutputSink* out, const RowChange* change, const char* table_name);
+void emit_summary(OutputSink* out, uint32_t frame_count, int partial_frame);
+void emit_message(OutputSink* out, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+#endif
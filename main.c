@@ -1,29 +1,262 @@
 #include "wal_parser.h"
+#include "wal_listener.h"
+#include "wal_monitor.h"
+#include "frame_decoder.h"
+#include "page_analyzer.h"
+#include "page_cache.h"
+#include "page_reader.h"
 #include "utils.h"
+#include "wal_stats.h"
+#include <getopt.h>
+#include <signal.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+
+#define USAGE "Usage: <program> [--jobs N] [--format text|json|binary] [--committed] [--rows [--changelog DIR]] [--table SPEC]...\n" \
+              "                 [--follow [--resume] | --page N [--commit C] | --snapshot] <database.db>\n" \
+              "       <program> [--format text|json|binary] --monitor [--resume] [--list FILE] [<database.db or pattern>...]\n" \
+              "       <program> [--format text|json|binary] --replay DIR\n" \
+              "       Every form also takes [--stats FILE [--stats-interval SECONDS]] [--io io_uring|pread] [--cache-mb N]"
+
+// Stops follow and monitor mode cleanly on Ctrl-C or SIGTERM
+static void handle_stop_signal(int signal_number) {
+    (void)signal_number;
+    stop_wal_listener();
+    stop_wal_monitor();
+}
+
+// Installs handle_stop_signal for SIGINT and SIGTERM. No SA_RESTART, so a
+// signal also interrupts a blocking inotify read or epoll wait.
+static void install_stop_handler(void) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+}
+
+// Dumps the stats to stderr on SIGUSR1
+static void handle_dump_signal(int signal_number) {
+    (void)signal_number;
+    stats_request_dump();
+}
+
+// Starts the stats reporter and routes SIGUSR1 to it. SA_RESTART keeps
+// the dump from interrupting reads and writes in progress.
+static int start_stats(const char *stats_filename, unsigned interval) {
+    if (stats_start(stats_filename, interval) != 0) {
+        return -1;
+    }
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_dump_signal;
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, NULL);
+    return 0;
+}
+
+// Watches many databases from one thread until interrupted
+static int run_monitor(char *const *patterns, int pattern_count, const char *list_filename, int resume,
+                       OutputFormat format) {
+    OutputSink out;
+    if (sink_init(&out, STDOUT_FILENO, format) != 0) {
+        return 1;
+    }
+    set_error_sink(&out);
+    install_stop_handler();
+    int status = monitor_wal_info(&out, patterns, pattern_count, list_filename, resume);
+    set_error_sink(NULL);
+    if (sink_flush(&out) != 0) {
+        status = -1;
+    }
+    sink_free(&out);
+    return status == 0 ? 0 : 1;
+}
+
+// Prints a change log written with --changelog
+static int run_replay(const char *directory, OutputFormat format) {
+    OutputSink out;
+    if (sink_init(&out, STDOUT_FILENO, format) != 0) {
+        return 1;
+    }
+    set_error_sink(&out);
+    int status = print_changelog(&out, directory);
+    set_error_sink(NULL);
+    if (sink_flush(&out) != 0) {
+        status = -1;
+    }
+    sink_free(&out);
+    return status == 0 ? 0 : 1;
+}
 
 // Main entry point for the database and WAL file parser
 int main(int argc, char *argv[]) {
-    // Check for correct number of arguments
-    if (argc != 2) {
-        report_error("Usage: <program> <database.db>", 1);
+    static const struct option options[] = {
+        {"follow", no_argument, NULL, 'f'},
+        {"page", required_argument, NULL, 'p'},
+        {"commit", required_argument, NULL, 'c'},
+        {"jobs", required_argument, NULL, 'j'},
+        {"format", required_argument, NULL, 'o'},
+        {"committed", no_argument, NULL, 't'},
+        {"rows", no_argument, NULL, 'r'},
+        {"monitor", no_argument, NULL, 'm'},
+        {"list", required_argument, NULL, 'l'},
+        {"resume", no_argument, NULL, 'R'},
+        {"stats", required_argument, NULL, 's'},
+        {"stats-interval", required_argument, NULL, 'i'},
+        {"table", required_argument, NULL, 'T'},
+        {"io", required_argument, NULL, 'u'},
+        {"cache-mb", required_argument, NULL, 'C'},
+        {"changelog", required_argument, NULL, 'L'},
+        {"replay", required_argument, NULL, 'P'},
+        {"snapshot", no_argument, NULL, 'n'},
+        {NULL, 0, NULL, 0}
+    };
+    int follow = 0;
+    int committed_only = 0;
+    int rows = 0;
+    int snapshot = 0;
+    int monitor = 0;
+    int resume = 0;
+    const char *list_filename = NULL;
+    const char *stats_filename = NULL;
+    const char *changelog_directory = NULL;
+    const char *replay_directory = NULL;
+    unsigned stats_interval = STATS_DEFAULT_INTERVAL;
+    uint32_t page_number = 0;
+    uint32_t commit = 0;
+    unsigned jobs = default_decode_jobs();
+    OutputFormat format = OUTPUT_TEXT;
+    Subscription subscription;
+    subscription_init(&subscription);
+    int option;
+    while ((option = getopt_long(argc, argv, "fp:c:j:o:trml:Rs:i:T:u:C:L:P:n", options, NULL)) != -1) {
+        switch (option) {
+            case 'f': follow = 1; break;
+            case 'p': page_number = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'c': commit = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'j': jobs = (unsigned)strtoul(optarg, NULL, 10); break;
+            case 't': committed_only = 1; break;
+            case 'r': rows = 1; break;
+            case 'n': snapshot = 1; break;
+            case 'm': monitor = 1; break;
+            case 'l': list_filename = optarg; break;
+            case 'R': resume = 1; break;
+            case 's': stats_filename = optarg; break;
+            case 'L': changelog_directory = optarg; break;
+            case 'P': replay_directory = optarg; break;
+            case 'i': stats_interval = (unsigned)strtoul(optarg, NULL, 10); break;
+            case 'C': page_cache_set_budget((size_t)strtoul(optarg, NULL, 10) << 20); break;
+            case 'T':
+                if (subscription_add(&subscription, optarg) != 0) {
+                    subscription_free(&subscription);
+                    return 1;
+                }
+                break;
+            case 'u':
+                if (page_reader_set_backend(optarg) != 0) {
+                    report_error(USAGE, 1);
+                    subscription_free(&subscription);
+                    return 1;
+                }
+                break;
+            case 'o':
+                if (sink_parse_format(optarg, &format) != 0) {
+                    report_error(USAGE, 1);
+                    subscription_free(&subscription);
+                    return 1;
+                }
+                break;
+            default:
+                report_error(USAGE, 1);
+                subscription_free(&subscription);
+                return 1;
+        }
+    }
+
+    // Monitor mode takes any number of databases, replay none; everything
+    // else takes one. Subscriptions filter decoded pages, which monitor and
+    // --page do not have. Only row changes go to a change log. A snapshot
+    // is its own pass over the WAL.
+    if (replay_directory ? optind != argc || monitor || follow || rows || snapshot || subscription.count
+        : monitor ? (optind == argc && !list_filename) || subscription.count || changelog_directory || snapshot
+                  : optind != argc - 1 || (resume && !follow) || (subscription.count && page_number != 0) ||
+                    (changelog_directory && (!rows || page_number != 0)) ||
+                    (snapshot && (follow || rows || page_number != 0))) {
+        report_error(USAGE, 1);
+        subscription_free(&subscription);
+        return 1;
+    }
+    const Subscription *tables = subscription.count ? &subscription : NULL;
+    if (stats_filename && start_stats(stats_filename, stats_interval) != 0) {
+        subscription_free(&subscription);
         return 1;
     }
+    if (monitor) {
+        int status = run_monitor(argv + optind, argc - optind, list_filename, resume, format);
+        stats_stop();
+        return status;
+    }
+    if (replay_directory) {
+        int status = run_replay(replay_directory, format);
+        subscription_free(&subscription);
+        stats_stop();
+        return status;
+    }
 
-    const char *db_filename = argv[1];
+    const char *db_filename = argv[optind];
     // Compute WAL filename by appending "-wal"
     size_t db_len = strlen(db_filename);
     char *wal_filename = malloc(db_len + 5); // "-wal" + null terminator
     if (!wal_filename) {
         report_error("Failed to allocate memory for WAL filename", 1);
+        subscription_free(&subscription);
+        stats_stop();
         return 1;
     }
     strcpy(wal_filename, db_filename);
     strcpy(wal_filename + db_len, "-wal");
 
+    OutputSink out;
+    if (sink_init(&out, STDOUT_FILENO, format) != 0) {
+        free(wal_filename);
+        subscription_free(&subscription);
+        stats_stop();
+        return 1;
+    }
+    // Non-fatal errors share the buffer so they stay next to their frame
+    set_error_sink(&out);
+
     // Process the WAL file and return appropriate status
-    int status = print_wal_info(wal_filename);
+    ChangeLogWriter changelog_writer;
+    int status = changelog_directory ? changelog_writer_open(&changelog_writer, changelog_directory, 0) : 0;
+    ChangeLogWriter *changelog = changelog_directory && status == 0 ? &changelog_writer : NULL;
+    if (status != 0) {
+        // The change log could not be opened, so nothing is decoded
+    } else if (follow) {
+        install_stop_handler();
+        status = follow_wal_info(&out, wal_filename, rows, resume, tables, changelog);
+    } else if (page_number != 0) {
+        status = print_page_version(&out, wal_filename, page_number, commit);
+    } else if (snapshot) {
+        status = print_wal_snapshot(&out, wal_filename, tables);
+    } else if (rows) {
+        status = print_wal_rows(&out, wal_filename, tables, changelog);
+    } else {
+        status = print_wal_info(&out, wal_filename, jobs, committed_only, tables);
+    }
+    if (changelog && changelog_writer_close(changelog) != 0) {
+        status = -1;
+    }
+    set_error_sink(NULL);
+    release_frame_arena();
+    if (sink_flush(&out) != 0) {
+        status = -1;
+    }
+    sink_free(&out);
     free(wal_filename);
+    subscription_free(&subscription);
+    stats_stop();
     return status == 0 ? 0 : 1;
 }
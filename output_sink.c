@@ -0,0 +1,275 @@
+#include "output_sink.h"
+#include "utils.h"
+#include "wal_stats.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Initial buffer of a memory-only sink; it doubles as needed
+#define MEMORY_SINK_BUFFER (64 * 1024)
+#define NO_RECORD ((size_t)-1)
+
+static const char hex_digits[] = "0123456789abcdef";
+
+// Non-zero for bytes that need escaping inside a JSON string
+static const uint8_t json_escape[256] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    ['\\'] = 1,
+};
+
+// Opens a sink writing to fd, or collecting in memory when fd is -1
+int sink_init(OutputSink *sink, int fd, OutputFormat format) {
+    sink->fd = fd;
+    sink->format = format;
+    sink->size = 0;
+    sink->capacity = fd < 0 ? MEMORY_SINK_BUFFER : OUTPUT_SINK_BUFFER;
+    sink->record_start = NO_RECORD;
+    sink->failed = 0;
+    sink->data = malloc(sink->capacity);
+    if (!sink->data) {
+        sink->capacity = 0;
+        sink->failed = 1;
+        return report_error("Failed to allocate output buffer", 1);
+    }
+    return 0;
+}
+
+// Maps a --format name to an OutputFormat; -1 if unknown
+int sink_parse_format(const char *name, OutputFormat *format) {
+    if (strcmp(name, "text") == 0) {
+        *format = OUTPUT_TEXT;
+    } else if (strcmp(name, "json") == 0) {
+        *format = OUTPUT_JSON;
+    } else if (strcmp(name, "binary") == 0) {
+        *format = OUTPUT_BINARY;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+// Makes room for length more bytes, flushing or growing the buffer.
+// Returns NULL once the sink has failed.
+char *sink_reserve(OutputSink *sink, size_t length) {
+    if (sink->failed) {
+        return NULL;
+    }
+    if (sink->capacity - sink->size >= length) {
+        return sink->data + sink->size;
+    }
+    // An open binary record is patched in place, so it must stay buffered
+    if (sink->fd >= 0 && sink->record_start == NO_RECORD) {
+        if (sink_flush(sink) != 0) {
+            return NULL;
+        }
+        if (sink->capacity >= length) {
+            return sink->data;
+        }
+    }
+    size_t capacity = sink->capacity ? sink->capacity : MEMORY_SINK_BUFFER;
+    while (capacity - sink->size < length) {
+        capacity *= 2;
+    }
+    char *data = realloc(sink->data, capacity);
+    if (!data) {
+        sink->failed = 1;
+        report_error("Failed to grow output buffer", 1);
+        return NULL;
+    }
+    sink->data = data;
+    sink->capacity = capacity;
+    return sink->data + sink->size;
+}
+
+// Appends raw bytes
+void sink_write(OutputSink *sink, const void *data, size_t length) {
+    char *dest = sink_reserve(sink, length);
+    if (dest) {
+        memcpy(dest, data, length);
+        sink->size += length;
+    }
+}
+
+// Appends a NUL-terminated string
+void sink_puts(OutputSink *sink, const char *text) {
+    sink_write(sink, text, strlen(text));
+}
+
+// Appends a single character
+void sink_putc(OutputSink *sink, char c) {
+    char *dest = sink_reserve(sink, 1);
+    if (dest) {
+        *dest = c;
+        sink->size++;
+    }
+}
+
+// Appends printf-style formatted text straight into the buffer
+void sink_printf(OutputSink *sink, const char *format, ...) {
+    if (sink->failed) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    size_t available = sink->capacity - sink->size;
+    int length = vsnprintf(sink->data + sink->size, available, format, args);
+    va_end(args);
+    if (length < 0) {
+        return;
+    }
+    if ((size_t)length >= available) {
+        // Too long for the space left: make room and format again
+        if (!sink_reserve(sink, (size_t)length + 1)) {
+            return;
+        }
+        va_start(args, format);
+        vsnprintf(sink->data + sink->size, (size_t)length + 1, format, args);
+        va_end(args);
+    }
+    sink->size += (size_t)length;
+}
+
+// Appends bytes as lowercase hex digits with no separators
+void sink_hex(OutputSink *sink, const uint8_t *data, size_t length) {
+    char *dest = sink_reserve(sink, length * 2);
+    if (!dest) {
+        return;
+    }
+    for (size_t i = 0; i < length; i++) {
+        dest[2 * i] = hex_digits[data[i] >> 4];
+        dest[2 * i + 1] = hex_digits[data[i] & 0x0f];
+    }
+    sink->size += length * 2;
+}
+
+// Appends a quoted JSON string. Runs of plain bytes are copied in one go;
+// only quotes, backslashes and control characters are escaped.
+void sink_json_string(OutputSink *sink, const char *text, size_t length) {
+    const uint8_t *bytes = (const uint8_t *)text;
+    sink_putc(sink, '"');
+    size_t start = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (!json_escape[bytes[i]]) {
+            continue;
+        }
+        sink_write(sink, text + start, i - start);
+        start = i + 1;
+        switch (bytes[i]) {
+            case '"': sink_write(sink, "\\\"", 2); break;
+            case '\\': sink_write(sink, "\\\\", 2); break;
+            case '\n': sink_write(sink, "\\n", 2); break;
+            case '\r': sink_write(sink, "\\r", 2); break;
+            case '\t': sink_write(sink, "\\t", 2); break;
+            default: {
+                char escaped[6] = { '\\', 'u', '0', '0', hex_digits[bytes[i] >> 4], hex_digits[bytes[i] & 0x0f] };
+                sink_write(sink, escaped, sizeof(escaped));
+                break;
+            }
+        }
+    }
+    sink_write(sink, text + start, length - start);
+    sink_putc(sink, '"');
+}
+
+// Appends an unsigned byte
+void sink_u8(OutputSink *sink, uint8_t value) {
+    sink_putc(sink, (char)value);
+}
+
+// Appends a little-endian 16-bit value
+void sink_u16(OutputSink *sink, uint16_t value) {
+    uint8_t bytes[2] = { (uint8_t)value, (uint8_t)(value >> 8) };
+    sink_write(sink, bytes, sizeof(bytes));
+}
+
+// Appends a little-endian 32-bit value
+void sink_u32(OutputSink *sink, uint32_t value) {
+    uint8_t bytes[4];
+    for (int i = 0; i < 4; i++) {
+        bytes[i] = (uint8_t)(value >> (8 * i));
+    }
+    sink_write(sink, bytes, sizeof(bytes));
+}
+
+// Appends a little-endian 64-bit signed value
+void sink_i64(OutputSink *sink, int64_t value) {
+    uint8_t bytes[8];
+    for (int i = 0; i < 8; i++) {
+        bytes[i] = (uint8_t)((uint64_t)value >> (8 * i));
+    }
+    sink_write(sink, bytes, sizeof(bytes));
+}
+
+// Starts a binary record; its length is filled in by sink_record_end()
+void sink_record_begin(OutputSink *sink, RecordType type) {
+    sink_reserve(sink, 5);
+    sink->record_start = sink->size;
+    sink_u32(sink, 0);
+    sink_u8(sink, (uint8_t)type);
+}
+
+// Closes the open binary record by patching in its length
+void sink_record_end(OutputSink *sink) {
+    size_t start = sink->record_start;
+    sink->record_start = NO_RECORD;
+    if (sink->failed || start == NO_RECORD) {
+        return;
+    }
+    uint32_t length = (uint32_t)(sink->size - start - 4);
+    for (int i = 0; i < 4; i++) {
+        sink->data[start + i] = (char)(length >> (8 * i));
+    }
+}
+
+// Moves everything buffered in from to the end of sink
+void sink_append(OutputSink *sink, OutputSink *from) {
+    sink_write(sink, from->data, from->size);
+    from->size = 0;
+}
+
+// Writes the buffer to the sink's file; memory sinks are left untouched
+int sink_flush(OutputSink *sink) {
+    if (sink->fd < 0 || sink->failed) {
+        return sink->failed ? -1 : 0;
+    }
+    if (sink->size == 0) {
+        return 0;
+    }
+    uint64_t start = stats_clock();
+    size_t written = 0;
+    while (written < sink->size) {
+        ssize_t result = write(sink->fd, sink->data + written, sink->size - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            sink->failed = 1;
+            sink->size = 0;
+            return report_error("Failed to write output", 1);
+        }
+        written += (size_t)result;
+    }
+    stats_record(STATS_WRITE, start);
+    stats_add(STATS_OUTPUT_BYTES, written);
+    sink->size = 0;
+    return 0;
+}
+
+// Drops whatever has not been flushed yet, including an open binary record
+void sink_discard(OutputSink *sink) {
+    sink->size = 0;
+    sink->record_start = NO_RECORD;
+}
+
+// Flushes and releases the sink's buffer
+void sink_free(OutputSink *sink) {
+    sink_flush(sink);
+    free(sink->data);
+    sink->data = NULL;
+    sink->size = sink->capacity = 0;
+}
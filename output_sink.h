@@ -0,0 +1,59 @@
+#ifndef OUTPUT_SINK_H
+#define OUTPUT_SINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bytes buffered before a file-backed sink issues a write
+#define OUTPUT_SINK_BUFFER (1 << 20)
+
+typedef enum {
+    OUTPUT_TEXT = 0,            // Human-readable report
+    OUTPUT_JSON,                // One JSON object per line
+    OUTPUT_BINARY               // Length-prefixed records, see README
+} OutputFormat;
+
+// Binary record types; each record is a u32 body length, the type byte and the body
+typedef enum {
+    RECORD_WAL_HEADER = 1,
+    RECORD_FRAME = 2,
+    RECORD_SUMMARY = 3,
+    RECORD_MESSAGE = 4,
+    RECORD_TRANSACTION = 5,
+    RECORD_ROW = 6
+} RecordType;
+
+// Buffered writer shared by every report. A sink with fd -1 only collects
+// into memory and grows as needed; otherwise the buffer is written out in
+// large chunks whenever it fills and on sink_flush().
+typedef struct {
+    int fd;
+    OutputFormat format;
+    char* data;
+    size_t size;
+    size_t capacity;
+    size_t record_start;        // Offset of the open binary record, if any
+    int failed;                 // Set once a write or allocation fails
+} OutputSink;
+
+int sink_init(OutputSink* sink, int fd, OutputFormat format);
+int sink_parse_format(const char* name, OutputFormat* format);
+char* sink_reserve(OutputSink* sink, size_t length);
+void sink_write(OutputSink* sink, const void* data, size_t length);
+void sink_puts(OutputSink* sink, const char* text);
+void sink_putc(OutputSink* sink, char c);
+void sink_printf(OutputSink* sink, const char* format, ...) __attribute__((format(printf, 2, 3)));
+void sink_hex(OutputSink* sink, const uint8_t* data, size_t length);
+void sink_json_string(OutputSink* sink, const char* text, size_t length);
+void sink_u8(OutputSink* sink, uint8_t value);
+void sink_u16(OutputSink* sink, uint16_t value);
+void sink_u32(OutputSink* sink, uint32_t value);
+void sink_i64(OutputSink* sink, int64_t value);
+void sink_record_begin(OutputSink* sink, RecordType type);
+void sink_record_end(OutputSink* sink);
+void sink_append(OutputSink* sink, OutputSink* from);
+int sink_flush(OutputSink* sink);
+void sink_discard(OutputSink* sink);
+void sink_free(OutputSink* sink);
+
+#endif
@@ -1,70 +1,78 @@
-#include "db_utils.h"
 #include "page_analyzer.h"
 #include "utils.h"
+#include "record_view.h"
+#include "wal_stats.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 // Prints the type of a database page based on its first byte
-void print_page_type(uint8_t *page_data, uint32_t page_number) {
+void print_page_type(OutputSink *out, const uint8_t *page_data, uint32_t page_number) {
     uint8_t page_type = page_data[0];
-    printf("  Page Type: ");
+    sink_puts(out, "  Page Type: ");
     switch (page_type) {
-        case 0x02: printf("B-tree Index Interior\n"); break;
-        case 0x05: printf("B-tree Table Interior\n"); break;
-        case 0x0A: printf("B-tree Index Leaf\n"); break;
-        case 0x0D: printf("B-tree Table Leaf\n"); break;
+        case 0x02: sink_puts(out, "B-tree Index Interior\n"); break;
+        case 0x05: sink_puts(out, "B-tree Table Interior\n"); break;
+        case 0x0A: sink_puts(out, "B-tree Index Leaf\n"); break;
+        case 0x0D: sink_puts(out, "B-tree Table Leaf\n"); break;
         case 0x00:
             if (page_number == 1) {
-                printf("Database Header\n");
+                sink_puts(out, "Database Header\n");
             } else {
-                printf("Freelist or Unused\n");
+                sink_puts(out, "Freelist or Unused\n");
             }
             break;
-        default: printf("Unknown (0x%02x)\n", page_type); break;
+        default: sink_printf(out, "Unknown (0x%02x)\n", page_type); break;
     }
 }
 
 // Prints the header information of a database page
-void print_page_header(uint8_t *page_data, uint32_t page_number, uint32_t page_size, const char* db_filename) {
+void print_page_header(OutputSink *out, const uint8_t *page_data, uint32_t page_number, uint32_t page_size, const PageOwnerMap* owners) {
+    print_page_header_named(out, page_data, page_number, page_size, page_owner_lookup(owners, page_number), NULL,
+                            NULL);
+}
+
+// Prints the page header with an owner name resolved by the caller. Column
+// values on overflow pages are read through source when it is not NULL.
+// filter, when not NULL, limits the cells and columns shown.
+void print_page_header_named(OutputSink *out, const uint8_t *page_data, uint32_t page_number, uint32_t page_size,
+                             const char *table_name, const SubscribedTable *filter, const PageSource *source) {
     uint8_t page_type = page_data[0];
-    uint8_t *header_start = page_data;
+    const uint8_t *header_start = page_data;
     if (page_number == 1) {
         header_start = page_data + 100;
     }
 
-    uint16_t freeblock_offset = to_host16(*(uint16_t *)(header_start + 1));
-    uint16_t cell_count = to_host16(*(uint16_t *)(header_start + 3));
-    uint16_t content_start = to_host16(*(uint16_t *)(header_start + 5));
+    uint16_t freeblock_offset = to_host16(*(const uint16_t *)(header_start + 1));
+    uint16_t cell_count = to_host16(*(const uint16_t *)(header_start + 3));
+    uint16_t content_start = to_host16(*(const uint16_t *)(header_start + 5));
     uint8_t fragmented_bytes = header_start[7];
 
-    printf("  Page Header:\n");
-    char *table_name = get_table_name_from_page(db_filename, page_number);
+    sink_puts(out, "  Page Header:\n");
     if (table_name) {
-        printf("    Table Name: %s\n", table_name);
-        free(table_name);
+        sink_printf(out, "    Table Name: %s\n", table_name);
     } else {
-        printf("    Table Name: (unknown)\n");
+        sink_puts(out, "    Table Name: (unknown)\n");
     }
-    printf("    First Freeblock Offset: %u (0 if no freeblocks)\n", freeblock_offset);
-    printf("    Number of Cells: %u\n", cell_count);
-    printf("    Cell Content Start: %u (0 if uninitialized, defaults to %u)\n",
+    sink_printf(out, "    First Freeblock Offset: %u (0 if no freeblocks)\n", freeblock_offset);
+    sink_printf(out, "    Number of Cells: %u\n", cell_count);
+    sink_printf(out, "    Cell Content Start: %u (0 if uninitialized, defaults to %u)\n",
            content_start, content_start == 0 ? page_size : content_start);
-    printf("    Fragmented Free Bytes: %u\n", fragmented_bytes);
+    sink_printf(out, "    Fragmented Free Bytes: %u\n", fragmented_bytes);
 
     // Print additional info for interior nodes
     if (page_type == 0x02 || page_type == 0x05) {
-        uint32_t rightmost_child = to_host32(*(uint32_t *)(header_start + 8));
-        printf("    Rightmost Child Page: %u\n", rightmost_child);
+        uint32_t rightmost_child = to_host32(*(const uint32_t *)(header_start + 8));
+        sink_printf(out, "    Rightmost Child Page: %u\n", rightmost_child);
     }
 
     // Process cells for table leaf pages
     if (page_type == 0x0D) {
         if (cell_count == 0) {
-            printf("    No cells to display.\n");
+            sink_puts(out, "    No cells to display.\n");
             return;
         }
-        printf("    Cells (%u):\n", cell_count);
+        sink_printf(out, "    Cells (%u):\n", cell_count);
 
         uint32_t pointer_array_size = 8 + cell_count * 2;
         if (pointer_array_size > page_size) {
@@ -72,7 +80,13 @@ void print_page_header(uint8_t *page_data, uint32_t page_number, uint32_t page_s
             return;
         }
 
-        uint16_t *cell_pointers = malloc(cell_count * sizeof(uint16_t));
+        // Scratch for this page only; released by the next page's reset
+        Arena *arena = frame_arena();
+        uint16_t *cell_pointers = NULL;
+        if (arena) {
+            arena_reset(arena);
+            cell_pointers = arena_alloc(arena, cell_count * sizeof(uint16_t));
+        }
         if (!cell_pointers) {
             report_error("Failed to allocate memory for cell pointers", 0);
             return;
@@ -80,100 +94,164 @@ void print_page_header(uint8_t *page_data, uint32_t page_number, uint32_t page_s
 
         for (uint16_t i = 0; i < cell_count; i++) {
             size_t offset = 8 + (i * 2);
-            cell_pointers[i] = to_host16(*(uint16_t *)(page_data + offset));
+            cell_pointers[i] = to_host16(*(const uint16_t *)(page_data + offset));
             if (cell_pointers[i] >= page_size) {
                 report_error("Invalid cell pointer exceeds page size", 0);
-                free(cell_pointers);
                 return;
             }
         }
 
+        uint64_t start = stats_clock();
+        uint32_t decoded = 0;
+        CellInfo cell;
         for (uint16_t i = 0; i < cell_count; i++) {
-            CellInfo cell = parse_cell(page_data, cell_pointers[i], page_size);
-            if (cell.payload_size >= 0) {
-                print_cell_info(&cell, page_data, page_size);
+            if (parse_cell(&cell, page_data, cell_pointers[i], page_size, arena) == 0) {
+                if (!filter || subscription_rowid_matches(filter, cell.rowid)) {
+                    print_cell_info(out, &cell, page_data, page_size, filter, source);
+                }
+                decoded++;
             }
-            free_cell_info(&cell);
         }
-        free(cell_pointers);
+        stats_record(STATS_CELLS_PAGE, start);
+        stats_add(STATS_CELLS, decoded);
     }
 }
 
-// Parses a cell from a table leaf page
-CellInfo parse_cell(uint8_t *page_data, uint32_t offset, uint32_t page_size) {
-    CellInfo cell = { .offset = offset, .serial_types = NULL };
+// Parses a cell from a table leaf page into *cell. Up to CELL_INLINE_COLUMNS
+// serial types are kept inline; wider records take them from the arena, or
+// from the heap when arena is NULL (release those with free_cell_info).
+// Returns 0 on success, -1 with payload_size set to -1 on a malformed cell.
+int parse_cell(CellInfo *cell, const uint8_t *page_data, uint32_t offset, uint32_t page_size, Arena *arena) {
+    cell->offset = offset;
+    cell->record_offset = 0;
+    cell->payload_size = -1;
+    cell->rowid = 0;
+    cell->header_size = 0;
+    cell->column_count = 0;
+    cell->serial_types = cell->inline_types;
+    cell->heap_types = 0;
     size_t pos = offset;
-    int bytes_read;
+    uint64_t value;
+    int used;
 
     if (pos >= page_size) {
         report_error("Cell offset exceeds page size", 0);
-        cell.payload_size = -1;
-        return cell;
+        return -1;
     }
 
-    cell.payload_size = parse_varint(page_data, &pos, page_size, &bytes_read);
-    if (cell.payload_size < 0) return cell;
-
-    cell.rowid = parse_varint(page_data, &pos, page_size, &bytes_read);
-    if (cell.rowid < 0) {
-        cell.payload_size = -1;
-        return cell;
+    used = decode_varint(page_data + pos, page_size - pos, &value);
+    if (used == 0 || value > INT64_MAX) {
+        return -1;
     }
+    pos += used;
+    int64_t payload_size = (int64_t)value;
 
-    cell.header_size = parse_varint(page_data, &pos, page_size, &bytes_read);
-    if (cell.header_size < 0 || pos + cell.header_size > page_size) {
-        cell.payload_size = -1;
-        return cell;
+    // Rowids are signed; a 9-byte varint carries negative ones
+    used = decode_varint(page_data + pos, page_size - pos, &value);
+    if (used == 0) {
+        return -1;
     }
+    pos += used;
+    cell->rowid = (int64_t)value;
 
+    // The record header size counts its own varint
     size_t header_start = pos;
-    size_t header_end = header_start + cell.header_size;
-    cell.column_count = 0;
-
-    #define MAX_COLUMNS 1024
-    cell.serial_types = malloc(MAX_COLUMNS * sizeof(int64_t));
-    if (!cell.serial_types) {
-        report_error("Failed to allocate memory for serial types", 0);
-        cell.payload_size = -1;
-        return cell;
-    }
-
-    size_t current_pos = header_start;
-    while (current_pos < header_end && cell.column_count < MAX_COLUMNS) {
-        int64_t serial_type = parse_varint(page_data, &current_pos, page_size, &bytes_read);
-        if (serial_type < 0) {
-            free(cell.serial_types);
-            cell.serial_types = NULL;
-            cell.payload_size = -1;
-            return cell;
+    used = decode_varint(page_data + pos, page_size - pos, &value);
+    if (used == 0 || value < (uint64_t)used || value > page_size - header_start) {
+        return -1;
+    }
+    cell->header_size = (int64_t)value;
+    cell->record_offset = (uint32_t)header_start;
+    size_t header_end = header_start + cell->header_size;
+    pos += used;
+
+    // Every serial type takes at least one byte, which bounds the column count
+    size_t max_columns = header_end - pos;
+    if (max_columns > CELL_INLINE_COLUMNS) {
+        if (arena) {
+            cell->serial_types = arena_alloc(arena, max_columns * sizeof(int64_t));
+        } else {
+            cell->serial_types = malloc(max_columns * sizeof(int64_t));
+            cell->heap_types = cell->serial_types != NULL;
+        }
+        if (!cell->serial_types) {
+            cell->serial_types = cell->inline_types;
+            report_error("Failed to allocate memory for serial types", 0);
+            return -1;
         }
-        cell.serial_types[cell.column_count++] = serial_type;
     }
 
-    if (current_pos != header_end) {
+    size_t consumed;
+    cell->column_count = decode_varint_batch(page_data + pos, header_end - pos, cell->serial_types,
+                                             (uint32_t)max_columns, &consumed);
+    if (pos + consumed != header_end) {
         report_error("Header size mismatch", 0);
-        free(cell.serial_types);
-        cell.serial_types = NULL;
-        cell.payload_size = -1;
+        free_cell_info(cell);
+        return -1;
     }
 
-    return cell;
+    cell->payload_size = payload_size;
+    return 0;
 }
 
-// Prints information about a parsed cell
-void print_cell_info(CellInfo *cell, uint8_t *page_data, uint32_t page_size) {
-    printf("      Cell at offset %u:\n", cell->offset);
-    printf("        Payload Size: %lld bytes\n", cell->payload_size);
-    printf("        RowID: %lld\n", cell->rowid);
-    printf("        Number of Columns: %u\n", cell->column_count);
-    // TODO: Implement detailed column value printing
+// Prints information about a parsed cell and the values of its columns,
+// or of the columns filter selects when it is not NULL
+void print_cell_info(OutputSink *out, CellInfo *cell, const uint8_t *page_data, uint32_t page_size,
+                     const SubscribedTable *filter, const PageSource *source) {
+    sink_printf(out, "      Cell at offset %u:\n", cell->offset);
+    sink_printf(out, "        Payload Size: %lld bytes\n", (long long)cell->payload_size);
+    sink_printf(out, "        RowID: %lld\n", (long long)cell->rowid);
+    sink_printf(out, "        Number of Columns: %u\n", cell->column_count);
+
+    RecordView view;
+    if (record_view_init(&view, cell, page_data, page_size, source, frame_arena()) != 0) {
+        report_error("Invalid record header", 0);
+        return;
+    }
+    for (uint32_t i = 0; i < view.column_count; i++) {
+        if (filter && !subscription_column_matches(filter, i)) {
+            continue;
+        }
+        const char *type_name;
+        uint32_t length;
+        parse_serial_type(view.serial_types[i], &type_name, &length);
+        sink_printf(out, "          Column %u (%s): ", i, type_name);
+        print_column_value(out, &view, i);
+        sink_putc(out, '\n');
+    }
+    record_view_free(&view);
 }
 
-// Frees resources allocated for a CellInfo structure
+// Frees serial types that parse_cell had to take from the heap
 void free_cell_info(CellInfo *cell) {
-    if (cell->serial_types) {
+    if (cell->heap_types) {
         free(cell->serial_types);
-        cell->serial_types = NULL;
+        cell->heap_types = 0;
+    }
+    cell->serial_types = cell->inline_types;
+}
+
+// Each decoding thread keeps one arena, reset at the start of every page
+static __thread Arena *thread_arena = NULL;
+
+// Returns the calling thread's scratch arena, creating it on first use
+Arena *frame_arena(void) {
+    if (!thread_arena) {
+        thread_arena = malloc(sizeof(Arena));
+        if (!thread_arena) {
+            return NULL;
+        }
+        arena_init(thread_arena, ARENA_BLOCK_SIZE);
+    }
+    return thread_arena;
+}
+
+// Frees the calling thread's arena; call before a decoding thread exits
+void release_frame_arena(void) {
+    if (thread_arena) {
+        arena_free(thread_arena);
+        free(thread_arena);
+        thread_arena = NULL;
     }
 }
 
@@ -190,35 +268,65 @@ int parse_serial_type(int64_t serial_type, const char **type_name, uint32_t *len
     if (serial_type == 8) { *type_name = "ZERO"; *length = 0; return 0; }
     if (serial_type == 9) { *type_name = "ONE"; *length = 0; return 0; }
     if (serial_type >= 12 && serial_type % 2 == 0) {
-        *type_name = "TEXT"; *length = (serial_type - 12) / 2; return 0;
+        *type_name = "BLOB"; *length = (serial_type - 12) / 2; return 0;
     }
     if (serial_type >= 13 && serial_type % 2 == 1) {
-        *type_name = "BLOB"; *length = (serial_type - 13) / 2; return 0;
+        *type_name = "TEXT"; *length = (serial_type - 13) / 2; return 0;
     }
     return -1;
 }
 
-// Prints the value of a column based on its serial type
-void print_column_value(const uint8_t *data, size_t pos, size_t max_pos, const char *type_name, uint32_t length) {
-    if (pos + length > max_pos) {
-        report_error("Value exceeds page size", 0);
-        return;
+// Returns how many payload bytes a cell keeps on its b-tree page; the rest
+// spills onto an overflow chain (see "Cell Payload Overflow Pages" in the
+// SQLite file format)
+uint32_t btree_local_payload(uint8_t page_type, int64_t payload_size, uint32_t usable_size) {
+    uint32_t max_local = page_type == 0x0D ? usable_size - 35 : (usable_size - 12) * 64 / 255 - 23;
+    uint32_t min_local = (usable_size - 12) * 32 / 255 - 23;
+    if (payload_size <= max_local) {
+        return (uint32_t)payload_size;
     }
+    uint32_t surplus = min_local + (uint32_t)((payload_size - min_local) % (usable_size - 4));
+    return surplus <= max_local ? surplus : min_local;
+}
 
-    if (strcmp(type_name, "NULL") == 0) printf("NULL");
-    else if (strcmp(type_name, "ZERO") == 0) printf("0");
-    else if (strcmp(type_name, "ONE") == 0) printf("1");
-    else if (strcmp(type_name, "INT8") == 0) printf("%d", (int8_t)data[pos]);
-    else if (strcmp(type_name, "INT16") == 0) printf("%d", (int16_t)to_host16(*(uint16_t *)(data + pos)));
-    else if (strcmp(type_name, "INT24") == 0) printf("%d", (int32_t)((data[pos] << 16) | (data[pos + 1] << 8) | data[pos + 2]));
-    else if (strcmp(type_name, "INT32") == 0) printf("%d", (int32_t)to_host32(*(uint32_t *)(data + pos)));
-    else if (strcmp(type_name, "INT64") == 0) printf("%lld", (int64_t)to_host64(*(uint64_t *)(data + pos)));
-    else if (strcmp(type_name, "FLOAT64") == 0) printf("%f", *(double *)(data + pos));
-    else if (strcmp(type_name, "TEXT") == 0) {
-        printf("\"");
-        for (uint32_t i = 0; i < length; i++) printf("%c", data[pos + i]);
-        printf("\"");
-    }
-    else if (strcmp(type_name, "BLOB") == 0) printf("BLOB(%u bytes)", length);
-    else printf("Unknown type");
+// Prints the value of one column, decoding only that column. BLOBs print
+// their length only, so their bytes are never copied off overflow pages.
+void print_column_value(OutputSink *out, const RecordView *view, uint32_t column) {
+    int64_t integer;
+    double real;
+    const uint8_t *bytes;
+    uint32_t length;
+    switch (record_column_class(view, column)) {
+        case SERIAL_NULL:
+            sink_puts(out, "NULL");
+            return;
+        case SERIAL_INTEGER:
+            if (record_column_int64(view, column, &integer) == 0) {
+                sink_printf(out, "%lld", (long long)integer);
+                return;
+            }
+            break;
+        case SERIAL_FLOAT:
+            if (record_column_double(view, column, &real) == 0) {
+                sink_printf(out, "%.17g", real);
+                return;
+            }
+            break;
+        case SERIAL_TEXT:
+            if (record_column_fetch(view, column, &bytes, &length) == 0) {
+                sink_putc(out, '"');
+                sink_write(out, bytes, length);
+                sink_putc(out, '"');
+                return;
+            }
+            break;
+        case SERIAL_BLOB:
+            sink_printf(out, "BLOB(%u bytes)", serial_type_length(view->serial_types[column]));
+            return;
+        default:
+            sink_puts(out, "Unknown type");
+            return;
+    }
+    // The value lies on overflow pages that could not be read
+    sink_puts(out, "(overflow)");
 }
@@ -1,24 +1,43 @@
 #ifndef PAGE_ANALYZER_H
 #define PAGE_ANALYZER_H
 
+#include "arena.h"
+#include "output_sink.h"
+#include "page_owner.h"
+#include "page_source.h"
+#include "subscription.h"
 #include <stdint.h>
 #include <stddef.h>
+#include <stdio.h>
+
+// Serial types stored inside CellInfo itself; wider records use the arena
+#define CELL_INLINE_COLUMNS 16
 
 typedef struct {
     uint32_t offset;
+    uint32_t record_offset;     // Page offset of the record header
     int64_t payload_size;
     int64_t rowid;
     int64_t header_size;
     uint32_t column_count;
-    int64_t* serial_types;
+    int64_t* serial_types;      // inline_types, arena memory, or heap without an arena
+    int64_t inline_types[CELL_INLINE_COLUMNS];
+    uint8_t heap_types;         // serial_types came from malloc
 } CellInfo;
 
-void print_page_type(uint8_t* page_data, uint32_t page_number);
-void print_page_header(uint8_t* page_data, uint32_t page_number, uint32_t page_size, const char* db_filename);
-CellInfo parse_cell(uint8_t* page_data, uint32_t offset, uint32_t page_size);
-void print_cell_info(CellInfo* cell, uint8_t* page_data, uint32_t page_size);
+void print_page_type(OutputSink* out, const uint8_t* page_data, uint32_t page_number);
+void print_page_header(OutputSink* out, const uint8_t* page_data, uint32_t page_number, uint32_t page_size, const PageOwnerMap* owners);
+void print_page_header_named(OutputSink* out, const uint8_t* page_data, uint32_t page_number, uint32_t page_size,
+                             const char* table_name, const SubscribedTable* filter, const PageSource* source);
+int parse_cell(CellInfo* cell, const uint8_t* page_data, uint32_t offset, uint32_t page_size, Arena* arena);
+void print_cell_info(OutputSink* out, CellInfo* cell, const uint8_t* page_data, uint32_t page_size,
+                     const SubscribedTable* filter, const PageSource* source);
 void free_cell_info(CellInfo* cell);
+Arena* frame_arena(void);
+void release_frame_arena(void);
 int parse_serial_type(int64_t serial_type, const char** type_name, uint32_t* length);
-void print_column_value(const uint8_t* data, size_t pos, size_t max_pos, const char* type_name, uint32_t length);
+uint32_t btree_local_payload(uint8_t page_type, int64_t payload_size, uint32_t usable_size);
+struct RecordView;
+void print_column_value(OutputSink* out, const struct RecordView* view, uint32_t column);
 
 #endif
\ No newline at end of file
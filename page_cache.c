@@ -0,0 +1,447 @@
+#include "page_cache.h"
+#include "utils.h"
+#include "wal_stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static size_t cache_budget = PAGE_CACHE_DEFAULT_BYTES;
+
+// Sets the page data memory of caches set up afterwards with capacity 0
+void page_cache_set_budget(size_t bytes) {
+    cache_budget = bytes ? bytes : PAGE_CACHE_DEFAULT_BYTES;
+}
+
+// Hash bucket of a page number; Fibonacci hashing spreads sequential pages
+static uint32_t bucket_of(const PageCache *cache, uint32_t page_number) {
+    return (uint32_t)((page_number * 2654435761u) >> 7) & cache->bucket_mask;
+}
+
+// Sets up an empty cache of capacity pages over fd; 0 fits the budget
+int page_cache_init(PageCache *cache, int fd, uint32_t page_size, uint32_t capacity) {
+    memset(cache, 0, sizeof(*cache));
+    cache->fd = fd;
+    cache->page_size = page_size;
+    if (capacity == 0) {
+        size_t pages = cache_budget / page_size;
+        capacity = pages < PAGE_CACHE_MIN_PAGES ? PAGE_CACHE_MIN_PAGES : (uint32_t)(pages < (1u << 24) ? pages : (1u << 24));
+    }
+    cache->capacity = capacity;
+    cache->hot_target = capacity * 3 / 4;
+    pthread_mutex_init(&cache->lock, NULL);
+    pthread_cond_init(&cache->loaded, NULL);
+    // Resident and non-resident entries together keep the load factor at 1/2
+    uint32_t buckets = 1;
+    while (buckets < cache->capacity * 4) {
+        buckets <<= 1;
+    }
+    cache->bucket_mask = buckets - 1;
+
+    uint32_t entries = cache->capacity * 2;
+    cache->data = malloc((size_t)cache->capacity * page_size);
+    cache->page_numbers = calloc(entries, sizeof(uint32_t));
+    cache->next = malloc(entries * sizeof(int32_t));
+    cache->buckets = malloc(buckets * sizeof(int32_t));
+    cache->flags = calloc(cache->capacity, 1);
+    cache->pins = calloc(cache->capacity, sizeof(uint32_t));
+    if (!cache->data || !cache->page_numbers || !cache->next || !cache->buckets || !cache->flags || !cache->pins) {
+        page_cache_free(cache);
+        return report_error("Failed to allocate memory for page cache", 1);
+    }
+    memset(cache->buckets, 0xff, buckets * sizeof(int32_t));
+    memset(cache->next, 0xff, entries * sizeof(int32_t));
+    page_reader_init(&cache->readers[0], fd, cache->data, (size_t)cache->capacity * page_size);
+    cache->reader_count = 1;
+    return 0;
+}
+
+// Returns the entry holding page_number, resident or not, or -1
+static int32_t find_entry(const PageCache *cache, uint32_t page_number) {
+    int32_t entry = cache->buckets[bucket_of(cache, page_number)];
+    while (entry >= 0 && cache->page_numbers[entry] != page_number) {
+        entry = cache->next[entry];
+    }
+    return entry;
+}
+
+// Unlinks an entry from its hash bucket and empties it
+static void unlink_entry(PageCache *cache, int32_t entry) {
+    int32_t *link = &cache->buckets[bucket_of(cache, cache->page_numbers[entry])];
+    while (*link != entry) {
+        link = &cache->next[*link];
+    }
+    *link = cache->next[entry];
+    cache->next[entry] = -1;
+    cache->page_numbers[entry] = 0;
+}
+
+// Makes an empty entry the holder of page_number
+static void link_entry(PageCache *cache, int32_t entry, uint32_t page_number) {
+    uint32_t bucket = bucket_of(cache, page_number);
+    cache->page_numbers[entry] = page_number;
+    cache->next[entry] = cache->buckets[bucket];
+    cache->buckets[bucket] = entry;
+}
+
+// Empties a resident slot, e.g. after its read failed
+static void drop_slot(PageCache *cache, int32_t slot) {
+    if (cache->flags[slot] & PAGE_CACHE_HOT) {
+        cache->hot_count--;
+    }
+    cache->flags[slot] = 0;
+    if (cache->page_numbers[slot]) {
+        unlink_entry(cache, slot);
+    }
+}
+
+// Evicts a cold slot, keeping a non-resident entry for its page in place
+// of the oldest one
+static void evict_slot(PageCache *cache, int32_t slot) {
+    uint32_t page_number = cache->page_numbers[slot];
+    drop_slot(cache, slot);
+    int32_t entry = (int32_t)(cache->capacity + cache->test_hand);
+    cache->test_hand = (cache->test_hand + 1) % cache->capacity;
+    if (cache->page_numbers[entry]) {
+        unlink_entry(cache, entry);
+    }
+    link_entry(cache, entry, page_number);
+    cache->evictions++;
+    stats_add(STATS_CACHE_EVICTIONS, 1);
+}
+
+// Records a use of a resident slot. A prefetched page's first use is the
+// one it was read for, so only later ones count as reuse.
+static void touch_slot(PageCache *cache, int32_t slot) {
+    if (cache->flags[slot] & PAGE_CACHE_PREFETCHED) {
+        cache->flags[slot] &= ~PAGE_CACHE_PREFETCHED;
+    } else {
+        cache->flags[slot] |= PAGE_CACHE_REFERENCED;
+    }
+}
+
+// Advances the clock hand to a slot that may be replaced, promoting cold
+// pages used since the last pass and demoting unused hot pages while there
+// are too many. Returns -1 when every slot is pinned.
+static int32_t choose_victim(PageCache *cache) {
+    // Unless slots are pinned, four sweeps are enough to clear references,
+    // demote the extra hot pages and reach a cold one
+    for (uint64_t step = 0; step < (uint64_t)cache->capacity * 4; step++) {
+        uint32_t slot = cache->hand;
+        cache->hand = (cache->hand + 1) % cache->capacity;
+        if (cache->pins[slot]) {
+            continue;
+        }
+        if (cache->page_numbers[slot] == 0) {
+            return (int32_t)slot;
+        }
+        uint8_t flags = cache->flags[slot];
+        if (flags & PAGE_CACHE_HOT) {
+            if (flags & PAGE_CACHE_REFERENCED) {
+                cache->flags[slot] = PAGE_CACHE_HOT;
+            } else if (cache->hot_count > cache->hot_target) {
+                cache->flags[slot] = 0;
+                cache->hot_count--;
+            }
+        } else if (flags & PAGE_CACHE_REFERENCED) {
+            cache->flags[slot] = PAGE_CACHE_HOT;
+            cache->hot_count++;
+        } else {
+            evict_slot(cache, (int32_t)slot);
+            return (int32_t)slot;
+        }
+    }
+    return -1;
+}
+
+// Links page_number into a free slot and returns it, or -1 if every slot
+// is pinned. A page whose non-resident entry survives comes back hot: its
+// reuse distance is shorter than what a cold page gets.
+static int32_t admit_page(PageCache *cache, uint32_t page_number, uint8_t flags) {
+    int32_t slot = choose_victim(cache);
+    if (slot < 0) {
+        return -1;
+    }
+    // Looked up after the eviction, which may have reused the entry
+    int32_t entry = find_entry(cache, page_number);
+    if (entry >= 0) {
+        unlink_entry(cache, entry);
+        flags |= PAGE_CACHE_HOT;
+        cache->hot_count++;
+    }
+    link_entry(cache, slot, page_number);
+    cache->flags[slot] = flags;
+    cache->misses++;
+    stats_add(STATS_CACHE_MISSES, 1);
+    return slot;
+}
+
+// Returns the resident slot holding page_number, or -1
+static int32_t resident_slot(const PageCache *cache, uint32_t page_number) {
+    int32_t entry = find_entry(cache, page_number);
+    return entry < (int32_t)cache->capacity ? entry : -1;
+}
+
+// Returns the resident slot holding page_number, counting a hit, or -1
+static int32_t lookup_slot(PageCache *cache, uint32_t page_number) {
+    int32_t entry = resident_slot(cache, page_number);
+    if (entry < 0) {
+        return -1;
+    }
+    cache->hits++;
+    stats_add(STATS_CACHE_HITS, 1);
+    touch_slot(cache, entry);
+    return entry;
+}
+
+// Claims a slot admit_page() returned for a read made with the lock dropped
+static void begin_load(PageCache *cache, int32_t slot) {
+    cache->flags[slot] |= PAGE_CACHE_LOADING;
+    cache->pins[slot]++;
+}
+
+// Publishes a slot once its read is over, or empties it if the read
+// failed. Returns 1 when the slot now holds page_number; a slot that
+// page_cache_invalidate() emptied during the read stays empty.
+static int finish_load(PageCache *cache, int32_t slot, uint32_t page_number, int ok) {
+    cache->pins[slot]--;
+    if (cache->page_numbers[slot] != page_number || !(cache->flags[slot] & PAGE_CACHE_LOADING)) {
+        return 0;
+    }
+    if (!ok) {
+        drop_slot(cache, slot);
+        return 0;
+    }
+    cache->flags[slot] &= ~PAGE_CACHE_LOADING;
+    return 1;
+}
+
+// Waits until another thread's read of a resident slot is over. Returns 1
+// when the slot then holds page_number, at once if it was already loaded.
+static int wait_for_load(PageCache *cache, int32_t slot, uint32_t page_number) {
+    cache->pins[slot]++;
+    while ((cache->flags[slot] & PAGE_CACHE_LOADING) && cache->page_numbers[slot] == page_number) {
+        pthread_cond_wait(&cache->loaded, &cache->lock);
+    }
+    cache->pins[slot]--;
+    return cache->page_numbers[slot] == page_number;
+}
+
+// Takes a reader for one batch, setting up another while fewer than
+// PAGE_CACHE_READERS exist and waiting when all of them are in use.
+// Returns its index; called and returns with the lock held.
+static uint32_t acquire_reader(PageCache *cache) {
+    for (;;) {
+        for (uint32_t i = 0; i < cache->reader_count; i++) {
+            if (!(cache->readers_busy & (1u << i))) {
+                cache->readers_busy |= 1u << i;
+                return i;
+            }
+        }
+        if (cache->reader_count < PAGE_CACHE_READERS) {
+            page_reader_init(&cache->readers[cache->reader_count++], cache->fd, cache->data,
+                             (size_t)cache->capacity * cache->page_size);
+            continue;
+        }
+        pthread_cond_wait(&cache->loaded, &cache->lock);
+    }
+}
+
+// Copies a page of the main database into buffer, reading it from the file
+// on a miss. Returns 0, or -1 if the page is not in the file.
+int page_cache_read(PageCache *cache, uint32_t page_number, uint8_t *buffer) {
+    if (page_number == 0) {
+        return -1;
+    }
+    off_t offset = (off_t)(page_number - 1) * cache->page_size;
+    pthread_mutex_lock(&cache->lock);
+    int32_t slot = lookup_slot(cache, page_number);
+    if (slot >= 0 && wait_for_load(cache, slot, page_number)) {
+        memcpy(buffer, cache->data + (size_t)slot * cache->page_size, cache->page_size);
+        pthread_mutex_unlock(&cache->lock);
+        return 0;
+    }
+
+    slot = slot < 0 ? admit_page(cache, page_number, 0) : -1;
+    if (slot < 0) {
+        // Every slot is pinned, or another thread's read of the page did
+        // not stick; read around the cache
+        pthread_mutex_unlock(&cache->lock);
+        return pread(cache->fd, buffer, cache->page_size, offset) == (ssize_t)cache->page_size ? 0 : -1;
+    }
+    uint8_t *page = cache->data + (size_t)slot * cache->page_size;
+    begin_load(cache, slot);
+    pthread_mutex_unlock(&cache->lock);
+    int ok = pread(cache->fd, page, cache->page_size, offset) == (ssize_t)cache->page_size;
+    pthread_mutex_lock(&cache->lock);
+    finish_load(cache, slot, page_number, ok);
+    if (ok) {
+        memcpy(buffer, page, cache->page_size);
+    }
+    pthread_cond_broadcast(&cache->loaded);
+    pthread_mutex_unlock(&cache->lock);
+    return ok ? 0 : -1;
+}
+
+// Admits up to PAGE_READER_DEPTH pages and reads them as one batch
+// straight into their slots. The slots are claimed as loading, the lock
+// is dropped for the reads and taken again to publish them, and failed
+// reads empty their slots. Called and returns with the lock held; on
+// return slots[i] is the slot of pages[i], or -1.
+static void read_slots(PageCache *cache, const uint32_t *pages, uint32_t count, uint8_t flags, int32_t *slots) {
+    PageRead reads[PAGE_READER_DEPTH];
+    uint32_t targets[PAGE_READER_DEPTH];
+    uint32_t read_count = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        slots[i] = admit_page(cache, pages[i], flags);
+        if (slots[i] < 0) {
+            continue;
+        }
+        begin_load(cache, slots[i]);
+        PageRead *read = &reads[read_count];
+        read->buffer = cache->data + (size_t)slots[i] * cache->page_size;
+        read->offset = (uint64_t)(pages[i] - 1) * cache->page_size;
+        read->length = cache->page_size;
+        targets[read_count++] = i;
+    }
+    if (read_count == 0) {
+        return;
+    }
+    uint32_t reader = acquire_reader(cache);
+    pthread_mutex_unlock(&cache->lock);
+    page_reader_read(&cache->readers[reader], reads, read_count);
+    pthread_mutex_lock(&cache->lock);
+    cache->readers_busy &= ~(1u << reader);
+    for (uint32_t j = 0; j < read_count; j++) {
+        uint32_t i = targets[j];
+        if (!finish_load(cache, slots[i], pages[i], reads[j].result == (int32_t)cache->page_size)) {
+            slots[i] = -1;
+        }
+    }
+    pthread_cond_broadcast(&cache->loaded);
+}
+
+// Reads the listed pages into the cache ahead of page_cache_read(), as
+// batches of concurrent reads straight into their slots. Cached, loading
+// and repeated pages are skipped, and at most capacity pages are read so
+// the call cannot evict its own pages.
+void page_cache_prefetch(PageCache *cache, const uint32_t *pages, uint32_t count) {
+    uint32_t missing[PAGE_READER_DEPTH];
+    int32_t slots[PAGE_READER_DEPTH];
+    uint32_t taken = 0;
+    pthread_mutex_lock(&cache->lock);
+    for (uint32_t i = 0; i < count && taken < cache->capacity;) {
+        uint32_t missing_count = 0;
+        for (; i < count && missing_count < PAGE_READER_DEPTH && taken < cache->capacity; i++) {
+            int repeated = resident_slot(cache, pages[i]) >= 0;
+            for (uint32_t j = 0; j < missing_count && !repeated; j++) {
+                repeated = missing[j] == pages[i];
+            }
+            if (pages[i] != 0 && !repeated) {
+                missing[missing_count++] = pages[i];
+                taken++;
+            }
+        }
+        read_slots(cache, missing, missing_count, PAGE_CACHE_PREFETCHED, slots);
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// Pins up to PAGE_READER_DEPTH pages, reading the missing ones as one
+// batch, and points images[i] at the cached bytes of pages[i]. Those stay
+// valid and unchanged until page_cache_unpin(). images[i] is NULL for page
+// 0, pages not in the file, and when every slot is already pinned. Pages
+// another thread is reading are waited for after this call's own batch,
+// so two pinning threads never wait on each other.
+void page_cache_pin(PageCache *cache, const uint32_t *pages, uint32_t count, const uint8_t **images) {
+    uint32_t missing[PAGE_READER_DEPTH];
+    int32_t slots[PAGE_READER_DEPTH];
+    uint32_t loading[PAGE_READER_DEPTH];
+    uint32_t missing_count = 0, loading_count = 0;
+    pthread_mutex_lock(&cache->lock);
+    for (uint32_t i = 0; i < count; i++) {
+        images[i] = NULL;
+        int32_t slot = pages[i] ? lookup_slot(cache, pages[i]) : -1;
+        if (slot >= 0) {
+            cache->pins[slot]++;
+            images[i] = cache->data + (size_t)slot * cache->page_size;
+            if (cache->flags[slot] & PAGE_CACHE_LOADING) {
+                loading[loading_count++] = i;
+            }
+            continue;
+        }
+        int repeated = pages[i] == 0;
+        for (uint32_t j = 0; j < missing_count && !repeated; j++) {
+            repeated = missing[j] == pages[i];
+        }
+        if (!repeated) {
+            missing[missing_count++] = pages[i];
+        }
+    }
+    read_slots(cache, missing, missing_count, 0, slots);
+    // A page listed twice is read once and pinned for each listing
+    for (uint32_t i = 0; i < count && missing_count; i++) {
+        for (uint32_t j = 0; j < missing_count && !images[i] && pages[i]; j++) {
+            if (missing[j] == pages[i] && slots[j] >= 0) {
+                cache->pins[slots[j]]++;
+                images[i] = cache->data + (size_t)slots[j] * cache->page_size;
+            }
+        }
+    }
+    for (uint32_t k = 0; k < loading_count; k++) {
+        uint32_t i = loading[k];
+        int32_t slot = (int32_t)((images[i] - cache->data) / cache->page_size);
+        if (!wait_for_load(cache, slot, pages[i])) {
+            cache->pins[slot]--;
+            images[i] = NULL;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// Releases pages pinned by page_cache_pin(); NULL images are skipped
+void page_cache_unpin(PageCache *cache, const uint8_t *const *images, uint32_t count) {
+    pthread_mutex_lock(&cache->lock);
+    for (uint32_t i = 0; i < count; i++) {
+        if (images[i]) {
+            cache->pins[(images[i] - cache->data) / cache->page_size]--;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// Forgets every page, e.g. once a checkpoint has copied WAL frames into the
+// database file. Pinned slots keep their bytes until they are unpinned,
+// and reads still running are not published.
+void page_cache_invalidate(PageCache *cache) {
+    if (!cache->capacity) {
+        return;
+    }
+    pthread_mutex_lock(&cache->lock);
+    memset(cache->page_numbers, 0, cache->capacity * 2 * sizeof(uint32_t));
+    memset(cache->next, 0xff, cache->capacity * 2 * sizeof(int32_t));
+    memset(cache->buckets, 0xff, (cache->bucket_mask + 1) * sizeof(int32_t));
+    memset(cache->flags, 0, cache->capacity);
+    cache->hot_count = 0;
+    cache->invalidations++;
+    stats_add(STATS_CACHE_INVALIDATIONS, 1);
+    pthread_cond_broadcast(&cache->loaded);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// Releases the cache's memory; the file descriptor belongs to the caller
+void page_cache_free(PageCache *cache) {
+    if (cache->capacity) {
+        pthread_mutex_destroy(&cache->lock);
+        pthread_cond_destroy(&cache->loaded);
+    }
+    for (uint32_t i = 0; i < cache->reader_count; i++) {
+        page_reader_free(&cache->readers[i]);
+    }
+    free(cache->data);
+    free(cache->page_numbers);
+    free(cache->next);
+    free(cache->buckets);
+    free(cache->flags);
+    free(cache->pins);
+    memset(cache, 0, sizeof(*cache));
+}
@@ -0,0 +1,71 @@
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include "page_reader.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Memory a cache takes for page data unless told otherwise
+#define PAGE_CACHE_DEFAULT_BYTES (4u << 20)
+#define PAGE_CACHE_MIN_PAGES 16
+// Batches of different threads that can be read at once
+#define PAGE_CACHE_READERS 4
+
+// Per-slot flags
+#define PAGE_CACHE_HOT 0x01         // Reused while resident, or soon after eviction
+#define PAGE_CACHE_REFERENCED 0x02  // Used since the hand last passed
+#define PAGE_CACHE_PREFETCHED 0x04  // Read ahead and not used yet
+#define PAGE_CACHE_LOADING 0x08     // Being read from the file; pinned until then
+
+// Fixed-size cache of main-database pages, shared by everything that reads
+// the database file. Replacement is a simplified CLOCK-Pro: a page starts
+// cold and becomes hot once it is used again while resident, or when it
+// is read back while its non-resident entry (kept for as many recently
+// evicted pages as there are slots) is still there. Only cold pages are
+// evicted. Hot pages are demoted to cold once they fill more than
+// hot_target slots and were not used since the hand last passed. One-off
+// scans therefore cycle through the cold slots and leave hot pages such
+// as b-tree interiors in place. Pinned slots are never replaced. Entries
+// [0, capacity) are the resident slots and [capacity, 2 * capacity) the
+// non-resident ones; all share one hash. The lock guards this bookkeeping
+// but is never held across file reads, so one cache can be shared by every
+// decoding thread: a miss claims its slot as loading, reads with the lock
+// dropped, then publishes the page or empties the slot. Threads that want
+// a loading page wait for it on the loaded condition.
+typedef struct {
+    int fd;
+    uint32_t page_size;
+    uint32_t capacity;          // Resident slots
+    uint32_t hot_target;        // Slots hot pages may fill before the hand demotes them
+    uint32_t hot_count;
+    uint8_t* data;              // capacity * page_size bytes
+    uint32_t* page_numbers;     // Page of each entry, 0 if empty
+    int32_t* next;              // Next entry in the same hash bucket, -1 at the end
+    int32_t* buckets;           // First entry of each bucket, -1 if empty
+    uint32_t bucket_mask;
+    uint8_t* flags;             // PAGE_CACHE_* flags of each resident slot
+    uint32_t* pins;             // Holders of each resident slot
+    uint32_t hand;              // CLOCK hand over the resident slots
+    uint32_t test_hand;         // Oldest non-resident entry, reused first
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t invalidations;
+    pthread_mutex_t lock;
+    pthread_cond_t loaded;      // Signalled when reads finish or a reader is released
+    PageReader readers[PAGE_CACHE_READERS]; // Batched reads for prefetches and pins, set up as needed
+    uint32_t reader_count;
+    uint32_t readers_busy;      // Bit per reader in use by a batch
+} PageCache;
+
+void page_cache_set_budget(size_t bytes);
+int page_cache_init(PageCache* cache, int fd, uint32_t page_size, uint32_t capacity);
+int page_cache_read(PageCache* cache, uint32_t page_number, uint8_t* buffer);
+void page_cache_prefetch(PageCache* cache, const uint32_t* pages, uint32_t count);
+void page_cache_pin(PageCache* cache, const uint32_t* pages, uint32_t count, const uint8_t** images);
+void page_cache_unpin(PageCache* cache, const uint8_t* const* images, uint32_t count);
+void page_cache_invalidate(PageCache* cache);
+void page_cache_free(PageCache* cache);
+
+#endif
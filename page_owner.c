@@ -0,0 +1,686 @@
+#include "page_owner.h"
+#include "page_analyzer.h"
+#include "utils.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAX_BTREE_DEPTH 32
+#define MAX_SCHEMA_RECORD (1 << 20)
+
+// Pages left to visit in a walk, or overflow chains still being followed
+typedef struct {
+    uint32_t *pages;
+    int64_t *budgets;           // Pages each chain may still take; unused for b-tree levels
+    uint32_t count;
+    uint32_t capacity;
+} PageList;
+
+// Grows the per-page arrays so page_number is a valid index
+static int ensure_capacity(PageOwnerMap *map, uint32_t page_number) {
+    if (page_number < map->capacity) {
+        return 1;
+    }
+    uint32_t capacity = map->capacity ? map->capacity : 64;
+    while (capacity <= page_number) {
+        capacity *= 2;
+    }
+    uint32_t *owners = realloc(map->owners, capacity * sizeof(uint32_t));
+    if (!owners) {
+        report_error("Failed to grow page ownership map", 0);
+        return 0;
+    }
+    map->owners = owners;
+    uint32_t *wal_frames = realloc(map->wal_frames, capacity * sizeof(uint32_t));
+    if (!wal_frames) {
+        report_error("Failed to grow page ownership map", 0);
+        return 0;
+    }
+    map->wal_frames = wal_frames;
+    if (map->watched) {
+        uint64_t *watched = realloc(map->watched, capacity / 64 * sizeof(uint64_t));
+        if (!watched) {
+            report_error("Failed to grow page ownership map", 0);
+            return 0;
+        }
+        map->watched = watched;
+        memset(map->watched + map->capacity / 64, 0, (capacity - map->capacity) / 64 * sizeof(uint64_t));
+    }
+    memset(map->owners + map->capacity, 0, (capacity - map->capacity) * sizeof(uint32_t));
+    memset(map->wal_frames + map->capacity, 0, (capacity - map->capacity) * sizeof(uint32_t));
+    map->capacity = capacity;
+    return 1;
+}
+
+// Sets the owner of a page, keeping the watched bitmap in step
+static void set_owner(PageOwnerMap *map, uint32_t page_number, uint32_t owner) {
+    map->owners[page_number] = owner;
+    if (map->watched) {
+        uint64_t bit = 1ULL << (page_number & 63);
+        if (owner && map->btrees[owner - 1].watched) {
+            map->watched[page_number >> 6] |= bit;
+        } else {
+            map->watched[page_number >> 6] &= ~bit;
+        }
+    }
+}
+
+// Returns 1 when name is one of the watched b-tree names
+static int is_watched_name(const PageOwnerMap *map, const char *name) {
+    for (uint32_t i = 0; i < map->watch_count; i++) {
+        if (strcmp(map->watch_names[i], name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Returns the newest applied WAL copy of a page, or NULL if there is none
+static const uint8_t *wal_copy(const PageOwnerMap *map, uint32_t page_number) {
+    if (map->wal && page_number < map->capacity && map->wal_frames[page_number]) {
+        WalFrameView view;
+        if (wal_reader_frame(map->wal, map->wal_frames[page_number], &view) == 0) {
+            return view.page_data;
+        }
+    }
+    return NULL;
+}
+
+// Returns a page image, preferring the newest applied WAL copy over the
+// main database. Main-database reads land in the scratch buffer for depth.
+static const uint8_t *read_page(PageOwnerMap *map, uint32_t page_number, int depth) {
+    if (page_number == 0) {
+        return NULL;
+    }
+    const uint8_t *copy = wal_copy(map, page_number);
+    if (copy) {
+        return copy;
+    }
+    uint8_t *buffer = map->scratch + (size_t)depth * map->page_size;
+    return page_cache_read(&map->cache, page_number, buffer) == 0 ? buffer : NULL;
+}
+
+// Reads the first length bytes of up to PAGE_READER_DEPTH database pages
+// as one batch into map->batch. images[i] stays NULL for page 0 and for
+// pages that cannot be read.
+static void read_page_batch(PageOwnerMap *map, const uint32_t *pages, uint32_t count, uint32_t length,
+                            const uint8_t **images) {
+    PageRead reads[PAGE_READER_DEPTH];
+    uint32_t targets[PAGE_READER_DEPTH];
+    uint32_t read_count = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (images[i] || pages[i] == 0) {
+            continue;
+        }
+        PageRead *read = &reads[read_count];
+        read->buffer = map->batch + (size_t)i * map->page_size;
+        read->offset = (uint64_t)(pages[i] - 1) * map->page_size;
+        read->length = length;
+        targets[read_count++] = i;
+    }
+    page_reader_read(&map->reader, reads, read_count);
+    for (uint32_t i = 0; i < read_count; i++) {
+        if (reads[i].result == (int32_t)length) {
+            images[targets[i]] = reads[i].buffer;
+        }
+    }
+}
+
+// Fetches up to PAGE_READER_DEPTH b-tree pages for a walk: WAL copies in
+// place, the rest pinned in the page cache, whose misses are read as one
+// batch. Pages the cache cannot hold are read around it. Release the pins
+// with page_cache_unpin() on pinned.
+static void fetch_page_batch(PageOwnerMap *map, const uint32_t *pages, uint32_t count,
+                             const uint8_t **images, const uint8_t **pinned) {
+    uint32_t database[PAGE_READER_DEPTH];
+    for (uint32_t i = 0; i < count; i++) {
+        images[i] = pages[i] ? wal_copy(map, pages[i]) : NULL;
+        database[i] = images[i] ? 0 : pages[i];
+    }
+    page_cache_pin(&map->cache, database, count, pinned);
+    for (uint32_t i = 0; i < count; i++) {
+        if (pinned[i]) {
+            images[i] = pinned[i];
+        }
+    }
+    read_page_batch(map, database, count, map->page_size, images);
+}
+
+// Appends a page to a walk list; budget is what an overflow chain may still take
+static int push_page(PageList *list, uint32_t page_number, int64_t budget) {
+    if (list->count == list->capacity) {
+        uint32_t capacity = list->capacity ? list->capacity * 2 : 64;
+        uint32_t *pages = realloc(list->pages, capacity * sizeof(uint32_t));
+        if (pages) {
+            list->pages = pages;
+        }
+        int64_t *budgets = realloc(list->budgets, capacity * sizeof(int64_t));
+        if (budgets) {
+            list->budgets = budgets;
+        }
+        if (!pages || !budgets) {
+            report_error("Failed to allocate memory for b-tree walk", 0);
+            return -1;
+        }
+        list->capacity = capacity;
+    }
+    list->pages[list->count] = page_number;
+    list->budgets[list->count] = budget;
+    list->count++;
+    return 0;
+}
+
+// Queues the children of an interior page for the next level and the
+// overflow chains of its cells (or a leaf's) for follow_overflow_chains()
+static void scan_btree_page(PageOwnerMap *map, uint32_t page_number, const uint8_t *page,
+                            PageList *children, PageList *chains) {
+    const uint8_t *header = page + (page_number == 1 ? 100 : 0);
+    uint8_t page_type = header[0];
+    if (page_type != 0x02 && page_type != 0x05 && page_type != 0x0A && page_type != 0x0D) {
+        return;
+    }
+    int interior = page_type == 0x02 || page_type == 0x05;
+    uint16_t cell_count = to_host16(*(const uint16_t *)(header + 3));
+    const uint8_t *pointers = header + (interior ? 12 : 8);
+    if (pointers + cell_count * 2 > page + map->page_size) {
+        return;
+    }
+
+    for (uint16_t i = 0; i < cell_count; i++) {
+        uint16_t offset = to_host16(*(const uint16_t *)(pointers + i * 2));
+        if (offset + 4 > map->page_size) {
+            continue;
+        }
+        size_t pos = offset;
+        if (interior) {
+            push_page(children, to_host32(*(const uint32_t *)(page + offset)), 0);
+            pos += 4;
+        }
+        if (page_type == 0x05) {
+            continue; // Table interior cells carry no payload
+        }
+
+        int bytes_read;
+        int64_t payload_size = parse_varint(page, &pos, map->page_size, &bytes_read);
+        if (payload_size < 0) {
+            continue;
+        }
+        if (page_type == 0x0D) {
+            parse_varint(page, &pos, map->page_size, &bytes_read);
+        }
+        uint32_t local = btree_local_payload(page_type, payload_size, map->usable_size);
+        if (local < payload_size && pos + local + 4 <= map->page_size) {
+            // Bound the chain by the payload length so a corrupt chain cannot loop
+            int64_t max_pages = (payload_size - local) / (map->usable_size - 4) + 1;
+            push_page(chains, to_host32(*(const uint32_t *)(page + pos + local)), max_pages);
+        }
+    }
+
+    if (interior) {
+        push_page(children, to_host32(*(const uint32_t *)(header + 8)), 0);
+    }
+}
+
+// Marks every page of the queued overflow chains as owned by owner. All
+// chains advance one page per round, so each round's next pointers are
+// read as one batch.
+static void follow_overflow_chains(PageOwnerMap *map, uint32_t owner, PageList *chains) {
+    while (chains->count) {
+        uint32_t kept = 0;
+        for (uint32_t start = 0; start < chains->count; start += PAGE_READER_DEPTH) {
+            uint32_t count = chains->count - start < PAGE_READER_DEPTH ? chains->count - start : PAGE_READER_DEPTH;
+            uint32_t *pages = chains->pages + start;
+            for (uint32_t i = 0; i < count; i++) {
+                if (pages[i] == 0 || !ensure_capacity(map, pages[i])) {
+                    pages[i] = 0;
+                    continue;
+                }
+                set_owner(map, pages[i], owner);
+                if (--chains->budgets[start + i] == 0) {
+                    pages[i] = 0;
+                }
+            }
+            const uint8_t *images[PAGE_READER_DEPTH];
+            for (uint32_t i = 0; i < count; i++) {
+                images[i] = pages[i] ? wal_copy(map, pages[i]) : NULL;
+            }
+            read_page_batch(map, pages, count, sizeof(uint32_t), images);
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t next = images[i] ? to_host32(*(const uint32_t *)images[i]) : 0;
+                if (next != 0) {
+                    chains->budgets[kept] = chains->budgets[start + i];
+                    chains->pages[kept++] = next;
+                }
+            }
+        }
+        chains->count = kept;
+    }
+}
+
+// Marks a b-tree page and everything below it as owned by btree_index.
+// Goes one level at a time so the database pages of a level, like each
+// round of overflow chain steps, are read PAGE_READER_DEPTH at a time
+// rather than one by one.
+static void walk_btree(PageOwnerMap *map, uint32_t btree_index, uint32_t page_number) {
+    PageList level = { 0 }, children = { 0 }, chains = { 0 };
+    push_page(&level, page_number, 0);
+    for (int depth = 0; depth < MAX_BTREE_DEPTH && level.count; depth++) {
+        for (uint32_t start = 0; start < level.count; start += PAGE_READER_DEPTH) {
+            uint32_t count = level.count - start < PAGE_READER_DEPTH ? level.count - start : PAGE_READER_DEPTH;
+            uint32_t *pages = level.pages + start;
+            for (uint32_t i = 0; i < count; i++) {
+                if (!ensure_capacity(map, pages[i])) {
+                    pages[i] = 0;
+                    continue;
+                }
+                // The parent pointer alone settles ownership, even if this page is not
+                // readable yet (e.g. its WAL frame comes later in the same transaction)
+                set_owner(map, pages[i], btree_index + 1);
+            }
+            const uint8_t *images[PAGE_READER_DEPTH];
+            const uint8_t *pinned[PAGE_READER_DEPTH];
+            fetch_page_batch(map, pages, count, images, pinned);
+            for (uint32_t i = 0; i < count; i++) {
+                if (images[i]) {
+                    scan_btree_page(map, pages[i], images[i], &children, &chains);
+                }
+            }
+            page_cache_unpin(&map->cache, pinned, count);
+        }
+        PageList walked = level;
+        level = children;
+        children = walked;
+        children.count = 0;
+    }
+    follow_overflow_chains(map, btree_index + 1, &chains);
+    free(level.pages);
+    free(level.budgets);
+    free(children.pages);
+    free(children.budgets);
+    free(chains.pages);
+    free(chains.budgets);
+}
+
+// Copies a whole cell payload, following its overflow chain. Returns the
+// number of bytes assembled or -1 on a broken chain.
+static int64_t assemble_payload(PageOwnerMap *map, const uint8_t *local_data, uint32_t local,
+                                int64_t payload_size, uint32_t overflow, int depth, uint8_t *out) {
+    memcpy(out, local_data, local);
+    int64_t copied = local;
+    while (copied < payload_size) {
+        const uint8_t *page = read_page(map, overflow, depth);
+        if (!page) {
+            return -1;
+        }
+        int64_t chunk = payload_size - copied;
+        if (chunk > map->usable_size - 4) {
+            chunk = map->usable_size - 4;
+        }
+        memcpy(out + copied, page + 4, chunk);
+        copied += chunk;
+        overflow = to_host32(*(const uint32_t *)page);
+    }
+    return copied;
+}
+
+// Locates column `column` of a record. Returns 0 and fills data/length/serial.
+static int record_column(const uint8_t *payload, size_t size, uint32_t column,
+                         const uint8_t **data, uint32_t *length, int64_t *serial) {
+    size_t pos = 0;
+    int bytes_read;
+    int64_t header_size = parse_varint(payload, &pos, size, &bytes_read);
+    if (header_size < 0 || (size_t)header_size > size) {
+        return -1;
+    }
+    size_t body = header_size;
+    for (uint32_t i = 0; pos < (size_t)header_size; i++) {
+        int64_t serial_type = parse_varint(payload, &pos, header_size, &bytes_read);
+        if (serial_type < 0 || serial_type == 10 || serial_type == 11) {
+            return -1;
+        }
+        static const uint8_t fixed_lengths[] = {0, 1, 2, 3, 4, 6, 8, 8, 0, 0};
+        uint32_t field_length = serial_type >= 12 ? (uint32_t)((serial_type - 12) / 2) : fixed_lengths[serial_type];
+        if (i == column) {
+            if (body + field_length > size) {
+                return -1;
+            }
+            *data = payload + body;
+            *length = field_length;
+            *serial = serial_type;
+            return 0;
+        }
+        body += field_length;
+    }
+    return -1;
+}
+
+// Decodes an integer column of a schema record
+static int64_t record_integer(const uint8_t *data, int64_t serial) {
+    static const uint8_t widths[] = {0, 1, 2, 3, 4, 6, 8};
+    if (serial == 8) return 0;
+    if (serial == 9) return 1;
+    if (serial < 1 || serial > 6) return -1;
+    int64_t value = (int8_t)data[0];
+    for (int i = 1; i < widths[serial]; i++) {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+// Adds one sqlite_schema row with a b-tree (tables and indexes) to the list
+static void collect_schema_row(const uint8_t *payload, size_t size, BtreeInfo **list, uint32_t *count) {
+    const uint8_t *type, *name, *root;
+    uint32_t type_length, name_length, root_length;
+    int64_t type_serial, name_serial, root_serial;
+    if (record_column(payload, size, 0, &type, &type_length, &type_serial) != 0 ||
+        record_column(payload, size, 1, &name, &name_length, &name_serial) != 0 ||
+        record_column(payload, size, 3, &root, &root_length, &root_serial) != 0) {
+        return;
+    }
+    int64_t root_page = record_integer(root, root_serial);
+    if (root_page <= 0) {
+        return; // Views and triggers own no pages
+    }
+    BtreeInfo *grown = realloc(*list, (*count + 1) * sizeof(BtreeInfo));
+    if (!grown) {
+        report_error("Failed to allocate memory for schema entry", 0);
+        return;
+    }
+    *list = grown;
+    BtreeInfo *info = &grown[*count];
+    info->name = strndup((const char *)name, name_length);
+    info->root_page = (uint32_t)root_page;
+    info->is_index = type_length == 5 && memcmp(type, "index", 5) == 0;
+    info->watched = 0;
+    if (info->name) {
+        (*count)++;
+    }
+}
+
+// Walks the sqlite_schema b-tree and collects every table and index root
+static void walk_schema(PageOwnerMap *map, uint32_t page_number, int depth, BtreeInfo **list, uint32_t *count) {
+    // Leaves need two buffers: one for the page and one for overflow reads
+    if (depth + 1 >= MAX_BTREE_DEPTH) {
+        return;
+    }
+    const uint8_t *page = read_page(map, page_number, depth);
+    if (!page) {
+        return;
+    }
+    const uint8_t *header = page + (page_number == 1 ? 100 : 0);
+    uint8_t page_type = header[0];
+    uint16_t cell_count = to_host16(*(const uint16_t *)(header + 3));
+    const uint8_t *pointers = header + (page_type == 0x05 ? 12 : 8);
+    if (pointers + cell_count * 2 > page + map->page_size) {
+        return;
+    }
+    if (page_type == 0x05) {
+        for (uint16_t i = 0; i < cell_count; i++) {
+            uint16_t offset = to_host16(*(const uint16_t *)(pointers + i * 2));
+            if (offset + 4 <= map->page_size) {
+                walk_schema(map, to_host32(*(const uint32_t *)(page + offset)), depth + 1, list, count);
+            }
+        }
+        walk_schema(map, to_host32(*(const uint32_t *)(header + 8)), depth + 1, list, count);
+        return;
+    }
+    if (page_type != 0x0D) {
+        return;
+    }
+
+    for (uint16_t i = 0; i < cell_count; i++) {
+        size_t pos = to_host16(*(const uint16_t *)(pointers + i * 2));
+        if (pos >= map->page_size) {
+            continue;
+        }
+        int bytes_read;
+        int64_t payload_size = parse_varint(page, &pos, map->page_size, &bytes_read);
+        if (payload_size <= 0 || payload_size > MAX_SCHEMA_RECORD ||
+            parse_varint(page, &pos, map->page_size, &bytes_read) < 0) {
+            continue;
+        }
+        uint32_t local = btree_local_payload(page_type, payload_size, map->usable_size);
+        if (pos + local + (local < payload_size ? 4 : 0) > map->page_size) {
+            continue;
+        }
+        uint32_t overflow = local < payload_size ? to_host32(*(const uint32_t *)(page + pos + local)) : 0;
+        uint8_t *payload = malloc(payload_size);
+        if (!payload) {
+            continue;
+        }
+        if (assemble_payload(map, page + pos, local, payload_size, overflow, depth + 1, payload) == payload_size) {
+            collect_schema_row(payload, payload_size, list, count);
+        }
+        free(payload);
+    }
+}
+
+// Clears every page currently attributed to a b-tree
+static void clear_btree_pages(PageOwnerMap *map, uint32_t btree_index) {
+    for (uint32_t page = 0; page < map->capacity; page++) {
+        if (map->owners[page] == btree_index + 1) {
+            set_owner(map, page, 0);
+        }
+    }
+}
+
+// Re-reads sqlite_schema and walks only b-trees that are new or moved
+static void refresh_schema(PageOwnerMap *map) {
+    BtreeInfo *list = NULL;
+    uint32_t count = 0;
+    walk_schema(map, 1, 0, &list, &count);
+    walk_btree(map, 0, 1);
+
+    // Drop b-trees that disappeared from the schema
+    for (uint32_t i = 1; i < map->btree_count; i++) {
+        BtreeInfo *old = &map->btrees[i];
+        if (old->root_page == 0) {
+            continue;
+        }
+        int found = 0;
+        for (uint32_t j = 0; j < count && !found; j++) {
+            found = list[j].root_page == old->root_page && strcmp(list[j].name, old->name) == 0;
+        }
+        if (!found) {
+            clear_btree_pages(map, i);
+            old->root_page = 0;
+        }
+    }
+
+    // Add and walk new ones; existing b-trees keep their index
+    for (uint32_t j = 0; j < count; j++) {
+        int found = 0;
+        for (uint32_t i = 1; i < map->btree_count && !found; i++) {
+            found = map->btrees[i].root_page == list[j].root_page && strcmp(map->btrees[i].name, list[j].name) == 0;
+        }
+        if (found) {
+            free(list[j].name);
+            continue;
+        }
+        BtreeInfo *grown = realloc(map->btrees, (map->btree_count + 1) * sizeof(BtreeInfo));
+        if (!grown) {
+            report_error("Failed to allocate memory for schema entry", 0);
+            free(list[j].name);
+            continue;
+        }
+        map->btrees = grown;
+        map->btrees[map->btree_count] = list[j];
+        map->btrees[map->btree_count].watched = (uint8_t)is_watched_name(map, list[j].name);
+        walk_btree(map, map->btree_count, list[j].root_page);
+        map->btree_count++;
+    }
+    free(list);
+}
+
+// Builds the ownership map for a database by walking every b-tree once
+int page_owner_open(PageOwnerMap *map, const char *db_filename) {
+    memset(map, 0, sizeof(*map));
+    map->fd = open(db_filename, O_RDONLY | O_CLOEXEC);
+    if (map->fd < 0) {
+        report_error("Failed to open database file", 0);
+        return -1;
+    }
+
+    uint8_t header[100];
+    struct stat st;
+    if (fstat(map->fd, &st) != 0 || pread(map->fd, header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header, "SQLite format 3", 16) != 0) {
+        close(map->fd);
+        map->fd = -1;
+        return -1;
+    }
+    uint16_t raw_page_size = to_host16(*(const uint16_t *)(header + 16));
+    map->page_size = raw_page_size == 1 ? 65536 : raw_page_size;
+    map->usable_size = map->page_size - header[20];
+
+    map->scratch = malloc((size_t)MAX_BTREE_DEPTH * map->page_size);
+    map->batch = malloc((size_t)PAGE_READER_DEPTH * map->page_size);
+    map->btrees = malloc(sizeof(BtreeInfo));
+    if (!map->scratch || !map->batch || !map->btrees || !ensure_capacity(map, st.st_size / map->page_size + 1)) {
+        page_owner_close(map);
+        report_error("Failed to allocate page ownership map", 0);
+        return -1;
+    }
+    map->btrees[0].name = strdup(SCHEMA_BTREE_NAME);
+    map->btrees[0].root_page = 1;
+    map->btrees[0].is_index = 0;
+    map->btrees[0].watched = 0;
+    map->btree_count = 1;
+    if (page_cache_init(&map->cache, map->fd, map->page_size, 0) != 0) {
+        page_owner_close(map);
+        return -1;
+    }
+    page_reader_init(&map->reader, map->fd, map->batch, (size_t)PAGE_READER_DEPTH * map->page_size);
+
+    refresh_schema(map);
+    return 0;
+}
+
+// Returns the index of the b-tree owning a page, or -1 if unknown
+int page_owner_btree(const PageOwnerMap *map, uint32_t page_number) {
+    if (!map || page_number >= map->capacity || map->owners[page_number] == 0) {
+        return -1;
+    }
+    return (int)map->owners[page_number] - 1;
+}
+
+// Returns the table or index name owning a page, or NULL if unknown
+const char *page_owner_lookup(const PageOwnerMap *map, uint32_t page_number) {
+    int btree = page_owner_btree(map, page_number);
+    return btree < 0 ? NULL : map->btrees[btree].name;
+}
+
+// Drops the applied WAL frames; they refer to a reader no longer in use
+static void forget_wal_frames(PageOwnerMap *map) {
+    if (map->wal_frames) {
+        memset(map->wal_frames, 0, map->capacity * sizeof(uint32_t));
+    }
+    map->wal = NULL;
+}
+
+// Walks the children of an unwatched b-tree's interior page that the map
+// gives to another b-tree, such as pages a watched table freed and this
+// one reused. Children it already owns are left alone, so only pages
+// whose owner changed are read.
+static void adopt_children(PageOwnerMap *map, uint32_t btree_index, uint32_t page_number, const uint8_t *page) {
+    PageList children = { 0 }, chains = { 0 };
+    scan_btree_page(map, page_number, page, &children, &chains);
+    for (uint32_t i = 0; i < children.count; i++) {
+        if (page_owner_btree(map, children.pages[i]) != (int)btree_index) {
+            walk_btree(map, btree_index, children.pages[i]);
+        }
+    }
+    free(children.pages);
+    free(children.budgets);
+    free(chains.pages);
+    free(chains.budgets);
+}
+
+// Records a WAL frame as the newest copy of its page and rebuilds whatever
+// part of the map it can affect: the schema for sqlite_schema pages, the
+// subtree below a rewritten interior page, or a leaf's overflow chains.
+// While watching, other b-trees' interior pages only claim the children
+// that changed owner, and their leaves are not walked at all.
+void page_owner_apply_frame(PageOwnerMap *map, const WalReader *reader, const WalFrameView *frame) {
+    uint32_t page_number = frame->header.page_number;
+    if (!ensure_capacity(map, page_number)) {
+        return;
+    }
+    if (map->wal != reader) {
+        forget_wal_frames(map);
+        map->wal = reader;
+    }
+    map->wal_frames[page_number] = frame->frame_number;
+
+    int owner = page_owner_btree(map, page_number);
+    if (page_number == 1 || owner == 0) {
+        refresh_schema(map);
+        return;
+    }
+    if (owner > 0 && (!map->watched || map->btrees[owner].watched)) {
+        walk_btree(map, owner, page_number);
+    } else if (owner > 0) {
+        adopt_children(map, (uint32_t)owner, page_number, frame->page_data);
+    }
+}
+
+// Forgets applied WAL frames, e.g. after the WAL was reset by a checkpoint.
+// The checkpoint may have copied any of them into the database file, so
+// the page cache is emptied as well.
+void page_owner_reset_wal(PageOwnerMap *map) {
+    forget_wal_frames(map);
+    page_cache_invalidate(&map->cache);
+}
+
+// Narrows the map to the b-trees named in names, which must outlive it.
+// A bitmap then tracks the pages they own, and page_owner_apply_frame()
+// stops walking every other b-tree below the pages whose owner changed:
+// that is enough to take back pages a watched b-tree freed, which
+// page_owner_watched() must stop reporting. sqlite_schema is still
+// followed so that watched b-trees created or moved later are picked up.
+int page_owner_watch(PageOwnerMap *map, const char *const *names, uint32_t count) {
+    uint64_t *watched = calloc(map->capacity / 64, sizeof(uint64_t));
+    if (!watched) {
+        report_error("Failed to allocate page bitmap", 0);
+        return -1;
+    }
+    free(map->watched);
+    map->watched = watched;
+    map->watch_names = names;
+    map->watch_count = count;
+    for (uint32_t i = 0; i < map->btree_count; i++) {
+        map->btrees[i].watched = (uint8_t)is_watched_name(map, map->btrees[i].name);
+    }
+    for (uint32_t page = 0; page < map->capacity; page++) {
+        set_owner(map, page, map->owners[page]);
+    }
+    return 0;
+}
+
+// Returns 1 when a watched b-tree owns the page; only valid after
+// page_owner_watch()
+int page_owner_watched(const PageOwnerMap *map, uint32_t page_number) {
+    return page_number < map->capacity && (map->watched[page_number >> 6] >> (page_number & 63) & 1);
+}
+
+// Releases the map and closes the database file
+void page_owner_close(PageOwnerMap *map) {
+    for (uint32_t i = 0; i < map->btree_count; i++) {
+        free(map->btrees[i].name);
+    }
+    free(map->btrees);
+    free(map->owners);
+    free(map->wal_frames);
+    page_reader_free(&map->reader);
+    page_cache_free(&map->cache);
+    free(map->scratch);
+    free(map->batch);
+    free(map->watched);
+    if (map->fd >= 0) {
+        close(map->fd);
+    }
+    memset(map, 0, sizeof(*map));
+    map->fd = -1;
+}
@@ -0,0 +1,49 @@
+#ifndef PAGE_OWNER_H
+#define PAGE_OWNER_H
+
+#include "page_cache.h"
+#include "page_reader.h"
+#include "wal_reader.h"
+#include <stdint.h>
+
+#define SCHEMA_BTREE_NAME "sqlite_schema"
+
+typedef struct {
+    char* name;            // Table or index name from sqlite_schema
+    uint32_t root_page;    // 0 once the b-tree has been dropped
+    uint8_t is_index;
+    uint8_t watched;       // Named in page_owner_watch()
+} BtreeInfo;
+
+// Maps every page of a database to the b-tree that owns it. Built once by
+// walking each b-tree from its root, then patched as WAL frames arrive.
+// Its page cache is shared with everything else reading the database file.
+typedef struct {
+    int fd;                     // Main database file
+    uint32_t page_size;
+    uint32_t usable_size;       // Page size minus reserved bytes
+    uint32_t capacity;          // Entries in owners[] and wal_frames[]
+    uint32_t* owners;           // owners[page] = btree index + 1, 0 if unknown
+    uint32_t* wal_frames;       // Latest applied WAL frame for each page, 0 if none
+    const WalReader* wal;       // Reader the wal_frames[] entries refer to
+    BtreeInfo* btrees;
+    uint32_t btree_count;
+    uint8_t* scratch;           // One page buffer per b-tree level
+    uint8_t* batch;             // PAGE_READER_DEPTH page buffers for reads around the cache
+    PageReader reader;          // Reads batches into batch, registered with io_uring
+    PageCache cache;            // Main-database pages; emptied by page_owner_reset_wal()
+    uint64_t* watched;          // Bit per page owned by a watched b-tree; NULL when not watching
+    const char* const* watch_names;
+    uint32_t watch_count;
+} PageOwnerMap;
+
+int page_owner_open(PageOwnerMap* map, const char* db_filename);
+const char* page_owner_lookup(const PageOwnerMap* map, uint32_t page_number);
+int page_owner_btree(const PageOwnerMap* map, uint32_t page_number);
+void page_owner_apply_frame(PageOwnerMap* map, const WalReader* reader, const WalFrameView* frame);
+void page_owner_reset_wal(PageOwnerMap* map);
+int page_owner_watch(PageOwnerMap* map, const char* const* names, uint32_t count);
+int page_owner_watched(const PageOwnerMap* map, uint32_t page_number);
+void page_owner_close(PageOwnerMap* map);
+
+#endif
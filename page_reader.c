@@ -0,0 +1,245 @@
+#include "page_reader.h"
+#include "utils.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register)
+#define PAGE_READER_HAVE_URING 1
+#endif
+#endif
+#endif
+
+static PageReaderBackend preferred_backend = PAGE_READER_URING;
+
+#ifdef PAGE_READER_HAVE_URING
+
+// The kernel interface has no libc wrappers; these are the raw system calls
+static int uring_setup(uint32_t entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int ring_fd, uint32_t submit, uint32_t min_complete, uint32_t flags) {
+    return (int)syscall(__NR_io_uring_enter, ring_fd, submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int ring_fd, uint32_t opcode, const void *arg, uint32_t count) {
+    return (int)syscall(__NR_io_uring_register, ring_fd, opcode, arg, count);
+}
+
+// Unmaps the rings and closes the instance, which also drops its registered buffers
+static void stop_uring(PageReader *reader) {
+    if (reader->sqes) {
+        munmap(reader->sqes, reader->sqes_size);
+    }
+    if (reader->cq_ring && reader->cq_ring != reader->sq_ring) {
+        munmap(reader->cq_ring, reader->cq_ring_size);
+    }
+    if (reader->sq_ring) {
+        munmap(reader->sq_ring, reader->sq_ring_size);
+    }
+    close(reader->ring_fd);
+    reader->ring_fd = -1;
+    reader->sq_ring = reader->cq_ring = reader->sqes = NULL;
+    reader->registered = NULL;
+    reader->registered_size = 0;
+    reader->backend = PAGE_READER_PREAD;
+}
+
+// Creates the ring and maps its queues; leaves the reader on pread when any step fails
+static void start_uring(PageReader *reader, uint8_t *registered, size_t registered_size) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int ring_fd = uring_setup(PAGE_READER_DEPTH, &params);
+    if (ring_fd < 0) {
+        return; // ENOSYS on old kernels, EPERM where io_uring is disabled
+    }
+    reader->ring_fd = ring_fd;
+    reader->backend = PAGE_READER_URING;
+    reader->depth = params.sq_entries;
+
+    reader->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    reader->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    int single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && reader->cq_ring_size > reader->sq_ring_size) {
+        reader->sq_ring_size = reader->cq_ring_size;
+    }
+    reader->sq_ring = mmap(NULL, reader->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           ring_fd, IORING_OFF_SQ_RING);
+    if (reader->sq_ring == MAP_FAILED) {
+        reader->sq_ring = NULL;
+        stop_uring(reader);
+        return;
+    }
+    reader->cq_ring = single_mmap ? reader->sq_ring
+                                  : mmap(NULL, reader->cq_ring_size, PROT_READ | PROT_WRITE,
+                                         MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    if (reader->cq_ring == MAP_FAILED) {
+        reader->cq_ring = NULL;
+        stop_uring(reader);
+        return;
+    }
+    reader->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    reader->sqes = mmap(NULL, reader->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring_fd, IORING_OFF_SQES);
+    if (reader->sqes == MAP_FAILED) {
+        reader->sqes = NULL;
+        stop_uring(reader);
+        return;
+    }
+
+    uint8_t *sq = reader->sq_ring;
+    uint8_t *cq = reader->cq_ring;
+    reader->sq_head = (uint32_t *)(sq + params.sq_off.head);
+    reader->sq_tail = (uint32_t *)(sq + params.sq_off.tail);
+    reader->sq_mask = *(uint32_t *)(sq + params.sq_off.ring_mask);
+    reader->sq_array = (uint32_t *)(sq + params.sq_off.array);
+    reader->cq_head = (uint32_t *)(cq + params.cq_off.head);
+    reader->cq_tail = (uint32_t *)(cq + params.cq_off.tail);
+    reader->cq_mask = *(uint32_t *)(cq + params.cq_off.ring_mask);
+    reader->cqes = cq + params.cq_off.cqes;
+
+    // Registration counts against RLIMIT_MEMLOCK and may be refused; plain reads still work then
+    if (registered && registered_size) {
+        struct iovec region = { registered, registered_size };
+        if (uring_register(ring_fd, IORING_REGISTER_BUFFERS, &region, 1) == 0) {
+            reader->registered = registered;
+            reader->registered_size = registered_size;
+        }
+    }
+}
+
+// Queues one read; READ_FIXED when its buffer lies inside the registered region
+static void queue_read(PageReader *reader, const PageRead *read, uint64_t tag) {
+    uint32_t tail = *reader->sq_tail;
+    uint32_t index = tail & reader->sq_mask;
+    struct io_uring_sqe *sqe = &((struct io_uring_sqe *)reader->sqes)[index];
+    memset(sqe, 0, sizeof(*sqe));
+    int fixed = reader->registered && read->buffer >= reader->registered &&
+                read->buffer + read->length <= reader->registered + reader->registered_size;
+    sqe->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = reader->fd;
+    sqe->off = read->offset;
+    sqe->addr = (uint64_t)(uintptr_t)read->buffer;
+    sqe->len = read->length;
+    sqe->buf_index = 0;
+    sqe->user_data = tag;
+    reader->sq_array[index] = index;
+    // The kernel reads the entry once it sees the new tail
+    __atomic_store_n(reader->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// Moves finished reads from the completion queue into their results
+static uint32_t reap_reads(PageReader *reader, PageRead *reads) {
+    uint32_t head = *reader->cq_head;
+    uint32_t tail = __atomic_load_n(reader->cq_tail, __ATOMIC_ACQUIRE);
+    uint32_t reaped = 0;
+    for (; head != tail; head++, reaped++) {
+        const struct io_uring_cqe *cqe = &((const struct io_uring_cqe *)reader->cqes)[head & reader->cq_mask];
+        reads[cqe->user_data].result = cqe->res;
+    }
+    __atomic_store_n(reader->cq_head, head, __ATOMIC_RELEASE);
+    return reaped;
+}
+
+// Keeps up to depth reads in flight until all count have completed. Gives
+// up on the ring if the kernel rejects it; unfinished reads are then left
+// failed for page_reader_read() to redo with pread.
+static void uring_read(PageReader *reader, PageRead *reads, uint32_t count) {
+    uint32_t submitted = 0;
+    uint32_t completed = 0;
+    while (completed < count) {
+        while (submitted < count && submitted - completed < reader->depth) {
+            reads[submitted].result = -EINPROGRESS;
+            queue_read(reader, &reads[submitted], submitted);
+            submitted++;
+        }
+        uint32_t unsubmitted = *reader->sq_tail - __atomic_load_n(reader->sq_head, __ATOMIC_ACQUIRE);
+        if (uring_enter(reader->ring_fd, unsubmitted, 1, IORING_ENTER_GETEVENTS) < 0 &&
+            errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            // A read still in flight can only land the same file bytes the retry reads
+            for (uint32_t i = submitted; i < count; i++) {
+                reads[i].result = -errno;
+            }
+            stop_uring(reader);
+            return;
+        }
+        completed += reap_reads(reader, reads);
+    }
+}
+
+#endif
+
+// Sets up a reader over fd, registering [registered, registered + size)
+// with the ring when possible. Falls back to pread instead of failing.
+void page_reader_init(PageReader *reader, int fd, uint8_t *registered, size_t registered_size) {
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = fd;
+    reader->ring_fd = -1;
+    reader->backend = PAGE_READER_PREAD;
+#ifdef PAGE_READER_HAVE_URING
+    if (preferred_backend == PAGE_READER_URING) {
+        start_uring(reader, registered, registered_size);
+    }
+#else
+    (void)registered;
+    (void)registered_size;
+#endif
+}
+
+// Runs every read and fills in its result; returns how many read their
+// full length. A read io_uring fails, e.g. a kernel without
+// IORING_OP_READ, is redone with pread.
+uint32_t page_reader_read(PageReader *reader, PageRead *reads, uint32_t count) {
+#ifdef PAGE_READER_HAVE_URING
+    if (reader->backend == PAGE_READER_URING) {
+        uring_read(reader, reads, count);
+    }
+#endif
+    uint32_t complete = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        PageRead *read = &reads[i];
+        if (reader->backend != PAGE_READER_URING || read->result < 0) {
+            ssize_t bytes = pread(reader->fd, read->buffer, read->length, (off_t)read->offset);
+            read->result = bytes < 0 ? -errno : (int32_t)bytes;
+        }
+        if (read->result == (int32_t)read->length) {
+            complete++;
+        }
+    }
+    return complete;
+}
+
+// Returns the backend a reader ended up with, "io_uring" or "pread"
+const char *page_reader_name(const PageReader *reader) {
+    return reader->backend == PAGE_READER_URING ? "io_uring" : "pread";
+}
+
+// Chooses the backend for readers set up afterwards ("io_uring" or "pread"); -1 if unknown
+int page_reader_set_backend(const char *name) {
+    if (strcmp(name, "io_uring") == 0) {
+        preferred_backend = PAGE_READER_URING;
+        return 0;
+    }
+    if (strcmp(name, "pread") == 0) {
+        preferred_backend = PAGE_READER_PREAD;
+        return 0;
+    }
+    return -1;
+}
+
+// Tears down the ring, if any; the file descriptor belongs to the caller
+void page_reader_free(PageReader *reader) {
+#ifdef PAGE_READER_HAVE_URING
+    if (reader->backend == PAGE_READER_URING) {
+        stop_uring(reader);
+    }
+#endif
+    reader->backend = PAGE_READER_PREAD;
+}
@@ -0,0 +1,67 @@
+#ifndef PAGE_READER_H
+#define PAGE_READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Reads a batch keeps in flight at once
+#define PAGE_READER_DEPTH 64
+
+typedef enum {
+    PAGE_READER_PREAD = 0,
+    PAGE_READER_URING
+} PageReaderBackend;
+
+// One positioned read of a batch
+typedef struct {
+    uint8_t* buffer;
+    uint64_t offset;
+    uint32_t length;
+    int32_t result;             // Bytes read, or -errno
+} PageRead;
+
+// Reads batches of pages from one file. With io_uring, up to
+// PAGE_READER_DEPTH reads are in flight at once and a batch costs a system
+// call per round rather than per page; buffers inside the registered region
+// are read with READ_FIXED, which skips pinning their memory on every read.
+// Where io_uring is missing or refused (old kernels, seccomp filters, or
+// page_reader_set_backend("pread")) every read is a plain pread.
+typedef struct {
+    int fd;
+    PageReaderBackend backend;
+    int ring_fd;
+    uint32_t depth;             // Submission queue entries
+    uint8_t* registered;        // Buffer region registered with the ring, NULL if none
+    size_t registered_size;
+    void* sq_ring;              // Rings and entries shared with the kernel
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    void* sqes;
+    size_t sqes_size;
+    uint32_t* sq_head;
+    uint32_t* sq_tail;
+    uint32_t* sq_array;
+    uint32_t sq_mask;
+    uint32_t* cq_head;
+    uint32_t* cq_tail;
+    void* cqes;
+    uint32_t cq_mask;
+} PageReader;
+
+// Sets up a reader over fd, registering [registered, registered + size)
+// with the ring when possible. Falls back to pread instead of failing.
+void page_reader_init(PageReader* reader, int fd, uint8_t* registered, size_t registered_size);
+
+// Runs every read and fills in its result; returns how many read their full length
+uint32_t page_reader_read(PageReader* reader, PageRead* reads, uint32_t count);
+
+// Returns the backend a reader ended up with, "io_uring" or "pread"
+const char* page_reader_name(const PageReader* reader);
+
+// Chooses the backend for readers set up afterwards ("io_uring" or "pread"); -1 if unknown
+int page_reader_set_backend(const char* name);
+
+void page_reader_free(PageReader* reader);
+
+#endif
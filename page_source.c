@@ -0,0 +1,81 @@
+#include "page_source.h"
+#include <stdint.h>
+
+// Sets up a source over a WAL index and a database page cache; either may be NULL
+void page_source_init(PageSource *source, const WalReader *wal, const FrameIndex *index,
+                      PageCache *cache, uint32_t page_size, uint32_t usable_size) {
+    source->wal = wal;
+    source->index = wal ? index : NULL;
+    source->cache = cache;
+    source->page_size = page_size;
+    source->usable_size = usable_size ? usable_size : page_size;
+    source->max_frame = 0;
+}
+
+// Returns a copy of source that sees every frame up to the end of
+// frame_number's transaction. Overflow pages are written by the same
+// transaction as the cell that points at them, possibly in later frames.
+// A transaction that never committed runs to the last frame.
+PageSource page_source_at_frame(const PageSource *source, uint32_t frame_number) {
+    PageSource scoped = *source;
+    if (source->index) {
+        uint32_t commit_frame = frame_index_commit_covering(source->index, frame_number);
+        scoped.max_frame = commit_frame ? commit_frame : source->index->last_frame;
+    }
+    return scoped;
+}
+
+// Returns the contents of a page: a pointer into the WAL mapping when a
+// visible frame holds the page, otherwise buffer filled from the database
+// file. buffer must hold page_size bytes. Returns NULL if neither has it.
+const uint8_t *page_source_read(const PageSource *source, uint32_t page_number, uint8_t *buffer) {
+    if (source->index) {
+        uint32_t frame_number = source->max_frame
+            ? frame_index_find(source->index, page_number, source->max_frame)
+            : frame_index_lookup(source->index, page_number, UINT32_MAX);
+        WalFrameView frame;
+        if (frame_number && wal_reader_frame(source->wal, frame_number, &frame) == 0) {
+            return frame.page_data;
+        }
+    }
+    if (source->cache && page_cache_read(source->cache, page_number, buffer) == 0) {
+        return buffer;
+    }
+    return NULL;
+}
+
+// Returns the version of a page as it was before frame_number: the newest
+// earlier WAL frame holding it, else the database file. NULL if the page
+// did not exist yet.
+const uint8_t *page_source_previous(const PageSource *source, uint32_t page_number, uint32_t frame_number,
+                                    uint8_t *buffer) {
+    if (source->index && frame_number > 1) {
+        uint32_t previous = frame_index_find(source->index, page_number, frame_number - 1);
+        WalFrameView frame;
+        if (previous && wal_reader_frame(source->wal, previous, &frame) == 0) {
+            return frame.page_data;
+        }
+    }
+    if (source->cache && page_cache_read(source->cache, page_number, buffer) == 0) {
+        return buffer;
+    }
+    return NULL;
+}
+
+// Warms the cache with the database copies page_source_previous() will
+// need for these pages, skipping pages with an earlier WAL frame. The
+// list is compacted in place.
+void page_source_prefetch_previous(const PageSource *source, uint32_t *pages, uint32_t count,
+                                   uint32_t frame_number) {
+    if (!source->cache) {
+        return;
+    }
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (!source->index || frame_number <= 1 ||
+            frame_index_find(source->index, pages[i], frame_number - 1) == 0) {
+            pages[kept++] = pages[i];
+        }
+    }
+    page_cache_prefetch(source->cache, pages, kept);
+}
@@ -0,0 +1,31 @@
+#ifndef PAGE_SOURCE_H
+#define PAGE_SOURCE_H
+
+#include "frame_index.h"
+#include "page_cache.h"
+#include "wal_reader.h"
+#include <stdint.h>
+
+// Where pages not in the frame being decoded come from, such as the pages
+// of an overflow chain: the newest visible WAL copy first, then the main
+// database through a page cache. Cheap to copy; decoders take a copy per
+// frame with max_frame narrowed to the end of that frame's transaction.
+typedef struct {
+    const WalReader* wal;
+    const FrameIndex* index;    // NULL to skip the WAL
+    PageCache* cache;           // NULL when the database file is not open
+    uint32_t page_size;
+    uint32_t usable_size;       // Page size minus reserved bytes
+    uint32_t max_frame;         // Newest WAL frame visible even if uncommitted, 0 for the last commit
+} PageSource;
+
+void page_source_init(PageSource* source, const WalReader* wal, const FrameIndex* index,
+                      PageCache* cache, uint32_t page_size, uint32_t usable_size);
+PageSource page_source_at_frame(const PageSource* source, uint32_t frame_number);
+const uint8_t* page_source_read(const PageSource* source, uint32_t page_number, uint8_t* buffer);
+const uint8_t* page_source_previous(const PageSource* source, uint32_t page_number, uint32_t frame_number,
+                                    uint8_t* buffer);
+void page_source_prefetch_previous(const PageSource* source, uint32_t* pages, uint32_t count,
+                                   uint32_t frame_number);
+
+#endif
@@ -0,0 +1,265 @@
+#include "record_view.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const uint8_t fixed_lengths[12] = {0, 1, 2, 3, 4, 6, 8, 8, 0, 0, 0, 0};
+
+// Maps a serial type to the class of value it stores
+SerialClass serial_type_class(int64_t serial_type) {
+    if (serial_type >= 12) {
+        return (serial_type & 1) ? SERIAL_TEXT : SERIAL_BLOB;
+    }
+    switch (serial_type) {
+        case 0: return SERIAL_NULL;
+        case 1: case 2: case 3: case 4: case 5: case 6: case 8: case 9: return SERIAL_INTEGER;
+        case 7: return SERIAL_FLOAT;
+        default: return SERIAL_INVALID;
+    }
+}
+
+// Returns the number of body bytes a serial type occupies
+uint32_t serial_type_length(int64_t serial_type) {
+    if (serial_type >= 12) {
+        return (uint32_t)((serial_type - 12) / 2);
+    }
+    return serial_type >= 0 ? fixed_lengths[serial_type] : 0;
+}
+
+// Builds a view over a parsed table-leaf cell. Offsets for up to
+// CELL_INLINE_COLUMNS columns are kept inline; wider records use the arena,
+// or the heap when arena is NULL (release with record_view_free). source
+// may be NULL, in which case columns on overflow pages are unavailable.
+int record_view_init(RecordView *view, const CellInfo *cell, const uint8_t *page_data,
+                     uint32_t page_size, const PageSource *source, Arena *arena) {
+    view->offsets = view->inline_offsets;
+    view->heap_offsets = 0;
+    view->column_count = 0;
+    view->serial_types = cell->serial_types;
+    view->payload_size = cell->payload_size;
+    view->overflow_page = 0;
+    view->source = source;
+    view->arena = arena;
+    if (cell->payload_size < 0 || cell->record_offset >= page_size) {
+        return -1;
+    }
+    view->payload = page_data + cell->record_offset;
+    uint32_t usable_size = source ? source->usable_size : page_size;
+    uint32_t local = btree_local_payload(0x0D, cell->payload_size, usable_size);
+    if (local > page_size - cell->record_offset) {
+        local = page_size - cell->record_offset;
+    }
+    view->local_size = local;
+    // The local bytes are followed by the number of the first overflow page
+    if (local < cell->payload_size && local + 4 <= page_size - cell->record_offset) {
+        view->overflow_page = to_host32(*(const uint32_t *)(view->payload + local));
+    }
+
+    if (cell->column_count > CELL_INLINE_COLUMNS) {
+        if (arena) {
+            view->offsets = arena_alloc(arena, cell->column_count * sizeof(uint32_t));
+        } else {
+            view->offsets = malloc(cell->column_count * sizeof(uint32_t));
+            view->heap_offsets = view->offsets != NULL;
+        }
+        if (!view->offsets) {
+            view->offsets = view->inline_offsets;
+            report_error("Failed to allocate memory for column offsets", 0);
+            return -1;
+        }
+    }
+
+    // A running sum of lengths; the values themselves are not touched
+    uint64_t body = (uint64_t)cell->header_size;
+    for (uint32_t i = 0; i < cell->column_count; i++) {
+        if (serial_type_class(cell->serial_types[i]) == SERIAL_INVALID) {
+            record_view_free(view);
+            return -1;
+        }
+        view->offsets[i] = (uint32_t)body;
+        body += serial_type_length(cell->serial_types[i]);
+        if (body > (uint64_t)cell->payload_size) {
+            record_view_free(view);
+            return -1;
+        }
+    }
+    view->column_count = cell->column_count;
+    return 0;
+}
+
+// Frees column offsets that record_view_init had to take from the heap
+void record_view_free(RecordView *view) {
+    if (view->heap_offsets) {
+        free(view->offsets);
+        view->heap_offsets = 0;
+    }
+    view->offsets = view->inline_offsets;
+}
+
+// Returns the class of a column, SERIAL_INVALID if out of range
+SerialClass record_column_class(const RecordView *view, uint32_t column) {
+    if (column >= view->column_count) {
+        return SERIAL_INVALID;
+    }
+    return serial_type_class(view->serial_types[column]);
+}
+
+// Returns 1 when a column's bytes are on the page, 0 if they spilled to overflow pages
+int record_column_available(const RecordView *view, uint32_t column) {
+    if (column >= view->column_count) {
+        return 0;
+    }
+    return (uint64_t)view->offsets[column] + serial_type_length(view->serial_types[column]) <= view->local_size;
+}
+
+// Copies length payload bytes starting at offset into dest. Bytes past the
+// local part are read by walking the overflow chain from its first page.
+// Returns 0, or -1 if the chain is missing, broken or too short.
+static int read_payload(const RecordView *view, uint64_t offset, uint32_t length, uint8_t *dest) {
+    if (offset + length > (uint64_t)view->payload_size) {
+        return -1;
+    }
+    if (offset < view->local_size) {
+        uint32_t count = view->local_size - (uint32_t)offset;
+        if (count > length) {
+            count = length;
+        }
+        memcpy(dest, view->payload + offset, count);
+        dest += count;
+        offset += count;
+        length -= count;
+    }
+    if (length == 0) {
+        return 0;
+    }
+    if (!view->source || view->overflow_page == 0 || view->source->usable_size <= 4) {
+        return -1;
+    }
+
+    const PageSource *source = view->source;
+    uint8_t *scratch = view->arena ? arena_alloc(view->arena, source->page_size) : malloc(source->page_size);
+    if (!scratch) {
+        report_error("Failed to allocate memory for overflow page", 0);
+        return -1;
+    }
+    // Every overflow page holds a 4-byte next pointer and usable_size - 4
+    // payload bytes; the page count bounds the walk if the chain loops
+    uint32_t per_page = source->usable_size - 4;
+    uint64_t pages_left = ((uint64_t)view->payload_size - view->local_size + per_page - 1) / per_page;
+    uint64_t chain_offset = view->local_size;     // Payload offset of the current page's first byte
+    uint32_t page_number = view->overflow_page;
+    int result = -1;
+    while (page_number != 0 && pages_left-- > 0) {
+        const uint8_t *page = page_source_read(source, page_number, scratch);
+        if (!page) {
+            report_error("Overflow page not found in WAL or database", 0);
+            break;
+        }
+        if (offset < chain_offset + per_page) {
+            uint32_t start = (uint32_t)(offset - chain_offset);
+            uint32_t count = per_page - start;
+            if (count > length) {
+                count = length;
+            }
+            memcpy(dest, page + 4 + start, count);
+            dest += count;
+            offset += count;
+            length -= count;
+            if (length == 0) {
+                result = 0;
+                break;
+            }
+        }
+        chain_offset += per_page;
+        page_number = to_host32(*(const uint32_t *)page);
+    }
+    if (!view->arena) {
+        free(scratch);
+    }
+    return result;
+}
+
+// Returns a fixed-size column's bytes: in the page when they are local,
+// otherwise copied into copy (at least 8 bytes) from the overflow chain
+static const uint8_t *fixed_column(const RecordView *view, uint32_t column, uint8_t *copy) {
+    if (record_column_available(view, column)) {
+        return view->payload + view->offsets[column];
+    }
+    uint32_t length = serial_type_length(view->serial_types[column]);
+    return read_payload(view, view->offsets[column], length, copy) == 0 ? copy : NULL;
+}
+
+// Reads an integer column; -1 if it is not an integer or cannot be read
+int record_column_int64(const RecordView *view, uint32_t column, int64_t *value) {
+    if (record_column_class(view, column) != SERIAL_INTEGER) {
+        return -1;
+    }
+    int64_t serial_type = view->serial_types[column];
+    if (serial_type == 8 || serial_type == 9) {
+        *value = serial_type - 8;
+        return 0;
+    }
+    uint8_t copy[8];
+    const uint8_t *data = fixed_column(view, column, copy);
+    if (!data) {
+        return -1;
+    }
+    // Big-endian two's complement; the first byte carries the sign
+    uint32_t length = serial_type_length(serial_type);
+    int64_t result = (int8_t)data[0];
+    for (uint32_t i = 1; i < length; i++) {
+        result = (int64_t)((uint64_t)result << 8) | data[i];
+    }
+    *value = result;
+    return 0;
+}
+
+// Reads a FLOAT64 column, stored as a big-endian IEEE 754 double
+int record_column_double(const RecordView *view, uint32_t column, double *value) {
+    if (record_column_class(view, column) != SERIAL_FLOAT) {
+        return -1;
+    }
+    uint8_t copy[8];
+    const uint8_t *data = fixed_column(view, column, copy);
+    if (!data) {
+        return -1;
+    }
+    uint64_t bits;
+    memcpy(&bits, data, sizeof(bits));
+    bits = to_host64(bits);
+    memcpy(value, &bits, sizeof(*value));
+    return 0;
+}
+
+// Points at a TEXT or BLOB column inside the page; nothing is copied, so
+// columns on overflow pages fail (see record_column_fetch)
+int record_column_bytes(const RecordView *view, uint32_t column, const uint8_t **data, uint32_t *length) {
+    SerialClass class = record_column_class(view, column);
+    if ((class != SERIAL_TEXT && class != SERIAL_BLOB) || !record_column_available(view, column)) {
+        return -1;
+    }
+    *data = view->payload + view->offsets[column];
+    *length = serial_type_length(view->serial_types[column]);
+    return 0;
+}
+
+// Returns a TEXT or BLOB column wherever it is stored. Local values point
+// into the page as with record_column_bytes; values that reach into the
+// overflow chain are assembled in the view's arena, which must be set.
+int record_column_fetch(const RecordView *view, uint32_t column, const uint8_t **data, uint32_t *length) {
+    if (record_column_bytes(view, column, data, length) == 0) {
+        return 0;
+    }
+    SerialClass class = record_column_class(view, column);
+    if ((class != SERIAL_TEXT && class != SERIAL_BLOB) || !view->arena) {
+        return -1;
+    }
+    uint32_t size = serial_type_length(view->serial_types[column]);
+    uint8_t *copy = arena_alloc(view->arena, size ? size : 1);
+    if (!copy || read_payload(view, view->offsets[column], size, copy) != 0) {
+        return -1;
+    }
+    *data = copy;
+    *length = size;
+    return 0;
+}
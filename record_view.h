@@ -0,0 +1,48 @@
+#ifndef RECORD_VIEW_H
+#define RECORD_VIEW_H
+
+#include "arena.h"
+#include "page_analyzer.h"
+#include "page_source.h"
+#include <stdint.h>
+
+typedef enum {
+    SERIAL_NULL = 0,
+    SERIAL_INTEGER,             // Serial types 1-6, 8 and 9
+    SERIAL_FLOAT,               // Serial type 7
+    SERIAL_BLOB,                // Even serial types from 12
+    SERIAL_TEXT,                // Odd serial types from 13
+    SERIAL_INVALID              // Reserved types 10 and 11, or negative
+} SerialClass;
+
+// Zero-copy view of one record. Column offsets are computed once from the
+// serial types; values are decoded only when an accessor asks for them and
+// point straight into the page buffer. Columns that spilled onto overflow
+// pages are read through the page source, and only when asked for.
+typedef struct RecordView {
+    const uint8_t* payload;     // Record start (header size varint) in the page
+    uint32_t local_size;        // Payload bytes stored on the page itself
+    uint32_t column_count;
+    const int64_t* serial_types;
+    uint32_t* offsets;          // Body offset of each column from payload
+    uint32_t inline_offsets[CELL_INLINE_COLUMNS];
+    uint8_t heap_offsets;       // offsets came from malloc
+    int64_t payload_size;       // Whole payload, local and overflow
+    uint32_t overflow_page;     // First page of the overflow chain, 0 if none
+    const PageSource* source;   // NULL if overflow pages cannot be read
+    Arena* arena;               // Holds overflow values copied out by record_column_fetch
+} RecordView;
+
+SerialClass serial_type_class(int64_t serial_type);
+uint32_t serial_type_length(int64_t serial_type);
+int record_view_init(RecordView* view, const CellInfo* cell, const uint8_t* page_data,
+                     uint32_t page_size, const PageSource* source, Arena* arena);
+void record_view_free(RecordView* view);
+SerialClass record_column_class(const RecordView* view, uint32_t column);
+int record_column_available(const RecordView* view, uint32_t column);
+int record_column_int64(const RecordView* view, uint32_t column, int64_t* value);
+int record_column_double(const RecordView* view, uint32_t column, double* value);
+int record_column_bytes(const RecordView* view, uint32_t column, const uint8_t** data, uint32_t* length);
+int record_column_fetch(const RecordView* view, uint32_t column, const uint8_t** data, uint32_t* length);
+
+#endif
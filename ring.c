@@ -0,0 +1,128 @@
+#include "ring.h"
+#include "utils.h"
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Spins before a waiting side yields, then before it starts sleeping
+#define RING_SPIN_LIMIT 64
+#define RING_YIELD_LIMIT 128
+#define RING_SLEEP_NS 50000
+
+// Prepares an empty ring holding at least capacity values; the capacity is
+// rounded up to a power of two so an index maps to its slot with a mask
+int ring_init(Ring *ring, uint32_t capacity) {
+    memset(ring, 0, sizeof(*ring));
+    uint32_t size = 1;
+    while (size < capacity && size < (1u << 31)) {
+        size <<= 1;
+    }
+    ring->slots = malloc(size * sizeof(uint64_t));
+    if (!ring->slots) {
+        report_error("Failed to allocate memory for ring", 0);
+        return -1;
+    }
+    ring->mask = size - 1;
+    return 0;
+}
+
+// Returns how many values the producer can push without waiting
+uint32_t ring_space(Ring *ring) {
+    uint64_t capacity = (uint64_t)ring->mask + 1;
+    if (ring->head - ring->tail_cache == capacity) {
+        ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    }
+    return (uint32_t)(capacity - (ring->head - ring->tail_cache));
+}
+
+// Pushes up to count values as one batch and returns how many fit.
+// Producer only.
+uint32_t ring_push(Ring *ring, const uint64_t *values, uint32_t count) {
+    uint32_t space = ring_space(ring);
+    if (count > space) {
+        count = space;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        ring->slots[(ring->head + i) & ring->mask] = values[i];
+    }
+    // Publishes the slots written above along with everything the producer wrote before
+    __atomic_store_n(&ring->head, ring->head + count, __ATOMIC_RELEASE);
+    return count;
+}
+
+// Copies up to count of the oldest values without consuming them and
+// returns how many there were. Consumer only.
+uint32_t ring_peek(Ring *ring, uint64_t *values, uint32_t count) {
+    if (ring->head_cache - ring->tail < count) {
+        ring->head_cache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    }
+    uint64_t available = ring->head_cache - ring->tail;
+    if (count > available) {
+        count = (uint32_t)available;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        values[i] = ring->slots[(ring->tail + i) & ring->mask];
+    }
+    return count;
+}
+
+// Hands the oldest count peeked values back to the producer. Consumer only.
+void ring_release(Ring *ring, uint32_t count) {
+    __atomic_store_n(&ring->tail, ring->tail + count, __ATOMIC_RELEASE);
+}
+
+// Takes up to count values at once; ring_peek() and ring_release() in one
+uint32_t ring_pop(Ring *ring, uint64_t *values, uint32_t count) {
+    count = ring_peek(ring, values, count);
+    ring_release(ring, count);
+    return count;
+}
+
+// Returns the number of values queued; from any thread, for metrics
+uint32_t ring_depth(const Ring *ring) {
+    uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    return head > tail ? (uint32_t)(head - tail) : 0;
+}
+
+// Marks the end of the stream once the producer's last push is done
+void ring_close(Ring *ring) {
+    __atomic_store_n(&ring->closed, 1, __ATOMIC_RELEASE);
+}
+
+// Returns 1 once the ring is closed and every value has been taken.
+// Consumer only.
+int ring_finished(Ring *ring) {
+    // closed is read first: a push made before ring_close() is then visible below
+    if (!__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    ring->head_cache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    return ring->head_cache == ring->tail;
+}
+
+// Waits a little longer each call while a ring stays full or empty: spins
+// first, then yields, then sleeps so a stalled stage does not burn a core.
+// Reset *spins to 0 once the ring moves.
+void ring_backoff(uint32_t *spins) {
+    if (*spins < RING_SPIN_LIMIT) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    } else if (*spins < RING_YIELD_LIMIT) {
+        sched_yield();
+    } else {
+        struct timespec pause = { 0, RING_SLEEP_NS };
+        nanosleep(&pause, NULL);
+    }
+    if (*spins < RING_YIELD_LIMIT) {
+        (*spins)++;
+    }
+}
+
+// Releases the slots; both threads must be done with the ring
+void ring_free(Ring *ring) {
+    free(ring->slots);
+    ring->slots = NULL;
+}
@@ -0,0 +1,36 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+
+#define RING_CACHE_LINE 64
+
+// Bounded lock-free queue of 64-bit values between exactly one producer
+// thread and one consumer thread. head and tail sit on their own cache
+// lines, and each side keeps a private copy of the other's index, so the
+// shared line is only read when that copy says the ring is full or empty.
+// The consumer peeks at values in place and releases them once it is done,
+// which lets a value name a buffer the producer reuses after the release.
+typedef struct {
+    _Alignas(RING_CACHE_LINE) uint64_t head;    // Values pushed; written by the producer
+    uint64_t tail_cache;                        // Producer's last view of tail
+    int closed;                                 // Producer has pushed its last value
+    _Alignas(RING_CACHE_LINE) uint64_t tail;    // Values released; written by the consumer
+    uint64_t head_cache;                        // Consumer's last view of head
+    _Alignas(RING_CACHE_LINE) uint64_t* slots;
+    uint32_t mask;                              // Capacity minus one
+} Ring;
+
+int ring_init(Ring* ring, uint32_t capacity);
+uint32_t ring_space(Ring* ring);
+uint32_t ring_push(Ring* ring, const uint64_t* values, uint32_t count);
+uint32_t ring_peek(Ring* ring, uint64_t* values, uint32_t count);
+void ring_release(Ring* ring, uint32_t count);
+uint32_t ring_pop(Ring* ring, uint64_t* values, uint32_t count);
+uint32_t ring_depth(const Ring* ring);
+void ring_close(Ring* ring);
+int ring_finished(Ring* ring);
+void ring_backoff(uint32_t* spins);
+void ring_free(Ring* ring);
+
+#endif
@@ -0,0 +1,151 @@
+#include "row_changes.h"
+#include "frame_index.h"
+#include "utils.h"
+
+// Applies a whole transaction to the owner map before any of it is
+// decoded. A subscription needs this: a page can join a watched table
+// through a parent written later in the same transaction.
+void apply_transaction_owners(PageOwnerMap *owners, const WalReader *reader, const WalTransaction *transaction) {
+    WalFrameView frame;
+    for (uint32_t n = transaction->first_frame; n <= transaction->commit_frame; n++) {
+        if (wal_reader_frame(reader, n, &frame) == 0) {
+            page_owner_apply_frame(owners, reader, &frame);
+        }
+    }
+}
+
+// Returns the subscription spec of a b-tree, or NULL when there is no
+// subscription or the b-tree is unknown
+const SubscribedTable *subscribed_btree(const PageOwnerMap *owners, const Subscription *subscription, int btree) {
+    if (!subscription || !owners || btree < 0) {
+        return NULL;
+    }
+    return subscription_find(subscription, owners->btrees[btree].name);
+}
+
+// Restricts the record comparison to a subscribed table's columns, or lifts it
+static void set_diff_columns(RowDiff *diff, const SubscribedTable *filter) {
+    diff->columns = filter ? filter->columns : NULL;
+    diff->column_count = filter ? filter->column_count : 0;
+}
+
+// Prefetches the earlier versions of the next PAGE_READER_DEPTH pages
+// collect_row_changes() will diff, starting at frame `from`, so their
+// database reads go out as one batch. Returns the frame after the last
+// page taken.
+static uint32_t prefetch_previous_pages(const PageOwnerMap *owners, const Subscription *subscription,
+                                        const WalReader *reader, const WalTransaction *transaction,
+                                        const PageSource *source, uint32_t from) {
+    uint32_t pages[PAGE_READER_DEPTH];
+    uint32_t count = 0;
+    uint32_t n = from;
+    WalFrameView frame;
+    for (; n <= transaction->commit_frame && count < PAGE_READER_DEPTH; n++) {
+        if (wal_reader_frame(reader, n, &frame) != 0) {
+            continue;
+        }
+        uint32_t page_number = frame.header.page_number;
+        if ((!subscription || page_owner_watched(owners, page_number)) &&
+            frame_index_find(source->index, page_number, transaction->commit_frame) == n) {
+            pages[count++] = page_number;
+        }
+    }
+    page_source_prefetch_previous(source, pages, count, transaction->first_frame);
+    return n;
+}
+
+// Replaces diff's changes with the net row changes of one committed
+// transaction, sorted by table and rowid. Each table leaf it wrote is
+// diffed against the page as it was before the transaction; source must
+// already index the transaction's frames. Earlier versions read from the
+// database file are copied into arena, so every page a change points at
+// stays valid until the arena is reset or the WAL is remapped. owners, if
+// not NULL, takes in the transaction's frames; a page's rows before the
+// transaction belong to its owner before any frame was applied, so a leaf
+// handed from one b-tree to another yields deletes from the first and
+// inserts into the second. With a subscription, owners must be watching
+// its tables: only leaves they owned before or after are diffed, and
+// changes outside their rowid ranges or columns are dropped.
+int collect_row_changes(RowDiff *diff, PageOwnerMap *owners, const Subscription *subscription,
+                        const WalReader *reader, const WalTransaction *transaction, const PageSource *source,
+                        Arena *arena) {
+    row_diff_reset(diff);
+    WalFrameView frame;
+    uint32_t frame_count = transaction->commit_frame - transaction->first_frame + 1;
+    int32_t *old_tables = arena_alloc(arena, frame_count * sizeof(int32_t));
+    if (!old_tables) {
+        report_error("Failed to allocate memory for row diff", 0);
+        return -1;
+    }
+    for (uint32_t n = transaction->first_frame; n <= transaction->commit_frame; n++) {
+        old_tables[n - transaction->first_frame] =
+            wal_reader_frame(reader, n, &frame) == 0 ? page_owner_btree(owners, frame.header.page_number) : -1;
+    }
+    if (subscription) {
+        apply_transaction_owners(owners, reader, transaction);
+    }
+    uint8_t *scratch = NULL;
+    uint32_t prefetched = transaction->first_frame;
+    for (uint32_t n = transaction->first_frame; n <= transaction->commit_frame; n++) {
+        if (n == prefetched) {
+            prefetched = prefetch_previous_pages(owners, subscription, reader, transaction, source, n);
+        }
+        if (wal_reader_frame(reader, n, &frame) != 0) {
+            continue;
+        }
+        uint32_t page_number = frame.header.page_number;
+        int old_table = old_tables[n - transaction->first_frame];
+        if (owners && !subscription) {
+            page_owner_apply_frame(owners, reader, &frame);
+        }
+        // A page that leaves its b-tree keeps the owner it had before
+        int new_table = page_owner_btree(owners, page_number);
+        new_table = new_table >= 0 ? new_table : old_table;
+        if (subscription && !page_owner_watched(owners, page_number) &&
+            (old_table < 0 || !owners->btrees[old_table].watched)) {
+            continue;
+        }
+        // A page written twice in one transaction is diffed once, at its last copy
+        if (frame_index_find(source->index, page_number, transaction->commit_frame) != n) {
+            continue;
+        }
+        // Only a copy from the database file lands in scratch; a WAL copy is returned in place
+        if (!scratch && !(scratch = arena_alloc(arena, reader->page_size))) {
+            report_error("Failed to allocate memory for row diff", 0);
+            return -1;
+        }
+        const uint8_t *old_page = page_source_previous(source, page_number, transaction->first_frame, scratch);
+        if (old_page == scratch) {
+            scratch = NULL;
+        }
+        const SubscribedTable *old_filter = subscribed_btree(owners, subscription, old_table);
+        const SubscribedTable *new_filter = subscribed_btree(owners, subscription, new_table);
+        // Each side's rows are digested over its own table's columns
+        if (old_filter != new_filter) {
+            set_diff_columns(diff, old_filter);
+            if (row_diff_pages(diff, old_page, NULL, page_number, reader->page_size, source->usable_size,
+                               old_table, old_table) != 0) {
+                return -1;
+            }
+            old_page = NULL;
+        }
+        set_diff_columns(diff, new_filter);
+        if (row_diff_pages(diff, old_page, frame.page_data, page_number, reader->page_size,
+                           source->usable_size, old_table, new_table) != 0) {
+            return -1;
+        }
+    }
+    row_diff_reconcile(diff);
+    if (subscription) {
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < diff->count; i++) {
+            // A leaf handed to an unwatched b-tree brings in rows nobody asked for
+            const SubscribedTable *filter = subscribed_btree(owners, subscription, diff->changes[i].table);
+            if (filter && subscription_rowid_matches(filter, diff->changes[i].rowid)) {
+                diff->changes[kept++] = diff->changes[i];
+            }
+        }
+        diff->count = kept;
+    }
+    return 0;
+}
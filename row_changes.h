@@ -0,0 +1,19 @@
+#ifndef ROW_CHANGES_H
+#define ROW_CHANGES_H
+
+#include "arena.h"
+#include "page_owner.h"
+#include "page_source.h"
+#include "row_diff.h"
+#include "subscription.h"
+#include "wal_reader.h"
+#include "wal_transaction.h"
+#include <stdint.h>
+
+void apply_transaction_owners(PageOwnerMap* owners, const WalReader* reader, const WalTransaction* transaction);
+const SubscribedTable* subscribed_btree(const PageOwnerMap* owners, const Subscription* subscription, int btree);
+int collect_row_changes(RowDiff* diff, PageOwnerMap* owners, const Subscription* subscription,
+                        const WalReader* reader, const WalTransaction* transaction, const PageSource* source,
+                        Arena* arena);
+
+#endif
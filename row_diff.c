@@ -0,0 +1,297 @@
+#include "row_diff.h"
+#include "page_analyzer.h"
+#include "record_view.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Cells of one table leaf page, walked in pointer order (ascending rowid)
+typedef struct {
+    const uint8_t* page;
+    uint32_t page_size;
+    uint32_t usable_size;
+    uint32_t pointer_offset;    // Start of the cell pointer array
+    uint16_t cell_count;
+    uint16_t next;              // Next cell to decode
+} LeafCursor;
+
+// The parts of a cell the diff needs; the record itself is not decoded
+typedef struct {
+    int64_t rowid;
+    const uint8_t* page;
+    uint16_t offset;            // Cell offset in page
+    const uint8_t* record;      // Payload's local bytes, then the overflow pointer if any
+    uint32_t record_length;
+    uint32_t local_length;      // record_length without the overflow pointer
+} LeafCell;
+
+// Positions a cursor on a table leaf page; any other page reads as empty
+static void leaf_cursor_init(LeafCursor *cursor, const uint8_t *page, uint32_t page_number,
+                             uint32_t page_size, uint32_t usable_size) {
+    uint32_t header = page_number == 1 ? 100 : 0;
+    cursor->page = page;
+    cursor->page_size = page_size;
+    cursor->usable_size = usable_size;
+    cursor->pointer_offset = header + 8;
+    cursor->cell_count = 0;
+    cursor->next = 0;
+    if (page && header + 8 <= page_size && page[header] == 0x0D) {
+        cursor->cell_count = to_host16(*(const uint16_t *)(page + header + 3));
+    }
+}
+
+// Decodes the next cell's rowid and record extent; 0 at the end or on a
+// malformed cell, which ends the page
+static int leaf_cursor_next(LeafCursor *cursor, LeafCell *cell) {
+    while (cursor->next < cursor->cell_count) {
+        uint32_t slot = cursor->pointer_offset + 2u * cursor->next++;
+        if (slot + 2 > cursor->page_size) {
+            break;
+        }
+        uint32_t pos = (uint32_t)(cursor->page[slot] << 8 | cursor->page[slot + 1]);
+        uint16_t offset = (uint16_t)pos;
+        uint64_t payload_size, rowid;
+        int used;
+        if (pos >= cursor->page_size ||
+            (used = decode_varint(cursor->page + pos, cursor->page_size - pos, &payload_size)) == 0) {
+            break;
+        }
+        pos += used;
+        if ((used = decode_varint(cursor->page + pos, cursor->page_size - pos, &rowid)) == 0) {
+            break;
+        }
+        pos += used;
+        if (payload_size > INT64_MAX) {
+            break;
+        }
+        uint32_t local = btree_local_payload(0x0D, (int64_t)payload_size, cursor->usable_size);
+        uint32_t length = local + (local < payload_size ? 4 : 0);
+        if (length > cursor->page_size - pos) {
+            break;
+        }
+        cell->rowid = (int64_t)rowid;
+        cell->page = cursor->page;
+        cell->offset = offset;
+        cell->record = cursor->page + pos;
+        cell->record_length = length;
+        cell->local_length = local;
+        return 1;
+    }
+    cursor->next = cursor->cell_count;
+    return 0;
+}
+
+// Folds bytes into an FNV-1a hash
+static uint64_t digest_bytes(uint64_t hash, const uint8_t *data, uint32_t length) {
+    for (uint32_t i = 0; i < length; i++) {
+        hash = (hash ^ data[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// FNV-1a over the serial types and values of the given record columns.
+// Returns 0 when a column's value is not wholly on the page.
+static uint64_t columns_digest(const LeafCell *cell, const uint32_t *columns, uint32_t column_count) {
+    uint64_t header_size;
+    int used = decode_varint(cell->record, cell->local_length, &header_size);
+    if (used == 0 || header_size > cell->local_length) {
+        return 0;
+    }
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    uint64_t body = header_size;
+    uint32_t pos = (uint32_t)used;
+    uint32_t next = 0;
+    for (uint32_t column = 0; pos < header_size && next < column_count; column++) {
+        uint64_t serial_type;
+        if ((used = decode_varint(cell->record + pos, header_size - pos, &serial_type)) == 0) {
+            return 0;
+        }
+        pos += used;
+        uint32_t length = serial_type_length((int64_t)serial_type);
+        if (column == columns[next]) {
+            if (body + length > cell->local_length) {
+                return 0;
+            }
+            hash = digest_bytes(hash, (const uint8_t *)&serial_type, sizeof(serial_type));
+            hash = digest_bytes(hash, cell->record + body, length);
+            next++;
+        }
+        body += length;
+    }
+    return hash | 1;
+}
+
+// FNV-1a over a record's on-page bytes, or over just the diff's columns
+// when it has some and they are all on the page; never 0, which marks an
+// absent row
+static uint64_t record_digest(const RowDiff *diff, const LeafCell *cell) {
+    uint64_t hash = diff->columns ? columns_digest(cell, diff->columns, diff->column_count) : 0;
+    if (hash) {
+        return hash;
+    }
+    return digest_bytes(0xcbf29ce484222325ULL, cell->record, cell->record_length) | 1;
+}
+
+// Returns 1 when two versions of a row differ in anything the diff looks at
+static int records_differ(const RowDiff *diff, const LeafCell *before, const LeafCell *after) {
+    if (diff->columns) {
+        return record_digest(diff, before) != record_digest(diff, after);
+    }
+    return before->record_length != after->record_length ||
+           memcmp(before->record, after->record, before->record_length) != 0;
+}
+
+// Appends one change; -1 if memory runs out
+static int add_change(RowDiff *diff, uint8_t type, int64_t rowid, const LeafCell *before,
+                      const LeafCell *after, uint32_t page_number, int32_t table) {
+    if (diff->count == diff->capacity) {
+        uint32_t capacity = diff->capacity ? diff->capacity * 2 : 64;
+        RowChange *changes = realloc(diff->changes, capacity * sizeof(RowChange));
+        if (!changes) {
+            report_error("Failed to allocate memory for row changes", 0);
+            return -1;
+        }
+        diff->changes = changes;
+        diff->capacity = capacity;
+    }
+    RowChange *change = &diff->changes[diff->count++];
+    change->rowid = rowid;
+    change->old_digest = before ? record_digest(diff, before) : 0;
+    change->new_digest = after ? record_digest(diff, after) : 0;
+    change->page_number = page_number;
+    change->table = table;
+    change->type = type;
+    change->old_page = before ? before->page : NULL;
+    change->old_cell = before ? before->offset : 0;
+    change->new_page = after ? after->page : NULL;
+    change->new_cell = after ? after->offset : 0;
+    return 0;
+}
+
+// Prepares an empty change list
+void row_diff_init(RowDiff *diff) {
+    memset(diff, 0, sizeof(*diff));
+}
+
+// Compares two versions of a table leaf page and appends a change for every
+// row that was inserted, updated or deleted. Both cell arrays are sorted by
+// rowid, so one merge pass pairs them up; record bytes are compared only
+// for rowids present in both. old_page may be NULL for a page that did not
+// exist before; a page that is not a table leaf counts as holding no rows.
+// Only on-page bytes are compared: for a record that spills, that is its
+// local part and first overflow page number, so an edit confined to the
+// overflow chain of a record that keeps its first overflow page is missed.
+// With diff->columns set, an update that leaves those columns alone is not
+// a change. old_table and new_table own the page before and after; when
+// the page moved to another b-tree, rows are never paired, so every old
+// row is a delete from old_table and every new row an insert into
+// new_table.
+int row_diff_pages(RowDiff *diff, const uint8_t *old_page, const uint8_t *new_page, uint32_t page_number,
+                   uint32_t page_size, uint32_t usable_size, int32_t old_table, int32_t new_table) {
+    int same_table = old_table == new_table;
+    if (same_table && old_page && new_page && memcmp(old_page, new_page, page_size) == 0) {
+        return 0;
+    }
+    LeafCursor before, after;
+    leaf_cursor_init(&before, old_page, page_number, page_size, usable_size);
+    leaf_cursor_init(&after, new_page, page_number, page_size, usable_size);
+    LeafCell old_cell, new_cell;
+    int has_old = leaf_cursor_next(&before, &old_cell);
+    int has_new = leaf_cursor_next(&after, &new_cell);
+    int status = 0;
+    while ((has_old || has_new) && status == 0) {
+        if (has_old && (!has_new || old_cell.rowid < new_cell.rowid || !same_table)) {
+            status = add_change(diff, ROW_DELETE, old_cell.rowid, &old_cell, NULL, page_number, old_table);
+            has_old = leaf_cursor_next(&before, &old_cell);
+        } else if (has_new && (!has_old || new_cell.rowid < old_cell.rowid || !same_table)) {
+            status = add_change(diff, ROW_INSERT, new_cell.rowid, NULL, &new_cell, page_number, new_table);
+            has_new = leaf_cursor_next(&after, &new_cell);
+        } else {
+            diff->cells_compared++;
+            if (records_differ(diff, &old_cell, &new_cell)) {
+                status = add_change(diff, ROW_UPDATE, new_cell.rowid, &old_cell, &new_cell, page_number,
+                                    new_table);
+            }
+            has_old = leaf_cursor_next(&before, &old_cell);
+            has_new = leaf_cursor_next(&after, &new_cell);
+        }
+    }
+    return status;
+}
+
+// Orders changes by table and rowid
+static int compare_changes(const void *a, const void *b) {
+    const RowChange *left = a, *right = b;
+    if (left->table != right->table) {
+        return left->table < right->table ? -1 : 1;
+    }
+    if (left->rowid != right->rowid) {
+        return left->rowid < right->rowid ? -1 : 1;
+    }
+    return 0;
+}
+
+// Folds the changes to each row into its net effect across all pages of
+// the transaction. Every page is diffed against its state before the
+// transaction, so a row moved from one page to another shows up as a
+// delete on one and an insert on the other; if the record bytes match the
+// pair cancels out, otherwise it becomes an update. Leaves the changes
+// sorted by table and rowid.
+void row_diff_reconcile(RowDiff *diff) {
+    if (diff->count < 2) {
+        return;
+    }
+    qsort(diff->changes, diff->count, sizeof(RowChange), compare_changes);
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < diff->count;) {
+        RowChange merged = diff->changes[i];
+        uint32_t j = i + 1;
+        for (; j < diff->count && compare_changes(&diff->changes[j], &merged) == 0; j++) {
+            const RowChange *next = &diff->changes[j];
+            if (next->old_digest) {
+                merged.old_digest = next->old_digest;
+                merged.old_page = next->old_page;
+                merged.old_cell = next->old_cell;
+            }
+            if (next->new_digest) {
+                merged.new_digest = next->new_digest;
+                merged.page_number = next->page_number;
+                merged.new_page = next->new_page;
+                merged.new_cell = next->new_cell;
+            }
+        }
+        i = j;
+        if (merged.old_digest && merged.new_digest) {
+            if (merged.old_digest == merged.new_digest) {
+                continue;
+            }
+            merged.type = ROW_UPDATE;
+        } else {
+            merged.type = merged.new_digest ? ROW_INSERT : ROW_DELETE;
+        }
+        diff->changes[kept++] = merged;
+    }
+    diff->count = kept;
+}
+
+// Returns the upper-case name of a change type
+const char *row_change_name(uint8_t type) {
+    switch (type) {
+        case ROW_INSERT: return "INSERT";
+        case ROW_UPDATE: return "UPDATE";
+        case ROW_DELETE: return "DELETE";
+        default: return "UNKNOWN";
+    }
+}
+
+// Empties the list, keeping its memory for the next transaction
+void row_diff_reset(RowDiff *diff) {
+    diff->count = 0;
+    diff->cells_compared = 0;
+}
+
+// Releases the change list
+void row_diff_free(RowDiff *diff) {
+    free(diff->changes);
+    row_diff_init(diff);
+}
@@ -0,0 +1,47 @@
+#ifndef ROW_DIFF_H
+#define ROW_DIFF_H
+
+#include <stdint.h>
+
+typedef enum {
+    ROW_INSERT = 0,
+    ROW_UPDATE,
+    ROW_DELETE
+} RowChangeType;
+
+// One row-level change found by comparing two versions of a table leaf page
+typedef struct {
+    int64_t rowid;
+    uint64_t old_digest;        // Hash of the record before the change, 0 if the row was absent
+    uint64_t new_digest;        // Hash of the record after the change, 0 if the row is gone
+    uint32_t page_number;       // Page holding the row afterwards, or before for deletes
+    int32_t table;              // Owning b-tree (page_owner_btree), -1 if unknown
+    uint8_t type;               // RowChangeType
+    uint16_t old_cell;          // Cell offset of the row in old_page
+    uint16_t new_cell;          // Cell offset of the row in new_page
+    const uint8_t* old_page;    // Page image holding the row before, NULL if absent; as passed to row_diff_pages
+    const uint8_t* new_page;    // Page image holding the row after, NULL if gone
+} RowChange;
+
+// Changes collected for one transaction. Pages are diffed one at a time;
+// row_diff_reconcile then folds the per-page events so that a row moved
+// between pages by a b-tree rebalance is not reported as a delete and an
+// insert.
+typedef struct {
+    RowChange* changes;
+    uint32_t count;
+    uint32_t capacity;
+    uint64_t cells_compared;    // Cell pairs whose bytes had to be compared
+    const uint32_t* columns;    // Record columns a change must touch, ascending; NULL for any
+    uint32_t column_count;
+} RowDiff;
+
+void row_diff_init(RowDiff* diff);
+int row_diff_pages(RowDiff* diff, const uint8_t* old_page, const uint8_t* new_page, uint32_t page_number,
+                   uint32_t page_size, uint32_t usable_size, int32_t old_table, int32_t new_table);
+void row_diff_reconcile(RowDiff* diff);
+const char* row_change_name(uint8_t type);
+void row_diff_reset(RowDiff* diff);
+void row_diff_free(RowDiff* diff);
+
+#endif
@@ -0,0 +1,201 @@
+#include "subscription.h"
+#include "utils.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Parses a whole decimal integer; -1 on anything else, including ""
+static int parse_int64(const char *text, int64_t *value) {
+    char *end;
+    errno = 0;
+    long long parsed = strtoll(text, &end, 10);
+    if (end == text || *end != '\0' || errno != 0) {
+        return -1;
+    }
+    *value = parsed;
+    return 0;
+}
+
+// Parses "FIRST..LAST"; either end may be left out to leave it open
+static int parse_rowid_range(char *text, SubscribedTable *table) {
+    char *dots = strstr(text, "..");
+    if (!dots) {
+        return -1;
+    }
+    *dots = '\0';
+    if (*text && parse_int64(text, &table->min_rowid) != 0) {
+        return -1;
+    }
+    if (dots[2] && parse_int64(dots + 2, &table->max_rowid) != 0) {
+        return -1;
+    }
+    return table->min_rowid <= table->max_rowid ? 0 : -1;
+}
+
+// Orders column numbers ascending
+static int compare_columns(const void *a, const void *b) {
+    uint32_t left = *(const uint32_t *)a, right = *(const uint32_t *)b;
+    return left < right ? -1 : left > right;
+}
+
+// Parses "N,N,..." into a sorted list without duplicates
+static int parse_columns(char *text, SubscribedTable *table) {
+    char *field;
+    while ((field = strsep(&text, ",")) != NULL) {
+        int64_t column;
+        if (parse_int64(field, &column) != 0 || column < 0 || column > UINT32_MAX) {
+            return -1;
+        }
+        uint32_t *columns = realloc(table->columns, (table->column_count + 1) * sizeof(uint32_t));
+        if (!columns) {
+            report_error("Failed to allocate memory for table columns", 0);
+            return -1;
+        }
+        table->columns = columns;
+        table->columns[table->column_count++] = (uint32_t)column;
+    }
+    qsort(table->columns, table->column_count, sizeof(uint32_t), compare_columns);
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < table->column_count; i++) {
+        if (kept == 0 || table->columns[kept - 1] != table->columns[i]) {
+            table->columns[kept++] = table->columns[i];
+        }
+    }
+    table->column_count = kept;
+    return 0;
+}
+
+// Starts an empty subscription
+void subscription_init(Subscription *subscription) {
+    memset(subscription, 0, sizeof(*subscription));
+}
+
+// Adds one spec of the form NAME[:rowid=FIRST..LAST][:columns=N,N,...].
+// Columns count from 0 in record order, as the text output numbers them.
+int subscription_add(Subscription *subscription, const char *spec) {
+    char *copy = strdup(spec);
+    if (!copy) {
+        report_error("Failed to allocate memory for table spec", 0);
+        return -1;
+    }
+    char *rest = copy;
+    char *name = strsep(&rest, ":");
+    SubscribedTable table = { .min_rowid = INT64_MIN, .max_rowid = INT64_MAX };
+    int status = *name ? 0 : -1;
+    char *field;
+    while (status == 0 && (field = strsep(&rest, ":")) != NULL) {
+        if (strncmp(field, "rowid=", 6) == 0) {
+            status = parse_rowid_range(field + 6, &table);
+        } else if (strncmp(field, "columns=", 8) == 0) {
+            status = parse_columns(field + 8, &table);
+        } else {
+            status = -1;
+        }
+    }
+    if (status == 0) {
+        table.name = strdup(name);
+        SubscribedTable *tables = realloc(subscription->tables, (subscription->count + 1) * sizeof(SubscribedTable));
+        if (tables) {
+            subscription->tables = tables;
+        }
+        const char **names = realloc(subscription->names, (subscription->count + 1) * sizeof(char *));
+        if (names) {
+            subscription->names = names;
+        }
+        if (!table.name || !tables || !names) {
+            report_error("Failed to allocate memory for table spec", 0);
+            status = -1;
+        }
+    } else {
+        report_error("Invalid table spec; expected NAME[:rowid=FIRST..LAST][:columns=N,N,...]", 0);
+    }
+    free(copy);
+    if (status != 0) {
+        free(table.name);
+        free(table.columns);
+        return -1;
+    }
+    subscription->tables[subscription->count] = table;
+    subscription->names[subscription->count] = table.name;
+    subscription->count++;
+    return 0;
+}
+
+// Returns the spec for a table name, or NULL when it is not subscribed
+const SubscribedTable *subscription_find(const Subscription *subscription, const char *name) {
+    for (uint32_t i = 0; name && i < subscription->count; i++) {
+        if (strcmp(subscription->tables[i].name, name) == 0) {
+            return &subscription->tables[i];
+        }
+    }
+    return NULL;
+}
+
+// Returns 1 when a row falls inside the spec's rowid range
+int subscription_rowid_matches(const SubscribedTable *table, int64_t rowid) {
+    return rowid >= table->min_rowid && rowid <= table->max_rowid;
+}
+
+// Returns 1 when a record column is one the spec shows
+int subscription_column_matches(const SubscribedTable *table, uint32_t column) {
+    if (!table->columns) {
+        return 1;
+    }
+    uint32_t low = 0, high = table->column_count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (table->columns[middle] < column) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low < table->column_count && table->columns[low] == column;
+}
+
+// Returns 0 for a table leaf page that holds no row in the spec's rowid
+// range, 1 for any other page, including a malformed one. Only the rowid
+// varints are decoded, and the scan stops at the first row past the range
+// since cells are in rowid order.
+int subscription_page_matches(const SubscribedTable *table, const uint8_t *page, uint32_t page_number,
+                              uint32_t page_size) {
+    uint32_t header = page_number == 1 ? 100 : 0;
+    if (table->min_rowid == INT64_MIN && table->max_rowid == INT64_MAX) {
+        return 1;
+    }
+    if (header + 8 > page_size || page[header] != 0x0D) {
+        return 1;
+    }
+    uint16_t cell_count = to_host16(*(const uint16_t *)(page + header + 3));
+    for (uint16_t i = 0; i < cell_count; i++) {
+        uint32_t slot = header + 8 + 2u * i;
+        if (slot + 2 > page_size) {
+            return 1;
+        }
+        uint32_t pos = (uint32_t)(page[slot] << 8 | page[slot + 1]);
+        uint64_t payload_size, rowid;
+        int used;
+        if (pos >= page_size || (used = decode_varint(page + pos, page_size - pos, &payload_size)) == 0 ||
+            decode_varint(page + pos + used, page_size - pos - used, &rowid) == 0) {
+            return 1;
+        }
+        if ((int64_t)rowid > table->max_rowid) {
+            return 0;
+        }
+        if ((int64_t)rowid >= table->min_rowid) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Releases every spec
+void subscription_free(Subscription *subscription) {
+    for (uint32_t i = 0; i < subscription->count; i++) {
+        free(subscription->tables[i].name);
+        free(subscription->tables[i].columns);
+    }
+    free(subscription->tables);
+    free(subscription->names);
+    subscription_init(subscription);
+}
@@ -0,0 +1,34 @@
+#ifndef SUBSCRIPTION_H
+#define SUBSCRIPTION_H
+
+#include <stdint.h>
+
+// One --table spec: a table (or index) to follow, optionally narrowed to a
+// rowid range and to some of its record columns
+typedef struct {
+    char* name;
+    int64_t min_rowid;          // Inclusive; INT64_MIN when unbounded
+    int64_t max_rowid;          // Inclusive; INT64_MAX when unbounded
+    uint32_t* columns;          // Record columns to show, ascending; NULL for all
+    uint32_t column_count;
+} SubscribedTable;
+
+// The tables a run is restricted to. The names are handed to
+// page_owner_watch(), which turns them into a bitmap of the pages those
+// b-trees own; frames of any other page are only checksummed.
+typedef struct {
+    SubscribedTable* tables;
+    const char** names;         // tables[i].name, in the form page_owner_watch() takes
+    uint32_t count;
+} Subscription;
+
+void subscription_init(Subscription* subscription);
+int subscription_add(Subscription* subscription, const char* spec);
+const SubscribedTable* subscription_find(const Subscription* subscription, const char* name);
+int subscription_rowid_matches(const SubscribedTable* table, int64_t rowid);
+int subscription_column_matches(const SubscribedTable* table, uint32_t column);
+int subscription_page_matches(const SubscribedTable* table, const uint8_t* page, uint32_t page_number,
+                              uint32_t page_size);
+void subscription_free(Subscription* subscription);
+
+#endif
@@ -1,15 +1,55 @@
 #include "test_harness.h"
 
 void register_wal_parser_tests(void);
+void register_wal_checksum_tests(void);
 void register_utils_tests(void);
 void register_page_analyzer_tests(void);
 void register_db_utils_tests(void);
+void register_wal_reader_tests(void);
+void register_page_owner_tests(void);
+void register_wal_listener_tests(void);
+void register_frame_index_tests(void);
+void register_frame_decoder_tests(void);
+void register_output_sink_tests(void);
+void register_arena_tests(void);
+void register_record_view_tests(void);
+void register_page_cache_tests(void);
+void register_wal_transaction_tests(void);
+void register_row_diff_tests(void);
+void register_wal_monitor_tests(void);
+void register_wal_gen_tests(void);
+void register_wal_stats_tests(void);
+void register_subscription_tests(void);
+void register_walpulse_tests(void);
+void register_ring_tests(void);
+void register_page_reader_tests(void);
+void register_changelog_tests(void);
 
 void run_all_tests(void) {
     register_wal_parser_tests();
+    register_wal_checksum_tests();
     register_utils_tests();
     register_page_analyzer_tests();
     register_db_utils_tests();
+    register_wal_reader_tests();
+    register_page_owner_tests();
+    register_wal_listener_tests();
+    register_frame_index_tests();
+    register_frame_decoder_tests();
+    register_output_sink_tests();
+    register_arena_tests();
+    register_record_view_tests();
+    register_page_cache_tests();
+    register_wal_transaction_tests();
+    register_row_diff_tests();
+    register_wal_monitor_tests();
+    register_wal_gen_tests();
+    register_wal_stats_tests();
+    register_subscription_tests();
+    register_walpulse_tests();
+    register_ring_tests();
+    register_page_reader_tests();
+    register_changelog_tests();
 }
 
 int main(void) {
@@ -0,0 +1,43 @@
+#include "../arena.h"
+#include "test_harness.h"
+#include <stdint.h>
+#include <string.h>
+
+TEST(test_arena_reuse) {
+    Arena arena;
+    arena_init(&arena, 1024);
+    uint8_t *first = arena_alloc(&arena, 100);
+    uint8_t *second = arena_alloc(&arena, 100);
+    ASSERT(first != NULL && second != NULL);
+    ASSERT(((uintptr_t)second & 15) == 0);
+    ASSERT(second >= first + 100);
+    memset(first, 0xAA, 100);
+
+    // Spills into a second block, then an oversized one
+    ASSERT(arena_alloc(&arena, 900) != NULL);
+    ASSERT(arena_alloc(&arena, 5000) != NULL);
+    ArenaBlock *blocks = arena.first;
+    int block_count = 0;
+    for (ArenaBlock *block = blocks; block; block = block->next) {
+        block_count++;
+    }
+    ASSERT(block_count == 3);
+
+    // After a reset the same pattern is served from the kept blocks
+    arena_reset(&arena);
+    ASSERT(arena_alloc(&arena, 100) == first);
+    ASSERT(arena_alloc(&arena, 100) == second);
+    ASSERT(arena_alloc(&arena, 900) != NULL);
+    ASSERT(arena_alloc(&arena, 5000) != NULL);
+    int reused_count = 0;
+    for (ArenaBlock *block = arena.first; block; block = block->next) {
+        reused_count++;
+    }
+    ASSERT(reused_count == 3);
+    arena_free(&arena);
+    ASSERT(arena.first == NULL);
+}
+
+void register_arena_tests(void) {
+    run_test("test_arena_reuse", test_arena_reuse);
+}
@@ -0,0 +1,256 @@
+#include "../changelog.h"
+#include "../wal_parser.h"
+#include "test_harness.h"
+#include <fcntl.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TEST_TRANSACTIONS 40
+
+// Removes a change log's segments and its directory
+static void remove_changelog(const char *directory) {
+    uint32_t count;
+    char **paths = changelog_list_segments(directory, &count);
+    for (uint32_t i = 0; paths && i < count; i++) {
+        unlink(paths[i]);
+    }
+    changelog_free_segments(paths, count);
+    rmdir(directory);
+}
+
+// Fills the changes of transaction t: rowids jump both ways, tables
+// include an unknown one, and the last transactions are empty
+static uint32_t make_changes(uint32_t t, RowChange *changes) {
+    uint32_t count = t >= TEST_TRANSACTIONS - 2 ? 0 : t % 7 + 1;
+    for (uint32_t i = 0; i < count; i++) {
+        memset(&changes[i], 0, sizeof(changes[i]));
+        changes[i].rowid = i % 2 ? -(int64_t)(t * 1000 + i) : (int64_t)t << (i * 8);
+        changes[i].page_number = t * 3 + 100 - i;
+        changes[i].table = (int32_t)((t + i) % 4) - 1;
+        changes[i].type = (uint8_t)((t + i) % 3);
+    }
+    return count;
+}
+
+// Reads every segment back and counts transactions that differ from what was written
+static int check_changelog(const char *directory, uint32_t *transactions, uint32_t *segments) {
+    static const char *names[] = {"sqlite_schema", "t", "u"};
+    uint32_t count;
+    char **paths = changelog_list_segments(directory, &count);
+    int wrong = 0;
+    uint32_t t = 0;
+    *segments = count;
+    for (uint32_t s = 0; paths && s < count; s++) {
+        ChangeLogSegment segment;
+        if (changelog_segment_open(&segment, paths[s]) != 0) {
+            wrong++;
+            continue;
+        }
+        wrong += segment.sequence != s + 1;
+        ChangeLogCursor cursor;
+        changelog_cursor_init(&cursor, &segment);
+        ChangeLogBlock block;
+        while (changelog_next_block(&cursor, &block) > 0) {
+            if (block.type == CHANGELOG_BLOCK_GENERATION) {
+                wrong += t != TEST_TRANSACTIONS / 2 || block.checkpoint != 7 || block.salt2 != 0xdeadbeef;
+                continue;
+            }
+            RowChange expected[8], change;
+            uint32_t expected_count = make_changes(t, expected);
+            wrong += block.change_count != expected_count || block.transaction.commit_frame != t * 2 + 1 ||
+                     block.transaction.database_size != 1000 + t;
+            for (uint32_t i = 0; changelog_next_change(&cursor, &change) > 0; i++) {
+                const char *name = changelog_table_name(&segment, change.table);
+                const char *expected_name = expected[i].table < 0 ? NULL : names[expected[i].table];
+                wrong += change.rowid != expected[i].rowid || change.page_number != expected[i].page_number ||
+                         change.type != expected[i].type || (name == NULL) != (expected_name == NULL) ||
+                         (name && strcmp(name, expected_name) != 0);
+            }
+            t++;
+        }
+        changelog_segment_close(&segment);
+    }
+    changelog_free_segments(paths, count);
+    *transactions = t;
+    return wrong;
+}
+
+TEST(test_changelog_roundtrip) {
+    char directory[256];
+    snprintf(directory, sizeof(directory), "/tmp/walpulse_changelog_%d", (int)getpid());
+    remove_changelog(directory);
+
+    BtreeInfo btrees[3] = {{"sqlite_schema", 1, 0, 0}, {"t", 2, 0, 0}, {"u", 3, 0, 0}};
+    PageOwnerMap owners;
+    memset(&owners, 0, sizeof(owners));
+    owners.btrees = btrees;
+    owners.btree_count = 3;
+
+    // Small segments, so tables are defined again after each rotation
+    ChangeLogWriter writer;
+    ASSERT(changelog_writer_open(&writer, directory, 256) == 0);
+    RowChange changes[8];
+    WalHeader header = {.checkpoint = 7, .salt1 = 1, .salt2 = 0xdeadbeef};
+    for (uint32_t t = 0; t < TEST_TRANSACTIONS; t++) {
+        if (t == TEST_TRANSACTIONS / 2) {
+            ASSERT(changelog_write_generation(&writer, &header) == 0);
+        }
+        WalTransaction transaction = {t * 2, t * 2 + 1, 1000 + t};
+        uint32_t count = make_changes(t, changes);
+        ASSERT(changelog_write_transaction(&writer, &transaction, changes, count, &owners) == 0);
+    }
+    ASSERT(changelog_writer_close(&writer) == 0);
+
+    uint32_t transactions, segments;
+    ASSERT(check_changelog(directory, &transactions, &segments) == 0);
+    ASSERT(transactions == TEST_TRANSACTIONS);
+    ASSERT(segments > 2);
+
+    // A damaged block is reported, not decoded
+    uint32_t count;
+    char **paths = changelog_list_segments(directory, &count);
+    ASSERT(paths != NULL && count == segments);
+    int fd = open(paths[0], O_RDWR);
+    uint8_t byte;
+    ASSERT(pread(fd, &byte, 1, CHANGELOG_HEADER_SIZE + CHANGELOG_BLOCK_HEADER_SIZE + 2) == 1);
+    byte ^= 0x40;
+    ASSERT(pwrite(fd, &byte, 1, CHANGELOG_HEADER_SIZE + CHANGELOG_BLOCK_HEADER_SIZE + 2) == 1);
+    close(fd);
+    ChangeLogSegment segment;
+    ASSERT(changelog_segment_open(&segment, paths[0]) == 0);
+    ChangeLogCursor cursor;
+    changelog_cursor_init(&cursor, &segment);
+    ChangeLogBlock block;
+    ASSERT(changelog_next_block(&cursor, &block) == -1);
+    changelog_segment_close(&segment);
+    changelog_free_segments(paths, count);
+    remove_changelog(directory);
+}
+
+TEST(test_changelog_recovery) {
+    char directory[256];
+    snprintf(directory, sizeof(directory), "/tmp/walpulse_changelog_recovery_%d", (int)getpid());
+    remove_changelog(directory);
+
+    BtreeInfo btrees[3] = {{"sqlite_schema", 1, 0, 0}, {"t", 2, 0, 0}, {"u", 3, 0, 0}};
+    PageOwnerMap owners;
+    memset(&owners, 0, sizeof(owners));
+    owners.btrees = btrees;
+    owners.btree_count = 3;
+    RowChange changes[8];
+
+    // A writer that dies mid-block leaves an unsealed segment with a torn tail
+    ChangeLogWriter writer;
+    ASSERT(changelog_writer_open(&writer, directory, 0) == 0);
+    for (uint32_t t = 0; t < 3; t++) {
+        WalTransaction transaction = {t * 2, t * 2 + 1, 1000 + t};
+        ASSERT(changelog_write_transaction(&writer, &transaction, changes, make_changes(t, changes), &owners) == 0);
+    }
+    uint8_t torn[CHANGELOG_BLOCK_HEADER_SIZE + 8] = {8, 0, 0, 0, CHANGELOG_BLOCK_TRANSACTION};
+    ASSERT(write(writer.fd, torn, sizeof(torn) - 4) == (ssize_t)sizeof(torn) - 4);
+    close(writer.fd);
+    writer.fd = -1;
+    changelog_writer_close(&writer);
+
+    uint32_t count;
+    char **paths = changelog_list_segments(directory, &count);
+    ASSERT(count == 1 && !changelog_segment_sealed(paths[0]));
+    ChangeLogSegment segment;
+    ASSERT(changelog_segment_open(&segment, paths[0]) == -1);
+    changelog_free_segments(paths, count);
+
+    // Reopening seals what was intact and continues in a new segment
+    ASSERT(changelog_writer_open(&writer, directory, 0) == 0);
+    for (uint32_t t = 3; t < TEST_TRANSACTIONS; t++) {
+        if (t == TEST_TRANSACTIONS / 2) {
+            WalHeader header = {.checkpoint = 7, .salt1 = 1, .salt2 = 0xdeadbeef};
+            ASSERT(changelog_write_generation(&writer, &header) == 0);
+        }
+        WalTransaction transaction = {t * 2, t * 2 + 1, 1000 + t};
+        ASSERT(changelog_write_transaction(&writer, &transaction, changes, make_changes(t, changes), &owners) == 0);
+    }
+    ASSERT(changelog_writer_close(&writer) == 0);
+    uint32_t transactions, segments;
+    ASSERT(check_changelog(directory, &transactions, &segments) == 0);
+    ASSERT(transactions == TEST_TRANSACTIONS && segments == 2);
+    remove_changelog(directory);
+}
+
+// Drops the lines that mention a WAL generation, which replay words differently
+static void strip_generations(char *text) {
+    char *out = text;
+    for (char *line = text; *line;) {
+        char *end = strchr(line, '\n');
+        size_t length = end ? (size_t)(end - line) + 1 : strlen(line);
+        if (!strstr(line, "WAL generation") || (end && strstr(line, "WAL generation") > end)) {
+            memmove(out, line, length);
+            out += length;
+        }
+        line += length;
+    }
+    *out = '\0';
+}
+
+TEST(test_changelog_replay) {
+    char path[TEST_PATH_SIZE], wal[TEST_PATH_SIZE], directory[TEST_PATH_SIZE + 16];
+    temp_db_path(path, wal, "replay");
+    snprintf(directory, sizeof(directory), "%s-changelog", path);
+    remove_changelog(directory);
+
+    sqlite3 *db = make_wal_db(path, 1024,
+                              "CREATE TABLE t(id INTEGER PRIMARY KEY, v TEXT);"
+                              "CREATE TABLE u(id INTEGER PRIMARY KEY, v TEXT);"
+                              "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 300) "
+                              "INSERT INTO t SELECT i * 7, printf('v%05d', i) FROM n;"
+                              "INSERT INTO u VALUES (-5, 'negative'), (9000000000, 'large');"
+                              "UPDATE t SET v = 'changed' WHERE id % 3 = 0;"
+                              "DELETE FROM t WHERE id > 1500;");
+    ASSERT(db != NULL);
+
+    OutputSink live;
+    ASSERT(sink_init(&live, -1, OUTPUT_TEXT) == 0);
+    ASSERT(print_wal_rows(&live, wal, NULL, NULL) == 0);
+    sink_putc(&live, '\0');
+    strip_generations(live.data);
+
+    ChangeLogWriter writer;
+    ASSERT(changelog_writer_open(&writer, directory, 0) == 0);
+    OutputSink quiet;
+    ASSERT(sink_init(&quiet, -1, OUTPUT_TEXT) == 0);
+    ASSERT(print_wal_rows(&quiet, wal, NULL, &writer) == 0);
+    ASSERT(changelog_writer_close(&writer) == 0);
+    sink_putc(&quiet, '\0');
+    ASSERT(strstr(quiet.data, " rowid ") == NULL);
+
+    OutputSink replayed;
+    ASSERT(sink_init(&replayed, -1, OUTPUT_TEXT) == 0);
+    ASSERT(print_changelog(&replayed, directory) == 0);
+    sink_putc(&replayed, '\0');
+    strip_generations(replayed.data);
+    ASSERT(strstr(live.data, "INSERT u rowid 9000000000 ") != NULL);
+    ASSERT(strstr(live.data, "DELETE t rowid 1505 ") != NULL);
+    ASSERT(strcmp(live.data, replayed.data) == 0);
+
+    // A change log that cannot take the changes fails the pass
+    ASSERT(changelog_writer_open(&writer, directory, 0) == 0);
+    char *kept = writer.directory;
+    writer.directory = "/nonexistent/walpulse";
+    ASSERT(print_wal_rows(&quiet, wal, NULL, &writer) == -1);
+    writer.directory = kept;
+    ASSERT(changelog_writer_close(&writer) == 0);
+
+    sink_free(&live);
+    sink_free(&quiet);
+    sink_free(&replayed);
+    remove_wal_db(db, path);
+    remove_changelog(directory);
+}
+
+void register_changelog_tests(void) {
+    run_test("test_changelog_roundtrip", test_changelog_roundtrip);
+    run_test("test_changelog_recovery", test_changelog_recovery);
+    run_test("test_changelog_replay", test_changelog_replay);
+}
@@ -1,14 +1,77 @@
 #include "../db_utils.h"
 #include "test_harness.h"
+#include <sqlite3.h>
+#include <stdlib.h>
 #include <string.h>
 
+#define MOVED_PAGE_LIMIT 512
+
 TEST(test_get_table_name_from_page) {
     // This test requires a real SQLite database file, which isn't provided.
     // For now, test with a mock failure case assuming NULL on error.
     char* table_name = get_table_name_from_page("./tests/testdata/nonexistent.db", 1);
     ASSERT(table_name == NULL);
+
+    table_name = get_table_name_from_page("./tests/testdata/test.db", 2);
+    ASSERT(table_name != NULL && strcmp(table_name, "abc") == 0);
+    free(table_name);
+    table_name = get_table_name_from_page("./tests/testdata/test.db", 3);
+    ASSERT(table_name != NULL && strcmp(table_name, "def") == 0);
+    free(table_name);
+    ASSERT(get_table_name_from_page("./tests/testdata/test.db", 4000) == NULL);
+}
+
+// Records which of t1 and t2 owns each page, by dbstat: 1, 2 or 0
+static void read_owners(sqlite3 *db, uint8_t *owners) {
+    memset(owners, 0, MOVED_PAGE_LIMIT);
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT name, pageno FROM dbstat", -1, &stmt, NULL) != SQLITE_OK) {
+        return;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *name = (const char *)sqlite3_column_text(stmt, 0);
+        int page = sqlite3_column_int(stmt, 1);
+        if (page < MOVED_PAGE_LIMIT && name && (strcmp(name, "t1") == 0 || strcmp(name, "t2") == 0)) {
+            owners[page] = (uint8_t)(name[1] - '0');
+        }
+    }
+    sqlite3_finalize(stmt);
+}
+
+TEST(test_get_table_name_from_wal) {
+    char path[TEST_PATH_SIZE];
+    temp_db_path(path, NULL, "table_name_wal");
+    sqlite3 *db = make_wal_db(path, 1024,
+                              "CREATE TABLE t1(id INTEGER PRIMARY KEY, v TEXT);"
+                              "CREATE TABLE t2(id INTEGER PRIMARY KEY, v TEXT);"
+                              "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 400) "
+                              "INSERT INTO t1 SELECT i, printf('%040d', i) FROM n;"
+                              "PRAGMA wal_checkpoint(TRUNCATE);");
+    ASSERT(db != NULL);
+    uint8_t before[MOVED_PAGE_LIMIT], after[MOVED_PAGE_LIMIT];
+    read_owners(db, before);
+
+    // Only the WAL knows that t1's freed leaves went to t2
+    sqlite3_exec(db,
+                 "DELETE FROM t1 WHERE id > 20;"
+                 "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 300) "
+                 "INSERT INTO t2 SELECT i, printf('%040d', i) FROM n;",
+                 NULL, NULL, NULL);
+    read_owners(db, after);
+    int moved = 0;
+    for (int page = 1; page < MOVED_PAGE_LIMIT; page++) {
+        if (before[page] == 1 && after[page] == 2) {
+            moved++;
+            char *table_name = get_table_name_from_page(path, (uint32_t)page);
+            ASSERT(table_name != NULL && strcmp(table_name, "t2") == 0);
+            free(table_name);
+        }
+    }
+    ASSERT(moved > 0);
+    remove_wal_db(db, path);
 }
 
 void register_db_utils_tests(void) {
     run_test("test_get_table_name_from_page", test_get_table_name_from_page);
+    run_test("test_get_table_name_from_wal", test_get_table_name_from_wal);
 }
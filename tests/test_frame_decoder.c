@@ -0,0 +1,234 @@
+#include "../bench/wal_gen.h"
+#include "../frame_decoder.h"
+#include "../output_sink.h"
+#include "../page_cache.h"
+#include "../frame_index.h"
+#include "../page_analyzer.h"
+#include "../wal_stats.h"
+#include "test_harness.h"
+#include <pthread.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Decodes every frame of a WAL with the given worker count into a memory sink
+static int decode_to_sink(const WalReader *reader, const FrameCheck *checks, uint32_t frame_count,
+                          unsigned jobs, OutputFormat format, OutputSink *out) {
+    if (sink_init(out, -1, format) != 0) {
+        return -1;
+    }
+    return decode_wal_frames(out, reader, checks, frame_count, NULL, jobs);
+}
+
+TEST(test_decode_wal_frames_ordered) {
+    char path[TEST_PATH_SIZE], wal[TEST_PATH_SIZE];
+    temp_db_path(path, wal, "decoder");
+    sqlite3 *db = make_wal_db(path, 1024, "CREATE TABLE t(id INTEGER PRIMARY KEY, body TEXT);");
+    ASSERT(db != NULL);
+    // Many small commits so the WAL spans several decoder chunks
+    for (int i = 0; i < 40; i++) {
+        sqlite3_exec(db, "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 400) "
+                         "INSERT INTO t(body) SELECT printf('row-%08d', random()) FROM n;", NULL, NULL, NULL);
+    }
+
+    WalReader reader;
+    ASSERT(wal_reader_open(&reader, wal) == 0);
+    ASSERT(reader.frame_count > 3 * FRAME_DECODER_CHUNK);
+    PageOwnerMap owners;
+    ASSERT(page_owner_open(&owners, path) == 0);
+
+    uint32_t frame_count;
+    FrameCheck *checks = check_wal_frames(&reader, &owners, NULL, &frame_count);
+    ASSERT(checks != NULL);
+    ASSERT(frame_count == reader.frame_count);
+    for (uint32_t i = 0; i < frame_count; i++) {
+        ASSERT(checks[i].status == FRAME_VALID);
+    }
+
+    OutputSink sequential, parallel;
+    ASSERT(decode_to_sink(&reader, checks, frame_count, 1, OUTPUT_TEXT, &sequential) == 0);
+    ASSERT(decode_to_sink(&reader, checks, frame_count, 4, OUTPUT_TEXT, &parallel) == 0);
+    ASSERT(sequential.size == parallel.size);
+    ASSERT(memcmp(sequential.data, parallel.data, sequential.size) == 0);
+    sink_putc(&sequential, '\0');
+    ASSERT(strstr(sequential.data, "Table Name: t\n") != NULL);
+    sink_free(&sequential);
+    sink_free(&parallel);
+
+    // Structured formats go through the same ordered merge
+    ASSERT(decode_to_sink(&reader, checks, frame_count, 1, OUTPUT_JSON, &sequential) == 0);
+    ASSERT(decode_to_sink(&reader, checks, frame_count, 4, OUTPUT_JSON, &parallel) == 0);
+    ASSERT(sequential.size == parallel.size);
+    ASSERT(memcmp(sequential.data, parallel.data, sequential.size) == 0);
+    uint32_t lines = 0;
+    for (size_t i = 0; i < sequential.size; i++) {
+        lines += sequential.data[i] == '\n';
+    }
+    ASSERT(lines == frame_count);
+    sink_free(&sequential);
+    sink_free(&parallel);
+
+    free(checks);
+    page_owner_close(&owners);
+    wal_reader_close(&reader);
+    remove_wal_db(db, path);
+}
+
+TEST(test_decode_overflow_values) {
+    char path[TEST_PATH_SIZE], wal[TEST_PATH_SIZE];
+    temp_db_path(path, wal, "overflow");
+
+    // Row 1's overflow chain is checkpointed into the database; row 2's is
+    // written to the WAL in the same transaction as the leaf that points at it
+    sqlite3 *db = make_wal_db(path, 1024,
+                              "CREATE TABLE t(id INTEGER PRIMARY KEY, body TEXT);"
+                              "INSERT INTO t VALUES(1, 'old:' || replace(printf('%.3000c', '*'), '*', 'a') || ':end');"
+                              "PRAGMA wal_checkpoint(TRUNCATE);"
+                              "INSERT INTO t VALUES(2, 'new:' || replace(printf('%.3000c', '*'), '*', 'b') || ':end');");
+    ASSERT(db != NULL);
+
+    WalReader reader;
+    ASSERT(wal_reader_open(&reader, wal) == 0);
+    PageOwnerMap owners;
+    ASSERT(page_owner_open(&owners, path) == 0);
+    uint32_t frame_count;
+    FrameCheck *checks = check_wal_frames(&reader, &owners, NULL, &frame_count);
+    ASSERT(checks != NULL);
+
+    FrameIndex index;
+    frame_index_init(&index);
+    ASSERT(frame_index_build(&index, &reader) == (int)frame_count);
+    PageCache cache;
+    ASSERT(page_cache_init(&cache, owners.fd, reader.page_size, 4) == 0);
+    PageSource source;
+    page_source_init(&source, &reader, &index, &cache, reader.page_size, owners.usable_size);
+
+    OutputSink out;
+    ASSERT(sink_init(&out, -1, OUTPUT_TEXT) == 0);
+    ASSERT(decode_wal_frames(&out, &reader, checks, frame_count, &source, 1) == 0);
+    sink_putc(&out, '\0');
+    char *old_value = strstr(out.data, "\"old:aaaa");
+    char *new_value = strstr(out.data, "\"new:bbbb");
+    ASSERT(old_value != NULL && new_value != NULL);
+    ASSERT(old_value && strncmp(old_value + 3005, ":end\"", 5) == 0);
+    ASSERT(new_value && strncmp(new_value + 3005, ":end\"", 5) == 0);
+    ASSERT(strstr(out.data, "(overflow)") == NULL);
+    ASSERT(cache.misses > 0);
+    sink_free(&out);
+
+    // Without a source the values stay on their overflow pages
+    ASSERT(sink_init(&out, -1, OUTPUT_TEXT) == 0);
+    ASSERT(decode_wal_frames(&out, &reader, checks, frame_count, NULL, 1) == 0);
+    sink_putc(&out, '\0');
+    ASSERT(strstr(out.data, "(overflow)") != NULL);
+    ASSERT(strstr(out.data, ":end\"") == NULL);
+    sink_free(&out);
+
+    page_cache_free(&cache);
+    frame_index_free(&index);
+    free(checks);
+    release_frame_arena();
+    page_owner_close(&owners);
+    wal_reader_close(&reader);
+    remove_wal_db(db, path);
+}
+
+// A consumer that leaves a pipe unread until a pipeline stage has waited
+// on a full ring, then drains it. Four decoders' rings hold about half the
+// frames; the other half is several times what the pipe and the writer's
+// sink can take, so that wait comes however the threads are scheduled.
+// The 30 s limit only keeps a broken pipeline from hanging the test.
+typedef struct {
+    int fd;
+    OutputSink received;
+} StalledReader;
+
+static void *read_after_stall(void *arg) {
+    StalledReader *reader = arg;
+    StatsSnapshot *snapshot = malloc(sizeof(StatsSnapshot));
+    for (int waited = 0; snapshot && waited < 30000; waited++) {
+        stats_snapshot(snapshot);
+        if (snapshot->counters[STATS_BACKPRESSURE_WAITS] > 0) {
+            break;
+        }
+        usleep(1000);
+    }
+    free(snapshot);
+    char buffer[65536];
+    ssize_t length;
+    while ((length = read(reader->fd, buffer, sizeof(buffer))) > 0) {
+        sink_write(&reader->received, buffer, (size_t)length);
+    }
+    return NULL;
+}
+
+TEST(test_pipeline_stalled_output) {
+    char path[TEST_PATH_SIZE], wal[TEST_PATH_SIZE];
+    temp_db_path(path, wal, "pipeline");
+    WalGenConfig config;
+    wal_gen_defaults(&config);
+    config.page_size = 1024;
+    config.frames = 4000;
+    config.commit_every = 7;
+    WalGenStats generated;
+    ASSERT(wal_gen_write(&config, path, &generated) == 0);
+    WalReader reader;
+    ASSERT(wal_reader_open(&reader, wal) == 0);
+
+    PageOwnerMap owners;
+    OutputSink expected;
+    PipelineSummary sequential, piped;
+    ASSERT(page_owner_open(&owners, path) == 0);
+    ASSERT(sink_init(&expected, -1, OUTPUT_TEXT) == 0);
+    ASSERT(pipeline_wal_frames(&expected, &reader, &owners, NULL, 1, NULL, 1, &sequential) == 0);
+    page_owner_close(&owners);
+    ASSERT(sequential.decode_count == 4000 && sequential.dropped == 0);
+    ASSERT(expected.size > 8 * OUTPUT_SINK_BUFFER);
+
+    // The writer blocks on the pipe while the reader stalls; the stages
+    // upstream wait on their full rings and nothing is lost. Stats are on
+    // before the consumer starts, which watches them for the first wait.
+    int fds[2];
+    ASSERT(pipe(fds) == 0);
+    StalledReader stalled = { .fd = fds[0] };
+    ASSERT(sink_init(&stalled.received, -1, OUTPUT_TEXT) == 0);
+    stats_enable(1);
+    stats_reset();
+    pthread_t consumer;
+    ASSERT(pthread_create(&consumer, NULL, read_after_stall, &stalled) == 0);
+    OutputSink out;
+    ASSERT(page_owner_open(&owners, path) == 0);
+    ASSERT(sink_init(&out, fds[1], OUTPUT_TEXT) == 0);
+    ASSERT(pipeline_wal_frames(&out, &reader, &owners, NULL, 1, NULL, 4, &piped) == 0);
+    sink_flush(&out);
+    close(fds[1]);
+    pthread_join(consumer, NULL);
+    close(fds[0]);
+
+    StatsSnapshot *snapshot = malloc(sizeof(StatsSnapshot));
+    stats_snapshot(snapshot);
+    ASSERT(snapshot->counters[STATS_BACKPRESSURE_WAITS] > 0);
+    ASSERT(snapshot->counters[STATS_FRAMES] == 4000);
+    ASSERT(snapshot->gauges[STATS_DECODE_QUEUE] == 0 && snapshot->gauges[STATS_DECODE_BACKLOG] == 0);
+    free(snapshot);
+    stats_enable(0);
+    stats_reset();
+
+    ASSERT(piped.decode_count == sequential.decode_count && piped.dropped == sequential.dropped);
+    ASSERT(stalled.received.size == expected.size);
+    ASSERT(memcmp(stalled.received.data, expected.data, expected.size) == 0);
+    sink_free(&out);
+    sink_free(&stalled.received);
+    sink_free(&expected);
+    page_owner_close(&owners);
+    wal_reader_close(&reader);
+    remove_wal_db(NULL, path);
+}
+
+void register_frame_decoder_tests(void) {
+    run_test("test_decode_wal_frames_ordered", test_decode_wal_frames_ordered);
+    run_test("test_pipeline_stalled_output", test_pipeline_stalled_output);
+    run_test("test_decode_overflow_values", test_decode_overflow_values);
+}
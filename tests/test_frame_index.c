@@ -0,0 +1,63 @@
+#include "../frame_index.h"
+#include "test_harness.h"
+
+TEST(test_frame_index_lookup) {
+    FrameIndex index;
+    frame_index_init(&index);
+    // Commit 1: frames 1-3; commit 2: frames 4-5; frame 6 never commits
+    ASSERT(frame_index_add(&index, 1, 2, 0) == 0);
+    ASSERT(frame_index_add(&index, 2, 7, 0) == 0);
+    ASSERT(frame_index_add(&index, 3, 1, 7) == 0);
+    ASSERT(frame_index_add(&index, 4, 2, 0) == 0);
+    ASSERT(frame_index_add(&index, 5, 1, 7) == 0);
+    ASSERT(frame_index_add(&index, 6, 2, 0) == 0);
+
+    ASSERT(index.commit_count == 2);
+    ASSERT(frame_index_commit_frame(&index, 1) == 3);
+    ASSERT(frame_index_commit_frame(&index, 2) == 5);
+    ASSERT(frame_index_commit_frame(&index, 3) == 0);
+    ASSERT(frame_index_last_commit(&index) == 5);
+
+    // Page 2 as of commit 1 and 2; frame 6 is uncommitted and never returned
+    ASSERT(frame_index_lookup(&index, 2, 3) == 1);
+    ASSERT(frame_index_lookup(&index, 2, 5) == 4);
+    ASSERT(frame_index_lookup(&index, 2, 100) == 4);
+    ASSERT(frame_index_latest(&index, 2) == 4);
+    ASSERT(frame_index_latest(&index, 7) == 2);
+    ASSERT(frame_index_lookup(&index, 7, 1) == 0);
+    ASSERT(frame_index_latest(&index, 9) == 0);
+    ASSERT(frame_index_latest(&index, 100000) == 0);
+
+    // Uncommitted frames are visible to find, and each frame maps to its commit
+    ASSERT(frame_index_find(&index, 2, 100) == 6);
+    ASSERT(frame_index_find(&index, 2, 5) == 4);
+    ASSERT(frame_index_commit_covering(&index, 1) == 3);
+    ASSERT(frame_index_commit_covering(&index, 3) == 3);
+    ASSERT(frame_index_commit_covering(&index, 4) == 5);
+    ASSERT(frame_index_commit_covering(&index, 6) == 0);
+
+    frame_index_reset(&index);
+    ASSERT(frame_index_latest(&index, 2) == 0);
+    ASSERT(index.commit_count == 0);
+    frame_index_free(&index);
+}
+
+TEST(test_frame_index_build) {
+    WalReader reader;
+    ASSERT(wal_reader_open(&reader, "./tests/testdata/test.db-wal") == 0);
+    FrameIndex index;
+    frame_index_init(&index);
+    ASSERT(frame_index_build(&index, &reader) == 2);
+    ASSERT(index.commit_count == 2);
+    ASSERT(frame_index_latest(&index, 3) == 2);
+    ASSERT(frame_index_lookup(&index, 3, frame_index_commit_frame(&index, 1)) == 1);
+    ASSERT(frame_index_latest(&index, 2) == 0);
+    ASSERT(index.salt1 == reader.header.salt1);
+    frame_index_free(&index);
+    wal_reader_close(&reader);
+}
+
+void register_frame_index_tests(void) {
+    run_test("test_frame_index_lookup", test_frame_index_lookup);
+    run_test("test_frame_index_build", test_frame_index_build);
+}
@@ -1,4 +1,5 @@
 #include "test_harness.h"
+#include <unistd.h>
 
 int test_failures = 0;
 
@@ -12,3 +13,49 @@ void run_test(const char* name, test_func func) {
     }
     test_failures = 0; // Reset for next test
 }
+
+// Names a scratch database and its WAL
+void temp_db_path(char *path, char *wal, const char *tag) {
+    snprintf(path, TEST_PATH_SIZE, "/tmp/walpulse_%s_%d.db", tag, (int)getpid());
+    if (wal) {
+        snprintf(wal, TEST_PATH_SIZE, "%s-wal", path);
+    }
+}
+
+// Deletes a database with its -wal and -shm files
+static void unlink_db(const char *path) {
+    char sidecar[TEST_PATH_SIZE + 8];
+    unlink(path);
+    snprintf(sidecar, sizeof(sidecar), "%s-wal", path);
+    unlink(sidecar);
+    snprintf(sidecar, sizeof(sidecar), "%s-shm", path);
+    unlink(sidecar);
+}
+
+// Creates a fresh WAL-mode database and runs sql on it; NULL on failure
+sqlite3 *make_wal_db(const char *path, int page_size, const char *sql) {
+    unlink_db(path);
+    sqlite3 *db;
+    if (sqlite3_open(path, &db) != SQLITE_OK) {
+        sqlite3_close(db);
+        return NULL;
+    }
+    // The page size has to be set before WAL mode writes the first page
+    char pragmas[128];
+    int length = page_size ? snprintf(pragmas, sizeof(pragmas), "PRAGMA page_size=%d; ", page_size) : 0;
+    snprintf(pragmas + length, sizeof(pragmas) - length, "PRAGMA journal_mode=WAL; PRAGMA wal_autocheckpoint=0;");
+    if (sqlite3_exec(db, pragmas, NULL, NULL, NULL) != SQLITE_OK ||
+        (sql && sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK)) {
+        sqlite3_close(db);
+        return NULL;
+    }
+    return db;
+}
+
+// Closes a scratch database, if open, and deletes its files
+void remove_wal_db(sqlite3 *db, const char *path) {
+    if (db) {
+        sqlite3_close(db);
+    }
+    unlink_db(path);
+}
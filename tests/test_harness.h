@@ -1,14 +1,26 @@
 #ifndef TEST_HARNESS_H
 #define TEST_HARNESS_H
 
+#include <sqlite3.h>
 #include <stdio.h>
 #define TEST(name) void name(void)
 #define ASSERT(cond) do { if (!(cond)) { printf("Assertion failed: %s, %s:%d\n", #cond, __FILE__, __LINE__); test_failures++; }} while(0)
 
+#define TEST_PATH_SIZE 256
+
 typedef void (*test_func)(void);
 
 void run_test(const char* name, test_func func);
 void run_all_tests(void);
 extern int test_failures;
 
-#endif
\ No newline at end of file
+// Scratch databases: temp_db_path() names /tmp/walpulse_<tag>_<pid>.db and,
+// unless wal is NULL, its WAL (both TEST_PATH_SIZE buffers); make_wal_db()
+// creates the database from scratch in WAL mode with automatic checkpoints
+// off, page_size bytes a page (0 for SQLite's default), and runs sql on it;
+// remove_wal_db() closes it and deletes it with its -wal and -shm files.
+void temp_db_path(char* path, char* wal, const char* tag);
+sqlite3* make_wal_db(const char* path, int page_size, const char* sql);
+void remove_wal_db(sqlite3* db, const char* path);
+
+#endif
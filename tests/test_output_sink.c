@@ -0,0 +1,74 @@
+#include "../output_sink.h"
+#include "test_harness.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+TEST(test_sink_printf_grows) {
+    OutputSink out;
+    ASSERT(sink_init(&out, -1, OUTPUT_TEXT) == 0);
+    size_t initial = out.capacity;
+    // Formatting past the end of a memory sink grows it rather than truncating
+    char *long_text = malloc(initial + 100);
+    ASSERT(long_text != NULL);
+    memset(long_text, 'x', initial + 99);
+    long_text[initial + 99] = '\0';
+    sink_printf(&out, "[%s]", long_text);
+    ASSERT(out.size == initial + 101);
+    ASSERT(out.data[0] == '[' && out.data[out.size - 1] == ']');
+    ASSERT(!out.failed);
+    free(long_text);
+    sink_free(&out);
+}
+
+TEST(test_sink_json_string) {
+    OutputSink out;
+    ASSERT(sink_init(&out, -1, OUTPUT_JSON) == 0);
+    const char text[] = "a\"b\\c\nd\x01" "e";
+    sink_json_string(&out, text, sizeof(text) - 1);
+    const char expected[] = "\"a\\\"b\\\\c\\nd\\u0001e\"";
+    ASSERT(out.size == sizeof(expected) - 1);
+    ASSERT(memcmp(out.data, expected, out.size) == 0);
+    sink_free(&out);
+}
+
+TEST(test_sink_binary_record) {
+    OutputSink out;
+    ASSERT(sink_init(&out, -1, OUTPUT_BINARY) == 0);
+    sink_record_begin(&out, RECORD_SUMMARY);
+    sink_u32(&out, 0x01020304);
+    sink_u8(&out, 1);
+    sink_record_end(&out);
+    const uint8_t expected[] = { 6, 0, 0, 0, RECORD_SUMMARY, 0x04, 0x03, 0x02, 0x01, 1 };
+    ASSERT(out.size == sizeof(expected));
+    ASSERT(memcmp(out.data, expected, sizeof(expected)) == 0);
+    sink_free(&out);
+}
+
+TEST(test_sink_flush_to_fd) {
+    int fds[2];
+    ASSERT(pipe(fds) == 0);
+    OutputSink out;
+    ASSERT(sink_init(&out, fds[1], OUTPUT_TEXT) == 0);
+    sink_puts(&out, "hello ");
+    sink_printf(&out, "%d", 42);
+    ASSERT(sink_flush(&out) == 0);
+    ASSERT(out.size == 0);
+    char buffer[16] = {0};
+    ASSERT(read(fds[0], buffer, sizeof(buffer) - 1) == 8);
+    ASSERT(strcmp(buffer, "hello 42") == 0);
+    sink_free(&out);
+    close(fds[0]);
+    close(fds[1]);
+
+    OutputFormat format;
+    ASSERT(sink_parse_format("json", &format) == 0 && format == OUTPUT_JSON);
+    ASSERT(sink_parse_format("xml", &format) == -1);
+}
+
+void register_output_sink_tests(void) {
+    run_test("test_sink_printf_grows", test_sink_printf_grows);
+    run_test("test_sink_json_string", test_sink_json_string);
+    run_test("test_sink_binary_record", test_sink_binary_record);
+    run_test("test_sink_flush_to_fd", test_sink_flush_to_fd);
+}
@@ -16,15 +16,16 @@ TEST(test_parse_serial_type) {
     ASSERT(strcmp(type_name, "INT8") == 0);
     ASSERT(length == 1);
 
+    // Even serial types from 12 are BLOBs, odd ones from 13 are TEXT
     result = parse_serial_type(12, &type_name, &length);
     ASSERT(result == 0);
-    ASSERT(strcmp(type_name, "TEXT") == 0);
+    ASSERT(strcmp(type_name, "BLOB") == 0);
     ASSERT(length == 0);
 
-    result = parse_serial_type(13, &type_name, &length);
+    result = parse_serial_type(19, &type_name, &length);
     ASSERT(result == 0);
-    ASSERT(strcmp(type_name, "BLOB") == 0);
-    ASSERT(length == 0);
+    ASSERT(strcmp(type_name, "TEXT") == 0);
+    ASSERT(length == 3);
 
     result = parse_serial_type(11, &type_name, &length);
     ASSERT(result == -1);
@@ -34,14 +35,15 @@ TEST(test_parse_cell) {
     uint8_t page_data[] = {
         0x03, // Payload size: 3 bytes
         0x01, // RowID: 1
-        0x02, // Header size: 2 bytes
+        0x03, // Header size: 3 bytes, counting this varint
         0x01, // Serial type: INT8
         0x02  // Serial type: INT16
     };
-    CellInfo cell = parse_cell(page_data, 0, sizeof(page_data));
+    CellInfo cell;
+    ASSERT(parse_cell(&cell, page_data, 0, sizeof(page_data), NULL) == 0);
     ASSERT(cell.payload_size == 3);
     ASSERT(cell.rowid == 1);
-    ASSERT(cell.header_size == 2);
+    ASSERT(cell.header_size == 3);
     printf("Header size: %lld\n", cell.header_size);
     ASSERT(cell.column_count == 2);
     ASSERT(cell.serial_types[0] == 1);
@@ -49,20 +51,66 @@ TEST(test_parse_cell) {
     free_cell_info(&cell);
 }
 
+TEST(test_parse_cell_wide_record) {
+    // 40 columns: more than fit inline, so they come from the arena
+    uint8_t page_data[64] = {
+        0x29, // Payload size: 41-byte header, all columns NULL
+        0x07, // RowID: 7
+        0x29  // Header size: 41 bytes, counting this varint
+    };
+    Arena arena;
+    arena_init(&arena, 0);
+    CellInfo cell;
+    ASSERT(parse_cell(&cell, page_data, 0, sizeof(page_data), &arena) == 0);
+    ASSERT(cell.column_count == 40);
+    ASSERT(cell.serial_types != cell.inline_types);
+    ASSERT(cell.serial_types[39] == 0);
+
+    // Without an arena the types are taken from the heap instead
+    ASSERT(parse_cell(&cell, page_data, 0, sizeof(page_data), NULL) == 0);
+    ASSERT(cell.column_count == 40 && cell.heap_types);
+    free_cell_info(&cell);
+    ASSERT(cell.serial_types == cell.inline_types);
+    arena_free(&arena);
+}
+
 TEST(test_print_page_header) {
-    uint8_t page_data[] = {
+    uint8_t page_data[1024] = {0};
+    uint8_t btree_header[] = {
         0x0D, // Leaf table b-tree page
         0x00, 0x00, // Freeblock offset
         0x00, 0x02, // Cell count: 2
         0x03, 0xFF, // Cell content area start
         0x00  // Fragmented bytes
     };
-    print_page_header(page_data, 1, 1024, "./tests/testdata/test.db");
-    // No direct assertions possible due to output-only function; test for no crash
+    memcpy(page_data + 100, btree_header, sizeof(btree_header)); // Page 1 header follows the database header
+    PageOwnerMap owners;
+    ASSERT(page_owner_open(&owners, "./tests/testdata/test.db") == 0);
+    OutputSink out;
+    ASSERT(sink_init(&out, -1, OUTPUT_TEXT) == 0);
+    print_page_header(&out, page_data, 1, 1024, &owners);
+    page_owner_close(&owners);
+    sink_putc(&out, '\0');
+    ASSERT(strstr(out.data, "Table Name: sqlite_schema") != NULL);
+    sink_free(&out);
+}
+
+TEST(test_btree_local_payload) {
+    // Table leaf on a 4096-byte page keeps up to 4061 bytes locally
+    ASSERT(btree_local_payload(0x0D, 100, 4096) == 100);
+    ASSERT(btree_local_payload(0x0D, 4061, 4096) == 4061);
+    // 5000 bytes: min_local 489 + (5000 - 489) % 4092 = 908
+    ASSERT(btree_local_payload(0x0D, 5000, 4096) == 908);
+    // Index pages spill much earlier (max_local 1002)
+    ASSERT(btree_local_payload(0x0A, 1002, 4096) == 1002);
+    // 1100 bytes: surplus 489 + 611 exceeds max_local, so only min_local stays
+    ASSERT(btree_local_payload(0x0A, 1100, 4096) == 489);
 }
 
 void register_page_analyzer_tests(void) {
     run_test("test_parse_serial_type", test_parse_serial_type);
     run_test("test_parse_cell", test_parse_cell);
+    run_test("test_parse_cell_wide_record", test_parse_cell_wide_record);
     run_test("test_print_page_header", test_print_page_header);
+    run_test("test_btree_local_payload", test_btree_local_payload);
 }
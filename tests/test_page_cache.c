@@ -0,0 +1,249 @@
+#include "../page_cache.h"
+#include "test_harness.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TEST_PAGE_SIZE 512
+
+TEST(test_page_cache_clock) {
+    char path[TEST_PATH_SIZE];
+    temp_db_path(path, NULL, "cache");
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    ASSERT(fd >= 0);
+    // Eight pages, each filled with its own page number
+    uint8_t page[TEST_PAGE_SIZE];
+    for (int i = 1; i <= 8; i++) {
+        memset(page, i, sizeof(page));
+        ASSERT(write(fd, page, sizeof(page)) == (ssize_t)sizeof(page));
+    }
+
+    PageCache cache;
+    ASSERT(page_cache_init(&cache, fd, TEST_PAGE_SIZE, 2) == 0);
+    ASSERT(page_cache_read(&cache, 1, page) == 0 && page[0] == 1 && page[TEST_PAGE_SIZE - 1] == 1);
+    ASSERT(page_cache_read(&cache, 2, page) == 0 && page[0] == 2);
+    ASSERT(cache.misses == 2 && cache.hits == 0);
+    ASSERT(page_cache_read(&cache, 1, page) == 0 && page[0] == 1);
+    ASSERT(cache.hits == 1);
+
+    // Page 1 was used again, so page 2 is the one replaced
+    ASSERT(page_cache_read(&cache, 3, page) == 0 && page[0] == 3);
+    ASSERT(page_cache_read(&cache, 1, page) == 0 && page[0] == 1);
+    ASSERT(cache.hits == 2);
+    ASSERT(page_cache_read(&cache, 2, page) == 0 && page[0] == 2);
+    ASSERT(cache.misses == 4);
+
+    // Pages past the end of the file and page 0 do not exist
+    ASSERT(page_cache_read(&cache, 9, page) == -1);
+    ASSERT(page_cache_read(&cache, 0, page) == -1);
+    ASSERT(page_cache_read(&cache, 8, page) == 0 && page[0] == 8);
+
+    page_cache_free(&cache);
+    close(fd);
+    unlink(path);
+}
+
+TEST(test_page_cache_prefetch) {
+    char path[TEST_PATH_SIZE];
+    temp_db_path(path, NULL, "prefetch");
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    ASSERT(fd >= 0);
+    uint8_t page[TEST_PAGE_SIZE];
+    for (int i = 1; i <= 8; i++) {
+        memset(page, i, sizeof(page));
+        ASSERT(write(fd, page, sizeof(page)) == (ssize_t)sizeof(page));
+    }
+
+    PageCache cache;
+    ASSERT(page_cache_init(&cache, fd, TEST_PAGE_SIZE, 4) == 0);
+    ASSERT(page_cache_read(&cache, 2, page) == 0);
+    // Cached and repeated pages are read once; page 9 is past the end
+    const uint32_t pages[] = { 3, 4, 3, 0, 2, 9, 5, 6 };
+    page_cache_prefetch(&cache, pages, 8);
+    ASSERT(cache.misses == 5);
+    ASSERT(page_cache_read(&cache, 3, page) == 0 && page[0] == 3 && page[TEST_PAGE_SIZE - 1] == 3);
+    ASSERT(page_cache_read(&cache, 4, page) == 0 && page[0] == 4);
+    ASSERT(page_cache_read(&cache, 5, page) == 0 && page[0] == 5);
+    ASSERT(cache.hits == 3 && cache.misses == 5);
+    ASSERT(page_cache_read(&cache, 9, page) == -1);
+
+    page_cache_free(&cache);
+    close(fd);
+    unlink(path);
+}
+
+// Writes count pages, each filled with the low byte of its page number
+static int write_pages(const char *path, int count) {
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    uint8_t page[TEST_PAGE_SIZE];
+    for (int i = 1; fd >= 0 && i <= count; i++) {
+        memset(page, i, sizeof(page));
+        if (write(fd, page, sizeof(page)) != (ssize_t)sizeof(page)) {
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+TEST(test_page_cache_scan_resistance) {
+    char path[TEST_PATH_SIZE];
+    temp_db_path(path, NULL, "scan");
+    int fd = write_pages(path, 120);
+    ASSERT(fd >= 0);
+    PageCache cache;
+    uint8_t page[TEST_PAGE_SIZE];
+    ASSERT(page_cache_init(&cache, fd, TEST_PAGE_SIZE, 8) == 0);
+
+    // A working set used twice, like the interior pages of a b-tree
+    for (int round = 0; round < 2; round++) {
+        for (uint32_t p = 1; p <= 4; p++) {
+            ASSERT(page_cache_read(&cache, p, page) == 0 && page[0] == p);
+        }
+    }
+    // A one-off scan twenty times the cache size only churns the cold slots
+    for (uint32_t p = 10; p <= 100; p++) {
+        ASSERT(page_cache_read(&cache, p, page) == 0 && page[0] == p);
+    }
+    ASSERT(cache.hot_count == 4);
+    ASSERT(cache.evictions == 91 - 4);
+    uint64_t hits = cache.hits;
+    for (uint32_t p = 1; p <= 4; p++) {
+        ASSERT(page_cache_read(&cache, p, page) == 0 && page[0] == p);
+    }
+    ASSERT(cache.hits == hits + 4);
+
+    // A page read again soon after its eviction comes back hot
+    ASSERT(page_cache_read(&cache, 95, page) == 0 && page[0] == 95);
+    ASSERT(cache.hot_count == 5 && cache.hits == hits + 4);
+
+    // A checkpoint empties the cache
+    page_cache_invalidate(&cache);
+    ASSERT(cache.invalidations == 1 && cache.hot_count == 0);
+    ASSERT(page_cache_read(&cache, 1, page) == 0 && page[0] == 1);
+    ASSERT(cache.hits == hits + 4);
+
+    page_cache_free(&cache);
+    close(fd);
+    unlink(path);
+}
+
+TEST(test_page_cache_pin) {
+    char path[TEST_PATH_SIZE];
+    temp_db_path(path, NULL, "pin");
+    int fd = write_pages(path, 8);
+    ASSERT(fd >= 0);
+    PageCache cache;
+    uint8_t page[TEST_PAGE_SIZE];
+    ASSERT(page_cache_init(&cache, fd, TEST_PAGE_SIZE, 4) == 0);
+
+    // A repeated page is read once and pinned twice; page 0 and 9 do not exist
+    const uint32_t pages[] = { 1, 2, 2, 0, 9 };
+    const uint8_t *images[5];
+    page_cache_pin(&cache, pages, 5, images);
+    ASSERT(images[0] && images[0][0] == 1 && images[1] && images[1][TEST_PAGE_SIZE - 1] == 2);
+    ASSERT(images[2] == images[1] && !images[3] && !images[4]);
+    ASSERT(cache.misses == 3);
+
+    // Pinned pages survive reads that cycle through every other slot
+    for (uint32_t p = 3; p <= 8; p++) {
+        ASSERT(page_cache_read(&cache, p, page) == 0 && page[0] == p);
+    }
+    ASSERT(images[0][0] == 1 && images[1][0] == 2);
+
+    // With every slot pinned, reads go around the cache
+    const uint32_t more[] = { 5, 6 };
+    const uint8_t *more_images[2];
+    page_cache_pin(&cache, more, 2, more_images);
+    ASSERT(more_images[0] && more_images[1]);
+    const uint32_t full[] = { 7 };
+    const uint8_t *full_image[1];
+    page_cache_pin(&cache, full, 1, full_image);
+    ASSERT(full_image[0] == NULL);
+    ASSERT(page_cache_read(&cache, 7, page) == 0 && page[0] == 7);
+
+    page_cache_unpin(&cache, more_images, 2);
+    page_cache_unpin(&cache, images, 5);
+    page_cache_pin(&cache, full, 1, full_image);
+    ASSERT(full_image[0] && full_image[0][0] == 7);
+    page_cache_unpin(&cache, full_image, 1);
+
+    page_cache_free(&cache);
+    close(fd);
+    unlink(path);
+}
+
+#define THREAD_TEST_PAGES 64
+#define THREAD_TEST_ROUNDS 2000
+
+typedef struct {
+    PageCache *cache;
+    uint32_t seed;
+    int wrong;
+} CacheWorker;
+
+// Reads and pins overlapping pages, counting any that come back with the wrong bytes
+static void *use_cache(void *arg) {
+    CacheWorker *worker = arg;
+    uint8_t page[TEST_PAGE_SIZE];
+    for (int round = 0; round < THREAD_TEST_ROUNDS; round++) {
+        uint32_t pages[3];
+        for (int i = 0; i < 3; i++) {
+            worker->seed = worker->seed * 1103515245u + 12345u;
+            pages[i] = (worker->seed >> 16) % THREAD_TEST_PAGES + 1;
+        }
+        worker->wrong += page_cache_read(worker->cache, pages[0], page) != 0 || page[0] != pages[0] ||
+                         page[TEST_PAGE_SIZE - 1] != pages[0];
+        const uint8_t *images[3];
+        page_cache_pin(worker->cache, pages, 3, images);
+        for (int i = 0; i < 3; i++) {
+            worker->wrong += images[i] && (images[i][0] != pages[i] || images[i][TEST_PAGE_SIZE - 1] != pages[i]);
+        }
+        page_cache_unpin(worker->cache, images, 3);
+        page_cache_prefetch(worker->cache, pages + 1, 2);
+        if (round % 500 == 499) {
+            page_cache_invalidate(worker->cache);
+        }
+    }
+    return NULL;
+}
+
+TEST(test_page_cache_threads) {
+    char path[TEST_PATH_SIZE];
+    temp_db_path(path, NULL, "cache_threads");
+    int fd = write_pages(path, THREAD_TEST_PAGES);
+    ASSERT(fd >= 0);
+    PageCache cache;
+    ASSERT(page_cache_init(&cache, fd, TEST_PAGE_SIZE, 16) == 0);
+
+    // Misses read with the lock dropped; every page still arrives whole,
+    // and no slot is left loading or pinned
+    CacheWorker workers[4];
+    pthread_t threads[4];
+    for (int i = 0; i < 4; i++) {
+        workers[i] = (CacheWorker){ .cache = &cache, .seed = (uint32_t)i * 7919u + 1 };
+        ASSERT(pthread_create(&threads[i], NULL, use_cache, &workers[i]) == 0);
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+        ASSERT(workers[i].wrong == 0);
+    }
+    for (uint32_t slot = 0; slot < cache.capacity; slot++) {
+        ASSERT(cache.pins[slot] == 0 && !(cache.flags[slot] & PAGE_CACHE_LOADING));
+    }
+    ASSERT(cache.hits > 0 && cache.misses > 0 && cache.readers_busy == 0);
+
+    page_cache_free(&cache);
+    close(fd);
+    unlink(path);
+}
+
+void register_page_cache_tests(void) {
+    run_test("test_page_cache_clock", test_page_cache_clock);
+    run_test("test_page_cache_prefetch", test_page_cache_prefetch);
+    run_test("test_page_cache_scan_resistance", test_page_cache_scan_resistance);
+    run_test("test_page_cache_pin", test_page_cache_pin);
+    run_test("test_page_cache_threads", test_page_cache_threads);
+}
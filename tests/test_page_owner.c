@@ -0,0 +1,184 @@
+#include "../page_owner.h"
+#include "../wal_checksum.h"
+#include "test_harness.h"
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Counts dbstat rows whose owner disagrees with the map
+static int count_owner_mismatches(sqlite3 *db, const PageOwnerMap *map, int *checked) {
+    sqlite3_stmt *stmt;
+    int mismatches = 0;
+    *checked = 0;
+    if (sqlite3_prepare_v2(db, "SELECT name, pageno FROM dbstat", -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *expected = (const char *)sqlite3_column_text(stmt, 0);
+        const char *actual = page_owner_lookup(map, (uint32_t)sqlite3_column_int(stmt, 1));
+        if (!actual || strcmp(actual, expected) != 0) {
+            mismatches++;
+        }
+        (*checked)++;
+    }
+    sqlite3_finalize(stmt);
+    return mismatches;
+}
+
+// Counts dbstat rows where page_owner_watched() disagrees with whether
+// the watched table owns the page
+static int count_watch_mismatches(sqlite3 *db, const PageOwnerMap *map, const char *table, int *checked) {
+    sqlite3_stmt *stmt;
+    int mismatches = 0;
+    *checked = 0;
+    if (sqlite3_prepare_v2(db, "SELECT name, pageno FROM dbstat", -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        int expected = strcmp((const char *)sqlite3_column_text(stmt, 0), table) == 0;
+        mismatches += page_owner_watched(map, (uint32_t)sqlite3_column_int(stmt, 1)) != expected;
+        (*checked)++;
+    }
+    sqlite3_finalize(stmt);
+    return mismatches;
+}
+
+// Applies every frame of a WAL whose checksum chains to a map
+static void apply_wal_frames(PageOwnerMap *map, WalReader *reader) {
+    uint32_t checksum1 = reader->header.checksum1;
+    uint32_t checksum2 = reader->header.checksum2;
+    WalFrameView frame;
+    for (uint32_t n = 1; wal_reader_frame(reader, n, &frame) == 0; n++) {
+        if (!wal_frame_checksum_matches(&frame, &reader->header, &checksum1, &checksum2)) {
+            break;
+        }
+        page_owner_apply_frame(map, reader, &frame);
+    }
+}
+
+// Fills a database with enough rows for interior pages, indexes and overflow chains
+static void populate(sqlite3 *db, const char *table) {
+    char sql[512];
+    snprintf(sql, sizeof(sql),
+             "CREATE TABLE %s(id INTEGER PRIMARY KEY, name TEXT, body BLOB);"
+             "CREATE INDEX %s_name ON %s(name);"
+             "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 2000) "
+             "INSERT INTO %s SELECT i, printf('name-%%06d', i), "
+             "CASE WHEN i %% 97 = 0 THEN zeroblob(6000) ELSE randomblob(40) END FROM n;",
+             table, table, table, table);
+    sqlite3_exec(db, sql, NULL, NULL, NULL);
+}
+
+TEST(test_page_owner_testdata) {
+    PageOwnerMap map;
+    ASSERT(page_owner_open(&map, "./tests/testdata/test.db") == 0);
+    ASSERT(map.page_size == 4096);
+    ASSERT(page_owner_lookup(&map, 1) != NULL && strcmp(page_owner_lookup(&map, 1), "sqlite_schema") == 0);
+    ASSERT(page_owner_lookup(&map, 2) != NULL && strcmp(page_owner_lookup(&map, 2), "abc") == 0);
+    ASSERT(page_owner_lookup(&map, 3) != NULL && strcmp(page_owner_lookup(&map, 3), "def") == 0);
+    ASSERT(page_owner_lookup(&map, 4000) == NULL);
+    page_owner_close(&map);
+
+    ASSERT(page_owner_open(&map, "./tests/testdata/nonexistent.db") == -1);
+}
+
+TEST(test_page_owner_matches_dbstat) {
+    char path[TEST_PATH_SIZE];
+    temp_db_path(path, NULL, "owner");
+    remove_wal_db(NULL, path);
+    sqlite3 *db;
+    ASSERT(sqlite3_open(path, &db) == SQLITE_OK);
+    sqlite3_exec(db, "PRAGMA page_size=1024;", NULL, NULL, NULL);
+    populate(db, "alpha");
+    populate(db, "beta");
+
+    // Both read backends must walk to the same map
+    static const char *const backends[] = { "pread", "io_uring" };
+    for (int b = 0; b < 2; b++) {
+        ASSERT(page_reader_set_backend(backends[b]) == 0);
+        PageOwnerMap map;
+        ASSERT(page_owner_open(&map, path) == 0);
+        ASSERT(map.btree_count == 5); // sqlite_schema, two tables, two indexes
+        int checked;
+        ASSERT(count_owner_mismatches(db, &map, &checked) == 0);
+        ASSERT(checked > 100);
+        page_owner_close(&map);
+    }
+
+    remove_wal_db(db, path);
+}
+
+TEST(test_page_owner_apply_wal) {
+    char path[TEST_PATH_SIZE], wal_path[TEST_PATH_SIZE];
+    temp_db_path(path, wal_path, "owner_wal");
+    sqlite3 *db = make_wal_db(path, 1024, NULL);
+    ASSERT(db != NULL);
+    populate(db, "alpha");
+    sqlite3_exec(db, "PRAGMA wal_checkpoint(TRUNCATE);", NULL, NULL, NULL);
+
+    // Everything below exists only in the WAL: a new table and splits in alpha
+    populate(db, "gamma");
+    sqlite3_exec(db, "INSERT INTO alpha(name, body) SELECT name || '-x', randomblob(200) FROM alpha;", NULL, NULL, NULL);
+
+    PageOwnerMap map;
+    ASSERT(page_owner_open(&map, path) == 0);
+    ASSERT(page_owner_lookup(&map, 2) != NULL);
+
+    WalReader reader;
+    ASSERT(wal_reader_open(&reader, wal_path) == 0);
+    ASSERT(reader.frame_count > 0);
+    apply_wal_frames(&map, &reader);
+    ASSERT(map.btree_count == 5);
+    int checked;
+    ASSERT(count_owner_mismatches(db, &map, &checked) == 0);
+    ASSERT(checked > 100);
+
+    wal_reader_close(&reader);
+    page_owner_close(&map);
+    remove_wal_db(db, path);
+}
+
+TEST(test_page_owner_watch_reused_pages) {
+    char path[TEST_PATH_SIZE], wal_path[TEST_PATH_SIZE];
+    temp_db_path(path, wal_path, "owner_watch");
+    sqlite3 *db = make_wal_db(path, 1024, "CREATE TABLE beta(id INTEGER PRIMARY KEY, body BLOB);"
+                                          "INSERT INTO beta VALUES (1, randomblob(100));");
+    ASSERT(db != NULL);
+    populate(db, "alpha");
+    sqlite3_exec(db, "PRAGMA wal_checkpoint(TRUNCATE);", NULL, NULL, NULL);
+
+    PageOwnerMap map;
+    ASSERT(page_owner_open(&map, path) == 0);
+    static const char *const watched[] = { "alpha" };
+    ASSERT(page_owner_watch(&map, watched, 1) == 0);
+
+    // The watched table frees most of its pages and the unwatched one takes them over
+    sqlite3_exec(db, "DELETE FROM alpha WHERE id > 100;"
+                     "WITH RECURSIVE n(i) AS (SELECT 2 UNION ALL SELECT i + 1 FROM n WHERE i < 2600) "
+                     "INSERT INTO beta SELECT i, randomblob(100) FROM n;",
+                 NULL, NULL, NULL);
+    sqlite3_stmt *stmt;
+    ASSERT(sqlite3_prepare_v2(db, "PRAGMA freelist_count", -1, &stmt, NULL) == SQLITE_OK);
+    ASSERT(sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) < 50);
+    sqlite3_finalize(stmt);
+
+    WalReader reader;
+    ASSERT(wal_reader_open(&reader, wal_path) == 0);
+    apply_wal_frames(&map, &reader);
+    int checked;
+    ASSERT(count_watch_mismatches(db, &map, "alpha", &checked) == 0);
+    ASSERT(checked > 100);
+
+    wal_reader_close(&reader);
+    page_owner_close(&map);
+    remove_wal_db(db, path);
+}
+
+void register_page_owner_tests(void) {
+    run_test("test_page_owner_testdata", test_page_owner_testdata);
+    run_test("test_page_owner_matches_dbstat", test_page_owner_matches_dbstat);
+    run_test("test_page_owner_apply_wal", test_page_owner_apply_wal);
+    run_test("test_page_owner_watch_reused_pages", test_page_owner_watch_reused_pages);
+}
@@ -0,0 +1,80 @@
+#include "../page_reader.h"
+#include "test_harness.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TEST_PAGE_SIZE 512
+#define TEST_PAGES 200
+
+// Reads every page of the file in reverse with the given backend, half of
+// them into the registered region. Returns the number of pages whose
+// contents were wrong.
+static int read_all_pages(const char *backend, int fd, uint32_t *complete) {
+    if (page_reader_set_backend(backend) != 0) {
+        return -1;
+    }
+    uint8_t *registered = malloc((size_t)TEST_PAGES / 2 * TEST_PAGE_SIZE);
+    uint8_t *other = malloc((size_t)TEST_PAGES / 2 * TEST_PAGE_SIZE);
+    PageRead reads[TEST_PAGES + 1];
+    PageReader reader;
+    page_reader_init(&reader, fd, registered, (size_t)TEST_PAGES / 2 * TEST_PAGE_SIZE);
+    for (uint32_t i = 0; i < TEST_PAGES; i++) {
+        uint8_t *base = i % 2 ? registered : other;
+        reads[i].buffer = base + (size_t)(i / 2) * TEST_PAGE_SIZE;
+        reads[i].offset = (uint64_t)(TEST_PAGES - 1 - i) * TEST_PAGE_SIZE;
+        reads[i].length = TEST_PAGE_SIZE;
+    }
+    // One read past the end of the file comes back short
+    reads[TEST_PAGES].buffer = other;
+    reads[TEST_PAGES].offset = (uint64_t)TEST_PAGES * TEST_PAGE_SIZE;
+    reads[TEST_PAGES].length = TEST_PAGE_SIZE;
+    *complete = page_reader_read(&reader, reads, TEST_PAGES + 1);
+
+    int wrong = reads[TEST_PAGES].result != 0;
+    for (uint32_t i = 0; i < TEST_PAGES; i++) {
+        uint8_t expected = (uint8_t)(TEST_PAGES - 1 - i);
+        wrong += reads[i].result != TEST_PAGE_SIZE || reads[i].buffer[0] != expected ||
+                 reads[i].buffer[TEST_PAGE_SIZE - 1] != expected;
+    }
+    page_reader_free(&reader);
+    free(registered);
+    free(other);
+    return wrong;
+}
+
+TEST(test_page_reader_backends) {
+    char path[TEST_PATH_SIZE];
+    temp_db_path(path, NULL, "reader");
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    ASSERT(fd >= 0);
+    uint8_t page[TEST_PAGE_SIZE];
+    for (int i = 0; i < TEST_PAGES; i++) {
+        memset(page, i, sizeof(page));
+        ASSERT(write(fd, page, sizeof(page)) == (ssize_t)sizeof(page));
+    }
+
+    // More reads than the queue holds; io_uring falls back to pread where it is unavailable
+    uint32_t complete;
+    ASSERT(read_all_pages("pread", fd, &complete) == 0);
+    ASSERT(complete == TEST_PAGES);
+    ASSERT(read_all_pages("io_uring", fd, &complete) == 0);
+    ASSERT(complete == TEST_PAGES);
+    ASSERT(page_reader_set_backend("aio") == -1);
+
+    PageReader reader;
+    ASSERT(page_reader_set_backend("pread") == 0);
+    page_reader_init(&reader, fd, NULL, 0);
+    ASSERT(strcmp(page_reader_name(&reader), "pread") == 0);
+    page_reader_free(&reader);
+    ASSERT(page_reader_set_backend("io_uring") == 0);
+
+    close(fd);
+    unlink(path);
+}
+
+void register_page_reader_tests(void) {
+    run_test("test_page_reader_backends", test_page_reader_backends);
+}
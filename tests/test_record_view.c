@@ -0,0 +1,152 @@
+#include "../record_view.h"
+#include "test_harness.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+TEST(test_record_view_columns) {
+    uint8_t page_data[128] = {0};
+    uint8_t cell[] = {
+        0x25,                   // Payload size: 9-byte header + 28-byte body
+        0x2A,                   // RowID: 42
+        0x09,                   // Header size: 9 bytes, counting this varint
+        0x01, 0x03, 0x05, 0x07, // INT8, INT24, INT48, FLOAT64
+        0x17, 0x12, 0x00, 0x09, // TEXT(5), BLOB(3), NULL, ONE
+        0xFB,                               // -5
+        0xFF, 0xFF, 0xFE,                   // -2
+        0x01, 0x00, 0x00, 0x00, 0x00, 0x00, // 2^40
+        0x40, 0x0C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // 3.5
+        'h', 'e', 'l', 'l', 'o',
+        0xDE, 0xAD, 0xBE
+    };
+    memcpy(page_data + 10, cell, sizeof(cell));
+
+    CellInfo info;
+    ASSERT(parse_cell(&info, page_data, 10, sizeof(page_data), NULL) == 0);
+    ASSERT(info.rowid == 42 && info.column_count == 8 && info.record_offset == 12);
+    RecordView view;
+    ASSERT(record_view_init(&view, &info, page_data, sizeof(page_data), NULL, NULL) == 0);
+
+    int64_t integer;
+    ASSERT(record_column_int64(&view, 0, &integer) == 0 && integer == -5);
+    ASSERT(record_column_int64(&view, 1, &integer) == 0 && integer == -2);
+    ASSERT(record_column_int64(&view, 2, &integer) == 0 && integer == (int64_t)1 << 40);
+    ASSERT(record_column_int64(&view, 7, &integer) == 0 && integer == 1);
+    double real;
+    ASSERT(record_column_double(&view, 3, &real) == 0 && real == 3.5);
+    const uint8_t *bytes;
+    uint32_t length;
+    ASSERT(record_column_class(&view, 4) == SERIAL_TEXT);
+    ASSERT(record_column_bytes(&view, 4, &bytes, &length) == 0 && length == 5);
+    ASSERT(memcmp(bytes, "hello", 5) == 0 && bytes == page_data + 12 + 9 + 18);
+    ASSERT(record_column_class(&view, 5) == SERIAL_BLOB);
+    ASSERT(record_column_bytes(&view, 5, &bytes, &length) == 0 && length == 3 && bytes[0] == 0xDE);
+    ASSERT(record_column_class(&view, 6) == SERIAL_NULL);
+
+    // Wrong type or column
+    ASSERT(record_column_int64(&view, 4, &integer) == -1);
+    ASSERT(record_column_double(&view, 0, &real) == -1);
+    ASSERT(record_column_bytes(&view, 8, &bytes, &length) == -1);
+    record_view_free(&view);
+    free_cell_info(&info);
+}
+
+TEST(test_record_view_overflow) {
+    // A 5000-byte TEXT column on a 1024-byte page spills past the local bytes
+    uint8_t page_data[1024] = {0};
+    uint8_t cell[] = {
+        0xA7, 0x0B,             // Payload size: 3 + 5000 = 5003
+        0x01,                   // RowID: 1
+        0x03,                   // Header size: 3 bytes
+        0xCE, 0x1D              // TEXT(5000): 13 + 2 * 5000 = 10013
+    };
+    memcpy(page_data + 100, cell, sizeof(cell));
+    CellInfo info;
+    ASSERT(parse_cell(&info, page_data, 100, sizeof(page_data), NULL) == 0);
+    ASSERT(info.payload_size == 5003);
+    RecordView view;
+    ASSERT(record_view_init(&view, &info, page_data, sizeof(page_data), NULL, NULL) == 0);
+    ASSERT(record_column_class(&view, 0) == SERIAL_TEXT);
+    ASSERT(!record_column_available(&view, 0));
+    const uint8_t *bytes;
+    uint32_t length;
+    ASSERT(record_column_bytes(&view, 0, &bytes, &length) == -1);
+    ASSERT(record_column_fetch(&view, 0, &bytes, &length) == -1);
+    record_view_free(&view);
+}
+
+TEST(test_record_view_overflow_chain) {
+    // The same 5000-byte TEXT column, with its overflow chain on pages 3-6
+    // of a database file whose chain runs backwards through the file
+    enum { PAGE = 1024 };
+    uint8_t page_data[PAGE] = {0};
+    uint8_t cell[] = { 0xA7, 0x0B, 0x01, 0x03, 0xCE, 0x1D };
+    memcpy(page_data + 50, cell, sizeof(cell));
+    uint8_t text[5000];
+    for (uint32_t i = 0; i < sizeof(text); i++) {
+        text[i] = (uint8_t)('a' + i % 26);
+    }
+    uint32_t local = btree_local_payload(0x0D, 5003, PAGE);
+    ASSERT(local > 3 && 53 + local + 4 <= PAGE);
+    memcpy(page_data + 56, text, local - 3);
+    uint8_t *pointer = page_data + 53 + local;
+    pointer[0] = 0; pointer[1] = 0; pointer[2] = 0; pointer[3] = 6;
+
+    char path[TEST_PATH_SIZE];
+    temp_db_path(path, NULL, "overflow");
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    ASSERT(fd >= 0);
+    static uint8_t file[6 * PAGE];
+    memset(file, 0, sizeof(file));
+    uint32_t copied = local - 3;
+    uint32_t chain[] = { 6, 5, 4, 3 };
+    for (int i = 0; i < 4; i++) {
+        uint8_t *overflow = file + (chain[i] - 1) * PAGE;
+        uint32_t next = i < 3 ? chain[i + 1] : 0;
+        overflow[3] = (uint8_t)next;
+        uint32_t count = sizeof(text) - copied < PAGE - 4 ? sizeof(text) - copied : PAGE - 4;
+        memcpy(overflow + 4, text + copied, count);
+        copied += count;
+    }
+    ASSERT(copied == sizeof(text));
+    ASSERT(write(fd, file, sizeof(file)) == (ssize_t)sizeof(file));
+
+    PageCache cache;
+    ASSERT(page_cache_init(&cache, fd, PAGE, 2) == 0);
+    PageSource source;
+    page_source_init(&source, NULL, NULL, &cache, PAGE, PAGE);
+    Arena arena;
+    arena_init(&arena, 0);
+
+    CellInfo info;
+    ASSERT(parse_cell(&info, page_data, 50, PAGE, NULL) == 0);
+    RecordView view;
+    ASSERT(record_view_init(&view, &info, page_data, PAGE, &source, &arena) == 0);
+    ASSERT(view.overflow_page == 6);
+    const uint8_t *bytes;
+    uint32_t length;
+    ASSERT(record_column_bytes(&view, 0, &bytes, &length) == -1);
+    ASSERT(record_column_fetch(&view, 0, &bytes, &length) == 0);
+    ASSERT(length == sizeof(text) && memcmp(bytes, text, sizeof(text)) == 0);
+    ASSERT(cache.misses == 4);
+
+    // A chain that ends early is reported, not read past
+    file[(4 - 1) * PAGE + 3] = 0;
+    ASSERT(pwrite(fd, file, sizeof(file), 0) == (ssize_t)sizeof(file));
+    page_cache_free(&cache);
+    ASSERT(page_cache_init(&cache, fd, PAGE, 2) == 0);
+    ASSERT(record_column_fetch(&view, 0, &bytes, &length) == -1);
+    record_view_free(&view);
+
+    arena_free(&arena);
+    page_cache_free(&cache);
+    close(fd);
+    unlink(path);
+}
+
+void register_record_view_tests(void) {
+    run_test("test_record_view_columns", test_record_view_columns);
+    run_test("test_record_view_overflow", test_record_view_overflow);
+    run_test("test_record_view_overflow_chain", test_record_view_overflow_chain);
+}
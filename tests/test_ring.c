@@ -0,0 +1,101 @@
+#include "../ring.h"
+#include "test_harness.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#define RING_TEST_VALUES 1000000
+
+TEST(test_ring_batches) {
+    Ring ring;
+    ASSERT(ring_init(&ring, 5) == 0);
+    ASSERT(ring.mask == 7);
+    uint64_t values[10], out[10];
+    for (int i = 0; i < 10; i++) {
+        values[i] = 100 + i;
+    }
+    // A push takes what fits; the rest waits for the consumer
+    ASSERT(ring_push(&ring, values, 10) == 8);
+    ASSERT(ring_space(&ring) == 0 && ring_depth(&ring) == 8);
+    ASSERT(ring_push(&ring, values + 8, 2) == 0);
+
+    // Peeked values stay queued until they are released
+    ASSERT(ring_peek(&ring, out, 3) == 3);
+    ASSERT(out[0] == 100 && out[2] == 102);
+    ASSERT(ring_space(&ring) == 0);
+    ring_release(&ring, 3);
+    ASSERT(ring_space(&ring) == 3);
+
+    // Indices wrap around the slots
+    ASSERT(ring_push(&ring, values + 8, 2) == 2);
+    ASSERT(ring_pop(&ring, out, 10) == 7);
+    ASSERT(out[0] == 103 && out[4] == 107 && out[5] == 108 && out[6] == 109);
+    ASSERT(ring_pop(&ring, out, 10) == 0);
+
+    ASSERT(!ring_finished(&ring));
+    ASSERT(ring_push(&ring, values, 1) == 1);
+    ring_close(&ring);
+    ASSERT(!ring_finished(&ring));
+    ASSERT(ring_pop(&ring, out, 1) == 1 && out[0] == 100);
+    ASSERT(ring_finished(&ring));
+    ring_free(&ring);
+}
+
+// Pushes 1..RING_TEST_VALUES in batches of varying size
+static void *produce_values(void *arg) {
+    Ring *ring = arg;
+    uint64_t batch[16];
+    uint64_t next = 1;
+    uint32_t spins = 0;
+    while (next <= RING_TEST_VALUES) {
+        uint32_t size = (uint32_t)(next % 16) + 1;
+        if (size > RING_TEST_VALUES - next + 1) {
+            size = (uint32_t)(RING_TEST_VALUES - next + 1);
+        }
+        for (uint32_t i = 0; i < size; i++) {
+            batch[i] = next + i;
+        }
+        uint32_t pushed = ring_push(ring, batch, size);
+        next += pushed;
+        if (pushed == 0) {
+            ring_backoff(&spins);
+        } else {
+            spins = 0;
+        }
+    }
+    ring_close(ring);
+    return NULL;
+}
+
+TEST(test_ring_threads) {
+    Ring ring;
+    ASSERT(ring_init(&ring, 64) == 0);
+    pthread_t producer;
+    ASSERT(pthread_create(&producer, NULL, produce_values, &ring) == 0);
+    uint64_t expected = 1, out[32];
+    int in_order = 1;
+    uint32_t spins = 0;
+    for (;;) {
+        uint32_t count = ring_pop(&ring, out, 32);
+        if (count == 0) {
+            if (ring_finished(&ring)) {
+                break;
+            }
+            ring_backoff(&spins);
+            continue;
+        }
+        spins = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            in_order &= out[i] == expected++;
+        }
+    }
+    pthread_join(producer, NULL);
+    ASSERT(in_order);
+    ASSERT(expected == RING_TEST_VALUES + 1);
+    ring_free(&ring);
+}
+
+void register_ring_tests(void) {
+    run_test("test_ring_batches", test_ring_batches);
+    run_test("test_ring_threads", test_ring_threads);
+}
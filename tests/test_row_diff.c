@@ -0,0 +1,242 @@
+#include "../row_diff.h"
+#include "../wal_parser.h"
+#include "../output_sink.h"
+#include "../subscription.h"
+#include "test_harness.h"
+#include <sqlite3.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TEST_PAGE_SIZE 512
+#define ROWID_LIMIT 2048
+
+// Fills a table leaf page with one-column TEXT records, cells in rowid order
+static void build_leaf(uint8_t *page, const int64_t *rowids, const char **values, int count) {
+    memset(page, 0, TEST_PAGE_SIZE);
+    page[0] = 0x0D;
+    page[3] = (uint8_t)(count >> 8);
+    page[4] = (uint8_t)count;
+    uint32_t content = TEST_PAGE_SIZE;
+    for (int i = 0; i < count; i++) {
+        uint8_t length = (uint8_t)strlen(values[i]);
+        uint8_t cell[64] = {
+            (uint8_t)(2 + length),          // Payload: 2-byte header + text
+            (uint8_t)rowids[i],
+            2,                              // Header size
+            (uint8_t)(13 + 2 * length)      // TEXT(length)
+        };
+        memcpy(cell + 4, values[i], length);
+        content -= 4 + length;
+        memcpy(page + content, cell, 4 + length);
+        page[8 + 2 * i] = (uint8_t)(content >> 8);
+        page[9 + 2 * i] = (uint8_t)content;
+    }
+    page[5] = (uint8_t)(content >> 8);
+    page[6] = (uint8_t)content;
+}
+
+TEST(test_row_diff_pages) {
+    uint8_t old_page[TEST_PAGE_SIZE], new_page[TEST_PAGE_SIZE];
+    int64_t old_rowids[] = { 1, 2, 3 };
+    const char *old_values[] = { "one", "two", "three" };
+    int64_t new_rowids[] = { 1, 2, 4 };
+    const char *new_values[] = { "one", "TWO", "four" };
+    build_leaf(old_page, old_rowids, old_values, 3);
+    build_leaf(new_page, new_rowids, new_values, 3);
+
+    RowDiff diff;
+    row_diff_init(&diff);
+    ASSERT(row_diff_pages(&diff, old_page, new_page, 2, TEST_PAGE_SIZE, TEST_PAGE_SIZE, 0, 0) == 0);
+    ASSERT(diff.count == 3);
+    ASSERT(diff.cells_compared == 2);
+    ASSERT(diff.changes[0].type == ROW_UPDATE && diff.changes[0].rowid == 2);
+    ASSERT(diff.changes[1].type == ROW_DELETE && diff.changes[1].rowid == 3);
+    ASSERT(diff.changes[2].type == ROW_INSERT && diff.changes[2].rowid == 4);
+
+    // Identical pages are skipped without looking at the cells
+    row_diff_reset(&diff);
+    ASSERT(row_diff_pages(&diff, old_page, old_page, 2, TEST_PAGE_SIZE, TEST_PAGE_SIZE, 0, 0) == 0);
+    ASSERT(diff.count == 0 && diff.cells_compared == 0);
+
+    // A leaf handed to another table loses its rows from the old one, even unchanged
+    row_diff_reset(&diff);
+    ASSERT(row_diff_pages(&diff, old_page, old_page, 2, TEST_PAGE_SIZE, TEST_PAGE_SIZE, 0, 1) == 0);
+    ASSERT(diff.count == 6 && diff.cells_compared == 0);
+    ASSERT(diff.changes[0].type == ROW_DELETE && diff.changes[0].table == 0);
+    ASSERT(diff.changes[3].type == ROW_INSERT && diff.changes[3].table == 1 && diff.changes[3].rowid == 1);
+
+    // A page that did not exist before holds only inserts
+    row_diff_reset(&diff);
+    ASSERT(row_diff_pages(&diff, NULL, new_page, 3, TEST_PAGE_SIZE, TEST_PAGE_SIZE, 0, 0) == 0);
+    ASSERT(diff.count == 3 && diff.changes[0].type == ROW_INSERT);
+    row_diff_free(&diff);
+}
+
+TEST(test_row_diff_reconcile) {
+    // Rows 5 and 6 move from page 2, now an interior page, to page 3; row 6
+    // is also changed, and row 5 of another table is deleted
+    uint8_t old_page[TEST_PAGE_SIZE], new_page[TEST_PAGE_SIZE], interior[TEST_PAGE_SIZE];
+    int64_t rowids[] = { 5, 6 };
+    const char *old_values[] = { "five", "six" };
+    const char *new_values[] = { "five", "SIX" };
+    build_leaf(old_page, rowids, old_values, 2);
+    build_leaf(new_page, rowids, new_values, 2);
+    memset(interior, 0, sizeof(interior));
+    interior[0] = 0x05;
+
+    RowDiff diff;
+    row_diff_init(&diff);
+    ASSERT(row_diff_pages(&diff, old_page, interior, 2, TEST_PAGE_SIZE, TEST_PAGE_SIZE, 0, 0) == 0);
+    ASSERT(row_diff_pages(&diff, NULL, new_page, 3, TEST_PAGE_SIZE, TEST_PAGE_SIZE, 0, 0) == 0);
+    ASSERT(row_diff_pages(&diff, old_page, NULL, 9, TEST_PAGE_SIZE, TEST_PAGE_SIZE, 1, 1) == 0);
+    ASSERT(diff.count == 6);
+    row_diff_reconcile(&diff);
+    ASSERT(diff.count == 3);
+    ASSERT(diff.changes[0].type == ROW_UPDATE && diff.changes[0].rowid == 6 && diff.changes[0].table == 0);
+    ASSERT(diff.changes[0].page_number == 3);
+    ASSERT(diff.changes[1].type == ROW_DELETE && diff.changes[1].rowid == 5 && diff.changes[1].table == 1);
+    ASSERT(diff.changes[2].type == ROW_DELETE && diff.changes[2].rowid == 6 && diff.changes[2].table == 1);
+    row_diff_free(&diff);
+}
+
+TEST(test_print_wal_rows) {
+    char path[TEST_PATH_SIZE], wal[TEST_PATH_SIZE];
+    temp_db_path(path, wal, "rows");
+    sqlite3 *db = make_wal_db(path, 1024,
+                              "CREATE TABLE t(id INTEGER PRIMARY KEY, v TEXT);"
+                              "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 40) "
+                              "INSERT INTO t SELECT i, printf('v%05d', i) FROM n;"
+                              "PRAGMA wal_checkpoint(TRUNCATE);"
+                              "UPDATE t SET v = 'changed' WHERE id = 5;"
+                              "DELETE FROM t WHERE id = 7;"
+                              // Enough rows to split the root; the old rows move but do not change
+                              "WITH RECURSIVE n(i) AS (SELECT 100 UNION ALL SELECT i + 1 FROM n WHERE i < 199) "
+                              "INSERT INTO t SELECT i, printf('w%05d', i) FROM n;");
+    ASSERT(db != NULL);
+
+    OutputSink out;
+    ASSERT(sink_init(&out, -1, OUTPUT_TEXT) == 0);
+    ASSERT(print_wal_rows(&out, wal, NULL, NULL) == 0);
+    sink_putc(&out, '\0');
+    ASSERT(strstr(out.data, "UPDATE t rowid 5 ") != NULL);
+    ASSERT(strstr(out.data, "DELETE t rowid 7 ") != NULL);
+    ASSERT(strstr(out.data, "INSERT t rowid 100 ") != NULL);
+    ASSERT(strstr(out.data, "INSERT t rowid 199 ") != NULL);
+    ASSERT(strstr(out.data, "rowid 1 ") == NULL);
+    int deletes = 0, inserts = 0;
+    for (char *p = out.data; (p = strstr(p, "\nDELETE ")) != NULL; p++) {
+        deletes++;
+    }
+    for (char *p = out.data; (p = strstr(p, "\nINSERT ")) != NULL; p++) {
+        inserts++;
+    }
+    ASSERT(deletes == 1 && inserts == 100);
+    sink_free(&out);
+    remove_wal_db(db, path);
+}
+
+// Applies "INSERT|DELETE|UPDATE <table> rowid <n>" lines to per-table rowid
+// sets, t1 in present[0] and t2 in present[1]; returns the number of events
+// that did not fit the rows present at the time
+static int replay_row_events(const char *events, uint8_t present[2][ROWID_LIMIT]) {
+    int bad = 0;
+    for (const char *line = events; line && *line; line = strchr(line, '\n'), line = line ? line + 1 : NULL) {
+        char type[8], table[16];
+        long long rowid;
+        if (*line == '\n' || sscanf(line, "%7s %15s rowid %lld", type, table, &rowid) != 3 || rowid < 0 || rowid >= ROWID_LIMIT) {
+            continue;
+        }
+        int t = strcmp(table, "t1") == 0 ? 0 : strcmp(table, "t2") == 0 ? 1 : -1;
+        if (t < 0) {
+            bad++;
+        } else if (strcmp(type, "INSERT") == 0) {
+            bad += present[t][rowid];
+            present[t][rowid] = 1;
+        } else if (strcmp(type, "DELETE") == 0) {
+            bad += !present[t][rowid];
+            present[t][rowid] = 0;
+        } else {
+            bad += !present[t][rowid];
+        }
+    }
+    return bad;
+}
+
+// Returns the number of rowids whose presence in a table differs from expected
+static int count_rowid_mismatches(sqlite3 *db, const char *table, const uint8_t *expected) {
+    uint8_t actual[ROWID_LIMIT] = { 0 };
+    char sql[64];
+    snprintf(sql, sizeof(sql), "SELECT id FROM %s", table);
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        int64_t id = sqlite3_column_int64(stmt, 0);
+        if (id >= 0 && id < ROWID_LIMIT) {
+            actual[id] = 1;
+        }
+    }
+    sqlite3_finalize(stmt);
+    int mismatches = 0;
+    for (int i = 0; i < ROWID_LIMIT; i++) {
+        mismatches += actual[i] != expected[i];
+    }
+    return mismatches;
+}
+
+TEST(test_print_wal_rows_moved_leaf) {
+    char path[TEST_PATH_SIZE], wal[TEST_PATH_SIZE];
+    temp_db_path(path, wal, "rows_moved");
+    sqlite3 *db = make_wal_db(path, 1024,
+                              "CREATE TABLE t1(id INTEGER PRIMARY KEY, v TEXT);"
+                              "CREATE TABLE t2(id INTEGER PRIMARY KEY, v TEXT);"
+                              "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 600) "
+                              "INSERT INTO t1 SELECT i, printf('%040d', i) FROM n;"
+                              "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 50) "
+                              "INSERT INTO t2 SELECT i, printf('%040d', i) FROM n;"
+                              "PRAGMA wal_checkpoint(TRUNCATE);"
+                              // Leaves freed by t1 are handed to t2 in the same transaction
+                              "BEGIN;"
+                              "DELETE FROM t1 WHERE id % 4 != 0 OR id BETWEEN 200 AND 400;"
+                              "WITH RECURSIVE n(i) AS (SELECT 1000 UNION ALL SELECT i + 1 FROM n WHERE i < 1599) "
+                              "INSERT INTO t2 SELECT i, printf('%040d', i) FROM n;"
+                              "COMMIT;");
+    ASSERT(db != NULL);
+
+    Subscription both, first;
+    subscription_init(&both);
+    subscription_init(&first);
+    ASSERT(subscription_add(&both, "t1") == 0);
+    ASSERT(subscription_add(&both, "t2") == 0);
+    ASSERT(subscription_add(&first, "t1") == 0);
+    const Subscription *runs[] = { NULL, &both, &first };
+    for (int run = 0; run < 3; run++) {
+        uint8_t present[2][ROWID_LIMIT] = { { 0 } };
+        memset(present[0] + 1, 1, 600);
+        memset(present[1] + 1, 1, 50);
+        OutputSink out;
+        ASSERT(sink_init(&out, -1, OUTPUT_TEXT) == 0);
+        ASSERT(print_wal_rows(&out, wal, runs[run], NULL) == 0);
+        sink_putc(&out, '\0');
+        ASSERT(replay_row_events(out.data, present) == 0);
+        ASSERT(count_rowid_mismatches(db, "t1", present[0]) == 0);
+        if (runs[run] == &first) {
+            ASSERT(strstr(out.data, " t2 rowid ") == NULL);
+        } else {
+            ASSERT(count_rowid_mismatches(db, "t2", present[1]) == 0);
+        }
+        sink_free(&out);
+    }
+    subscription_free(&both);
+    subscription_free(&first);
+    remove_wal_db(db, path);
+}
+
+void register_row_diff_tests(void) {
+    run_test("test_row_diff_pages", test_row_diff_pages);
+    run_test("test_row_diff_reconcile", test_row_diff_reconcile);
+    run_test("test_print_wal_rows", test_print_wal_rows);
+    run_test("test_print_wal_rows_moved_leaf", test_print_wal_rows_moved_leaf);
+}
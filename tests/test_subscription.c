@@ -0,0 +1,119 @@
+#include "../subscription.h"
+#include "../frame_decoder.h"
+#include "../wal_parser.h"
+#include "test_harness.h"
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+TEST(test_subscription_specs) {
+    Subscription subscription;
+    subscription_init(&subscription);
+    ASSERT(subscription_add(&subscription, "orders") == 0);
+    ASSERT(subscription_add(&subscription, "items:rowid=10..20:columns=3,1,3") == 0);
+    ASSERT(subscription_add(&subscription, "users:rowid=..-5") == 0);
+    ASSERT(subscription_add(&subscription, "") != 0);
+    ASSERT(subscription_add(&subscription, "t:rowid=5") != 0);
+    ASSERT(subscription_add(&subscription, "t:rowid=9..1") != 0);
+    ASSERT(subscription_add(&subscription, "t:columns=1,x") != 0);
+    ASSERT(subscription_add(&subscription, "t:color=red") != 0);
+    ASSERT(subscription.count == 3);
+    ASSERT(strcmp(subscription.names[1], "items") == 0);
+
+    const SubscribedTable *orders = subscription_find(&subscription, "orders");
+    ASSERT(orders != NULL);
+    ASSERT(subscription_rowid_matches(orders, INT64_MIN) && subscription_rowid_matches(orders, INT64_MAX));
+    ASSERT(subscription_column_matches(orders, 7));
+
+    const SubscribedTable *items = subscription_find(&subscription, "items");
+    ASSERT(items != NULL && items->column_count == 2);
+    ASSERT(subscription_rowid_matches(items, 10) && subscription_rowid_matches(items, 20));
+    ASSERT(!subscription_rowid_matches(items, 9) && !subscription_rowid_matches(items, 21));
+    ASSERT(subscription_column_matches(items, 1) && subscription_column_matches(items, 3));
+    ASSERT(!subscription_column_matches(items, 0) && !subscription_column_matches(items, 2));
+
+    const SubscribedTable *users = subscription_find(&subscription, "users");
+    ASSERT(subscription_rowid_matches(users, -5) && !subscription_rowid_matches(users, -4));
+    ASSERT(subscription_find(&subscription, "missing") == NULL);
+    ASSERT(subscription_find(&subscription, NULL) == NULL);
+    subscription_free(&subscription);
+    ASSERT(subscription.count == 0);
+}
+
+TEST(test_subscription_filter) {
+    char path[TEST_PATH_SIZE], wal[TEST_PATH_SIZE];
+    temp_db_path(path, wal, "subscription");
+
+    sqlite3 *db = make_wal_db(path, 1024,
+                              "CREATE TABLE noise(id INTEGER PRIMARY KEY, v TEXT);"
+                              "CREATE TABLE t(id INTEGER PRIMARY KEY, a TEXT, b INTEGER);"
+                              "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 300) "
+                              "INSERT INTO noise SELECT i, printf('%0100d', i) FROM n;"
+                              "INSERT INTO t VALUES (1, 'one', 1), (2, 'two', 2), (3, 'three', 3);"
+                              "PRAGMA wal_checkpoint(TRUNCATE);"
+                              "UPDATE t SET a = 'ONE' WHERE id = 1;"
+                              "UPDATE t SET b = 20 WHERE id = 2;"
+                              "DELETE FROM noise WHERE id < 200;"
+                              // The freed noise pages are reused as t grows past its root
+                              "WITH RECURSIVE n(i) AS (SELECT 100 UNION ALL SELECT i + 1 FROM n WHERE i < 199) "
+                              "INSERT INTO t SELECT i, printf('%050d', i), i FROM n;");
+    ASSERT(db != NULL);
+
+    WalReader reader;
+    ASSERT(wal_reader_open(&reader, wal) == 0);
+    PageOwnerMap all_owners, owners;
+    ASSERT(page_owner_open(&all_owners, path) == 0);
+    uint32_t frame_count;
+    FrameCheck *all = check_wal_frames(&reader, &all_owners, NULL, &frame_count);
+
+    Subscription subscription;
+    subscription_init(&subscription);
+    ASSERT(subscription_add(&subscription, "t") == 0);
+    ASSERT(page_owner_open(&owners, path) == 0);
+    ASSERT(page_owner_watch(&owners, subscription.names, subscription.count) == 0);
+    FrameCheck *filtered = check_wal_frames(&reader, &owners, &subscription, &frame_count);
+    ASSERT(all != NULL && filtered != NULL);
+    // Exactly the frames an unfiltered pass attributes to t are kept
+    uint32_t kept = 0, skipped = 0;
+    for (uint32_t n = 0; n < frame_count; n++) {
+        int in_t = all[n].table_name && strcmp(all[n].table_name, "t") == 0;
+        ASSERT(filtered[n].skipped == !in_t);
+        ASSERT(filtered[n].status == all[n].status && filtered[n].checksum1 == all[n].checksum1);
+        if (!filtered[n].skipped) {
+            ASSERT(filtered[n].filter == subscription_find(&subscription, "t"));
+        }
+        kept += !filtered[n].skipped;
+        skipped += filtered[n].skipped;
+    }
+    ASSERT(kept > 0 && skipped > 0);
+    free(all);
+    free(filtered);
+    page_owner_close(&all_owners);
+    page_owner_close(&owners);
+    wal_reader_close(&reader);
+    subscription_free(&subscription);
+
+    // Rows outside the range and updates to other columns are left out
+    subscription_init(&subscription);
+    ASSERT(subscription_add(&subscription, "t:rowid=..150:columns=2") == 0);
+    OutputSink out;
+    ASSERT(sink_init(&out, -1, OUTPUT_TEXT) == 0);
+    ASSERT(print_wal_rows(&out, wal, &subscription, NULL) == 0);
+    sink_putc(&out, '\0');
+    ASSERT(strstr(out.data, "noise") == NULL);
+    ASSERT(strstr(out.data, "UPDATE t rowid 1 ") == NULL);
+    ASSERT(strstr(out.data, "UPDATE t rowid 2 ") != NULL);
+    ASSERT(strstr(out.data, "INSERT t rowid 150 ") != NULL);
+    ASSERT(strstr(out.data, "INSERT t rowid 151 ") == NULL);
+    sink_free(&out);
+    subscription_free(&subscription);
+
+    remove_wal_db(db, path);
+}
+
+void register_subscription_tests(void) {
+    run_test("test_subscription_specs", test_subscription_specs);
+    run_test("test_subscription_filter", test_subscription_filter);
+}
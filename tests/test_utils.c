@@ -1,5 +1,6 @@
 #include "../utils.h"
 #include "test_harness.h"
+#include <string.h>
 
 TEST(test_to_host32) {
     uint32_t big_endian = 0x12345678;
@@ -31,13 +32,45 @@ TEST(test_parse_varint) {
     ASSERT(result3 == -1);
 }
 
-TEST(test_compute_wal_checksum) {
-    uint8_t data[] = {0x01, 0x02, 0x03};
-    uint32_t checksum1 = 0;
-    uint32_t checksum2 = 0;
-    compute_wal_checksum(data, sizeof(data), &checksum1, &checksum2);
-    ASSERT(checksum1 == 0x06); // 1 + 2 + 3
-    ASSERT(checksum2 == 0x0A); // (0+1) + (1+2) + (1+2+3)
+TEST(test_decode_varint) {
+    // The ninth byte keeps all eight bits
+    uint8_t nine[] = {0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0xFF};
+    uint64_t value;
+    ASSERT(decode_varint(nine, sizeof(nine), &value) == 9);
+    ASSERT(value == 0xFF);
+    ASSERT(decode_varint(nine, 8, &value) == 0);
+
+    // Fast and byte-at-a-time paths agree for every length, with and without slack
+    uint64_t samples[] = {0, 1, 127, 128, 16383, 16384, 0x1fffff, 0x200000, 0xfffffffULL,
+                          0x7ffffffffULL, 0x3ffffffffffULL, 0x1ffffffffffffULL, 0xffffffffffffffULL,
+                          0x100000000000000ULL, 0x7fffffffffffffffULL, (uint64_t)-1, (uint64_t)-42};
+    for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); i++) {
+        uint8_t buffer[16] = {0};
+        int length = encode_varint(samples[i], buffer);
+        ASSERT(decode_varint(buffer, length, &value) == length && value == samples[i]);
+        ASSERT(decode_varint(buffer, sizeof(buffer), &value) == length && value == samples[i]);
+        ASSERT(length == 1 || decode_varint(buffer, length - 1, &value) == 0);
+    }
+}
+
+TEST(test_decode_varint_batch) {
+    uint8_t header[64];
+    int64_t expected[] = {1, 2, 3, 4, 5, 6, 7, 0, 8, 9, 13, 300, 12, 1, 70000, 7};
+    size_t length = 0;
+    uint32_t count = sizeof(expected) / sizeof(expected[0]);
+    for (uint32_t i = 0; i < count; i++) {
+        length += encode_varint((uint64_t)expected[i], header + length);
+    }
+    int64_t values[32];
+    size_t consumed;
+    ASSERT(decode_varint_batch(header, length, values, 32, &consumed) == count);
+    ASSERT(consumed == length);
+    ASSERT(memcmp(values, expected, sizeof(expected)) == 0);
+
+    // Stops at max_values and at a truncated varint
+    ASSERT(decode_varint_batch(header, length, values, 3, &consumed) == 3 && consumed == 3);
+    uint8_t truncated[] = {0x01, 0x81};
+    ASSERT(decode_varint_batch(truncated, sizeof(truncated), values, 32, &consumed) == 1 && consumed == 1);
 }
 
 TEST(test_report_error) {
@@ -61,14 +94,20 @@ TEST(test_to_host64) {
 
 TEST(test_print_hex_dump) {
     uint8_t data[] = {0x01, 0x02, 0x03, 0x04};
-    print_hex_dump(data, 4, 4);
-    // No direct assertions possible due to output-only function; test for no crash
+    OutputSink out;
+    ASSERT(sink_init(&out, -1, OUTPUT_TEXT) == 0);
+    print_hex_dump(&out, data, 4, 4);
+    const char expected[] = "    First 4 bytes (hex):\n    01 02 03 04 \n";
+    ASSERT(out.size == sizeof(expected) - 1);
+    ASSERT(memcmp(out.data, expected, out.size) == 0);
+    sink_free(&out);
 }
 
 void register_utils_tests(void) {
     run_test("test_to_host32", test_to_host32);
     run_test("test_parse_varint", test_parse_varint);
-    run_test("test_compute_wal_checksum", test_compute_wal_checksum);
+    run_test("test_decode_varint", test_decode_varint);
+    run_test("test_decode_varint_batch", test_decode_varint_batch);
     run_test("test_report_error", test_report_error);
     run_test("test_to_host16", test_to_host16);
     run_test("test_to_host64", test_to_host64);
@@ -0,0 +1,98 @@
+#include "../wal_checksum.h"
+#include "test_harness.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char *kernels[] = {"scalar", "sse4.1", "avx2", "avx512"};
+
+TEST(test_compute_wal_checksum) {
+    // Little-endian words: s1 = 1 + 0, s2 = 2 + 1
+    uint8_t data[] = {0x01, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00};
+    uint32_t checksum1 = 0;
+    uint32_t checksum2 = 0;
+    compute_wal_checksum(data, sizeof(data), 0, &checksum1, &checksum2);
+    ASSERT(checksum1 == 1);
+    ASSERT(checksum2 == 3);
+
+    // Same bytes read as big-endian words
+    checksum1 = 0;
+    checksum2 = 0;
+    compute_wal_checksum(data, sizeof(data), 1, &checksum1, &checksum2);
+    ASSERT(checksum1 == 0x01000000);
+    ASSERT(checksum2 == 0x03000000);
+
+    // Chaining two halves matches one pass over the whole buffer
+    uint8_t chained[16] = {0x10, 0x20, 0x30, 0x40, 0x50, 0x60, 0x70, 0x80,
+                           0x90, 0xA0, 0xB0, 0xC0, 0xD0, 0xE0, 0xF0, 0x01};
+    uint32_t whole1 = 7, whole2 = 9, part1 = 7, part2 = 9;
+    compute_wal_checksum(chained, 16, 0, &whole1, &whole2);
+    compute_wal_checksum(chained, 8, 0, &part1, &part2);
+    compute_wal_checksum(chained + 8, 8, 0, &part1, &part2);
+    ASSERT(whole1 == part1 && whole2 == part2);
+}
+
+TEST(test_checksum_kernels_agree) {
+    const char *selected = wal_checksum_kernel_name();
+    uint8_t *data = malloc(8192 + 8);
+    ASSERT(data != NULL);
+    srand(42);
+    for (size_t i = 0; i < 8192 + 8; i++) data[i] = (uint8_t)rand();
+
+    static const size_t lengths[] = {8, 24, 64, 128, 256, 264, 512, 1000, 4096, 8192 + 8};
+    for (int big_endian = 0; big_endian <= 1; big_endian++) {
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+            uint32_t expected1 = 0xDEADBEEF, expected2 = 0x01234567;
+            ASSERT(wal_checksum_set_kernel("scalar") == 0);
+            compute_wal_checksum(data, lengths[l], big_endian, &expected1, &expected2);
+            for (size_t k = 1; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+                if (wal_checksum_set_kernel(kernels[k]) != 0) continue; // Not on this CPU
+                uint32_t checksum1 = 0xDEADBEEF, checksum2 = 0x01234567;
+                compute_wal_checksum(data, lengths[l], big_endian, &checksum1, &checksum2);
+                ASSERT(checksum1 == expected1 && checksum2 == expected2);
+            }
+        }
+    }
+    wal_checksum_set_kernel(selected);
+    free(data);
+}
+
+TEST(test_wal_verify_frames) {
+    WalReader reader;
+    ASSERT(wal_reader_open(&reader, "./tests/testdata/test.db-wal") == 0);
+    ASSERT(reader.frame_count == 2);
+    ASSERT(verify_wal_header_checksum(reader.map, &reader.header) == 1);
+
+    uint32_t checksum1 = reader.header.checksum1;
+    uint32_t checksum2 = reader.header.checksum2;
+    ASSERT(wal_verify_frames(&reader, 1, reader.frame_count, &checksum1, &checksum2) == 0);
+    WalFrameView last;
+    ASSERT(wal_reader_frame(&reader, 2, &last) == 0);
+    ASSERT(checksum1 == last.header.checksum1 && checksum2 == last.header.checksum2);
+
+    // Copy the WAL and damage the second page to break the chain there
+    char path[] = "/tmp/walpulse_checksum_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    ASSERT(write(fd, reader.map, reader.file_size) == (ssize_t)reader.file_size);
+    uint8_t flipped = last.page_data[100] ^ 0xFF;
+    ASSERT(pwrite(fd, &flipped, 1, last.offset + WAL_FRAME_HEADER_SIZE + 100) == 1);
+    close(fd);
+    wal_reader_close(&reader);
+
+    ASSERT(wal_reader_open(&reader, path) == 0);
+    checksum1 = reader.header.checksum1;
+    checksum2 = reader.header.checksum2;
+    ASSERT(wal_verify_frames(&reader, 1, reader.frame_count, &checksum1, &checksum2) == 2);
+    WalFrameView first;
+    ASSERT(wal_reader_frame(&reader, 1, &first) == 0);
+    ASSERT(checksum1 == first.header.checksum1 && checksum2 == first.header.checksum2);
+    wal_reader_close(&reader);
+    unlink(path);
+}
+
+void register_wal_checksum_tests(void) {
+    run_test("test_compute_wal_checksum", test_compute_wal_checksum);
+    run_test("test_checksum_kernels_agree", test_checksum_kernels_agree);
+    run_test("test_wal_verify_frames", test_wal_verify_frames);
+}
@@ -0,0 +1,94 @@
+#include "../bench/wal_gen.h"
+#include "../frame_decoder.h"
+#include "../page_owner.h"
+#include "../wal_checksum.h"
+#include "../wal_reader.h"
+#include "test_harness.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Reads a whole file into memory; NULL if it cannot be read
+static uint8_t *read_file(const char *filename, long *size) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = malloc(*size);
+    if (data && fread(data, 1, *size, file) != (size_t)*size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    return data;
+}
+
+TEST(test_wal_gen_write) {
+    char path[TEST_PATH_SIZE], wal_path[TEST_PATH_SIZE];
+    temp_db_path(path, wal_path, "gen");
+
+    WalGenConfig config;
+    wal_gen_defaults(&config);
+    config.page_size = 1024;
+    config.frames = 500;
+    config.pages = 40;
+    config.cells_per_page = 6;
+    config.overflow_percent = 30;
+    config.commit_every = 7;
+    WalGenStats stats;
+    ASSERT(wal_gen_write(&config, path, &stats) == 0);
+    ASSERT(stats.frames == 500);
+    ASSERT(stats.overflow_frames > 0 && stats.index_leaf_frames > 0);
+    ASSERT(stats.table_leaf_frames + stats.index_leaf_frames + stats.overflow_frames == 500);
+
+    // Every frame chains its checksum and the last one commits
+    WalReader reader;
+    ASSERT(wal_reader_open(&reader, wal_path) == 0);
+    ASSERT(reader.frame_count == 500 && reader.page_size == 1024);
+    ASSERT(verify_wal_header_checksum(reader.map, &reader.header));
+    uint32_t checksum1 = reader.header.checksum1;
+    uint32_t checksum2 = reader.header.checksum2;
+    ASSERT(wal_verify_frames(&reader, 1, reader.frame_count, &checksum1, &checksum2) == 0);
+    WalFrameView frame;
+    ASSERT(wal_reader_frame(&reader, 500, &frame) == 0);
+    ASSERT(frame.header.commit_size == stats.database_pages);
+    uint32_t commits = 0;
+    for (uint32_t n = 1; n <= reader.frame_count && wal_reader_frame(&reader, n, &frame) == 0; n++) {
+        commits += frame.header.commit_size != 0;
+    }
+    ASSERT(commits == stats.commits);
+
+    // The database's schema owns every page the WAL writes, overflow pages included
+    PageOwnerMap owners;
+    ASSERT(page_owner_open(&owners, path) == 0);
+    uint32_t unknown = 0;
+    for (uint32_t n = 1; n <= reader.frame_count && wal_reader_frame(&reader, n, &frame) == 0; n++) {
+        page_owner_apply_frame(&owners, &reader, &frame);
+        const char *name = page_owner_lookup(&owners, frame.header.page_number);
+        unknown += !name || (strcmp(name, "bench") != 0 && strcmp(name, "bench_id") != 0);
+    }
+    ASSERT(unknown == 0);
+    page_owner_close(&owners);
+    wal_reader_close(&reader);
+
+    // The same configuration writes the same bytes
+    long first_size, second_size;
+    uint8_t *first = read_file(wal_path, &first_size);
+    ASSERT(wal_gen_write(&config, path, &stats) == 0);
+    uint8_t *second = read_file(wal_path, &second_size);
+    ASSERT(first && second && first_size == second_size && memcmp(first, second, first_size) == 0);
+    free(first);
+    free(second);
+
+    config.page_size = 3000;
+    ASSERT(wal_gen_write(&config, path, &stats) == -1);
+    remove_wal_db(NULL, path);
+}
+
+void register_wal_gen_tests(void) {
+    run_test("test_wal_gen_write", test_wal_gen_write);
+}
@@ -0,0 +1,280 @@
+#include "../wal_listener.h"
+#include "test_harness.h"
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct {
+    int frames;
+    int resets;
+    int transactions;
+    uint32_t last_frame;
+    uint32_t last_commit;
+    int fail_at;                // Transaction that fails, 0 for none
+    int failed;
+    int truncate_at;            // Transaction that truncates the WAL, then reads it; 0 for none
+    const char *wal_path;
+} ListenerCounts;
+
+static void count_frame(const WalReader *reader, const WalFrameView *frame, void *context) {
+    ListenerCounts *counts = context;
+    counts->frames++;
+    counts->last_frame = frame->frame_number;
+}
+
+static void count_transaction(const WalReader *reader, const WalTransaction *transaction, void *context) {
+    ListenerCounts *counts = context;
+    counts->transactions++;
+    if (counts->transactions == counts->fail_at) {
+        counts->failed = 1;
+        return;
+    }
+    if (counts->transactions == counts->truncate_at) {
+        // As a TRUNCATE checkpoint would, between the listener's refresh and this read
+        ASSERT(truncate(counts->wal_path, 0) == 0);
+        WalFrameView frame;
+        ASSERT(wal_reader_frame(reader, transaction->commit_frame, &frame) == 0);
+        volatile uint8_t byte = frame.page_data[0];
+        (void)byte;
+        ASSERT(0);
+    }
+    counts->last_commit = transaction->commit_frame;
+}
+
+static void count_reset(const WalHeader *header, void *context) {
+    ListenerCounts *counts = context;
+    counts->resets++;
+}
+
+TEST(test_process_wal_changes) {
+    char path[TEST_PATH_SIZE], wal_path[TEST_PATH_SIZE];
+    temp_db_path(path, wal_path, "listener");
+
+    sqlite3 *db = make_wal_db(path, 0, "CREATE TABLE t(x); INSERT INTO t VALUES (1);");
+    ASSERT(db != NULL);
+
+    ListenerCounts counts = {0};
+    WalListener listener = {
+        .on_frame = count_frame,
+        .on_transaction = count_transaction,
+        .on_reset = count_reset,
+        .context = &counts
+    };
+    WalReader reader;
+    ASSERT(wal_reader_open(&reader, wal_path) == 0);
+    WalState state;
+    wal_state_init(&state);
+
+    int first = process_wal_changes(&state, &reader, &listener);
+    ASSERT(first > 0);
+    ASSERT(counts.frames == first);
+    ASSERT(counts.resets == 1);
+    ASSERT(state.next_frame == (uint32_t)first + 1);
+    // Autocommit statements: one transaction each, ending at the last frame
+    ASSERT(counts.transactions == 2);
+    ASSERT(counts.last_commit == (uint32_t)first);
+
+    // Nothing new: nothing delivered
+    ASSERT(process_wal_changes(&state, &reader, &listener) == 0);
+
+    // One more commit: only its frames are delivered, continuing the numbering
+    sqlite3_exec(db, "INSERT INTO t VALUES (2);", NULL, NULL, NULL);
+    int second = process_wal_changes(&state, &reader, &listener);
+    ASSERT(second > 0);
+    ASSERT(counts.frames == first + second);
+    ASSERT(counts.last_frame == (uint32_t)(first + second));
+    ASSERT(counts.resets == 1);
+    ASSERT(counts.transactions == 3 && counts.last_commit == (uint32_t)(first + second));
+
+    // A checkpoint followed by a write restarts the WAL with new salts
+    sqlite3_exec(db, "PRAGMA wal_checkpoint(TRUNCATE); INSERT INTO t VALUES (3);", NULL, NULL, NULL);
+    counts.last_frame = 0;
+    int third = process_wal_changes(&state, &reader, &listener);
+    ASSERT(third > 0);
+    ASSERT(counts.resets == 2);
+    ASSERT(counts.last_frame == (uint32_t)third);
+    ASSERT(state.salt1 == reader.header.salt1 && state.salt2 == reader.header.salt2);
+
+    wal_reader_close(&reader);
+    remove_wal_db(db, path);
+}
+
+static void count_resume(const WalReader *reader, const WalResumePoint *point, void *context) {
+    ListenerCounts *counts = context;
+    counts->resets += 100;
+    counts->last_commit = point->commit_frame;
+}
+
+TEST(test_resume_wal_state) {
+    char path[TEST_PATH_SIZE], wal_path[TEST_PATH_SIZE];
+    temp_db_path(path, wal_path, "resume");
+    char *state_path = resume_filename(path);
+    ASSERT(state_path != NULL);
+
+    sqlite3 *db = make_wal_db(path, 0, "CREATE TABLE t(x); INSERT INTO t VALUES (1); INSERT INTO t VALUES (2);");
+    ASSERT(db != NULL);
+
+    ListenerCounts counts = {0};
+    WalListener listener = {
+        .on_frame = count_frame,
+        .on_transaction = count_transaction,
+        .on_reset = count_reset,
+        .on_resume = count_resume,
+        .context = &counts
+    };
+    WalReader reader;
+    ASSERT(wal_reader_open(&reader, wal_path) == 0);
+    WalState state;
+    wal_state_init(&state);
+    int first = process_wal_changes(&state, &reader, &listener);
+    ASSERT(first > 0 && counts.transactions == 3);
+    ASSERT(state.committed.commit_frame == (uint32_t)first);
+    ASSERT(save_resume_point(state_path, &state.committed) == 0);
+
+    // A restart from the saved point delivers nothing old, then only new commits
+    WalResumePoint point;
+    ASSERT(load_resume_point(state_path, &point) == 0);
+    ASSERT(resume_point_equal(&point, &state.committed));
+    ASSERT(point.checksum1 == state.checksum1 && point.checksum2 == state.checksum2);
+    ListenerCounts resumed_counts = {0};
+    listener.context = &resumed_counts;
+    WalState resumed;
+    wal_state_init(&resumed);
+    wal_state_set_resume(&resumed, &point);
+    ASSERT(process_wal_changes(&resumed, &reader, &listener) == 0);
+    ASSERT(resumed_counts.resets == 100 && resumed_counts.last_commit == (uint32_t)first);
+    sqlite3_exec(db, "INSERT INTO t VALUES (3);", NULL, NULL, NULL);
+    int second = process_wal_changes(&resumed, &reader, &listener);
+    ASSERT(second > 0 && resumed_counts.frames == second && resumed_counts.transactions == 1);
+    ASSERT(resumed.committed.commit_frame == (uint32_t)(first + second));
+
+    // A point from an older generation falls back to a full pass
+    sqlite3_exec(db, "PRAGMA wal_checkpoint(TRUNCATE); INSERT INTO t VALUES (4);", NULL, NULL, NULL);
+    ListenerCounts stale_counts = {0};
+    listener.context = &stale_counts;
+    WalState stale;
+    wal_state_init(&stale);
+    wal_state_set_resume(&stale, &point);
+    int third = process_wal_changes(&stale, &reader, &listener);
+    ASSERT(third > 0 && stale_counts.resets == 1 && stale_counts.frames == third);
+
+    // So does a point whose chain value does not match its commit frame
+    WalResumePoint forged = stale.committed;
+    forged.checksum1 ^= 1;
+    ListenerCounts forged_counts = {0};
+    listener.context = &forged_counts;
+    WalState checked;
+    wal_state_init(&checked);
+    wal_state_set_resume(&checked, &forged);
+    ASSERT(process_wal_changes(&checked, &reader, &listener) == third);
+    ASSERT(forged_counts.resets == 1);
+
+    // A damaged state file is ignored
+    FILE *file = fopen(state_path, "r+b");
+    ASSERT(file != NULL);
+    if (file) {
+        fseek(file, 30, SEEK_SET);
+        fputc(0x5a, file);
+        fclose(file);
+    }
+    ASSERT(load_resume_point(state_path, &point) == -1);
+
+    wal_reader_close(&reader);
+    remove_wal_db(db, path);
+    unlink(state_path);
+    free(state_path);
+}
+
+TEST(test_listener_failure) {
+    char path[TEST_PATH_SIZE], wal_path[TEST_PATH_SIZE];
+    temp_db_path(path, wal_path, "listener_failure");
+    char *state_path = resume_filename(path);
+    ASSERT(state_path != NULL);
+    unlink(state_path);
+    sqlite3 *db = make_wal_db(path, 0, "CREATE TABLE t(x); INSERT INTO t VALUES (1); INSERT INTO t VALUES (2);");
+    ASSERT(db != NULL);
+
+    // The second transaction fails: delivery stops there and the committed
+    // position stays after the first
+    ListenerCounts counts = { .fail_at = 2 };
+    WalListener listener = {
+        .on_transaction = count_transaction,
+        .context = &counts,
+        .failed = &counts.failed
+    };
+    WalReader reader;
+    ASSERT(wal_reader_open(&reader, wal_path) == 0);
+    WalState state;
+    wal_state_init(&state);
+    ASSERT(process_wal_changes(&state, &reader, &listener) == -1);
+    ASSERT(counts.transactions == 2 && counts.last_commit > 0);
+    ASSERT(state.committed.commit_frame == counts.last_commit);
+    wal_reader_close(&reader);
+
+    // A following listener returns at once and saves nothing past the failure
+    counts = (ListenerCounts){ .fail_at = 1 };
+    ASSERT(start_wal_listener(wal_path, &listener, state_path) == -1);
+    WalResumePoint point;
+    ASSERT(load_resume_point(state_path, &point) == -1);
+
+    remove_wal_db(db, path);
+    unlink(state_path);
+    free(state_path);
+}
+
+TEST(test_listener_truncated_wal) {
+    char path[TEST_PATH_SIZE], wal_path[TEST_PATH_SIZE];
+    temp_db_path(path, wal_path, "listener_truncated");
+    sqlite3 *db = make_wal_db(path, 0, "CREATE TABLE t(x); INSERT INTO t VALUES (1); INSERT INTO t VALUES (2);");
+    ASSERT(db != NULL);
+    FILE *file = fopen(wal_path, "rb");
+    ASSERT(file != NULL);
+    static uint8_t saved[1 << 16];
+    size_t saved_size = file ? fread(saved, 1, sizeof(saved), file) : 0;
+    if (file) {
+        fclose(file);
+    }
+    ASSERT(saved_size > 0 && saved_size < sizeof(saved));
+
+    // The WAL vanishes while the second transaction is read: the pass ends
+    // with -1 and the committed position stays after the first
+    ListenerCounts counts = { .truncate_at = 2, .wal_path = wal_path };
+    WalListener listener = {
+        .on_transaction = count_transaction,
+        .on_reset = count_reset,
+        .on_resume = count_resume,
+        .context = &counts
+    };
+    WalReader reader;
+    ASSERT(wal_reader_open(&reader, wal_path) == 0);
+    WalState state;
+    wal_state_init(&state);
+    ASSERT(process_wal_changes(&state, &reader, &listener) == -1);
+    ASSERT(counts.transactions == 2 && counts.resets == 1);
+    ASSERT(state.committed.commit_frame == counts.last_commit && !state.initialized);
+
+    // Nothing to read while it is empty; once the frames are back, the
+    // rescan resumes after the first transaction and delivers the rest
+    ASSERT(process_wal_changes(&state, &reader, &listener) == 0);
+    file = fopen(wal_path, "wb");
+    ASSERT(file != NULL);
+    if (file) {
+        ASSERT(fwrite(saved, 1, saved_size, file) == saved_size);
+        fclose(file);
+    }
+    counts.truncate_at = 0;
+    ASSERT(process_wal_changes(&state, &reader, &listener) > 0);
+    ASSERT(counts.resets == 101 && counts.transactions == 4);
+    ASSERT(state.committed.commit_frame == reader.frame_count && counts.last_commit == reader.frame_count);
+
+    wal_reader_close(&reader);
+    remove_wal_db(db, path);
+}
+
+void register_wal_listener_tests(void) {
+    run_test("test_process_wal_changes", test_process_wal_changes);
+    run_test("test_resume_wal_state", test_resume_wal_state);
+    run_test("test_listener_failure", test_listener_failure);
+    run_test("test_listener_truncated_wal", test_listener_truncated_wal);
+}
@@ -0,0 +1,115 @@
+#include "../wal_monitor.h"
+#include "test_harness.h"
+#include <sqlite3.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MONITOR_TEST_DATABASES 4
+
+typedef struct {
+    int transactions[MONITOR_TEST_DATABASES];
+    int resets;
+    int batches;
+    char directory[128];
+} MonitorCounts;
+
+// Maps a callback's database path back to its test index
+static int database_index(const MonitorCounts *counts, const char *database) {
+    size_t length = strlen(counts->directory);
+    if (strncmp(database, counts->directory, length) != 0) {
+        return -1;
+    }
+    int index = -1;
+    sscanf(database + length, "/tenant%d.db", &index);
+    return index;
+}
+
+static void count_transaction(const char *database, const WalReader *reader,
+                              const WalTransaction *transaction, void *context) {
+    MonitorCounts *counts = context;
+    int index = database_index(counts, database);
+    if (index >= 0 && index < MONITOR_TEST_DATABASES) {
+        counts->transactions[index]++;
+    }
+}
+
+static void count_reset(const char *database, const WalHeader *header, void *context) {
+    MonitorCounts *counts = context;
+    counts->resets++;
+}
+
+static void count_batch(void *context) {
+    MonitorCounts *counts = context;
+    counts->batches++;
+}
+
+TEST(test_wal_monitor) {
+    MonitorCounts counts = {0};
+    snprintf(counts.directory, sizeof(counts.directory), "/tmp/walpulse_monitor_%d", (int)getpid());
+    mkdir(counts.directory, 0700);
+
+    sqlite3 *dbs[MONITOR_TEST_DATABASES];
+    char path[256];
+    for (int i = 0; i < MONITOR_TEST_DATABASES; i++) {
+        snprintf(path, sizeof(path), "%s/tenant%d.db", counts.directory, i);
+        dbs[i] = make_wal_db(path, 0, "CREATE TABLE t(x);");
+        ASSERT(dbs[i] != NULL);
+    }
+
+    WalMonitor monitor;
+    ASSERT(wal_monitor_init(&monitor) == 0);
+    char pattern[256];
+    snprintf(pattern, sizeof(pattern), "%s/tenant*.db", counts.directory);
+    ASSERT(wal_monitor_add_pattern(&monitor, pattern) == 0);
+    // The glob skips -wal and -shm files, and adding a database twice is a no-op
+    ASSERT(monitor.count == MONITOR_TEST_DATABASES);
+    snprintf(path, sizeof(path), "%s/tenant0.db", counts.directory);
+    ASSERT(wal_monitor_add(&monitor, path) == 0);
+    ASSERT(monitor.count == MONITOR_TEST_DATABASES);
+
+    MonitorListener listener = {
+        .on_transaction = count_transaction,
+        .on_reset = count_reset,
+        .on_batch = count_batch,
+        .context = &counts
+    };
+    // Existing WALs: one CREATE TABLE transaction each, delivered in one batch
+    ASSERT(wal_monitor_scan(&monitor, &listener) == MONITOR_TEST_DATABASES);
+    ASSERT(counts.resets == MONITOR_TEST_DATABASES);
+    ASSERT(counts.batches == 1);
+    for (int i = 0; i < MONITOR_TEST_DATABASES; i++) {
+        ASSERT(counts.transactions[i] == 1);
+    }
+
+    // Nothing written yet: the wait times out
+    ASSERT(wal_monitor_poll(&monitor, &listener, 0) == 0);
+
+    // Writes to two databases are processed once each, however many events they raised
+    sqlite3_exec(dbs[1], "INSERT INTO t VALUES (1); INSERT INTO t VALUES (2);", NULL, NULL, NULL);
+    sqlite3_exec(dbs[3], "INSERT INTO t VALUES (3);", NULL, NULL, NULL);
+    ASSERT(wal_monitor_poll(&monitor, &listener, 1000) == 2);
+    ASSERT(counts.transactions[0] == 1);
+    ASSERT(counts.transactions[1] == 3);
+    ASSERT(counts.transactions[2] == 1);
+    ASSERT(counts.transactions[3] == 2);
+    ASSERT(monitor.events >= 2 && monitor.batches == 1);
+
+    // A checkpoint restarts the WAL; the next write starts a new generation
+    sqlite3_exec(dbs[2], "PRAGMA wal_checkpoint(TRUNCATE); INSERT INTO t VALUES (4);", NULL, NULL, NULL);
+    ASSERT(wal_monitor_poll(&monitor, &listener, 1000) == 1);
+    ASSERT(counts.transactions[2] == 2);
+    ASSERT(counts.resets == MONITOR_TEST_DATABASES + 1);
+
+    wal_monitor_free(&monitor);
+    for (int i = 0; i < MONITOR_TEST_DATABASES; i++) {
+        snprintf(path, sizeof(path), "%s/tenant%d.db", counts.directory, i);
+        remove_wal_db(dbs[i], path);
+    }
+    rmdir(counts.directory);
+}
+
+void register_wal_monitor_tests(void) {
+    run_test("test_wal_monitor", test_wal_monitor);
+}
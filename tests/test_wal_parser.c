@@ -1,6 +1,30 @@
 #include "../wal_parser.h"
+#include "../wal_checksum.h"
+#include "../subscription.h"
 #include "test_harness.h"
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+// Writes a byte buffer to a fresh temporary file and returns its path
+static char *write_temp_file(const uint8_t *data, size_t size) {
+    char *path = strdup("/tmp/walpulse_wal_XXXXXX");
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        free(path);
+        return NULL;
+    }
+    if (write(fd, data, size) != (ssize_t)size) {
+        close(fd);
+        unlink(path);
+        free(path);
+        return NULL;
+    }
+    close(fd);
+    return path;
+}
 
 TEST(test_read_wal_header) {
     uint8_t buffer[] = {
@@ -59,26 +83,130 @@ TEST(test_process_wal_frames) {
         0x01, 0x02, 0x03, 0x00  // First 4 bytes of page data
         // Remaining bytes would be padded to 1024
     };
-    FILE* file = fmemopen(buffer, sizeof(buffer), "rb");
-    ASSERT(file != NULL);
-    WalHeader header = read_wal_header(file);
-    process_wal_frames(file, &header, "./tests/testdata/test.db-wal");
-    fclose(file);
-    // No direct assertions possible due to output-only function; test for no crash
+    char *path = write_temp_file(buffer, sizeof(buffer));
+    ASSERT(path != NULL);
+    WalReader reader;
+    ASSERT(wal_reader_open(&reader, path) == 0);
+    ASSERT(reader.frame_count == 0); // Frame is truncated
+    OutputSink out;
+    ASSERT(sink_init(&out, -1, OUTPUT_TEXT) == 0);
+    process_wal_frames(&out, &reader, "./tests/testdata/test.db-wal", 1, 0, NULL);
+    wal_reader_close(&reader);
+    unlink(path);
+    free(path);
+    sink_putc(&out, '\0');
+    ASSERT(strstr(out.data, "Warning: Incomplete frame data for frame 1\n") != NULL);
+    ASSERT(strstr(out.data, "No frames found in the WAL file.\n") != NULL);
+    sink_free(&out);
 }
 
 TEST(test_verify_frame_checksum) {
-    FrameHeader frame = {
-        .page_number = 1,
-        .commit_size = 0,
+    WalHeader header = {
+        .magic = 0x377f0682,
+        .page_size = 8,
         .salt1 = 0x12345678,
         .salt2 = 0x87654321,
-        .checksum1 = 0x06,
-        .checksum2 = 0x0A
+        .checksum1 = 0x11,
+        .checksum2 = 0x22
     };
-    uint8_t page_data[] = {0x01, 0x02, 0x03};
-    verify_frame_checksum(&frame, page_data, 3, 0, 0);
-    // No return value to assert; test for no crash and assume logging on failure
+    uint8_t raw_header[24] = {
+        0x00, 0x00, 0x00, 0x01, // page_number: 1
+        0x00, 0x00, 0x00, 0x01  // commit_size: 1
+    };
+    uint8_t page_data[8] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08};
+    WalFrameView frame = {
+        .header = {
+            .page_number = 1,
+            .commit_size = 1,
+            .salt1 = 0x12345678,
+            .salt2 = 0x87654321
+        },
+        .raw_header = raw_header,
+        .page_data = page_data,
+        .frame_number = 1
+    };
+    frame.header.checksum1 = header.checksum1;
+    frame.header.checksum2 = header.checksum2;
+    compute_wal_checksum(raw_header, 8, 0, &frame.header.checksum1, &frame.header.checksum2);
+    compute_wal_checksum(page_data, 8, 0, &frame.header.checksum1, &frame.header.checksum2);
+    OutputSink out;
+    ASSERT(sink_init(&out, -1, OUTPUT_TEXT) == 0);
+    ASSERT(verify_frame_checksum(&out, &frame, &header, header.checksum1, header.checksum2) == 1);
+
+    // Wrong seed breaks the chain
+    ASSERT(verify_frame_checksum(&out, &frame, &header, 0, 0) == 0);
+
+    // Stale salts are rejected even with a matching checksum
+    frame.header.salt1 = 0;
+    ASSERT(verify_frame_checksum(&out, &frame, &header, header.checksum1, header.checksum2) == 0);
+    sink_putc(&out, '\0');
+    ASSERT(strstr(out.data, "Checksum verified successfully.\nChecksum mismatch") == out.data);
+    ASSERT(strstr(out.data, "Salt mismatch") != NULL);
+    sink_free(&out);
+}
+
+TEST(test_print_wal_snapshot) {
+    char path[TEST_PATH_SIZE], wal[TEST_PATH_SIZE];
+    temp_db_path(path, wal, "snapshot");
+
+    // One hot leaf rewritten by 200 transactions
+    sqlite3 *db = make_wal_db(path, 1024,
+                              "CREATE TABLE t(id INTEGER PRIMARY KEY, v INTEGER);"
+                              "INSERT INTO t VALUES (1, 1000);"
+                              "PRAGMA wal_checkpoint(TRUNCATE);");
+    ASSERT(db != NULL);
+    for (int i = 0; i < 200; i++) {
+        sqlite3_exec(db, "UPDATE t SET v = v + 1", NULL, NULL, NULL);
+    }
+
+    OutputSink out;
+    ASSERT(sink_init(&out, -1, OUTPUT_TEXT) == 0);
+    ASSERT(print_wal_snapshot(&out, wal, NULL) == 0);
+    sink_putc(&out, '\0');
+    ASSERT(strstr(out.data, "Frame 200:") != NULL);
+    ASSERT(strstr(out.data, "Frame 199:") == NULL);
+    ASSERT(strstr(out.data, "): 1200\n") != NULL);
+    ASSERT(strstr(out.data, "): 1199\n") == NULL);
+    ASSERT(strstr(out.data, "Table Name: t\n") != NULL);
+    ASSERT(strstr(out.data, "Snapshot as of frame 200: 1 of 1 pages decoded, 199 older copies not decoded") != NULL);
+    ASSERT(strstr(out.data, "Total frames: 1\n") != NULL);
+    sink_free(&out);
+
+    remove_wal_db(db, path);
+}
+
+TEST(test_print_wal_snapshot_subscription) {
+    char path[TEST_PATH_SIZE], wal[TEST_PATH_SIZE];
+    temp_db_path(path, wal, "snapshot_sub");
+
+    // Two tables each rewritten by 50 transactions; only one is followed
+    sqlite3 *db = make_wal_db(path, 1024,
+                              "CREATE TABLE a(id INTEGER PRIMARY KEY, v INTEGER);"
+                              "CREATE TABLE b(id INTEGER PRIMARY KEY, v INTEGER);"
+                              "INSERT INTO a VALUES (1, 1000);"
+                              "INSERT INTO b VALUES (1, 5000);"
+                              "PRAGMA wal_checkpoint(TRUNCATE);");
+    ASSERT(db != NULL);
+    for (int i = 0; i < 50; i++) {
+        sqlite3_exec(db, "UPDATE a SET v = v + 1", NULL, NULL, NULL);
+        sqlite3_exec(db, "UPDATE b SET v = v + 1", NULL, NULL, NULL);
+    }
+
+    Subscription subscription;
+    subscription_init(&subscription);
+    ASSERT(subscription_add(&subscription, "b") == 0);
+    OutputSink out;
+    ASSERT(sink_init(&out, -1, OUTPUT_TEXT) == 0);
+    ASSERT(print_wal_snapshot(&out, wal, &subscription) == 0);
+    sink_putc(&out, '\0');
+    ASSERT(strstr(out.data, "): 5050\n") != NULL);
+    ASSERT(strstr(out.data, "): 1050\n") == NULL);
+    ASSERT(strstr(out.data, "Snapshot as of frame 100: 1 of 2 pages decoded, 98 older copies not decoded") != NULL);
+    ASSERT(strstr(out.data, "Total frames: 1\n") != NULL);
+    sink_free(&out);
+    subscription_free(&subscription);
+
+    remove_wal_db(db, path);
 }
 
 void register_wal_parser_tests(void) {
@@ -86,4 +214,6 @@ void register_wal_parser_tests(void) {
     run_test("test_validate_wal_file_size", test_validate_wal_file_size);
     run_test("test_process_wal_frames", test_process_wal_frames);
     run_test("test_verify_frame_checksum", test_verify_frame_checksum);
+    run_test("test_print_wal_snapshot", test_print_wal_snapshot);
+    run_test("test_print_wal_snapshot_subscription", test_print_wal_snapshot_subscription);
 }
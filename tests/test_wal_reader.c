@@ -0,0 +1,111 @@
+#include "../wal_reader.h"
+#include "test_harness.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TEST_PAGE_SIZE 512
+
+// Builds a WAL header for a 512-byte page size
+static void fill_wal_header(uint8_t *buffer) {
+    static const uint8_t header[WAL_HEADER_SIZE] = {
+        0x37, 0x7F, 0x06, 0x82, // magic
+        0x00, 0x2D, 0xE2, 0x18, // format: 3007000
+        0x00, 0x00, 0x02, 0x00, // page_size: 512
+        0x00, 0x00, 0x00, 0x00, // checkpoint: 0
+        0x11, 0x22, 0x33, 0x44, // salt1
+        0x55, 0x66, 0x77, 0x88, // salt2
+        0x00, 0x00, 0x00, 0x00, // checksum1
+        0x00, 0x00, 0x00, 0x00  // checksum2
+    };
+    memcpy(buffer, header, sizeof(header));
+}
+
+// Builds a frame whose page is filled with the given byte
+static void fill_frame(uint8_t *buffer, uint32_t page_number, uint32_t commit_size, uint8_t fill) {
+    memset(buffer, 0, WAL_FRAME_HEADER_SIZE);
+    buffer[3] = (uint8_t)page_number;
+    buffer[7] = (uint8_t)commit_size;
+    memcpy(buffer + 8, "\x11\x22\x33\x44\x55\x66\x77\x88", 8);
+    memset(buffer + WAL_FRAME_HEADER_SIZE, fill, TEST_PAGE_SIZE);
+}
+
+TEST(test_wal_reader_frames) {
+    uint8_t wal[WAL_HEADER_SIZE + 2 * (WAL_FRAME_HEADER_SIZE + TEST_PAGE_SIZE)];
+    fill_wal_header(wal);
+    fill_frame(wal + WAL_HEADER_SIZE, 2, 0, 0xAB);
+    fill_frame(wal + WAL_HEADER_SIZE + WAL_FRAME_HEADER_SIZE + TEST_PAGE_SIZE, 5, 5, 0xCD);
+
+    char path[] = "/tmp/walpulse_reader_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    ASSERT(write(fd, wal, sizeof(wal)) == (ssize_t)sizeof(wal));
+
+    WalReader reader;
+    ASSERT(wal_reader_open(&reader, path) == 0);
+    ASSERT(reader.page_size == TEST_PAGE_SIZE);
+    ASSERT(reader.header.salt1 == 0x11223344);
+    ASSERT(reader.frame_count == 2);
+
+    WalFrameView view;
+    ASSERT(wal_reader_frame(&reader, 1, &view) == 0);
+    ASSERT(view.header.page_number == 2);
+    ASSERT(view.header.commit_size == 0);
+    ASSERT(view.header.salt2 == 0x55667788);
+    ASSERT(view.offset == WAL_HEADER_SIZE);
+    ASSERT(view.page_data[0] == 0xAB && view.page_data[TEST_PAGE_SIZE - 1] == 0xAB);
+
+    ASSERT(wal_reader_frame(&reader, 2, &view) == 0);
+    ASSERT(view.header.page_number == 5);
+    ASSERT(view.header.commit_size == 5);
+    ASSERT(view.page_data[0] == 0xCD);
+
+    ASSERT(wal_reader_frame(&reader, 0, &view) == -1);
+    ASSERT(wal_reader_frame(&reader, 3, &view) == -1);
+
+    wal_reader_close(&reader);
+    close(fd);
+    unlink(path);
+}
+
+TEST(test_wal_reader_refresh) {
+    uint8_t wal[WAL_HEADER_SIZE + 2 * (WAL_FRAME_HEADER_SIZE + TEST_PAGE_SIZE)];
+    size_t frame_size = WAL_FRAME_HEADER_SIZE + TEST_PAGE_SIZE;
+    fill_wal_header(wal);
+    fill_frame(wal + WAL_HEADER_SIZE, 1, 0, 0x01);
+    fill_frame(wal + WAL_HEADER_SIZE + frame_size, 1, 1, 0x02);
+
+    char path[] = "/tmp/walpulse_reader_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    // Start with one full frame and half of the second one
+    ASSERT(write(fd, wal, WAL_HEADER_SIZE + frame_size + 100) == (ssize_t)(WAL_HEADER_SIZE + frame_size + 100));
+
+    WalReader reader;
+    ASSERT(wal_reader_open(&reader, path) == 0);
+    ASSERT(reader.frame_count == 1);
+
+    // Growth: the writer finishes the second frame
+    ASSERT(pwrite(fd, wal, sizeof(wal), 0) == (ssize_t)sizeof(wal));
+    ASSERT(wal_reader_refresh(&reader) == 0);
+    ASSERT(reader.frame_count == 2);
+    WalFrameView view;
+    ASSERT(wal_reader_frame(&reader, 2, &view) == 0);
+    ASSERT(view.page_data[10] == 0x02);
+
+    // Truncation: a checkpoint reset the WAL
+    ASSERT(ftruncate(fd, 0) == 0);
+    ASSERT(wal_reader_refresh(&reader) == 0);
+    ASSERT(reader.frame_count == 0);
+    ASSERT(wal_reader_frame(&reader, 1, &view) == -1);
+
+    wal_reader_close(&reader);
+    close(fd);
+    unlink(path);
+}
+
+void register_wal_reader_tests(void) {
+    run_test("test_wal_reader_frames", test_wal_reader_frames);
+    run_test("test_wal_reader_refresh", test_wal_reader_refresh);
+}
@@ -0,0 +1,142 @@
+#include "../wal_stats.h"
+#include "../wal_parser.h"
+#include "../bench/wal_gen.h"
+#include "test_harness.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define COUNTING_THREADS 4
+#define COUNTS_PER_THREAD 1000
+
+TEST(test_stats_buckets) {
+    ASSERT(stats_bucket(0) == 0);
+    ASSERT(stats_bucket(15) == 15);
+    ASSERT(stats_bucket(31) == 31);
+    ASSERT(stats_bucket(UINT64_MAX) == STATS_BUCKETS - 1);
+    // Every bucket's upper bound maps back to it and stays within 1/16 of its lower neighbour
+    for (uint32_t b = 1; b < STATS_BUCKETS; b++) {
+        uint64_t upper = stats_bucket_upper(b);
+        uint64_t previous = stats_bucket_upper(b - 1);
+        ASSERT(upper > previous);
+        ASSERT(stats_bucket(upper) == b);
+        ASSERT(stats_bucket(previous + 1) == b);
+        ASSERT(upper - previous <= previous / 16 + 1);
+    }
+}
+
+static void *count_in_thread(void *arg) {
+    for (uint32_t i = 0; i < COUNTS_PER_THREAD; i++) {
+        stats_add(STATS_FRAMES, 1);
+        stats_record_ns(STATS_DECODE, 1000 + i);
+    }
+    // Half the threads exit without releasing, as if still running
+    if (arg) {
+        release_thread_stats();
+    }
+    return NULL;
+}
+
+TEST(test_stats_threads) {
+    stats_enable(1);
+    stats_reset();
+    pthread_t threads[COUNTING_THREADS];
+    for (int i = 0; i < COUNTING_THREADS; i++) {
+        pthread_create(&threads[i], NULL, count_in_thread, i % 2 ? (void *)1 : NULL);
+    }
+    for (int i = 0; i < COUNTING_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    stats_add(STATS_FRAMES, 5);
+    stats_gauge_add(STATS_DECODE_BACKLOG, 3);
+    stats_gauge_add(STATS_DECODE_BACKLOG, -1);
+
+    StatsSnapshot *snapshot = malloc(sizeof(StatsSnapshot));
+    stats_snapshot(snapshot);
+    ASSERT(snapshot->counters[STATS_FRAMES] == COUNTING_THREADS * COUNTS_PER_THREAD + 5);
+    ASSERT(snapshot->gauges[STATS_DECODE_BACKLOG] == 2);
+    uint64_t median = stats_percentile(snapshot, STATS_DECODE, 0.5);
+    ASSERT(median >= 1450 && median <= 1550);
+    ASSERT(stats_percentile(snapshot, STATS_DECODE, 1.0) >= 1999);
+    ASSERT(stats_percentile(snapshot, STATS_CHECKSUM, 0.99) == 0);
+
+    // Nothing is counted while disabled
+    stats_enable(0);
+    stats_add(STATS_FRAMES, 100);
+    ASSERT(stats_clock() == 0);
+    stats_snapshot(snapshot);
+    ASSERT(snapshot->counters[STATS_FRAMES] == COUNTING_THREADS * COUNTS_PER_THREAD + 5);
+    free(snapshot);
+    stats_reset();
+}
+
+TEST(test_stats_frame_loop) {
+    char db_filename[] = "/tmp/walpulse_stats_XXXXXX";
+    int fd = mkstemp(db_filename);
+    ASSERT(fd >= 0);
+    close(fd);
+    char wal_filename[64], stats_filename[64];
+    snprintf(wal_filename, sizeof(wal_filename), "%s-wal", db_filename);
+    snprintf(stats_filename, sizeof(stats_filename), "%s.prom", db_filename);
+
+    WalGenConfig config;
+    wal_gen_defaults(&config);
+    config.frames = 300;
+    WalGenStats generated;
+    ASSERT(wal_gen_write(&config, db_filename, &generated) == 0);
+
+    stats_enable(1);
+    stats_reset();
+    OutputSink out;
+    sink_init(&out, -1, OUTPUT_JSON);
+    ASSERT(print_wal_info(&out, wal_filename, 2, 0, NULL) == 0);
+    sink_free(&out);
+
+    StatsSnapshot *snapshot = malloc(sizeof(StatsSnapshot));
+    stats_snapshot(snapshot);
+    ASSERT(snapshot->counters[STATS_FRAMES] == generated.frames);
+    ASSERT(snapshot->counters[STATS_WAL_BYTES] == generated.wal_bytes - 32);
+    ASSERT(snapshot->counters[STATS_CHECKSUM_FAILURES] == 0);
+    ASSERT(snapshot->counters[STATS_CELLS] > 0);
+    ASSERT(snapshot->gauges[STATS_DECODE_BACKLOG] == 0);
+    uint64_t decoded = 0, checked = 0;
+    for (int b = 0; b < STATS_BUCKETS; b++) {
+        decoded += snapshot->buckets[STATS_DECODE][b];
+        checked += snapshot->buckets[STATS_CHECKSUM][b];
+    }
+    ASSERT(decoded == generated.frames);
+    ASSERT(checked == generated.frames);
+    free(snapshot);
+
+    ASSERT(stats_write_file(stats_filename) == 0);
+    FILE *file = fopen(stats_filename, "r");
+    ASSERT(file != NULL);
+    char expected[64];
+    snprintf(expected, sizeof(expected), "walpulse_frames_total %u\n", generated.frames);
+    const char *inf_bucket = "walpulse_stage_duration_seconds_bucket{stage=\"decode\",le=\"+Inf\"} ";
+    int found_frames = 0, found_inf = 0;
+    char line[256];
+    while (file && fgets(line, sizeof(line), file)) {
+        found_frames |= strcmp(line, expected) == 0;
+        found_inf |= strncmp(line, inf_bucket, strlen(inf_bucket)) == 0;
+    }
+    if (file) {
+        fclose(file);
+    }
+    ASSERT(found_frames);
+    ASSERT(found_inf);
+
+    stats_enable(0);
+    stats_reset();
+    unlink(stats_filename);
+    unlink(wal_filename);
+    unlink(db_filename);
+}
+
+void register_wal_stats_tests(void) {
+    run_test("test_stats_buckets", test_stats_buckets);
+    run_test("test_stats_threads", test_stats_threads);
+    run_test("test_stats_frame_loop", test_stats_frame_loop);
+}
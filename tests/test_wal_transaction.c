@@ -0,0 +1,67 @@
+#include "../wal_transaction.h"
+#include "test_harness.h"
+#include <string.h>
+
+// Builds a frame view with just the fields the batcher looks at
+static WalFrameView make_frame(uint32_t frame_number, uint32_t commit_size, uint32_t salt1, uint32_t salt2) {
+    WalFrameView frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.frame_number = frame_number;
+    frame.header.page_number = frame_number;
+    frame.header.commit_size = commit_size;
+    frame.header.salt1 = salt1;
+    frame.header.salt2 = salt2;
+    return frame;
+}
+
+TEST(test_transaction_batcher) {
+    WalHeader header;
+    memset(&header, 0, sizeof(header));
+    header.salt1 = 11;
+    header.salt2 = 22;
+    TransactionBatcher batcher;
+    transaction_batcher_init(&batcher, &header);
+    WalTransaction transaction;
+    WalFrameView frame;
+
+    // Frames 1-3 commit together, frame 4 commits alone
+    frame = make_frame(1, 0, 11, 22);
+    ASSERT(transaction_batcher_add(&batcher, &frame, 1, &transaction) == BATCH_BUFFERED);
+    frame = make_frame(2, 0, 11, 22);
+    ASSERT(transaction_batcher_add(&batcher, &frame, 1, &transaction) == BATCH_BUFFERED);
+    ASSERT(batcher.pending == 2);
+    frame = make_frame(3, 5, 11, 22);
+    ASSERT(transaction_batcher_add(&batcher, &frame, 1, &transaction) == BATCH_COMMITTED);
+    ASSERT(transaction.first_frame == 1 && transaction.commit_frame == 3 && transaction.database_size == 5);
+    frame = make_frame(4, 6, 11, 22);
+    ASSERT(transaction_batcher_add(&batcher, &frame, 1, &transaction) == BATCH_COMMITTED);
+    ASSERT(transaction.first_frame == 4 && transaction.commit_frame == 4);
+    ASSERT(batcher.committed == 2 && batcher.pending == 0);
+
+    // A frame from an older generation ends the log, taking the open transaction with it
+    frame = make_frame(5, 0, 11, 22);
+    ASSERT(transaction_batcher_add(&batcher, &frame, 1, &transaction) == BATCH_BUFFERED);
+    frame = make_frame(6, 0, 10, 22);
+    ASSERT(transaction_batcher_add(&batcher, &frame, 1, &transaction) == BATCH_DROPPED);
+    frame = make_frame(7, 7, 11, 22);
+    ASSERT(transaction_batcher_add(&batcher, &frame, 1, &transaction) == BATCH_DROPPED);
+    ASSERT(batcher.dropped == 3 && batcher.committed == 2);
+
+    // A new generation starts clean; a checksum failure also ends the log
+    transaction_batcher_init(&batcher, &header);
+    frame = make_frame(1, 0, 11, 22);
+    ASSERT(transaction_batcher_add(&batcher, &frame, 0, &transaction) == BATCH_DROPPED);
+    frame = make_frame(2, 2, 11, 22);
+    ASSERT(transaction_batcher_add(&batcher, &frame, 1, &transaction) == BATCH_DROPPED);
+
+    // An uncommitted tail is dropped on request
+    transaction_batcher_init(&batcher, &header);
+    frame = make_frame(1, 0, 11, 22);
+    transaction_batcher_add(&batcher, &frame, 1, &transaction);
+    ASSERT(transaction_batcher_abandon(&batcher) == 1);
+    ASSERT(batcher.dropped == 1 && batcher.pending == 0);
+}
+
+void register_wal_transaction_tests(void) {
+    run_test("test_transaction_batcher", test_transaction_batcher);
+}
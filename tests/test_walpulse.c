@@ -0,0 +1,115 @@
+#include "../walpulse.h"
+#include "test_harness.h"
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// What the tests need from the batches; the changes themselves are only
+// valid inside the callback
+typedef struct {
+    uint32_t batches;
+    uint32_t changes;
+    uint32_t other_table;       // Changes to tables other than t
+    int64_t last_rowid;
+    char name[32];              // Column 1 of the update, after and before
+    char old_name[32];
+    double score;               // Column 2 of the insert of rowid 1
+    int delete_seen;            // Rowid 1 deleted, with its last record
+} Collected;
+
+// Copies a TEXT column into a fixed buffer
+static void copy_text(const WalpulseRecord *record, uint32_t column, char *buffer, size_t size) {
+    const uint8_t *data;
+    uint32_t length;
+    buffer[0] = '\0';
+    if (record && walpulse_record_type(record, column) == WALPULSE_TEXT &&
+        walpulse_record_bytes(record, column, &data, &length) == 0 && length < size) {
+        memcpy(buffer, data, length);
+        buffer[length] = '\0';
+    }
+}
+
+static void collect_changes(const WalpulseChange *changes, uint32_t count, void *context) {
+    Collected *collected = context;
+    collected->batches++;
+    collected->changes += count;
+    for (uint32_t i = 0; i < count; i++) {
+        const WalpulseChange *change = &changes[i];
+        if (!change->table || strcmp(change->table, "t") != 0) {
+            collected->other_table++;
+            continue;
+        }
+        collected->last_rowid = change->rowid;
+        if (change->operation == WALPULSE_INSERT && change->rowid == 1 && change->record && !change->old_record) {
+            walpulse_record_double(change->record, 2, &collected->score);
+        } else if (change->operation == WALPULSE_UPDATE) {
+            copy_text(change->record, 1, collected->name, sizeof(collected->name));
+            copy_text(change->old_record, 1, collected->old_name, sizeof(collected->old_name));
+        } else if (change->operation == WALPULSE_DELETE && change->rowid == 1 && !change->record) {
+            collected->delete_seen = change->old_record && walpulse_record_columns(change->old_record) == 3;
+        }
+    }
+}
+
+TEST(test_walpulse_poll) {
+    char path[TEST_PATH_SIZE], wal[TEST_PATH_SIZE];
+    temp_db_path(path, wal, "library");
+
+    sqlite3 *db = make_wal_db(path, 1024,
+                              "CREATE TABLE t(id INTEGER PRIMARY KEY, name TEXT, score REAL);"
+                              "CREATE TABLE other(x);"
+                              "PRAGMA wal_checkpoint(TRUNCATE);");
+    ASSERT(db != NULL);
+
+    Walpulse *pulse = walpulse_open(path);
+    ASSERT(pulse != NULL);
+    ASSERT(walpulse_fd(pulse) >= 0);
+    Collected collected;
+    memset(&collected, 0, sizeof(collected));
+    walpulse_set_callback(pulse, collect_changes, &collected, NULL);
+    ASSERT(walpulse_poll(pulse) == 0);
+
+    sqlite3_exec(db, "INSERT INTO t VALUES (1, 'one', 1.5), (2, 'two', 2.5);"
+                     "UPDATE t SET name = 'TWO' WHERE id = 2;"
+                     "DELETE FROM t WHERE id = 1;"
+                     "INSERT INTO other VALUES (1);",
+                 NULL, NULL, NULL);
+    // One batch for the whole poll; the update and delete see the earlier WAL copy
+    ASSERT(walpulse_poll(pulse) == 5);
+    ASSERT(collected.batches == 1 && collected.changes == 5 && collected.other_table == 1);
+    ASSERT(collected.score == 1.5);
+    ASSERT(strcmp(collected.name, "TWO") == 0 && strcmp(collected.old_name, "two") == 0);
+    ASSERT(collected.delete_seen);
+    ASSERT(walpulse_poll(pulse) == 0 && collected.batches == 1);
+
+    // A subscription and max_changes=1: one batch per transaction, t only
+    ASSERT(walpulse_watch(pulse, "t:rowid=..50") == 0);
+    ASSERT(walpulse_watch(pulse, "t:rowid=5") != 0);
+    WalpulseOptions options = { .max_changes = 1, .max_latency_ms = 0 };
+    memset(&collected, 0, sizeof(collected));
+    walpulse_set_callback(pulse, collect_changes, &collected, &options);
+    sqlite3_exec(db, "INSERT INTO t VALUES (10, 'ten', 10);"
+                     "INSERT INTO other VALUES (2);"
+                     "INSERT INTO t VALUES (11, 'eleven', 11), (60, 'sixty', 60);",
+                 NULL, NULL, NULL);
+    ASSERT(walpulse_poll(pulse) == 2);
+    ASSERT(collected.batches == 2 && collected.changes == 2 && collected.other_table == 0);
+    ASSERT(collected.last_rowid == 11);
+
+    // The checkpoint moves the rows into the database file, so pages cached
+    // from it before are stale; the update must see the checkpointed row
+    sqlite3_exec(db, "PRAGMA wal_checkpoint(TRUNCATE); UPDATE t SET name = 'TEN' WHERE id = 10;", NULL, NULL, NULL);
+    memset(&collected, 0, sizeof(collected));
+    ASSERT(walpulse_poll(pulse) == 1);
+    ASSERT(strcmp(collected.name, "TEN") == 0 && strcmp(collected.old_name, "ten") == 0);
+    walpulse_close(pulse);
+
+    ASSERT(walpulse_open("/tmp/walpulse_library_missing.db") == NULL);
+    remove_wal_db(db, path);
+}
+
+void register_walpulse_tests(void) {
+    run_test("test_walpulse_poll", test_walpulse_poll);
+}
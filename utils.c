@@ -1,7 +1,12 @@
 #include "utils.h"
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+
+// Sink non-fatal errors go to on this thread; NULL means stdout
+static __thread OutputSink *error_sink = NULL;
 
 // Reports an error message, optionally marking it as fatal
 int report_error(const char *message, int fatal) {
@@ -9,10 +14,23 @@ int report_error(const char *message, int fatal) {
         perror(message);
         return -1;
     }
-    printf("Error: %s\n", message);
+    if (!error_sink) {
+        printf("Error: %s\n", message);
+    } else if (error_sink->format == OUTPUT_TEXT) {
+        sink_printf(error_sink, "Error: %s\n", message);
+    } else {
+        // Keep structured output parseable; the error may land mid-record
+        fprintf(stderr, "Error: %s\n", message);
+    }
     return 0;
 }
 
+// Routes this thread's non-fatal errors into a text sink so they stay in
+// line with the output around them
+void set_error_sink(OutputSink *sink) {
+    error_sink = sink;
+}
+
 // Converts big-endian 16-bit integer to host byte order
 uint16_t to_host16(uint16_t big_endian) {
     return __builtin_bswap16(big_endian);
@@ -29,16 +47,27 @@ uint64_t to_host64(uint64_t big_endian) {
 }
 
 // Prints a hex dump of the data, limited to max_bytes
-void print_hex_dump(const uint8_t *data, uint32_t size, uint32_t max_bytes) {
+void print_hex_dump(OutputSink *out, const uint8_t *data, uint32_t size, uint32_t max_bytes) {
+    static const char hex_digits[] = "0123456789abcdef";
     uint32_t bytes_to_print = (size < max_bytes) ? size : max_bytes;
-    printf("    First %u bytes (hex):\n    ", bytes_to_print);
+    sink_printf(out, "    First %u bytes (hex):\n    ", bytes_to_print);
+    // Each byte takes three characters plus five for every line break
+    char *dest = sink_reserve(out, (size_t)bytes_to_print * 3 + (bytes_to_print / 16) * 5 + 1);
+    if (!dest) {
+        return;
+    }
+    size_t length = 0;
     for (uint32_t i = 0; i < bytes_to_print; i++) {
-        printf("%02x ", data[i]);
+        dest[length++] = hex_digits[data[i] >> 4];
+        dest[length++] = hex_digits[data[i] & 0x0f];
+        dest[length++] = ' ';
         if ((i + 1) % 16 == 0) {
-            printf("\n    ");
+            memcpy(dest + length, "\n    ", 5);
+            length += 5;
         }
     }
-    printf("\n");
+    dest[length++] = '\n';
+    out->size += length;
 }
 
 // Captures a hex dump into a buffer, limited to max_bytes
@@ -54,37 +83,134 @@ void capture_hex_dump(const uint8_t *data, uint32_t size, uint32_t max_bytes, ch
     }
 }
 
-// Parses a SQLite varint from data at position pos
-int64_t parse_varint(const uint8_t *data, size_t *pos, size_t max_pos, int *bytes_read) {
-    int64_t result = 0;
-    *bytes_read = 0;
+// Decodes one SQLite varint from at most available bytes into *value.
+// Returns the number of bytes used (1-9), or 0 if it runs past the end.
+int decode_varint(const uint8_t *data, size_t available, uint64_t *value) {
+    if (available >= 8) {
+        // Load eight bytes at once; the first byte without its high bit set
+        // ends the varint, found by counting trailing zeros of the stop mask
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        uint64_t stops = ~word & 0x8080808080808080ULL;
+        int length = stops ? __builtin_ctzll(stops) / 8 + 1 : 8;
+        // Put the first byte in the top lane and drop the unused ones
+        uint64_t groups = __builtin_bswap64(word) & 0x7f7f7f7f7f7f7f7fULL;
+        groups >>= (8 - length) * 8;
+        // Pack the 7-bit groups together: 8 -> 14 -> 28 -> 56 bits
+        groups = ((groups & 0x7f007f007f007f00ULL) >> 1) | (groups & 0x007f007f007f007fULL);
+        groups = ((groups & 0x3fff00003fff0000ULL) >> 2) | (groups & 0x00003fff00003fffULL);
+        groups = ((groups & 0x0fffffff00000000ULL) >> 4) | (groups & 0x000000000fffffffULL);
+        if (stops) {
+            *value = groups;
+            return length;
+        }
+        // The ninth byte contributes all eight of its bits
+        if (available < 9) {
+            return 0;
+        }
+        *value = (groups << 8) | data[8];
+        return 9;
+    }
 
-    if (*pos >= max_pos) {
-        return -1;
+    // Near the end of the buffer: exact byte-at-a-time decode
+    uint64_t result = 0;
+    for (size_t i = 0; i < available; i++) {
+        result = (result << 7) | (data[i] & 0x7f);
+        if (data[i] < 0x80) {
+            *value = result;
+            return (int)i + 1;
+        }
     }
+    return 0;
+}
 
-    for (int i = 0; i < 9 && *pos < max_pos; i++) {
-        uint8_t byte = data[*pos];
-        (*pos)++;
-        (*bytes_read)++;
-        result = (result << 7) | (byte & 0x7F);
-        if (byte < 0x80) {
-            return result;
+// Writes all of length bytes, retrying short writes
+int write_fully(int fd, const uint8_t *data, size_t length) {
+    while (length) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
         }
+        data += written;
+        length -= (size_t)written;
     }
-    return -1;
+    return 0;
 }
 
-// Computes SQLite WAL checksums for the given data
-void compute_wal_checksum(uint8_t *data, size_t len, uint32_t *checksum1, uint32_t *checksum2) {
-    uint32_t s1 = *checksum1;
-    uint32_t s2 = *checksum2;
-    for (size_t i = 0; i < len; i++) {
-        s1 += data[i];
-        s2 += s1;
+// Encodes a value the way SQLite does; returns the number of bytes written
+int encode_varint(uint64_t value, uint8_t *out) {
+    if (value >> 56) {
+        out[8] = (uint8_t)value;
+        value >>= 8;
+        for (int i = 7; i >= 0; i--) {
+            out[i] = (uint8_t)((value & 0x7f) | 0x80);
+            value >>= 7;
+        }
+        return 9;
+    }
+    uint8_t reversed[9];
+    int length = 0;
+    do {
+        reversed[length++] = (uint8_t)((value & 0x7f) | 0x80);
+        value >>= 7;
+    } while (value);
+    reversed[0] &= 0x7f;
+    for (int i = 0; i < length; i++) {
+        out[i] = reversed[length - 1 - i];
+    }
+    return length;
+}
+
+// Decodes consecutive varints from [data, data + length), such as the serial
+// types of a record header, storing up to max_values of them. Returns how
+// many were decoded; *consumed is how many bytes they used.
+uint32_t decode_varint_batch(const uint8_t *data, size_t length, int64_t *values,
+                             uint32_t max_values, size_t *consumed) {
+    size_t pos = 0;
+    uint32_t count = 0;
+    while (pos < length && count < max_values) {
+        // Eight single-byte varints in a row are the common case for narrow columns
+        if (length - pos >= 8 && max_values - count >= 8) {
+            uint64_t word;
+            memcpy(&word, data + pos, sizeof(word));
+            if ((word & 0x8080808080808080ULL) == 0) {
+                for (int i = 0; i < 8; i++) {
+                    values[count + i] = data[pos + i];
+                }
+                count += 8;
+                pos += 8;
+                continue;
+            }
+        }
+        if (data[pos] < 0x80) {
+            values[count++] = data[pos++];
+            continue;
+        }
+        uint64_t value;
+        int used = decode_varint(data + pos, length - pos, &value);
+        if (used == 0) {
+            break;
+        }
+        values[count++] = (int64_t)value;
+        pos += used;
+    }
+    *consumed = pos;
+    return count;
+}
+
+// Parses a SQLite varint from data at position pos. Returns -1 on a
+// truncated varint; callers that accept negative values use decode_varint.
+int64_t parse_varint(const uint8_t *data, size_t *pos, size_t max_pos, int *bytes_read) {
+    uint64_t value;
+    *bytes_read = *pos < max_pos ? decode_varint(data + *pos, max_pos - *pos, &value) : 0;
+    if (*bytes_read == 0) {
+        return -1;
     }
-    *checksum1 = s1;
-    *checksum2 = s2;
+    *pos += *bytes_read;
+    return (int64_t)value;
 }
 
 // Derives the database filename from the WAL filename by removing "-wal" suffix
@@ -1,16 +1,22 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include "output_sink.h"
 #include <stdint.h>
 #include <stdio.h>
 
 int report_error(const char* message, int fatal);
+void set_error_sink(OutputSink* sink);
 uint16_t to_host16(uint16_t big_endian);
 uint32_t to_host32(uint32_t big_endian);
 uint64_t to_host64(uint64_t big_endian);
-void print_hex_dump(const uint8_t* data, uint32_t size, uint32_t max_bytes);
+void print_hex_dump(OutputSink* out, const uint8_t* data, uint32_t size, uint32_t max_bytes);
+int write_fully(int fd, const uint8_t* data, size_t length);
+int encode_varint(uint64_t value, uint8_t* out);
+int decode_varint(const uint8_t* data, size_t available, uint64_t* value);
+uint32_t decode_varint_batch(const uint8_t* data, size_t length, int64_t* values,
+                             uint32_t max_values, size_t* consumed);
 int64_t parse_varint(const uint8_t* data, size_t* pos, size_t max_pos, int* bytes_read);
-void compute_wal_checksum(uint8_t* data, size_t len, uint32_t* checksum1, uint32_t* checksum2);
 void capture_hex_dump(const uint8_t* data, uint32_t size, uint32_t max_bytes, char* buffer, size_t buffer_size);
 char* derive_db_filename(const char* wal_filename);
 
@@ -0,0 +1,339 @@
+#include "wal_checksum.h"
+#include "utils.h"
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WAL_CHECKSUM_X86 1
+#endif
+
+// SQLite's WAL checksum consumes the data as pairs of 32-bit words (a, b):
+//
+//     s1 += a + s2;  s2 += b + s1;
+//
+// which is the linear map S' = M*S + (a, a + b) with M = [[1, 1], [1, 2]].
+// The SIMD kernels give each vector lane its own accumulator over every L-th
+// pair (acc = M^L * acc + v) and fold the lanes back together at the end with
+// M^(L-1-k), so the only serial dependency is one multiply-add per vector.
+
+typedef void (*checksum_kernel)(const uint8_t *data, size_t pairs, int big_endian,
+                                uint32_t *checksum1, uint32_t *checksum2);
+
+#define MAX_LANES 32
+
+typedef struct {
+    uint32_t m11, m12, m22;   // M^n is symmetric, so m21 == m12
+} PowerMatrix;
+
+// powers[n] = M^n for n in [0, MAX_LANES]
+static PowerMatrix powers[MAX_LANES + 1];
+static checksum_kernel active_kernel;
+static const char *active_kernel_name;
+static pthread_once_t checksum_once = PTHREAD_ONCE_INIT;
+
+// Loads one 32-bit checksum word in the byte order chosen by the WAL magic
+static inline uint32_t load_word(const uint8_t *p, int big_endian) {
+    uint32_t word;
+    memcpy(&word, p, sizeof(word));
+    return big_endian ? to_host32(word) : word;
+}
+
+// Reference kernel, one pair of words per step
+static void checksum_scalar(const uint8_t *data, size_t pairs, int big_endian,
+                            uint32_t *checksum1, uint32_t *checksum2) {
+    uint32_t s1 = *checksum1;
+    uint32_t s2 = *checksum2;
+    for (size_t i = 0; i < pairs; i++, data += 8) {
+        s1 += load_word(data, big_endian) + s2;
+        s2 += load_word(data + 4, big_endian) + s1;
+    }
+    *checksum1 = s1;
+    *checksum2 = s2;
+}
+
+#ifdef WAL_CHECKSUM_X86
+
+// Builds per-dword constants for lanes [first_lane, first_lane + lanes):
+// diag = (m11, m22) and off = (m12, m12) of M^(exponent_base - lane)
+static void fill_lane_constants(uint32_t *diag, uint32_t *off, int first_lane, int lanes, int exponent_base) {
+    for (int w = 0; w < lanes; w++) {
+        const PowerMatrix *p = &powers[exponent_base - (first_lane + w)];
+        diag[2 * w] = p->m11;
+        diag[2 * w + 1] = p->m22;
+        off[2 * w] = p->m12;
+        off[2 * w + 1] = p->m12;
+    }
+}
+
+#define SSE_LANES 2
+#define SSE_UNROLL 4
+#define SSE_BLOCK (SSE_LANES * SSE_UNROLL)
+
+__attribute__((target("sse4.1")))
+static void checksum_sse41(const uint8_t *data, size_t pairs, int big_endian,
+                           uint32_t *checksum1, uint32_t *checksum2) {
+    size_t blocks = pairs / SSE_BLOCK;
+    if (blocks == 0) {
+        checksum_scalar(data, pairs, big_endian, checksum1, checksum2);
+        return;
+    }
+
+    const __m128i swap_words = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const PowerMatrix *step = &powers[SSE_BLOCK];
+    const __m128i step_diag = _mm_setr_epi32(step->m11, step->m22, step->m11, step->m22);
+    const __m128i step_off = _mm_set1_epi32(step->m12);
+
+    // The seed enters through the last lane so it is scaled by M^pairs
+    __m128i acc[SSE_UNROLL];
+    for (int u = 0; u < SSE_UNROLL; u++) acc[u] = _mm_setzero_si128();
+    acc[SSE_UNROLL - 1] = _mm_setr_epi32(0, 0, *checksum1, *checksum2);
+
+    for (size_t b = 0; b < blocks; b++, data += SSE_BLOCK * 8) {
+        for (int u = 0; u < SSE_UNROLL; u++) {
+            __m128i x = _mm_loadu_si128((const __m128i *)(data + u * 16));
+            if (big_endian) x = _mm_shuffle_epi8(x, swap_words);
+            __m128i v = _mm_add_epi32(x, _mm_slli_epi64(x, 32));
+            __m128i swapped = _mm_shuffle_epi32(acc[u], 0xB1);
+            acc[u] = _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi32(acc[u], step_diag),
+                                                 _mm_mullo_epi32(swapped, step_off)), v);
+        }
+    }
+
+    __m128i sum = _mm_setzero_si128();
+    for (int u = 0; u < SSE_UNROLL; u++) {
+        uint32_t diag[2 * SSE_LANES], off[2 * SSE_LANES];
+        fill_lane_constants(diag, off, u * SSE_LANES, SSE_LANES, SSE_BLOCK - 1);
+        __m128i swapped = _mm_shuffle_epi32(acc[u], 0xB1);
+        sum = _mm_add_epi32(sum, _mm_add_epi32(_mm_mullo_epi32(acc[u], _mm_loadu_si128((const __m128i *)diag)),
+                                               _mm_mullo_epi32(swapped, _mm_loadu_si128((const __m128i *)off))));
+    }
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, sum);
+    *checksum1 = lanes[0] + lanes[2];
+    *checksum2 = lanes[1] + lanes[3];
+
+    checksum_scalar(data, pairs - blocks * SSE_BLOCK, big_endian, checksum1, checksum2);
+}
+
+#define AVX2_LANES 4
+#define AVX2_UNROLL 4
+#define AVX2_BLOCK (AVX2_LANES * AVX2_UNROLL)
+
+__attribute__((target("avx2")))
+static void checksum_avx2(const uint8_t *data, size_t pairs, int big_endian,
+                          uint32_t *checksum1, uint32_t *checksum2) {
+    size_t blocks = pairs / AVX2_BLOCK;
+    if (blocks == 0) {
+        checksum_scalar(data, pairs, big_endian, checksum1, checksum2);
+        return;
+    }
+
+    const __m256i swap_words = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                                3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const PowerMatrix *step = &powers[AVX2_BLOCK];
+    const __m256i step_diag = _mm256_setr_epi32(step->m11, step->m22, step->m11, step->m22,
+                                                step->m11, step->m22, step->m11, step->m22);
+    const __m256i step_off = _mm256_set1_epi32(step->m12);
+
+    __m256i acc[AVX2_UNROLL];
+    for (int u = 0; u < AVX2_UNROLL; u++) acc[u] = _mm256_setzero_si256();
+    acc[AVX2_UNROLL - 1] = _mm256_setr_epi32(0, 0, 0, 0, 0, 0, *checksum1, *checksum2);
+
+    for (size_t b = 0; b < blocks; b++, data += AVX2_BLOCK * 8) {
+        for (int u = 0; u < AVX2_UNROLL; u++) {
+            __m256i x = _mm256_loadu_si256((const __m256i *)(data + u * 32));
+            if (big_endian) x = _mm256_shuffle_epi8(x, swap_words);
+            __m256i v = _mm256_add_epi32(x, _mm256_slli_epi64(x, 32));
+            __m256i swapped = _mm256_shuffle_epi32(acc[u], 0xB1);
+            acc[u] = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(acc[u], step_diag),
+                                                       _mm256_mullo_epi32(swapped, step_off)), v);
+        }
+    }
+
+    __m256i sum = _mm256_setzero_si256();
+    for (int u = 0; u < AVX2_UNROLL; u++) {
+        uint32_t diag[2 * AVX2_LANES], off[2 * AVX2_LANES];
+        fill_lane_constants(diag, off, u * AVX2_LANES, AVX2_LANES, AVX2_BLOCK - 1);
+        __m256i swapped = _mm256_shuffle_epi32(acc[u], 0xB1);
+        sum = _mm256_add_epi32(sum, _mm256_add_epi32(
+            _mm256_mullo_epi32(acc[u], _mm256_loadu_si256((const __m256i *)diag)),
+            _mm256_mullo_epi32(swapped, _mm256_loadu_si256((const __m256i *)off))));
+    }
+    uint32_t lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, sum);
+    *checksum1 = lanes[0] + lanes[2] + lanes[4] + lanes[6];
+    *checksum2 = lanes[1] + lanes[3] + lanes[5] + lanes[7];
+
+    checksum_scalar(data, pairs - blocks * AVX2_BLOCK, big_endian, checksum1, checksum2);
+}
+
+#define AVX512_LANES 8
+#define AVX512_UNROLL 4
+#define AVX512_BLOCK (AVX512_LANES * AVX512_UNROLL)
+
+__attribute__((target("avx512f,avx512bw")))
+static void checksum_avx512(const uint8_t *data, size_t pairs, int big_endian,
+                            uint32_t *checksum1, uint32_t *checksum2) {
+    size_t blocks = pairs / AVX512_BLOCK;
+    if (blocks == 0) {
+        checksum_avx2(data, pairs, big_endian, checksum1, checksum2);
+        return;
+    }
+
+    const __m512i swap_words = _mm512_set4_epi32(0x0c0d0e0f, 0x08090a0b, 0x04050607, 0x00010203);
+    const PowerMatrix *step = &powers[AVX512_BLOCK];
+    const __m512i step_diag = _mm512_set4_epi32(step->m22, step->m11, step->m22, step->m11);
+    const __m512i step_off = _mm512_set1_epi32(step->m12);
+
+    __m512i acc[AVX512_UNROLL];
+    for (int u = 0; u < AVX512_UNROLL; u++) acc[u] = _mm512_setzero_si512();
+    uint32_t seed[16] = {0};
+    seed[14] = *checksum1;
+    seed[15] = *checksum2;
+    acc[AVX512_UNROLL - 1] = _mm512_loadu_si512(seed);
+
+    for (size_t b = 0; b < blocks; b++, data += AVX512_BLOCK * 8) {
+        for (int u = 0; u < AVX512_UNROLL; u++) {
+            __m512i x = _mm512_loadu_si512(data + u * 64);
+            if (big_endian) x = _mm512_shuffle_epi8(x, swap_words);
+            __m512i v = _mm512_add_epi32(x, _mm512_slli_epi64(x, 32));
+            __m512i swapped = _mm512_shuffle_epi32(acc[u], (_MM_PERM_ENUM)0xB1);
+            acc[u] = _mm512_add_epi32(_mm512_add_epi32(_mm512_mullo_epi32(acc[u], step_diag),
+                                                       _mm512_mullo_epi32(swapped, step_off)), v);
+        }
+    }
+
+    __m512i sum = _mm512_setzero_si512();
+    for (int u = 0; u < AVX512_UNROLL; u++) {
+        uint32_t diag[2 * AVX512_LANES], off[2 * AVX512_LANES];
+        fill_lane_constants(diag, off, u * AVX512_LANES, AVX512_LANES, AVX512_BLOCK - 1);
+        __m512i swapped = _mm512_shuffle_epi32(acc[u], (_MM_PERM_ENUM)0xB1);
+        sum = _mm512_add_epi32(sum, _mm512_add_epi32(_mm512_mullo_epi32(acc[u], _mm512_loadu_si512(diag)),
+                                                     _mm512_mullo_epi32(swapped, _mm512_loadu_si512(off))));
+    }
+    // Even dwords hold s1 contributions and odd dwords s2 contributions
+    __m512i s1_lanes = _mm512_maskz_mov_epi32(0x5555, sum);
+    __m512i s2_lanes = _mm512_maskz_mov_epi32(0xAAAA, sum);
+    *checksum1 = (uint32_t)_mm512_reduce_add_epi32(s1_lanes);
+    *checksum2 = (uint32_t)_mm512_reduce_add_epi32(s2_lanes);
+
+    checksum_scalar(data, pairs - blocks * AVX512_BLOCK, big_endian, checksum1, checksum2);
+}
+
+#endif
+
+// Fills the M^n table and picks the widest kernel the CPU supports
+static void checksum_init(void) {
+    powers[0] = (PowerMatrix){1, 0, 1};
+    for (int n = 1; n <= MAX_LANES; n++) {
+        const PowerMatrix *p = &powers[n - 1];
+        // M^n = M^(n-1) * [[1, 1], [1, 2]]
+        powers[n].m11 = p->m11 + p->m12;
+        powers[n].m12 = p->m11 + 2 * p->m12;
+        powers[n].m22 = p->m12 + 2 * p->m22;
+    }
+
+    active_kernel = checksum_scalar;
+    active_kernel_name = "scalar";
+#ifdef WAL_CHECKSUM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+        active_kernel = checksum_avx512;
+        active_kernel_name = "avx512";
+    } else if (__builtin_cpu_supports("avx2")) {
+        active_kernel = checksum_avx2;
+        active_kernel_name = "avx2";
+    } else if (__builtin_cpu_supports("sse4.1")) {
+        active_kernel = checksum_sse41;
+        active_kernel_name = "sse4.1";
+    }
+#endif
+}
+
+// Returns non-zero when the WAL magic selects big-endian checksum words
+int wal_checksum_big_endian(uint32_t magic) {
+    return (magic & 1) != 0;
+}
+
+// Extends a running SQLite WAL checksum over len bytes (a multiple of 8)
+void compute_wal_checksum(const uint8_t *data, size_t len, int big_endian,
+                          uint32_t *checksum1, uint32_t *checksum2) {
+    pthread_once(&checksum_once, checksum_init);
+    active_kernel(data, len / 8, big_endian, checksum1, checksum2);
+}
+
+// Returns the name of the kernel selected for this CPU
+const char *wal_checksum_kernel_name(void) {
+    pthread_once(&checksum_once, checksum_init);
+    return active_kernel_name;
+}
+
+// Forces a kernel by name ("scalar", "sse4.1", "avx2", "avx512"); -1 if unsupported
+int wal_checksum_set_kernel(const char *name) {
+    pthread_once(&checksum_once, checksum_init);
+    if (strcmp(name, "scalar") == 0) {
+        active_kernel = checksum_scalar;
+        active_kernel_name = "scalar";
+        return 0;
+    }
+#ifdef WAL_CHECKSUM_X86
+    if (strcmp(name, "sse4.1") == 0 && __builtin_cpu_supports("sse4.1")) {
+        active_kernel = checksum_sse41;
+        active_kernel_name = "sse4.1";
+        return 0;
+    }
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        active_kernel = checksum_avx2;
+        active_kernel_name = "avx2";
+        return 0;
+    }
+    if (strcmp(name, "avx512") == 0 && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+        active_kernel = checksum_avx512;
+        active_kernel_name = "avx512";
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+// Returns 1 when the header checksum matches its first 24 bytes
+int verify_wal_header_checksum(const uint8_t *raw_header, const WalHeader *header) {
+    uint32_t checksum1 = 0;
+    uint32_t checksum2 = 0;
+    compute_wal_checksum(raw_header, 24, wal_checksum_big_endian(header->magic), &checksum1, &checksum2);
+    return checksum1 == header->checksum1 && checksum2 == header->checksum2;
+}
+
+// Chains one frame from the given seed; returns 1 when salts and checksum match.
+// The seed is always advanced to the computed checksum.
+int wal_frame_checksum_matches(const WalFrameView *frame, const WalHeader *header,
+                               uint32_t *checksum1, uint32_t *checksum2) {
+    int big_endian = wal_checksum_big_endian(header->magic);
+    // Only the page number and commit size are covered, not the salts or checksums
+    compute_wal_checksum(frame->raw_header, 8, big_endian, checksum1, checksum2);
+    compute_wal_checksum(frame->page_data, header->page_size, big_endian, checksum1, checksum2);
+    return frame->header.salt1 == header->salt1 && frame->header.salt2 == header->salt2 &&
+           *checksum1 == frame->header.checksum1 && *checksum2 == frame->header.checksum2;
+}
+
+// Verifies count frames starting at first_frame, chaining from the given seed.
+// Returns 0 when the whole run is valid, otherwise the first frame that breaks
+// the chain. The seed is advanced to the checksum of the last valid frame.
+uint32_t wal_verify_frames(const WalReader *reader, uint32_t first_frame, uint32_t count,
+                           uint32_t *checksum1, uint32_t *checksum2) {
+    WalFrameView frame;
+    for (uint32_t n = first_frame; n < first_frame + count; n++) {
+        if (wal_reader_frame(reader, n, &frame) != 0) {
+            return n;
+        }
+        uint32_t c1 = *checksum1;
+        uint32_t c2 = *checksum2;
+        if (!wal_frame_checksum_matches(&frame, &reader->header, &c1, &c2)) {
+            return n;
+        }
+        *checksum1 = c1;
+        *checksum2 = c2;
+    }
+    return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef WAL_CHECKSUM_H
+#define WAL_CHECKSUM_H
+
+#include "wal_reader.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Returns non-zero when the WAL magic selects big-endian checksum words
+int wal_checksum_big_endian(uint32_t magic);
+
+// Extends a running SQLite WAL checksum over len bytes (a multiple of 8)
+void compute_wal_checksum(const uint8_t* data, size_t len, int big_endian,
+                          uint32_t* checksum1, uint32_t* checksum2);
+
+// Returns the name of the kernel selected for this CPU
+const char* wal_checksum_kernel_name(void);
+
+// Forces a kernel by name ("scalar", "sse4.1", "avx2", "avx512"); -1 if unsupported
+int wal_checksum_set_kernel(const char* name);
+
+// Returns 1 when the header checksum matches its first 24 bytes
+int verify_wal_header_checksum(const uint8_t* raw_header, const WalHeader* header);
+
+// Chains one frame from the given seed; returns 1 when salts and checksum match
+int wal_frame_checksum_matches(const WalFrameView* frame, const WalHeader* header,
+                               uint32_t* checksum1, uint32_t* checksum2);
+
+// Verifies count frames starting at first_frame, chaining from the given seed.
+// Returns 0 when the whole run is valid, otherwise the first frame that breaks
+// the chain. The seed is advanced to the checksum of the last valid frame.
+uint32_t wal_verify_frames(const WalReader* reader, uint32_t first_frame, uint32_t count,
+                           uint32_t* checksum1, uint32_t* checksum2);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef WAL_FORMAT_H
+#define WAL_FORMAT_H
+
+#include <stdint.h>
+
+#define WAL_HEADER_SIZE 32
+#define WAL_FRAME_HEADER_SIZE 24
+#define WAL_MAGIC_LE 0x377f0682
+#define WAL_MAGIC_BE 0x377f0683
+
+typedef struct {
+    uint32_t magic;
+    uint32_t format;
+    uint32_t page_size;
+    uint32_t checkpoint;
+    uint32_t salt1;
+    uint32_t salt2;
+    uint32_t checksum1;
+    uint32_t checksum2;
+} WalHeader;
+
+typedef struct {
+    uint32_t page_number;
+    uint32_t commit_size;
+    uint32_t salt1;
+    uint32_t salt2;
+    uint32_t checksum1;
+    uint32_t checksum2;
+} FrameHeader;
+
+// Decodes an on-disk (big-endian) WAL header into host byte order
+WalHeader decode_wal_header(const uint8_t *raw);
+
+// Decodes an on-disk (big-endian) frame header into host byte order
+FrameHeader decode_frame_header(const uint8_t *raw);
+
+#endif
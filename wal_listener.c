@@ -0,0 +1,304 @@
+#include "wal_listener.h"
+#include "utils.h"
+#include "wal_checksum.h"
+#include "wal_stats.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+static volatile sig_atomic_t listener_stop = 0;
+
+// Clears a state so the next pass starts from the WAL header
+void wal_state_init(WalState *state) {
+    memset(state, 0, sizeof(*state));
+}
+
+// Starts a new WAL generation at frame 1, chained from the header checksum
+void wal_state_reset(WalState *state, const WalHeader *header) {
+    state->salt1 = header->salt1;
+    state->salt2 = header->salt2;
+    state->checkpoint = header->checkpoint;
+    state->next_frame = 1;
+    state->offset = WAL_HEADER_SIZE;
+    state->checksum1 = header->checksum1;
+    state->checksum2 = header->checksum2;
+    state->initialized = 1;
+    // An open transaction from the previous generation will never commit
+    transaction_batcher_init(&state->batch, header);
+    state->committed = (WalResumePoint){
+        .salt1 = header->salt1,
+        .salt2 = header->salt2,
+        .checkpoint = header->checkpoint,
+        .page_size = header->page_size,
+        .offset = WAL_HEADER_SIZE,
+        .checksum1 = header->checksum1,
+        .checksum2 = header->checksum2,
+    };
+}
+
+// Makes the next header check try to continue from a saved position
+// instead of frame 1
+void wal_state_set_resume(WalState *state, const WalResumePoint *point) {
+    state->resume = *point;
+    state->has_resume = 1;
+}
+
+// Returns 1 once a callback has reported a failure
+static int listener_failed(const WalListener *listener) {
+    return listener->failed && *listener->failed;
+}
+
+// Continues from the saved position if it belongs to the reader's current
+// generation: same salts, checkpoint and page size, the file still reaches
+// the offset, and the commit frame's stored checksum is the saved chain
+// value. One frame header is read, whatever the WAL's size.
+static int resume_wal_state(WalState *state, const WalReader *reader) {
+    const WalHeader *header = &reader->header;
+    const WalResumePoint *point = &state->resume;
+    if (point->salt1 != header->salt1 || point->salt2 != header->salt2 ||
+        point->checkpoint != header->checkpoint || point->page_size != header->page_size ||
+        point->offset > reader->file_size) {
+        return 0;
+    }
+    uint64_t frame_size = WAL_FRAME_HEADER_SIZE + (uint64_t)reader->page_size;
+    if (point->offset != WAL_HEADER_SIZE + point->commit_frame * frame_size) {
+        return 0;
+    }
+    if (point->commit_frame > 0) {
+        WalFrameView frame;
+        if (wal_reader_frame(reader, point->commit_frame, &frame) != 0 || frame.header.commit_size == 0 ||
+            frame.header.checksum1 != point->checksum1 || frame.header.checksum2 != point->checksum2) {
+            return 0;
+        }
+    } else if (point->checksum1 != header->checksum1 || point->checksum2 != header->checksum2) {
+        return 0;
+    }
+    wal_state_reset(state, header);
+    state->next_frame = point->commit_frame + 1;
+    state->offset = point->offset;
+    state->checksum1 = point->checksum1;
+    state->checksum2 = point->checksum2;
+    state->committed = *point;
+    return 1;
+}
+
+// Delivers the frames of a freshly refreshed reader; the body of
+// process_wal_changes(), which catches a WAL truncated under it
+static int deliver_wal_changes(WalState *state, WalReader *reader, const WalListener *listener) {
+    const WalHeader *header = &reader->header;
+    if (reader->page_size == 0) {
+        state->initialized = 0;
+        return 0;
+    }
+
+    if (!state->initialized || header->salt1 != state->salt1 || header->salt2 != state->salt2 ||
+        header->checkpoint != state->checkpoint || reader->file_size < state->offset) {
+        // A header that fails its checksum is still being written
+        if (!verify_wal_header_checksum(reader->map, header)) {
+            state->initialized = 0;
+            return 0;
+        }
+        int resumed = state->has_resume && resume_wal_state(state, reader);
+        state->has_resume = 0;
+        if (resumed) {
+            if (listener->on_resume) {
+                listener->on_resume(reader, &state->committed, listener->context);
+            }
+        } else {
+            wal_state_reset(state, header);
+            if (listener->on_reset) {
+                listener->on_reset(header, listener->context);
+            }
+        }
+        if (listener_failed(listener)) {
+            state->initialized = 0;
+            return -1;
+        }
+    }
+
+    int delivered = 0;
+    WalFrameView frame;
+    while (wal_reader_frame(reader, state->next_frame, &frame) == 0) {
+        uint32_t checksum1 = state->checksum1;
+        uint32_t checksum2 = state->checksum2;
+        // Stop at a frame that is half written or left over from an older generation
+        uint64_t start = stats_clock();
+        int matches = wal_frame_checksum_matches(&frame, header, &checksum1, &checksum2);
+        stats_record(STATS_CHECKSUM, start);
+        if (!matches) {
+            break;
+        }
+        stats_add(STATS_FRAMES, 1);
+        stats_add(STATS_WAL_BYTES, WAL_FRAME_HEADER_SIZE + reader->page_size);
+        if (listener->on_frame) {
+            listener->on_frame(reader, &frame, listener->context);
+        }
+        WalTransaction transaction;
+        if (transaction_batcher_add(&state->batch, &frame, 1, &transaction) == BATCH_COMMITTED) {
+            stats_add(STATS_TRANSACTIONS, 1);
+            if (listener->on_transaction) {
+                listener->on_transaction(reader, &transaction, listener->context);
+            }
+            if (listener_failed(listener)) {
+                state->initialized = 0;
+                return -1;
+            }
+            // Only a transaction delivered in full moves the committed position
+            state->committed.commit_frame = frame.frame_number;
+            state->committed.offset = frame.offset + WAL_FRAME_HEADER_SIZE + reader->page_size;
+            state->committed.checksum1 = checksum1;
+            state->committed.checksum2 = checksum2;
+        }
+        state->checksum1 = checksum1;
+        state->checksum2 = checksum2;
+        state->next_frame++;
+        state->offset = frame.offset + WAL_FRAME_HEADER_SIZE + reader->page_size;
+        delivered++;
+    }
+    stats_gauge_set(STATS_WAL_PENDING, (int64_t)(reader->file_size - state->offset));
+    return delivered;
+}
+
+// Delivers frames appended since the last call. Work is proportional to the
+// new frames only; a changed header (salts or checkpoint sequence) or a
+// truncated file restarts from frame 1. Returns the number of frames
+// delivered, or -1 when the WAL cannot be read or a callback failed; after
+// a failure the committed position stays before the failed transaction
+// and the next pass starts again from the header. Another process may
+// truncate the WAL between the refresh and a frame read (a TRUNCATE
+// checkpoint, journal_size_limit); the SIGBUS that raises is caught, and
+// the next pass rescans from the committed position, or from frame 1 if
+// the WAL has moved on to a new generation.
+int process_wal_changes(WalState *state, WalReader *reader, const WalListener *listener) {
+    if (wal_reader_refresh(reader) != 0) {
+        state->initialized = 0;
+        return -1;
+    }
+    WalFaultGuard guard;
+    wal_fault_guard_push(&guard, reader);
+    if (sigsetjmp(guard.jump, 1) != 0) {
+        wal_fault_guard_pop(&guard);
+        if (state->initialized) {
+            wal_state_set_resume(state, &state->committed);
+        }
+        state->initialized = 0;
+        return -1;
+    }
+    int delivered = deliver_wal_changes(state, reader, listener);
+    wal_fault_guard_pop(&guard);
+    return delivered;
+}
+
+// Processes new frames, then records the committed position in the state
+// file, if there is one, once it has moved. Listeners flush their output
+// per transaction, so the file never runs ahead of what was delivered.
+// Returns -1, without saving, when a callback failed.
+static int process_and_save(WalState *state, WalReader *reader, const WalListener *listener,
+                            const char *state_filename, WalResumePoint *saved) {
+    if (process_wal_changes(state, reader, listener) < 0 && listener_failed(listener)) {
+        return -1;
+    }
+    if (state_filename && state->initialized && !resume_point_equal(&state->committed, saved)) {
+        if (save_resume_point(state_filename, &state->committed) == 0) {
+            *saved = state->committed;
+        }
+    }
+    return 0;
+}
+
+// Blocks on inotify events for the WAL's directory and delivers new frames
+// as they are committed. Watching the directory rather than the file keeps
+// the listener attached when SQLite deletes and recreates the WAL. With a
+// state_filename, the position is saved there after each pass and a
+// restart continues from it rather than from the first frame. Returns -1
+// as soon as a callback reports a failure, before saving past it.
+int start_wal_listener(const char *wal_filename, const WalListener *listener, const char *state_filename) {
+    char *dir = strdup(wal_filename);
+    if (!dir) {
+        return report_error("Failed to allocate memory for WAL directory", 1);
+    }
+    char *slash = strrchr(dir, '/');
+    const char *base = slash ? wal_filename + (slash - dir) + 1 : wal_filename;
+    if (slash) {
+        *slash = '\0';
+    }
+
+    int inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (inotify_fd < 0) {
+        free(dir);
+        return report_error("Failed to initialize inotify", 1);
+    }
+    uint32_t mask = IN_MODIFY | IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM;
+    if (inotify_add_watch(inotify_fd, slash ? (dir[0] ? dir : "/") : ".", mask) < 0) {
+        close(inotify_fd);
+        free(dir);
+        return report_error("Failed to watch WAL directory", 1);
+    }
+
+    WalReader reader;
+    WalState state;
+    wal_state_init(&state);
+    WalResumePoint saved;
+    memset(&saved, 0, sizeof(saved));
+    if (state_filename && load_resume_point(state_filename, &saved) == 0) {
+        wal_state_set_resume(&state, &saved);
+    }
+    int is_open = access(wal_filename, F_OK) == 0 && wal_reader_open(&reader, wal_filename) == 0;
+    int status = 0;
+    if (is_open && process_and_save(&state, &reader, listener, state_filename, &saved) != 0) {
+        status = -1;
+    }
+
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    listener_stop = status != 0;
+    while (!listener_stop) {
+        ssize_t length = read(inotify_fd, buffer, sizeof(buffer));
+        if (length < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            status = report_error("Failed to read inotify events", 1);
+            break;
+        }
+
+        // Coalesce the batch: one pass over the WAL however many events arrived
+        int modified = 0, replaced = 0;
+        for (char *p = buffer; p < buffer + length;) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            if (event->len > 0 && strcmp(event->name, base) == 0) {
+                if (event->mask & IN_MODIFY) modified = 1;
+                if (event->mask & (IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM)) replaced = 1;
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+
+        if (replaced && is_open) {
+            wal_reader_close(&reader);
+            wal_state_init(&state);
+            is_open = 0;
+        }
+        if (!is_open && (replaced || modified) && access(wal_filename, F_OK) == 0) {
+            is_open = wal_reader_open(&reader, wal_filename) == 0;
+        }
+        if (is_open && (replaced || modified) &&
+            process_and_save(&state, &reader, listener, state_filename, &saved) != 0) {
+            status = -1;
+            break;
+        }
+    }
+
+    if (is_open) {
+        wal_reader_close(&reader);
+    }
+    close(inotify_fd);
+    free(dir);
+    return status;
+}
+
+// Asks a running listener to return; safe to call from a signal handler
+void stop_wal_listener(void) {
+    listener_stop = 1;
+}
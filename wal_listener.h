@@ -0,0 +1,51 @@
+#ifndef WAL_LISTENER_H
+#define WAL_LISTENER_H
+
+#include "wal_reader.h"
+#include "wal_resume.h"
+#include "wal_transaction.h"
+#include <stdint.h>
+
+// Resumable position in a WAL: everything before next_frame has been
+// verified and delivered, and checksum1/2 is the chain value after it
+typedef struct {
+    uint32_t salt1;
+    uint32_t salt2;
+    uint32_t checkpoint;
+    uint32_t next_frame;        // 1-based frame to process next
+    uint64_t offset;            // Byte offset of next_frame in the file
+    uint32_t checksum1;
+    uint32_t checksum2;
+    uint8_t initialized;        // 0 until a valid header has been seen
+    TransactionBatcher batch;   // Delivered frames not yet covered by a commit
+    WalResumePoint committed;   // Position after the last delivered commit
+    WalResumePoint resume;      // Saved position tried at the next header check
+    uint8_t has_resume;
+} WalState;
+
+typedef struct {
+    // Called for every newly verified frame, in order; may be NULL
+    void (*on_frame)(const WalReader* reader, const WalFrameView* frame, void* context);
+    // Called once per committed transaction, after on_frame for its commit
+    // frame; may be NULL. Frames after the last commit wait for the next one.
+    void (*on_transaction)(const WalReader* reader, const WalTransaction* transaction, void* context);
+    // Called when a new WAL generation starts (first header, checkpoint, restart)
+    void (*on_reset)(const WalHeader* header, void* context);
+    // Called instead of on_reset when a saved position is picked up; frames
+    // up to point->commit_frame were delivered by an earlier run. May be NULL.
+    void (*on_resume)(const WalReader* reader, const WalResumePoint* point, void* context);
+    void* context;
+    // Set non-zero by a callback that could not take what it was given,
+    // e.g. on a full disk; may be NULL. Delivery then stops and the failed
+    // transaction is not counted as committed, so it is never saved.
+    const int* failed;
+} WalListener;
+
+void wal_state_init(WalState* state);
+void wal_state_reset(WalState* state, const WalHeader* header);
+void wal_state_set_resume(WalState* state, const WalResumePoint* point);
+int process_wal_changes(WalState* state, WalReader* reader, const WalListener* listener);
+int start_wal_listener(const char* wal_filename, const WalListener* listener, const char* state_filename);
+void stop_wal_listener(void);
+
+#endif
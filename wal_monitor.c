@@ -0,0 +1,453 @@
+#include "wal_monitor.h"
+#include "utils.h"
+#include <errno.h>
+#include <glob.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+// Bytes of inotify events read per call; a busy host fills this in one go
+#define MONITOR_EVENT_BUFFER (64 * 1024)
+#define WAL_SUFFIX "-wal"
+#define WAL_SUFFIX_LENGTH 4
+#define MONITOR_WATCH_MASK (IN_MODIFY | IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM | IN_ONLYDIR)
+
+static volatile sig_atomic_t monitor_stop = 0;
+
+// Passed through process_wal_changes so callbacks learn which database fired
+typedef struct {
+    const MonitorListener *listener;
+    const char *database;
+} MonitorDispatch;
+
+// Hashes a database file name together with the watch of its directory
+static uint32_t monitor_hash(int32_t watch, const char *name, size_t length) {
+    uint32_t hash = 2166136261u ^ ((uint32_t)watch * 0x9e3779b1u);
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// File name part of a monitored database's path
+static const char *monitor_base(const WalMonitor *monitor, const MonitoredWal *wal) {
+    return monitor->names + wal->path + wal->base;
+}
+
+// Finds the database called name in the directory behind watch; -1 if not monitored
+static int64_t monitor_find(const WalMonitor *monitor, int32_t watch, const char *name, size_t length) {
+    uint32_t slot = monitor_hash(watch, name, length) & monitor->bucket_mask;
+    for (uint32_t entry = monitor->buckets[slot]; entry; entry = monitor->wals[entry - 1].next) {
+        const MonitoredWal *wal = &monitor->wals[entry - 1];
+        const char *base = monitor_base(monitor, wal);
+        if (wal->watch == watch && strncmp(base, name, length) == 0 && base[length] == '\0') {
+            return entry - 1;
+        }
+    }
+    return -1;
+}
+
+// Links a database into its bucket
+static void monitor_link(WalMonitor *monitor, uint32_t index) {
+    MonitoredWal *wal = &monitor->wals[index];
+    const char *base = monitor_base(monitor, wal);
+    uint32_t slot = monitor_hash(wal->watch, base, strlen(base)) & monitor->bucket_mask;
+    wal->next = monitor->buckets[slot];
+    monitor->buckets[slot] = index + 1;
+}
+
+// Doubles the bucket array and rehashes every database into it
+static int monitor_grow_buckets(WalMonitor *monitor) {
+    uint32_t count = (monitor->bucket_mask + 1) * 2;
+    uint32_t *buckets = calloc(count, sizeof(uint32_t));
+    if (!buckets) {
+        return report_error("Failed to grow monitor table", 1);
+    }
+    free(monitor->buckets);
+    monitor->buckets = buckets;
+    monitor->bucket_mask = count - 1;
+    for (uint32_t i = 0; i < monitor->count; i++) {
+        monitor_link(monitor, i);
+    }
+    return 0;
+}
+
+// Copies a path into the name pool; returns its offset or UINT32_MAX
+static uint32_t monitor_store_name(WalMonitor *monitor, const char *name, size_t length) {
+    if (monitor->names_capacity - monitor->names_size < length + 1) {
+        uint32_t capacity = monitor->names_capacity ? monitor->names_capacity : 4096;
+        while (capacity - monitor->names_size < length + 1) {
+            capacity *= 2;
+        }
+        char *names = realloc(monitor->names, capacity);
+        if (!names) {
+            report_error("Failed to grow monitor name pool", 1);
+            return UINT32_MAX;
+        }
+        monitor->names = names;
+        monitor->names_capacity = capacity;
+    }
+    uint32_t offset = monitor->names_size;
+    memcpy(monitor->names + offset, name, length);
+    monitor->names[offset + length] = '\0';
+    monitor->names_size += (uint32_t)length + 1;
+    return offset;
+}
+
+// Queues a database for the next processing pass, once however often it is hit
+static void monitor_mark_dirty(WalMonitor *monitor, uint32_t index) {
+    MonitoredWal *wal = &monitor->wals[index];
+    if (!wal->dirty) {
+        wal->dirty = 1;
+        wal->next_dirty = monitor->dirty_head;
+        monitor->dirty_head = index + 1;
+    }
+}
+
+// Creates an empty monitor with its inotify instance registered in epoll
+int wal_monitor_init(WalMonitor *monitor) {
+    memset(monitor, 0, sizeof(*monitor));
+    monitor->epoll_fd = -1;
+    monitor->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (monitor->inotify_fd < 0) {
+        return report_error("Failed to initialize inotify", 1);
+    }
+    monitor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (monitor->epoll_fd < 0) {
+        report_error("Failed to create epoll instance", 1);
+        wal_monitor_free(monitor);
+        return -1;
+    }
+    struct epoll_event event = { .events = EPOLLIN, .data.fd = monitor->inotify_fd };
+    if (epoll_ctl(monitor->epoll_fd, EPOLL_CTL_ADD, monitor->inotify_fd, &event) != 0) {
+        report_error("Failed to register inotify with epoll", 1);
+        wal_monitor_free(monitor);
+        return -1;
+    }
+    monitor->buckets = calloc(WAL_MONITOR_INITIAL_BUCKETS, sizeof(uint32_t));
+    if (!monitor->buckets) {
+        report_error("Failed to allocate monitor table", 1);
+        wal_monitor_free(monitor);
+        return -1;
+    }
+    monitor->bucket_mask = WAL_MONITOR_INITIAL_BUCKETS - 1;
+    return 0;
+}
+
+// Starts monitoring a database's WAL. The database's directory is watched
+// once, however many databases share it; adding a database twice is a no-op.
+int wal_monitor_add(WalMonitor *monitor, const char *db_filename) {
+    size_t length = strlen(db_filename);
+    if (length == 0 || length + WAL_SUFFIX_LENGTH >= PATH_MAX) {
+        report_error("Invalid database path", 0);
+        return -1;
+    }
+    const char *slash = strrchr(db_filename, '/');
+    uint32_t base = slash ? (uint32_t)(slash - db_filename) + 1 : 0;
+    if (db_filename[base] == '\0') {
+        report_error("Invalid database path", 0);
+        return -1;
+    }
+
+    char directory[PATH_MAX];
+    if (!slash) {
+        strcpy(directory, ".");
+    } else if (slash == db_filename) {
+        strcpy(directory, "/");
+    } else {
+        memcpy(directory, db_filename, base - 1);
+        directory[base - 1] = '\0';
+    }
+    // inotify hands back the existing descriptor for a directory it already watches
+    int watch = inotify_add_watch(monitor->inotify_fd, directory, MONITOR_WATCH_MASK);
+    if (watch < 0) {
+        return report_error("Failed to watch database directory", 1);
+    }
+    if (monitor_find(monitor, watch, db_filename + base, length - base) >= 0) {
+        return 0;
+    }
+
+    if (monitor->count == monitor->capacity) {
+        uint32_t capacity = monitor->capacity ? monitor->capacity * 2 : 64;
+        MonitoredWal *wals = realloc(monitor->wals, capacity * sizeof(MonitoredWal));
+        if (!wals) {
+            return report_error("Failed to grow monitored database list", 1);
+        }
+        monitor->wals = wals;
+        monitor->capacity = capacity;
+    }
+    uint32_t path = monitor_store_name(monitor, db_filename, length);
+    if (path == UINT32_MAX) {
+        return -1;
+    }
+    MonitoredWal *wal = &monitor->wals[monitor->count];
+    memset(wal, 0, sizeof(*wal));
+    wal_state_init(&wal->state);
+    wal->path = path;
+    wal->base = base;
+    wal->watch = watch;
+    if (monitor->resume) {
+        char state_filename[PATH_MAX];
+        WalResumePoint point;
+        snprintf(state_filename, sizeof(state_filename), "%s" RESUME_SUFFIX, db_filename);
+        if (load_resume_point(state_filename, &point) == 0) {
+            wal_state_set_resume(&wal->state, &point);
+        }
+    }
+    monitor_link(monitor, monitor->count);
+    monitor->count++;
+    if (monitor->count > monitor->bucket_mask + 1) {
+        return monitor_grow_buckets(monitor);
+    }
+    return 0;
+}
+
+// Returns 1 for a file SQLite or walpulse keeps beside a database
+static int is_companion_file(const char *path) {
+    static const char *suffixes[] = { WAL_SUFFIX, "-shm", RESUME_SUFFIX, RESUME_SUFFIX ".tmp" };
+    size_t length = strlen(path);
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+        size_t suffix_length = strlen(suffixes[i]);
+        if (length > suffix_length && strcmp(path + length - suffix_length, suffixes[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Adds every database matching a glob(3) pattern. A pattern without
+// matches is taken as a literal path, so a database can be watched before
+// it exists. WAL, shared-memory and state files caught by a broad pattern
+// are skipped.
+int wal_monitor_add_pattern(WalMonitor *monitor, const char *pattern) {
+    glob_t matches;
+    int result = glob(pattern, GLOB_NOCHECK, NULL, &matches);
+    if (result != 0) {
+        report_error("Failed to expand database pattern", 0);
+        return -1;
+    }
+    int status = 0;
+    for (size_t i = 0; i < matches.gl_pathc && status == 0; i++) {
+        if (!is_companion_file(matches.gl_pathv[i])) {
+            status = wal_monitor_add(monitor, matches.gl_pathv[i]);
+        }
+    }
+    globfree(&matches);
+    return status;
+}
+
+// Adds the databases named in a file, one path or pattern per line
+int wal_monitor_add_list(WalMonitor *monitor, const char *list_filename) {
+    FILE *list = fopen(list_filename, "r");
+    if (!list) {
+        return report_error("Failed to open database list", 1);
+    }
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t length;
+    int status = 0;
+    while (status == 0 && (length = getline(&line, &line_capacity, list)) >= 0) {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+            line[--length] = '\0';
+        }
+        if (length > 0 && line[0] != '#') {
+            status = wal_monitor_add_pattern(monitor, line);
+        }
+    }
+    free(line);
+    fclose(list);
+    return status;
+}
+
+// Path of the database at index, as it was added
+const char *wal_monitor_database(const WalMonitor *monitor, uint32_t index) {
+    return monitor->names + monitor->wals[index].path;
+}
+
+static void dispatch_transaction(const WalReader *reader, const WalTransaction *transaction, void *context) {
+    const MonitorDispatch *dispatch = context;
+    dispatch->listener->on_transaction(dispatch->database, reader, transaction, dispatch->listener->context);
+}
+
+static void dispatch_reset(const WalHeader *header, void *context) {
+    const MonitorDispatch *dispatch = context;
+    if (dispatch->listener->on_reset) {
+        dispatch->listener->on_reset(dispatch->database, header, dispatch->listener->context);
+    }
+}
+
+// Delivers whatever one database committed since it was last processed.
+// The WAL is opened and closed around the pass, so descriptors and
+// mappings do not grow with the number of databases.
+static void monitor_process(WalMonitor *monitor, uint32_t index, const MonitorListener *listener) {
+    MonitoredWal *wal = &monitor->wals[index];
+    const char *database = monitor->names + wal->path;
+    char wal_filename[PATH_MAX];
+    snprintf(wal_filename, sizeof(wal_filename), "%s" WAL_SUFFIX, database);
+    if (access(wal_filename, F_OK) != 0) {
+        wal_state_init(&wal->state);
+        return;
+    }
+    WalReader reader;
+    if (wal_reader_open(&reader, wal_filename) != 0) {
+        wal_state_init(&wal->state);
+        return;
+    }
+    MonitorDispatch dispatch = { .listener = listener, .database = database };
+    WalListener callbacks = {
+        .on_transaction = dispatch_transaction,
+        .on_reset = dispatch_reset,
+        .context = &dispatch
+    };
+    WalResumePoint before = wal->state.committed;
+    process_wal_changes(&wal->state, &reader, &callbacks);
+    wal_reader_close(&reader);
+    if (monitor->resume && wal->state.initialized && !resume_point_equal(&before, &wal->state.committed)) {
+        wal->unsaved = 1;
+    }
+}
+
+// Writes a database's committed position to its state file
+static void monitor_save(WalMonitor *monitor, uint32_t index) {
+    MonitoredWal *wal = &monitor->wals[index];
+    char state_filename[PATH_MAX];
+    snprintf(state_filename, sizeof(state_filename), "%s" RESUME_SUFFIX, monitor->names + wal->path);
+    if (save_resume_point(state_filename, &wal->state.committed) == 0) {
+        wal->unsaved = 0;
+    }
+}
+
+// Processes every queued database once; returns how many were processed.
+// State files are written after on_batch has flushed the batch's output,
+// so a saved position never runs ahead of what was delivered.
+static int monitor_process_dirty(WalMonitor *monitor, const MonitorListener *listener) {
+    int processed = 0;
+    for (uint32_t entry = monitor->dirty_head; entry; entry = monitor->wals[entry - 1].next_dirty) {
+        monitor_process(monitor, entry - 1, listener);
+        processed++;
+    }
+    if (processed && listener->on_batch) {
+        listener->on_batch(listener->context);
+    }
+    while (monitor->dirty_head) {
+        uint32_t index = monitor->dirty_head - 1;
+        MonitoredWal *wal = &monitor->wals[index];
+        monitor->dirty_head = wal->next_dirty;
+        wal->dirty = 0;
+        wal->next_dirty = 0;
+        if (wal->unsaved) {
+            monitor_save(monitor, index);
+        }
+    }
+    return processed;
+}
+
+// Reads every pending inotify event and queues the databases they name.
+// A replaced WAL starts over from its header; an overflowed queue means
+// events were lost, so every database is queued.
+static int monitor_drain(WalMonitor *monitor) {
+    char buffer[MONITOR_EVENT_BUFFER] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;) {
+        ssize_t length = read(monitor->inotify_fd, buffer, sizeof(buffer));
+        if (length < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+            return report_error("Failed to read inotify events", 1);
+        }
+        for (char *p = buffer; p < buffer + length;) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + event->len;
+            monitor->events++;
+            if (event->mask & IN_Q_OVERFLOW) {
+                for (uint32_t i = 0; i < monitor->count; i++) {
+                    monitor_mark_dirty(monitor, i);
+                }
+                continue;
+            }
+            size_t name_length = event->len ? strlen(event->name) : 0;
+            // Only -wal files matter; -shm and journal churn is dropped here
+            if (name_length <= WAL_SUFFIX_LENGTH ||
+                strcmp(event->name + name_length - WAL_SUFFIX_LENGTH, WAL_SUFFIX) != 0) {
+                continue;
+            }
+            int64_t index = monitor_find(monitor, event->wd, event->name, name_length - WAL_SUFFIX_LENGTH);
+            if (index < 0) {
+                continue;
+            }
+            if (event->mask & (IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM)) {
+                wal_state_init(&monitor->wals[index].state);
+            }
+            monitor_mark_dirty(monitor, (uint32_t)index);
+        }
+    }
+}
+
+// Delivers everything already in the monitored WALs
+int wal_monitor_scan(WalMonitor *monitor, const MonitorListener *listener) {
+    for (uint32_t i = 0; i < monitor->count; i++) {
+        monitor_mark_dirty(monitor, i);
+    }
+    return monitor_process_dirty(monitor, listener);
+}
+
+// Waits up to timeout_ms (-1 for ever) for WAL activity and processes one
+// batch of it. Returns the number of databases processed, 0 on timeout or
+// interruption, -1 on error.
+int wal_monitor_poll(WalMonitor *monitor, const MonitorListener *listener, int timeout_ms) {
+    struct epoll_event event;
+    int ready = epoll_wait(monitor->epoll_fd, &event, 1, timeout_ms);
+    if (ready < 0) {
+        return errno == EINTR ? 0 : report_error("Failed to wait for inotify events", 1);
+    }
+    if (ready == 0) {
+        return 0;
+    }
+    if (monitor_drain(monitor) != 0) {
+        return -1;
+    }
+    monitor->batches++;
+    return monitor_process_dirty(monitor, listener);
+}
+
+// Delivers existing transactions, then new ones as they are committed,
+// until stop_wal_monitor()
+int wal_monitor_run(WalMonitor *monitor, const MonitorListener *listener) {
+    monitor_stop = 0;
+    wal_monitor_scan(monitor, listener);
+    while (!monitor_stop) {
+        if (wal_monitor_poll(monitor, listener, -1) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Asks a running monitor to return; safe to call from a signal handler
+void stop_wal_monitor(void) {
+    monitor_stop = 1;
+}
+
+// Closes the monitor's descriptors and releases its tables
+void wal_monitor_free(WalMonitor *monitor) {
+    if (monitor->epoll_fd >= 0) {
+        close(monitor->epoll_fd);
+    }
+    if (monitor->inotify_fd >= 0) {
+        close(monitor->inotify_fd);
+    }
+    free(monitor->wals);
+    free(monitor->names);
+    free(monitor->buckets);
+    memset(monitor, 0, sizeof(*monitor));
+    monitor->epoll_fd = -1;
+    monitor->inotify_fd = -1;
+}
@@ -0,0 +1,68 @@
+#ifndef WAL_MONITOR_H
+#define WAL_MONITOR_H
+
+#include "wal_listener.h"
+#include "wal_transaction.h"
+#include <stdint.h>
+
+// Buckets of a new monitor's name table; it doubles as databases are added
+#define WAL_MONITOR_INITIAL_BUCKETS 64
+
+typedef struct {
+    // Called once per committed transaction of any watched database
+    void (*on_transaction)(const char* database, const WalReader* reader,
+                           const WalTransaction* transaction, void* context);
+    // Called when a database's WAL starts a new generation; may be NULL
+    void (*on_reset)(const char* database, const WalHeader* header, void* context);
+    // Called after each batch of databases has been processed; may be NULL
+    void (*on_batch)(void* context);
+    void* context;
+} MonitorListener;
+
+// Everything kept per database between events. The WAL is only opened
+// while its events are handled, so an idle database costs this struct and
+// its name rather than a descriptor and a mapping.
+typedef struct {
+    WalState state;
+    uint32_t path;              // Offset of the database path in the name pool
+    uint32_t base;              // Length of the directory part of the path
+    int32_t watch;              // inotify watch descriptor of the directory
+    uint32_t next;              // Next database in the same bucket, +1; 0 ends the chain
+    uint32_t next_dirty;        // Next database to process, +1; 0 ends the list
+    uint8_t dirty;
+    uint8_t unsaved;            // Committed position moved since the state file was written
+} MonitoredWal;
+
+// Watches the -wal files of many databases through one inotify instance
+// registered in epoll. Directories are watched rather than files, so one
+// watch covers every database in it and WALs can come and go. Each wakeup
+// drains all pending events and processes every database they touched once.
+typedef struct {
+    int inotify_fd;
+    int epoll_fd;
+    MonitoredWal* wals;
+    uint32_t count;
+    uint32_t capacity;
+    char* names;                // Database paths, NUL-terminated, back to back
+    uint32_t names_size;
+    uint32_t names_capacity;
+    uint32_t* buckets;          // (watch, file name) hash -> database index + 1
+    uint32_t bucket_mask;
+    uint32_t dirty_head;        // First database to process, +1; 0 if none
+    uint64_t events;            // inotify events read
+    uint64_t batches;           // Wakeups that had events to drain
+    uint8_t resume;             // Keep a state file per database; set before adding any
+} WalMonitor;
+
+int wal_monitor_init(WalMonitor* monitor);
+int wal_monitor_add(WalMonitor* monitor, const char* db_filename);
+int wal_monitor_add_pattern(WalMonitor* monitor, const char* pattern);
+int wal_monitor_add_list(WalMonitor* monitor, const char* list_filename);
+const char* wal_monitor_database(const WalMonitor* monitor, uint32_t index);
+int wal_monitor_scan(WalMonitor* monitor, const MonitorListener* listener);
+int wal_monitor_poll(WalMonitor* monitor, const MonitorListener* listener, int timeout_ms);
+int wal_monitor_run(WalMonitor* monitor, const MonitorListener* listener);
+void stop_wal_monitor(void);
+void wal_monitor_free(WalMonitor* monitor);
+
+#endif
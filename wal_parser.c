@@ -1,29 +1,35 @@
 #include "wal_parser.h"
 #include "utils.h"
+#include "wal_checksum.h"
 #include "page_analyzer.h"
+#include "page_owner.h"
+#include "wal_listener.h"
+#include "wal_monitor.h"
+#include "frame_index.h"
+#include "frame_decoder.h"
+#include "frame_output.h"
+#include "page_cache.h"
+#include "page_source.h"
+#include "row_changes.h"
+#include "row_diff.h"
+#include "wal_stats.h"
+#include "wal_transaction.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 // Reads and validates the WAL file header
 WalHeader read_wal_header(FILE *file) {
+    uint8_t raw[WAL_HEADER_SIZE];
     WalHeader header = {0};
-    if (fread(&header, sizeof(WalHeader), 1, file) != 1) {
+    if (fread(raw, sizeof(raw), 1, file) != 1) {
         report_error("Could not read WAL header", 1);
         return header;
     }
-
-    // Convert header fields from big-endian to host byte order
-    header.magic = to_host32(header.magic);
-    header.format = to_host32(header.format);
-    header.page_size = to_host32(header.page_size);
-    header.checkpoint = to_host32(header.checkpoint);
-    header.salt1 = to_host32(header.salt1);
-    header.salt2 = to_host32(header.salt2);
-    header.checksum1 = to_host32(header.checksum1);
-    header.checksum2 = to_host32(header.checksum2);
+    header = decode_wal_header(raw);
 
     // Validate magic number
-    if (header.magic != 0x377f0682 && header.magic != 0x377f0683) {
+    if (header.magic != WAL_MAGIC_LE && header.magic != WAL_MAGIC_BE) {
         report_error("Invalid WAL file: incorrect magic number", 1);
     }
     return header;
@@ -39,118 +45,692 @@ int validate_wal_file_size(long file_size, uint32_t page_size) {
     return remaining_size / frame_size;
 }
 
-// Process and prints information about WAL frames
-void process_wal_frames(FILE *file, WalHeader *header, const char *wal_filename) {
-    FrameHeader frame;
-    uint32_t frame_count = 0;
-    uint8_t *page_data = malloc(header->page_size);
-    if (!page_data) {
-        report_error("Could not allocate memory for page data", 1);
-        return;
+// Prints the frame header fields and the page type
+void print_frame_header(OutputSink *out, const WalFrameView *frame) {
+    sink_printf(out, "Frame %u:\n", frame->frame_number);
+    sink_printf(out, "  Page Number: %u\n", frame->header.page_number);
+    sink_printf(out, "  Commit Size: %u pages (0 if not a commit frame)\n", frame->header.commit_size);
+    sink_printf(out, "  Salt-1: 0x%08x\n", frame->header.salt1);
+    sink_printf(out, "  Salt-2: 0x%08x\n", frame->header.salt2);
+    sink_printf(out, "  Checksum-1: 0x%08x\n", frame->header.checksum1);
+    sink_printf(out, "  Checksum-2: 0x%08x\n", frame->header.checksum2);
+    print_page_type(out, frame->page_data, frame->header.page_number);
+}
+
+// Sets up where overflow pages are read from: the WAL frames in index, if
+// it was built, then the page cache over the database file when owners has
+// it open
+static PageSource *open_page_source(PageSource *source, const WalReader *reader, const FrameIndex *index,
+                                    PageOwnerMap *owners) {
+    PageCache *database = owners && owners->page_size == reader->page_size ? &owners->cache : NULL;
+    if (!index && !database) {
+        return NULL;
     }
+    page_source_init(source, reader, index, database, reader->page_size, owners ? owners->usable_size : 0);
+    return source;
+}
+
+// Narrows owners to the subscribed tables, if there is a subscription. It
+// needs the database file: ownership is what the filter runs on.
+static int watch_subscription(PageOwnerMap *owners, const Subscription *subscription) {
+    if (!subscription) {
+        return 0;
+    }
+    if (!owners) {
+        report_error("Table subscriptions need the database file", 0);
+        return -1;
+    }
+    return page_owner_watch(owners, subscription->names, subscription->count);
+}
 
-    // Derive database filename from WAL filename using utility function
+// Builds the page-to-table map for the WAL's database, narrowed to the
+// subscription. *owners is NULL when the database cannot be read, so
+// tables show as unknown; -1 only if the subscription cannot be applied.
+static int open_owners(PageOwnerMap *map, PageOwnerMap **owners, const char *wal_filename,
+                       const Subscription *subscription) {
+    *owners = NULL;
     char *db_filename = derive_db_filename(wal_filename);
     if (!db_filename) {
-        free(page_data);
+        return -1;
+    }
+    if (page_owner_open(map, db_filename) == 0) {
+        *owners = map;
+    }
+    free(db_filename);
+    if (watch_subscription(*owners, subscription) != 0) {
+        if (*owners) {
+            page_owner_close(*owners);
+        }
+        return -1;
+    }
+    return 0;
+}
+
+// Process and prints information about WAL frames. Frames are checked in
+// order, decoded on up to jobs threads and printed in frame order, with
+// the three running as pipeline stages (see pipeline_wal_frames). With
+// committed_only, frames that no valid commit covers are left out. With a
+// subscription, only frames of the subscribed tables are decoded; the rest
+// are just checksummed.
+void process_wal_frames(OutputSink *out, WalReader *reader, const char *wal_filename, unsigned jobs,
+                        int committed_only, const Subscription *subscription) {
+    uint32_t page_size = reader->page_size;
+
+    PageOwnerMap owner_map;
+    PageOwnerMap *owners;
+    if (open_owners(&owner_map, &owners, wal_filename, subscription) != 0) {
         return;
     }
 
-    printf("Frame Information:\n");
-    while (fread(&frame, sizeof(FrameHeader), 1, file) == 1) {
-        // Convert frame fields from big-endian to host byte order
-        frame.page_number = to_host32(frame.page_number);
-        frame.commit_size = to_host32(frame.commit_size);
-        frame.salt1 = to_host32(frame.salt1);
-        frame.salt2 = to_host32(frame.salt2);
-        frame.checksum1 = to_host32(frame.checksum1);
-        frame.checksum2 = to_host32(frame.checksum2);
+    if (out->format == OUTPUT_TEXT) {
+        sink_puts(out, "Frame Information:\n");
+    }
+    // Overflow chains are followed through the valid frames, then the database
+    FrameIndex index;
+    frame_index_init(&index);
+    int indexed = frame_index_build(&index, reader) >= 0;
+    PageSource page_source;
+    PageSource *source = open_page_source(&page_source, reader, indexed ? &index : NULL, owners);
+    PipelineSummary summary;
+    pipeline_wal_frames(out, reader, owners, subscription, committed_only, source, jobs, &summary);
+    frame_index_free(&index);
+    if (summary.dropped) {
+        emit_message(out, "Dropped %llu frames outside committed transactions", (unsigned long long)summary.dropped);
+    }
+    if (summary.skipped) {
+        emit_message(out, "Skipped %u frames outside the subscribed tables", summary.skipped);
+    }
 
-        // Read page data for the frame
-        if (fread(page_data, header->page_size, 1, file) != 1) {
-            printf("Warning: Incomplete frame data for frame %u\n", frame_count + 1);
-            break;
-        }
+    uint64_t frame_bytes = (uint64_t)summary.frame_count * (WAL_FRAME_HEADER_SIZE + page_size);
+    emit_summary(out, summary.decode_count, reader->file_size > WAL_HEADER_SIZE + frame_bytes);
+    if (owners) {
+        page_owner_close(owners);
+    }
+}
 
-        frame_count++;
-        printf("Frame %u:\n", frame_count);
-        printf("  Page Number: %u\n", frame.page_number);
-        printf("  Commit Size: %u pages (0 if not a commit frame)\n", frame.commit_size);
-        printf("  Salt-1: 0x%08x\n", frame.salt1);
-        printf("  Salt-2: 0x%08x\n", frame.salt2);
-        printf("  Checksum-1: 0x%08x\n", frame.checksum1);
-        printf("  Checksum-2: 0x%08x\n", frame.checksum2);
+// Prints the last committed copy of every page in the current generation,
+// in page order. Frames are indexed by page number first, so a page is
+// decoded once however often the WAL rewrote it; the copies it replaced
+// are only checksummed. The chosen frames are applied to the owner map in
+// WAL order, which leaves table names as of the last commit.
+void snapshot_wal_frames(OutputSink *out, WalReader *reader, const char *wal_filename,
+                         const Subscription *subscription) {
+    PageOwnerMap owner_map;
+    PageOwnerMap *owners;
+    if (open_owners(&owner_map, &owners, wal_filename, subscription) != 0) {
+        return;
+    }
+    FrameIndex index;
+    frame_index_init(&index);
+    int indexed = frame_index_build(&index, reader);
+    uint32_t last_commit = frame_index_last_commit(&index);
+    if (out->format == OUTPUT_TEXT) {
+        sink_puts(out, "Frame Information:\n");
+    }
 
-        print_page_type(page_data, frame.page_number);
-        verify_frame_checksum(&frame, page_data, header->page_size, frame.checksum1, frame.checksum2);
-        print_page_header(page_data, frame.page_number, header->page_size, db_filename);
-        print_hex_dump(page_data, header->page_size, 32);
-        printf("\n");
+    WalFrameView frame;
+    for (uint32_t n = 1; n <= last_commit && wal_reader_frame(reader, n, &frame) == 0; n++) {
+        if (owners && frame_index_latest(&index, frame.header.page_number) == n) {
+            page_owner_apply_frame(owners, reader, &frame);
+        }
+    }
+    PageSource page_source;
+    PageSource *source = open_page_source(&page_source, reader, &index, owners);
+    if (source) {
+        source->max_frame = last_commit;
     }
+    uint32_t pages = 0;         // Distinct pages with a committed copy
+    uint32_t emitted = 0;       // Those that passed the subscription and were decoded
+    for (uint32_t page_number = 1; page_number < index.page_capacity; page_number++) {
+        uint32_t n = frame_index_latest(&index, page_number);
+        if (n == 0 || wal_reader_frame(reader, n, &frame) != 0) {
+            continue;
+        }
+        pages++;
+        if (subscription && !page_owner_watched(owners, page_number)) {
+            continue;
+        }
+        FrameCheck check = {
+            .status = FRAME_VALID,
+            .checksum1 = frame.header.checksum1,
+            .checksum2 = frame.header.checksum2,
+            .table_name = page_owner_lookup(owners, page_number),
+            .filter = subscribed_btree(owners, subscription, page_owner_btree(owners, page_number))
+        };
+        if (check.filter && !subscription_page_matches(check.filter, frame.page_data, page_number,
+                                                       reader->page_size)) {
+            continue;
+        }
+        uint64_t start = stats_clock();
+        emit_frame(out, &frame, reader->page_size, &check, source);
+        stats_record(STATS_DECODE, start);
+        emitted++;
+    }
+    emit_message(out, "Snapshot as of frame %u: %u of %u pages decoded, %u older copies not decoded", last_commit,
+                 emitted, pages, last_commit - pages);
 
-    // Print summary of frames processed
-    if (frame_count == 0) {
-        printf("No frames found in the WAL file.\n");
-    } else {
-        printf("Total frames: %u\n", frame_count);
+    uint32_t frame_count = indexed > 0 ? (uint32_t)indexed : 0;
+    uint64_t frame_bytes = (uint64_t)frame_count * (WAL_FRAME_HEADER_SIZE + reader->page_size);
+    emit_summary(out, emitted, reader->file_size > WAL_HEADER_SIZE + frame_bytes);
+    frame_index_free(&index);
+    if (owners) {
+        page_owner_close(owners);
     }
-    free(db_filename);
-    free(page_data);
 }
 
-// Prints detailed information about the WAL file
-int print_wal_info(const char *filename) {
-    FILE *file = fopen(filename, "rb");
-    if (!file) {
-        return report_error("Failed to open WAL file", 1);
-    }
+// Prints the WAL header fields and whether the header checksum holds
+void print_wal_header(OutputSink *out, const char *filename, const WalReader *reader) {
+    const WalHeader *header = &reader->header;
+    sink_printf(out, "WAL File Information for %s:\n", filename);
+    sink_printf(out, "Magic Number: 0x%08x\n", header->magic);
+    sink_printf(out, "File Format: %u\n", header->format);
+    sink_printf(out, "Page Size: %u bytes\n", header->page_size);
+    sink_printf(out, "Checkpoint Sequence: %u\n", header->checkpoint);
+    sink_printf(out, "Salt-1: 0x%08x\n", header->salt1);
+    sink_printf(out, "Salt-2: 0x%08x\n", header->salt2);
+    sink_printf(out, "Checksum-1: 0x%08x\n", header->checksum1);
+    sink_printf(out, "Checksum-2: 0x%08x\n", header->checksum2);
+    sink_printf(out, "Header Checksum: %s\n", verify_wal_header_checksum(reader->map, header) ? "verified" : "mismatch");
+    sink_putc(out, '\n');
+}
 
-    // Get file size
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    rewind(file);
+// Opens a WAL for printing and prints its header
+static int open_wal_info(OutputSink *out, const char *filename, WalReader *reader) {
+    if (wal_reader_open(reader, filename) != 0) {
+        return -1;
+    }
 
     // Validate file size
-    if (file_size < sizeof(WalHeader)) {
-        fclose(file);
+    if (reader->file_size < WAL_HEADER_SIZE) {
+        wal_reader_close(reader);
         return report_error("File too small to be a WAL file", 1);
     }
 
-    // Read and process header
-    WalHeader header = read_wal_header(file);
-    validate_wal_file_size(file_size, header.page_size);
+    validate_wal_file_size(reader->file_size, reader->header.page_size);
 
-    // Print header information
-    printf("WAL File Information for %s:\n", filename);
-    printf("Magic Number: 0x%08x\n", header.magic);
-    printf("File Format: %u\n", header.format);
-    printf("Page Size: %u bytes\n", header.page_size);
-    printf("Checkpoint Sequence: %u\n", header.checkpoint);
-    printf("Salt-1: 0x%08x\n", header.salt1);
-    printf("Salt-2: 0x%08x\n", header.salt2);
-    printf("Checksum-1: 0x%08x\n", header.checksum1);
-    printf("Checksum-2: 0x%08x\n", header.checksum2);
-    printf("\n");
+    emit_wal_header(out, filename, reader);
+    return 0;
+}
+
+// Prints detailed information about the WAL file
+int print_wal_info(OutputSink *out, const char *filename, unsigned jobs, int committed_only,
+                   const Subscription *subscription) {
+    WalReader reader;
+    if (open_wal_info(out, filename, &reader) != 0) {
+        return -1;
+    }
 
     // Process frames
-    process_wal_frames(file, &header, filename);
-    fclose(file);
+    process_wal_frames(out, &reader, filename, jobs, committed_only, subscription);
+    wal_reader_close(&reader);
     return 0;
 }
 
-// Verifies the checksum of a frame against computed values
-void verify_frame_checksum(FrameHeader *frame, uint8_t *page_data, uint32_t page_size,
+// Prints the WAL header and the state of every page the WAL touched as of
+// its last commit, see snapshot_wal_frames()
+int print_wal_snapshot(OutputSink *out, const char *filename, const Subscription *subscription) {
+    WalReader reader;
+    if (open_wal_info(out, filename, &reader) != 0) {
+        return -1;
+    }
+    snapshot_wal_frames(out, &reader, filename, subscription);
+    wal_reader_close(&reader);
+    return 0;
+}
+
+// Verifies the checksum of a frame chained from the previous frame's checksum
+int verify_frame_checksum(OutputSink *out, const WalFrameView *frame, const WalHeader *header,
                           uint32_t initial_checksum1, uint32_t initial_checksum2) {
-    uint32_t computed_checksum1 = initial_checksum1;
-    uint32_t computed_checksum2 = initial_checksum2;
+    FrameCheck check;
+    int valid = check_frame(frame, header, initial_checksum1, initial_checksum2, &check);
+    print_frame_check(out, frame, &check);
+    return valid;
+}
 
-    compute_wal_checksum((uint8_t *)frame, sizeof(FrameHeader), &computed_checksum1, &computed_checksum2);
-    compute_wal_checksum(page_data, page_size, &computed_checksum1, &computed_checksum2);
+// Prints the committed copy of one page as of a commit (0 for the latest),
+// located through a frame index instead of a linear search
+int print_page_version(OutputSink *out, const char *filename, uint32_t page_number, uint32_t commit) {
+    WalReader reader;
+    if (wal_reader_open(&reader, filename) != 0) {
+        return -1;
+    }
+    FrameIndex index;
+    frame_index_init(&index);
+    if (frame_index_build(&index, &reader) < 0) {
+        wal_reader_close(&reader);
+        return -1;
+    }
+
+    if (commit > index.commit_count) {
+        emit_message(out, "WAL has only %u commits", index.commit_count);
+        frame_index_free(&index);
+        wal_reader_close(&reader);
+        return -1;
+    }
+    uint32_t commit_frame = commit ? frame_index_commit_frame(&index, commit) : frame_index_last_commit(&index);
+    uint32_t frame_number = frame_index_lookup(&index, page_number, commit_frame);
+    if (commit == 0) {
+        commit = index.commit_count;
+    }
 
-    if (computed_checksum1 != frame->checksum1 || computed_checksum2 != frame->checksum2) {
-        printf("Checksum mismatch for frame! Expected: 0x%08x 0x%08x, Computed: 0x%08x 0x%08x\n",
-               frame->checksum1, frame->checksum2, computed_checksum1, computed_checksum2);
+    WalFrameView frame;
+    if (frame_number == 0 || wal_reader_frame(&reader, frame_number, &frame) != 0) {
+        emit_message(out, "Page %u has no committed copy in the WAL as of commit %u", page_number, commit);
     } else {
-        printf("Checksum verified successfully.\n");
+        char *db_filename = derive_db_filename(filename);
+        PageOwnerMap owner_map;
+        PageOwnerMap *owners = NULL;
+        if (db_filename && page_owner_open(&owner_map, db_filename) == 0) {
+            owners = &owner_map;
+            page_owner_apply_frame(owners, &reader, &frame);
+        }
+        // The index only holds frames whose checksum chain verified
+        FrameCheck check = {
+            .status = FRAME_VALID,
+            .checksum1 = frame.header.checksum1,
+            .checksum2 = frame.header.checksum2,
+            .table_name = page_owner_lookup(owners, page_number)
+        };
+        emit_message(out, "Page %u as of commit %u of %u (frame %u):", page_number, commit,
+                     index.commit_count, frame_number);
+        // Overflow pages are read as of the same commit
+        PageSource page_source;
+        PageSource *source = open_page_source(&page_source, &reader, &index, owners);
+        if (source) {
+            source->max_frame = commit_frame;
+        }
+        emit_frame(out, &frame, reader.page_size, &check, source);
+        if (owners) {
+            page_owner_close(owners);
+        }
+        free(db_filename);
+    }
+
+    frame_index_free(&index);
+    wal_reader_close(&reader);
+    return 0;
+}
+
+typedef struct {
+    OutputSink *out;
+    const char *wal_filename;
+    PageOwnerMap *owners;
+    PageOwnerMap owner_map;
+    FrameIndex index;           // Frames delivered in the current generation
+    PageSource source;          // Overflow pages: index first, then the database
+    int rows;                   // Emit row changes instead of pages
+    RowDiff diff;
+    const Subscription* subscription;   // Tables to follow, NULL for all
+    ChangeLogWriter *changelog;         // Takes row changes and transactions instead of out, NULL if none
+    int failed;                 // A transaction could not be diffed or logged; stops the listener
+    int delivering;             // Inside follow_on_transaction(); still set if a truncated WAL cut it short
+} FollowContext;
+
+// Emits a committed transaction's pages as they were written, or those of
+// the subscribed tables. Returns the number of frames emitted.
+static uint32_t follow_frames(FollowContext *follow, const WalReader *reader, const WalTransaction *transaction,
+                          const PageSource *source) {
+    if (follow->subscription) {
+        apply_transaction_owners(follow->owners, reader, transaction);
+    }
+    uint32_t emitted = 0;
+    WalFrameView frame;
+    for (uint32_t n = transaction->first_frame; n <= transaction->commit_frame; n++) {
+        if (wal_reader_frame(reader, n, &frame) != 0) {
+            continue;
+        }
+        uint32_t page_number = frame.header.page_number;
+        if (follow->subscription) {
+            if (!page_owner_watched(follow->owners, page_number)) {
+                continue;
+            }
+        } else if (follow->owners) {
+            page_owner_apply_frame(follow->owners, reader, &frame);
+        }
+        FrameCheck check = {
+            .status = FRAME_VALID,
+            .checksum1 = frame.header.checksum1,
+            .checksum2 = frame.header.checksum2,
+            .table_name = page_owner_lookup(follow->owners, page_number),
+            .filter = subscribed_btree(follow->owners, follow->subscription,
+                                       page_owner_btree(follow->owners, page_number))
+        };
+        if (check.filter && !subscription_page_matches(check.filter, frame.page_data, page_number,
+                                                       reader->page_size)) {
+            continue;
+        }
+        emit_frame(follow->out, &frame, reader->page_size, &check, source);
+        emitted++;
+    }
+    return emitted;
+}
+
+// Emits the net row changes of a committed transaction, as
+// collect_row_changes() finds them. Returns the number of changes emitted.
+static uint32_t follow_rows(FollowContext *follow, const WalReader *reader, const WalTransaction *transaction,
+                            const PageSource *source) {
+    Arena *arena = frame_arena();
+    if (!arena) {
+        report_error("Failed to allocate memory for row diff", 0);
+        follow->failed = 1;
+        return 0;
+    }
+    arena_reset(arena);
+    if (collect_row_changes(&follow->diff, follow->owners, follow->subscription, reader, transaction, source,
+                            arena) != 0) {
+        follow->failed = 1;
+        return 0;
+    }
+    if (follow->changelog) {
+        if ((follow->diff.count || !follow->subscription) &&
+            changelog_write_transaction(follow->changelog, transaction, follow->diff.changes, follow->diff.count,
+                                        follow->owners) != 0) {
+            follow->failed = 1;
+        }
+        return follow->diff.count;
+    }
+    for (uint32_t i = 0; i < follow->diff.count; i++) {
+        const RowChange *change = &follow->diff.changes[i];
+        const char *table_name = change->table >= 0 && follow->owners ? follow->owners->btrees[change->table].name : NULL;
+        emit_row_change(follow->out, change, table_name);
+    }
+    return follow->diff.count;
+}
+
+// Prints a committed transaction as one batch with a single flush. With a
+// subscription, a transaction that touched none of its rows is left out.
+static void follow_on_transaction(const WalReader *reader, const WalTransaction *transaction, void *context) {
+    FollowContext *follow = context;
+    follow->delivering = 1;
+    WalFrameView frame;
+    // Index the whole batch first; overflow pages may follow the leaf that uses them
+    for (uint32_t n = transaction->first_frame; n <= transaction->commit_frame; n++) {
+        if (wal_reader_frame(reader, n, &frame) == 0) {
+            frame_index_add(&follow->index, n, frame.header.page_number, frame.header.commit_size);
+        }
+    }
+    PageSource source = follow->source;
+    source.wal = reader;
+    source.index = &follow->index;
+    source.page_size = reader->page_size;
+    source.usable_size = follow->owners ? follow->owners->usable_size : reader->page_size;
+    source.max_frame = transaction->commit_frame;
+
+    uint32_t emitted = follow->rows ? follow_rows(follow, reader, transaction, &source)
+                                    : follow_frames(follow, reader, transaction, &source);
+    if ((emitted || !follow->subscription) && !follow->changelog && !follow->failed) {
+        emit_transaction(follow->out, transaction, NULL);
+    }
+    sink_flush(follow->out);
+    follow->delivering = 0;
+}
+
+// Drops the buffered output of a transaction that a WAL truncated under
+// the listener cut short; the listener delivers it again, or moves on to
+// the next generation
+static void follow_drop_interrupted(FollowContext *follow) {
+    if (follow->delivering) {
+        sink_discard(follow->out);
+        follow->delivering = 0;
+    }
+}
+
+// Announces a new WAL generation; checkpointed pages now live in the database
+static void follow_on_reset(const WalHeader *header, void *context) {
+    FollowContext *follow = context;
+    follow_drop_interrupted(follow);
+    if (follow->owners) {
+        page_owner_reset_wal(follow->owners);
+    }
+    frame_index_reset(&follow->index);
+    if (follow->changelog && changelog_write_generation(follow->changelog, header) != 0) {
+        follow->failed = 1;
+    }
+    emit_message(follow->out, "WAL generation for %s: checkpoint %u, salts 0x%08x 0x%08x",
+                 follow->wal_filename, header->checkpoint, header->salt1, header->salt2);
+    if (follow->out->format == OUTPUT_TEXT) {
+        sink_putc(follow->out, '\n');
+    }
+    sink_flush(follow->out);
+}
+
+// Picks up after frames delivered by an earlier run. They are not printed
+// again, but their headers are indexed and their pages applied to the
+// owner map, so overflow pages and earlier page versions resolve as if
+// they had been followed; no checksums are computed.
+static void follow_on_resume(const WalReader *reader, const WalResumePoint *point, void *context) {
+    FollowContext *follow = context;
+    follow_drop_interrupted(follow);
+    if (follow->owners) {
+        page_owner_reset_wal(follow->owners);
+    }
+    frame_index_reset(&follow->index);
+    WalFrameView frame;
+    for (uint32_t n = 1; n <= point->commit_frame && wal_reader_frame(reader, n, &frame) == 0; n++) {
+        frame_index_add(&follow->index, n, frame.header.page_number, frame.header.commit_size);
+        if (follow->owners) {
+            page_owner_apply_frame(follow->owners, reader, &frame);
+        }
+    }
+    emit_message(follow->out, "Resuming %s after frame %u: checkpoint %u, salts 0x%08x 0x%08x",
+                 follow->wal_filename, point->commit_frame, point->checkpoint, point->salt1, point->salt2);
+    if (follow->out->format == OUTPUT_TEXT) {
+        sink_putc(follow->out, '\n');
+    }
+    sink_flush(follow->out);
+}
+
+// Opens the database side of a follow context; the WAL side of the page
+// source is filled in per transaction, once the listener has a reader
+static int follow_open(FollowContext *follow, OutputSink *out, const char *filename, int rows,
+                       const Subscription *subscription, ChangeLogWriter *changelog) {
+    memset(follow, 0, sizeof(*follow));
+    follow->out = out;
+    follow->changelog = changelog;
+    follow->wal_filename = filename;
+    follow->rows = rows;
+    follow->subscription = subscription;
+    char *db_filename = derive_db_filename(filename);
+    if (!db_filename) {
+        return -1;
+    }
+    if (page_owner_open(&follow->owner_map, db_filename) == 0) {
+        follow->owners = &follow->owner_map;
+    }
+    free(db_filename);
+    if (watch_subscription(follow->owners, subscription) != 0) {
+        if (follow->owners) {
+            page_owner_close(follow->owners);
+        }
+        return -1;
+    }
+    frame_index_init(&follow->index);
+    row_diff_init(&follow->diff);
+    page_source_init(&follow->source, NULL, NULL, follow->owners ? &follow->owners->cache : NULL, 0, 0);
+    return 0;
+}
+
+// Releases everything follow_open set up
+static void follow_close(FollowContext *follow) {
+    row_diff_free(&follow->diff);
+    frame_index_free(&follow->index);
+    if (follow->owners) {
+        page_owner_close(follow->owners);
+    }
+}
+
+// Prints committed transactions as they are appended to the WAL until
+// stop_wal_listener(). Frames are held back until their commit frame
+// arrives, so uncommitted data is never printed. With rows, each
+// transaction is printed as the rows it inserted, updated and deleted.
+// With resume, the position is kept in "<database>-walpulse" and a restart
+// continues after the last transaction printed. With a subscription, only
+// the subscribed tables are printed. With a change log, row changes and
+// transactions are appended to it instead of being printed. A transaction
+// that cannot be diffed or logged stops the listener with -1, before the
+// position moves past it.
+int follow_wal_info(OutputSink *out, const char *filename, int rows, int resume, const Subscription *subscription,
+                    ChangeLogWriter *changelog) {
+    FollowContext follow;
+    if (follow_open(&follow, out, filename, rows, subscription, changelog) != 0) {
+        return -1;
+    }
+    char *state_filename = NULL;
+    if (resume) {
+        char *db_filename = derive_db_filename(filename);
+        state_filename = db_filename ? resume_filename(db_filename) : NULL;
+        free(db_filename);
+        if (!state_filename) {
+            follow_close(&follow);
+            return -1;
+        }
+    }
+    WalListener listener = {
+        .on_transaction = follow_on_transaction,
+        .on_reset = follow_on_reset,
+        .on_resume = follow_on_resume,
+        .context = &follow,
+        .failed = &follow.failed
+    };
+    int status = start_wal_listener(filename, &listener, state_filename);
+    free(state_filename);
+    follow_close(&follow);
+    return status;
+}
+
+// Prints the row changes of every committed transaction in the WAL once,
+// through the same pipeline as follow mode, or appends them to changelog.
+// Returns -1 if a transaction could not be diffed or logged.
+int print_wal_rows(OutputSink *out, const char *filename, const Subscription *subscription,
+                   ChangeLogWriter *changelog) {
+    WalReader reader;
+    if (wal_reader_open(&reader, filename) != 0) {
+        return -1;
+    }
+    FollowContext follow;
+    if (follow_open(&follow, out, filename, 1, subscription, changelog) != 0) {
+        wal_reader_close(&reader);
+        return -1;
+    }
+    WalListener listener = {
+        .on_transaction = follow_on_transaction,
+        .on_reset = follow_on_reset,
+        .context = &follow,
+        .failed = &follow.failed
+    };
+    WalState state;
+    wal_state_init(&state);
+    int status = process_wal_changes(&state, &reader, &listener) < 0 ? -1 : 0;
+    follow_close(&follow);
+    wal_reader_close(&reader);
+    return status;
+}
+
+// Replays one segment; returns -1 if a block is damaged
+static int print_changelog_segment(OutputSink *out, const ChangeLogSegment *segment) {
+    ChangeLogCursor cursor;
+    changelog_cursor_init(&cursor, segment);
+    ChangeLogBlock block;
+    RowChange change;
+    int status;
+    while ((status = changelog_next_block(&cursor, &block)) > 0) {
+        if (block.type == CHANGELOG_BLOCK_GENERATION) {
+            emit_message(out, "WAL generation: checkpoint %u, salts 0x%08x 0x%08x", block.checkpoint, block.salt1,
+                         block.salt2);
+            if (out->format == OUTPUT_TEXT) {
+                sink_putc(out, '\n');
+            }
+            continue;
+        }
+        while ((status = changelog_next_change(&cursor, &change)) > 0) {
+            emit_row_change(out, &change, changelog_table_name(segment, change.table));
+        }
+        if (status < 0) {
+            break;
+        }
+        emit_transaction(out, &block.transaction, NULL);
+    }
+    return status < 0 ? -1 : 0;
+}
+
+// Prints a change log written by --changelog as --rows would have printed
+// it. Segments are mapped and decoded in place; a last segment still open
+// for writing is left out.
+int print_changelog(OutputSink *out, const char *directory) {
+    uint32_t count;
+    char **paths = changelog_list_segments(directory, &count);
+    if (!paths) {
+        return -1;
+    }
+    int status = 0;
+    for (uint32_t i = 0; i < count && status == 0; i++) {
+        if (i == count - 1 && !changelog_segment_sealed(paths[i])) {
+            break;
+        }
+        ChangeLogSegment segment;
+        if (changelog_segment_open(&segment, paths[i]) != 0) {
+            status = -1;
+            break;
+        }
+        if (print_changelog_segment(out, &segment) != 0) {
+            report_error("Change log block failed its checksum or is malformed", 0);
+            status = -1;
+        }
+        changelog_segment_close(&segment);
+    }
+    changelog_free_segments(paths, count);
+    return status;
+}
+
+// Prints one line per committed transaction, prefixed by its database
+static void monitor_on_transaction(const char *database, const WalReader *reader,
+                                   const WalTransaction *transaction, void *context) {
+    (void)reader;
+    emit_transaction(context, transaction, database);
+}
+
+// Announces a database's new WAL generation
+static void monitor_on_reset(const char *database, const WalHeader *header, void *context) {
+    emit_message(context, "WAL generation for %s: checkpoint %u, salts 0x%08x 0x%08x",
+                 database, header->checkpoint, header->salt1, header->salt2);
+}
+
+// Writes out a batch of events with one flush
+static void monitor_on_batch(void *context) {
+    sink_flush(context);
+}
+
+// Watches the WALs of every database named by patterns (glob(3) patterns
+// or plain paths) and list_filename (one per line, may be NULL) from a
+// single thread until stop_wal_monitor(). Only transaction boundaries are
+// printed, so nothing is kept per database beyond its WAL position; output
+// is flushed once per batch of events. With resume, each database's
+// position is kept in its "<database>-walpulse" file.
+int monitor_wal_info(OutputSink *out, char *const *patterns, int pattern_count, const char *list_filename,
+                     int resume) {
+    WalMonitor monitor;
+    if (wal_monitor_init(&monitor) != 0) {
+        return -1;
+    }
+    monitor.resume = (uint8_t)resume;
+    int status = 0;
+    for (int i = 0; i < pattern_count && status == 0; i++) {
+        status = wal_monitor_add_pattern(&monitor, patterns[i]);
+    }
+    if (status == 0 && list_filename) {
+        status = wal_monitor_add_list(&monitor, list_filename);
+    }
+    if (status == 0) {
+        emit_message(out, "Monitoring %u databases", monitor.count);
+        sink_flush(out);
+        MonitorListener listener = {
+            .on_transaction = monitor_on_transaction,
+            .on_reset = monitor_on_reset,
+            .on_batch = monitor_on_batch,
+            .context = out
+        };
+        status = wal_monitor_run(&monitor, &listener);
     }
+    wal_monitor_free(&monitor);
+    return status;
 }
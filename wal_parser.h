@@ -1,34 +1,35 @@
 #ifndef WAL_PARSER_H
 #define WAL_PARSER_H
 
+#include "changelog.h"
+#include "output_sink.h"
+#include "page_owner.h"
+#include "subscription.h"
+#include "wal_format.h"
+#include "wal_reader.h"
 #include <stdint.h>
 #include <stdio.h>
 
-typedef struct {
-    uint32_t magic;
-    uint32_t format;
-    uint32_t page_size;
-    uint32_t checkpoint;
-    uint32_t salt1;
-    uint32_t salt2;
-    uint32_t checksum1;
-    uint32_t checksum2;
-} WalHeader;
-
-typedef struct {
-    uint32_t page_number;
-    uint32_t commit_size;
-    uint32_t salt1;
-    uint32_t salt2;
-    uint32_t checksum1;
-    uint32_t checksum2;
-} FrameHeader;
-
 WalHeader read_wal_header(FILE* file);
 int validate_wal_file_size(long file_size, uint32_t page_size);
-void process_wal_frames(FILE *file, WalHeader *header, const char *wal_filename) ;
-int print_wal_info(const char* filename);
-void verify_frame_checksum(FrameHeader* frame, uint8_t* page_data, uint32_t page_size,
+void process_wal_frames(OutputSink* out, WalReader* reader, const char* wal_filename, unsigned jobs,
+                        int committed_only, const Subscription* subscription);
+void snapshot_wal_frames(OutputSink* out, WalReader* reader, const char* wal_filename,
+                         const Subscription* subscription);
+void print_wal_header(OutputSink* out, const char* filename, const WalReader* reader);
+void print_frame_header(OutputSink* out, const WalFrameView* frame);
+int print_wal_info(OutputSink* out, const char* filename, unsigned jobs, int committed_only,
+                   const Subscription* subscription);
+int print_wal_snapshot(OutputSink* out, const char* filename, const Subscription* subscription);
+int follow_wal_info(OutputSink* out, const char* filename, int rows, int resume, const Subscription* subscription,
+                    ChangeLogWriter* changelog);
+int print_wal_rows(OutputSink* out, const char* filename, const Subscription* subscription,
+                   ChangeLogWriter* changelog);
+int print_changelog(OutputSink* out, const char* directory);
+int monitor_wal_info(OutputSink* out, char* const* patterns, int pattern_count, const char* list_filename,
+                     int resume);
+int print_page_version(OutputSink* out, const char* filename, uint32_t page_number, uint32_t commit);
+int verify_frame_checksum(OutputSink* out, const WalFrameView* frame, const WalHeader* header,
                           uint32_t initial_checksum1, uint32_t initial_checksum2);
 
 #endif
@@ -0,0 +1,203 @@
+#define _GNU_SOURCE
+#include "wal_reader.h"
+#include "utils.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Decodes an on-disk (big-endian) WAL header into host byte order
+WalHeader decode_wal_header(const uint8_t *raw) {
+    WalHeader header;
+    memcpy(&header, raw, sizeof(WalHeader));
+    header.magic = to_host32(header.magic);
+    header.format = to_host32(header.format);
+    header.page_size = to_host32(header.page_size);
+    header.checkpoint = to_host32(header.checkpoint);
+    header.salt1 = to_host32(header.salt1);
+    header.salt2 = to_host32(header.salt2);
+    header.checksum1 = to_host32(header.checksum1);
+    header.checksum2 = to_host32(header.checksum2);
+    return header;
+}
+
+// Decodes an on-disk (big-endian) frame header into host byte order
+FrameHeader decode_frame_header(const uint8_t *raw) {
+    FrameHeader frame;
+    memcpy(&frame, raw, sizeof(FrameHeader));
+    frame.page_number = to_host32(frame.page_number);
+    frame.commit_size = to_host32(frame.commit_size);
+    frame.salt1 = to_host32(frame.salt1);
+    frame.salt2 = to_host32(frame.salt2);
+    frame.checksum1 = to_host32(frame.checksum1);
+    frame.checksum2 = to_host32(frame.checksum2);
+    return frame;
+}
+
+// Drops the current mapping, if any
+static void wal_reader_unmap(WalReader *reader) {
+    if (reader->map) {
+        munmap(reader->map, reader->map_size);
+    }
+    reader->map = NULL;
+    reader->map_size = 0;
+    reader->frame_count = 0;
+}
+
+// Opens and maps a WAL file for sequential zero-copy access
+int wal_reader_open(WalReader *reader, const char *filename) {
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (reader->fd < 0) {
+        return report_error("Failed to open WAL file", 1);
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(reader->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    if (wal_reader_refresh(reader) != 0) {
+        wal_reader_close(reader);
+        return -1;
+    }
+    return 0;
+}
+
+// Re-checks the file size and remaps if the WAL grew or was truncated.
+// Frame views handed out before this call must not be used afterwards.
+int wal_reader_refresh(WalReader *reader) {
+    struct stat st;
+    if (fstat(reader->fd, &st) != 0) {
+        return report_error("Failed to stat WAL file", 1);
+    }
+
+    size_t new_size = (size_t)st.st_size;
+    reader->file_size = new_size;
+
+    // A WAL without a complete header has nothing to map (e.g. just reset)
+    if (new_size < WAL_HEADER_SIZE) {
+        wal_reader_unmap(reader);
+        memset(&reader->header, 0, sizeof(WalHeader));
+        reader->page_size = 0;
+        return 0;
+    }
+
+    // The header is re-read even at the same size: a WAL restart rewrites it
+    // in place with new salts without changing the file length. It is read
+    // with pread, so a truncation since the fstat shows up as a short read.
+    uint8_t raw_header[WAL_HEADER_SIZE];
+    if (pread(reader->fd, raw_header, WAL_HEADER_SIZE, 0) != WAL_HEADER_SIZE) {
+        wal_reader_unmap(reader);
+        memset(&reader->header, 0, sizeof(WalHeader));
+        reader->page_size = 0;
+        return 0;
+    }
+    void *map = reader->map;
+    if (!reader->map) {
+        map = mmap(NULL, new_size, PROT_READ, MAP_SHARED, reader->fd, 0);
+    } else if (new_size != reader->map_size) {
+#ifdef MREMAP_MAYMOVE
+        map = mremap(reader->map, reader->map_size, new_size, MREMAP_MAYMOVE);
+#else
+        munmap(reader->map, reader->map_size);
+        map = mmap(NULL, new_size, PROT_READ, MAP_SHARED, reader->fd, 0);
+#endif
+    }
+    if (map == MAP_FAILED) {
+        reader->map = NULL;
+        reader->map_size = 0;
+        reader->frame_count = 0;
+        return report_error("Failed to map WAL file", 1);
+    }
+    if (map != reader->map || new_size != reader->map_size) {
+        reader->map = map;
+        reader->map_size = new_size;
+#ifdef MADV_SEQUENTIAL
+        madvise(reader->map, reader->map_size, MADV_SEQUENTIAL);
+#endif
+    }
+
+    reader->header = decode_wal_header(raw_header);
+    uint32_t page_size = reader->header.page_size;
+    if ((reader->header.magic != WAL_MAGIC_LE && reader->header.magic != WAL_MAGIC_BE) ||
+        page_size < 512 || page_size > 65536 || (page_size & (page_size - 1)) != 0) {
+        reader->page_size = 0;
+        reader->frame_count = 0;
+        report_error("Invalid WAL file: bad magic number or page size", 0);
+        return -1;
+    }
+    reader->page_size = page_size;
+
+    // A trailing partial frame is still being written; leave it for later
+    reader->frame_count = (new_size - WAL_HEADER_SIZE) / (WAL_FRAME_HEADER_SIZE + page_size);
+    return 0;
+}
+
+// Fills a view of the given 1-based frame without copying any data
+int wal_reader_frame(const WalReader *reader, uint32_t frame_number, WalFrameView *view) {
+    if (frame_number == 0 || frame_number > reader->frame_count) {
+        return -1;
+    }
+    uint64_t frame_size = WAL_FRAME_HEADER_SIZE + (uint64_t)reader->page_size;
+    uint64_t offset = WAL_HEADER_SIZE + (uint64_t)(frame_number - 1) * frame_size;
+    view->raw_header = reader->map + offset;
+    view->page_data = view->raw_header + WAL_FRAME_HEADER_SIZE;
+    view->header = decode_frame_header(view->raw_header);
+    view->frame_number = frame_number;
+    view->offset = offset;
+    return 0;
+}
+
+// Unmaps and closes the WAL file
+void wal_reader_close(WalReader *reader) {
+    wal_reader_unmap(reader);
+    if (reader->fd >= 0) {
+        close(reader->fd);
+    }
+    reader->fd = -1;
+    reader->file_size = 0;
+}
+
+static __thread WalFaultGuard *fault_guard;
+static pthread_once_t fault_handler_once = PTHREAD_ONCE_INIT;
+
+// Jumps back to the innermost guard when the fault lies in its reader's
+// mapping. Any other SIGBUS gets the default action: the handler is
+// removed and the faulting access is retried.
+static void handle_wal_fault(int signal_number, siginfo_t *info, void *context) {
+    (void)context;
+    WalFaultGuard *guard = fault_guard;
+    const uint8_t *address = info->si_addr;
+    if (guard && guard->reader->map && address >= guard->reader->map &&
+        address < guard->reader->map + guard->reader->map_size) {
+        siglongjmp(guard->jump, 1);
+    }
+    signal(signal_number, SIG_DFL);
+}
+
+// Installs the SIGBUS handler, once per process
+static void install_fault_handler(void) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = handle_wal_fault;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGBUS, &action, NULL);
+}
+
+// Makes guard the calling thread's innermost guard for reader's mapping.
+// The caller arms it with sigsetjmp(guard->jump, 1) right after, and pops
+// it on every way out.
+void wal_fault_guard_push(WalFaultGuard *guard, const WalReader *reader) {
+    pthread_once(&fault_handler_once, install_fault_handler);
+    guard->reader = reader;
+    guard->previous = fault_guard;
+    fault_guard = guard;
+}
+
+// Restores the guard that was innermost before guard
+void wal_fault_guard_pop(WalFaultGuard *guard) {
+    fault_guard = guard->previous;
+}
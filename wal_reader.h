@@ -0,0 +1,46 @@
+#ifndef WAL_READER_H
+#define WAL_READER_H
+
+#include "wal_format.h"
+#include <setjmp.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A zero-copy view of one frame inside a mapped WAL file. The pointers stay
+// valid until the next wal_reader_refresh() or wal_reader_close().
+typedef struct {
+    FrameHeader header;         // Frame header in host byte order
+    const uint8_t *raw_header;  // Frame header as stored on disk
+    const uint8_t *page_data;   // Page image, page_size bytes
+    uint32_t frame_number;      // 1-based frame number
+    uint64_t offset;            // Byte offset of the frame header in the file
+} WalFrameView;
+
+typedef struct {
+    int fd;
+    uint8_t *map;
+    size_t map_size;
+    size_t file_size;
+    WalHeader header;
+    uint32_t page_size;
+    uint32_t frame_count;       // Complete frames currently mapped
+} WalReader;
+
+// Turns the SIGBUS raised by touching a page of reader's mapping that
+// another process truncated away into a siglongjmp() to jump. Armed with
+// wal_fault_guard_push() then sigsetjmp(guard.jump, 1) in the function
+// that handles the fault; guards nest per thread.
+typedef struct WalFaultGuard {
+    sigjmp_buf jump;
+    const WalReader *reader;
+    struct WalFaultGuard *previous;
+} WalFaultGuard;
+
+int wal_reader_open(WalReader *reader, const char *filename);
+int wal_reader_refresh(WalReader *reader);
+int wal_reader_frame(const WalReader *reader, uint32_t frame_number, WalFrameView *view);
+void wal_reader_close(WalReader *reader);
+void wal_fault_guard_push(WalFaultGuard *guard, const WalReader *reader);
+void wal_fault_guard_pop(WalFaultGuard *guard);
+
+#endif
@@ -0,0 +1,142 @@
+#include "wal_resume.h"
+#include "utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// File layout, all big-endian like the WAL itself: magic, version, the
+// WalResumePoint fields in declaration order, then an FNV-1a hash of the
+// preceding 44 bytes
+#define RESUME_MAGIC "WPRS"
+#define RESUME_VERSION 1
+#define RESUME_HASHED_BYTES 44
+
+static void put_u32(uint8_t *out, uint32_t value) {
+    out[0] = (uint8_t)(value >> 24);
+    out[1] = (uint8_t)(value >> 16);
+    out[2] = (uint8_t)(value >> 8);
+    out[3] = (uint8_t)value;
+}
+
+static uint32_t get_u32(const uint8_t *in) {
+    return (uint32_t)in[0] << 24 | (uint32_t)in[1] << 16 | (uint32_t)in[2] << 8 | in[3];
+}
+
+static uint32_t resume_hash(const uint8_t *data, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Returns the sidecar path for a database, "<database>-walpulse"; free it
+char *resume_filename(const char *db_filename) {
+    size_t length = strlen(db_filename);
+    char *filename = malloc(length + sizeof(RESUME_SUFFIX));
+    if (!filename) {
+        report_error("Failed to allocate memory for state file name", 1);
+        return NULL;
+    }
+    memcpy(filename, db_filename, length);
+    memcpy(filename + length, RESUME_SUFFIX, sizeof(RESUME_SUFFIX));
+    return filename;
+}
+
+// Returns 1 when both points name the same commit of the same generation
+int resume_point_equal(const WalResumePoint *a, const WalResumePoint *b) {
+    return a->salt1 == b->salt1 && a->salt2 == b->salt2 && a->checkpoint == b->checkpoint &&
+           a->page_size == b->page_size && a->commit_frame == b->commit_frame && a->offset == b->offset;
+}
+
+// Syncs the directory holding filename, making a rename into it durable
+static int sync_parent_directory(const char *filename) {
+    const char *slash = strrchr(filename, '/');
+    char *directory = slash ? strndup(filename, slash == filename ? 1 : (size_t)(slash - filename)) : strdup(".");
+    if (!directory) {
+        return -1;
+    }
+    int fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    free(directory);
+    int status = fd < 0 || fsync(fd) != 0 ? -1 : 0;
+    if (fd >= 0) {
+        close(fd);
+    }
+    return status;
+}
+
+// Replaces the sidecar with point. The record is written and synced to a
+// temporary file, renamed over the old one, and the rename is synced, so
+// even a power loss leaves either the old or the new position, never a
+// mix or an empty file.
+int save_resume_point(const char *filename, const WalResumePoint *point) {
+    uint8_t record[RESUME_FILE_SIZE];
+    memcpy(record, RESUME_MAGIC, 4);
+    put_u32(record + 4, RESUME_VERSION);
+    put_u32(record + 8, point->salt1);
+    put_u32(record + 12, point->salt2);
+    put_u32(record + 16, point->checkpoint);
+    put_u32(record + 20, point->page_size);
+    put_u32(record + 24, point->commit_frame);
+    put_u32(record + 28, (uint32_t)(point->offset >> 32));
+    put_u32(record + 32, (uint32_t)point->offset);
+    put_u32(record + 36, point->checksum1);
+    put_u32(record + 40, point->checksum2);
+    put_u32(record + 44, resume_hash(record, RESUME_HASHED_BYTES));
+
+    size_t length = strlen(filename);
+    char *temporary = malloc(length + 5);
+    if (!temporary) {
+        return report_error("Failed to allocate memory for state file name", 1);
+    }
+    memcpy(temporary, filename, length);
+    memcpy(temporary + length, ".tmp", 5);
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    int status = fd < 0 || write_fully(fd, record, sizeof(record)) != 0 || fsync(fd) != 0 ? -1 : 0;
+    if (fd >= 0 && close(fd) != 0) {
+        status = -1;
+    }
+    if (status == 0 && (rename(temporary, filename) != 0 || sync_parent_directory(filename) != 0)) {
+        status = -1;
+    }
+    if (status != 0) {
+        report_error("Failed to write state file", 1);
+        unlink(temporary);
+    }
+    free(temporary);
+    return status;
+}
+
+// Reads a sidecar written by save_resume_point. Returns -1 when there is
+// none, or when it is truncated, corrupt or from another version; the
+// caller then starts from the WAL header.
+int load_resume_point(const char *filename, WalResumePoint *point) {
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            report_error("Failed to open state file", 0);
+        }
+        return -1;
+    }
+    uint8_t record[RESUME_FILE_SIZE];
+    ssize_t length = read(fd, record, sizeof(record));
+    close(fd);
+    if (length != (ssize_t)sizeof(record) || memcmp(record, RESUME_MAGIC, 4) != 0 ||
+        get_u32(record + 4) != RESUME_VERSION ||
+        get_u32(record + 44) != resume_hash(record, RESUME_HASHED_BYTES)) {
+        report_error("Ignoring damaged state file", 0);
+        return -1;
+    }
+    point->salt1 = get_u32(record + 8);
+    point->salt2 = get_u32(record + 12);
+    point->checkpoint = get_u32(record + 16);
+    point->page_size = get_u32(record + 20);
+    point->commit_frame = get_u32(record + 24);
+    point->offset = (uint64_t)get_u32(record + 28) << 32 | get_u32(record + 32);
+    point->checksum1 = get_u32(record + 36);
+    point->checksum2 = get_u32(record + 40);
+    return 0;
+}
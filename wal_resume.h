@@ -0,0 +1,29 @@
+#ifndef WAL_RESUME_H
+#define WAL_RESUME_H
+
+#include <stdint.h>
+
+// Suffix of the sidecar file kept next to a database
+#define RESUME_SUFFIX "-walpulse"
+#define RESUME_FILE_SIZE 48
+
+// Where a WAL was left: the generation, the last commit frame delivered
+// and the checksum chain value just after it. Everything up to
+// commit_frame was delivered, so a restart continues at commit_frame + 1.
+typedef struct {
+    uint32_t salt1;
+    uint32_t salt2;
+    uint32_t checkpoint;
+    uint32_t page_size;
+    uint32_t commit_frame;      // 0 before the generation's first commit
+    uint64_t offset;            // Byte offset of the frame after commit_frame
+    uint32_t checksum1;
+    uint32_t checksum2;
+} WalResumePoint;
+
+char* resume_filename(const char* db_filename);
+int resume_point_equal(const WalResumePoint* a, const WalResumePoint* b);
+int save_resume_point(const char* filename, const WalResumePoint* point);
+int load_resume_point(const char* filename, WalResumePoint* point);
+
+#endif
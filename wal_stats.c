@@ -0,0 +1,448 @@
+#include "wal_stats.h"
+#include "utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// How often the reporter thread wakes to look for a dump request
+#define REPORTER_TICK_NS 100000000L
+
+// One thread's counts. Only the owning thread writes them, so updates are
+// plain relaxed stores; snapshots read them with relaxed loads.
+typedef struct StatsShard {
+    uint64_t counters[STATS_COUNTER_COUNT];
+    uint64_t buckets[STATS_STAGE_COUNT][STATS_BUCKETS];
+    uint64_t sum_ns[STATS_STAGE_COUNT];
+    struct StatsShard *next;
+} StatsShard;
+
+static const char *counter_names[STATS_COUNTER_COUNT][2] = {
+    { "walpulse_frames_total", "Frames checksummed" },
+    { "walpulse_wal_bytes_read_total", "Frame header and page bytes read from WAL files" },
+    { "walpulse_checksum_failures_total", "Frames whose salt or checksum did not match" },
+    { "walpulse_cells_decoded_total", "Table leaf cells parsed" },
+    { "walpulse_transactions_total", "Committed transactions delivered in follow and monitor mode" },
+    { "walpulse_output_bytes_total", "Bytes written to the output" },
+    { "walpulse_backpressure_waits_total", "Times a pipeline stage waited because the next stage's queue was full" },
+    { "walpulse_page_cache_hits_total", "Database page reads served from the page cache" },
+    { "walpulse_page_cache_misses_total", "Database pages read from the file into the page cache" },
+    { "walpulse_page_cache_evictions_total", "Cold pages evicted from the page cache" },
+    { "walpulse_page_cache_invalidations_total", "Times the page cache was emptied after a checkpoint" },
+};
+
+static const char *gauge_names[STATS_GAUGE_COUNT][2] = {
+    { "walpulse_decode_backlog_chunks", "Decoded chunks waiting to be written in frame order" },
+    { "walpulse_wal_pending_bytes", "WAL bytes past the last verified frame after the latest pass" },
+    { "walpulse_decode_queue_chunks", "Checked chunks waiting for a decoder" },
+};
+
+static const char *stage_names[STATS_STAGE_COUNT] = { "checksum", "lookup", "decode", "cells", "write" };
+
+// Histogram bounds published in the stats file, in nanoseconds
+static const uint64_t exported_bounds[] = {
+    250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+    1000000, 2500000, 5000000, 10000000, 25000000, 50000000, 100000000, 250000000, 500000000, 1000000000
+};
+
+static const double exported_quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+static int stats_on = 0;
+static __thread StatsShard *thread_shard = NULL;
+static StatsShard *live_shards = NULL;
+static StatsShard retired;          // Totals of threads that released their shard
+static pthread_mutex_t shards_lock = PTHREAD_MUTEX_INITIALIZER;
+static int64_t gauges[STATS_GAUGE_COUNT];
+
+static pthread_t reporter;
+static int reporter_running = 0;
+static volatile sig_atomic_t reporter_stop = 0;
+static volatile sig_atomic_t dump_requested = 0;
+static char *stats_filename = NULL;
+static unsigned stats_interval = STATS_DEFAULT_INTERVAL;
+
+static void relaxed_add(uint64_t *value, uint64_t amount) {
+    __atomic_store_n(value, __atomic_load_n(value, __ATOMIC_RELAXED) + amount, __ATOMIC_RELAXED);
+}
+
+// Returns the calling thread's shard, creating and registering it on first use
+static StatsShard *shard(void) {
+    if (!thread_shard) {
+        StatsShard *created = calloc(1, sizeof(StatsShard));
+        if (!created) {
+            return NULL;
+        }
+        pthread_mutex_lock(&shards_lock);
+        created->next = live_shards;
+        live_shards = created;
+        pthread_mutex_unlock(&shards_lock);
+        thread_shard = created;
+    }
+    return thread_shard;
+}
+
+// Turns instrumentation on or off; while off every hook returns at once
+void stats_enable(int enabled) {
+    __atomic_store_n(&stats_on, enabled, __ATOMIC_RELAXED);
+}
+
+int stats_is_enabled(void) {
+    return __atomic_load_n(&stats_on, __ATOMIC_RELAXED);
+}
+
+void stats_add(StatsCounter counter, uint64_t amount) {
+    StatsShard *own;
+    if (stats_is_enabled() && (own = shard())) {
+        relaxed_add(&own->counters[counter], amount);
+    }
+}
+
+void stats_gauge_set(StatsGauge gauge, int64_t value) {
+    if (stats_is_enabled()) {
+        __atomic_store_n(&gauges[gauge], value, __ATOMIC_RELAXED);
+    }
+}
+
+void stats_gauge_add(StatsGauge gauge, int64_t amount) {
+    if (stats_is_enabled()) {
+        __atomic_fetch_add(&gauges[gauge], amount, __ATOMIC_RELAXED);
+    }
+}
+
+// Start time of a timed stage; 0, and no clock read, while stats are off
+uint64_t stats_clock(void) {
+    if (!stats_is_enabled()) {
+        return 0;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Records the time since a stats_clock() reading
+void stats_record(StatsStage stage, uint64_t start) {
+    if (start != 0) {
+        uint64_t end = stats_clock();
+        stats_record_ns(stage, end > start ? end - start : 0);
+    }
+}
+
+void stats_record_ns(StatsStage stage, uint64_t ns) {
+    StatsShard *own;
+    if (stats_is_enabled() && (own = shard())) {
+        relaxed_add(&own->buckets[stage][stats_bucket(ns)], 1);
+        relaxed_add(&own->sum_ns[stage], ns);
+    }
+}
+
+static void merge_shard(StatsShard *into, const StatsShard *from) {
+    for (int i = 0; i < STATS_COUNTER_COUNT; i++) {
+        into->counters[i] += __atomic_load_n(&from->counters[i], __ATOMIC_RELAXED);
+    }
+    for (int stage = 0; stage < STATS_STAGE_COUNT; stage++) {
+        into->sum_ns[stage] += __atomic_load_n(&from->sum_ns[stage], __ATOMIC_RELAXED);
+        for (int b = 0; b < STATS_BUCKETS; b++) {
+            into->buckets[stage][b] += __atomic_load_n(&from->buckets[stage][b], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// Folds the calling thread's counts into the totals and frees its shard;
+// call before a counting thread exits
+void release_thread_stats(void) {
+    if (!thread_shard) {
+        return;
+    }
+    pthread_mutex_lock(&shards_lock);
+    merge_shard(&retired, thread_shard);
+    for (StatsShard **link = &live_shards; *link; link = &(*link)->next) {
+        if (*link == thread_shard) {
+            *link = thread_shard->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&shards_lock);
+    free(thread_shard);
+    thread_shard = NULL;
+}
+
+// Zeroes every count; only safe while no other thread is counting
+void stats_reset(void) {
+    pthread_mutex_lock(&shards_lock);
+    memset(&retired, 0, sizeof(retired));
+    for (StatsShard *s = live_shards; s; s = s->next) {
+        StatsShard *next = s->next;
+        memset(s, 0, sizeof(*s));
+        s->next = next;
+    }
+    memset(gauges, 0, sizeof(gauges));
+    pthread_mutex_unlock(&shards_lock);
+}
+
+// Maps a duration to its histogram bucket. Values below 2^SUB_BUCKET_BITS
+// get a bucket each; above that, the leading bit picks a power of two and
+// the next SUB_BUCKET_BITS bits the bucket within it.
+uint32_t stats_bucket(uint64_t ns) {
+    const uint32_t sub_buckets = 1u << STATS_SUB_BUCKET_BITS;
+    if (ns < sub_buckets) {
+        return (uint32_t)ns;
+    }
+    uint32_t top = 63 - (uint32_t)__builtin_clzll(ns);
+    if (top > STATS_MAX_BITS) {
+        return STATS_BUCKETS - 1;
+    }
+    uint32_t shift = top - STATS_SUB_BUCKET_BITS;
+    return ((shift + 1) << STATS_SUB_BUCKET_BITS) + (uint32_t)((ns >> shift) & (sub_buckets - 1));
+}
+
+// Largest duration that falls into a bucket
+uint64_t stats_bucket_upper(uint32_t bucket) {
+    const uint32_t sub_buckets = 1u << STATS_SUB_BUCKET_BITS;
+    if (bucket < 2 * sub_buckets) {
+        return bucket;
+    }
+    uint32_t shift = (bucket >> STATS_SUB_BUCKET_BITS) - 1;
+    uint64_t lower = (uint64_t)(sub_buckets + (bucket & (sub_buckets - 1))) << shift;
+    return lower + (1ull << shift) - 1;
+}
+
+// Sums every thread's counts, including threads that have exited
+void stats_snapshot(StatsSnapshot *snapshot) {
+    StatsShard total;
+    memset(&total, 0, sizeof(total));
+    pthread_mutex_lock(&shards_lock);
+    merge_shard(&total, &retired);
+    for (StatsShard *s = live_shards; s; s = s->next) {
+        merge_shard(&total, s);
+    }
+    pthread_mutex_unlock(&shards_lock);
+    memcpy(snapshot->counters, total.counters, sizeof(total.counters));
+    memcpy(snapshot->buckets, total.buckets, sizeof(total.buckets));
+    memcpy(snapshot->sum_ns, total.sum_ns, sizeof(total.sum_ns));
+    for (int i = 0; i < STATS_GAUGE_COUNT; i++) {
+        snapshot->gauges[i] = __atomic_load_n(&gauges[i], __ATOMIC_RELAXED);
+    }
+}
+
+// Returns the upper bound of the bucket holding the given quantile of a
+// stage's durations, or 0 if nothing was recorded
+uint64_t stats_percentile(const StatsSnapshot *snapshot, StatsStage stage, double quantile) {
+    uint64_t count = 0;
+    for (int b = 0; b < STATS_BUCKETS; b++) {
+        count += snapshot->buckets[stage][b];
+    }
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(quantile * count + 0.5);
+    rank = rank ? rank : 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < STATS_BUCKETS; b++) {
+        seen += snapshot->buckets[stage][b];
+        if (seen >= rank) {
+            return stats_bucket_upper(b);
+        }
+    }
+    return stats_bucket_upper(STATS_BUCKETS - 1);
+}
+
+// Writes a snapshot in the Prometheus text exposition format
+void stats_format(OutputSink *out, const StatsSnapshot *snapshot) {
+    for (int i = 0; i < STATS_COUNTER_COUNT; i++) {
+        sink_printf(out, "# HELP %s %s.\n# TYPE %s counter\n%s %llu\n", counter_names[i][0], counter_names[i][1],
+                    counter_names[i][0], counter_names[i][0], (unsigned long long)snapshot->counters[i]);
+    }
+    for (int i = 0; i < STATS_GAUGE_COUNT; i++) {
+        sink_printf(out, "# HELP %s %s.\n# TYPE %s gauge\n%s %lld\n", gauge_names[i][0], gauge_names[i][1],
+                    gauge_names[i][0], gauge_names[i][0], (long long)snapshot->gauges[i]);
+    }
+
+    sink_puts(out, "# HELP walpulse_stage_duration_seconds Time spent per item in each stage of the frame loop.\n"
+                   "# TYPE walpulse_stage_duration_seconds histogram\n");
+    for (int stage = 0; stage < STATS_STAGE_COUNT; stage++) {
+        uint64_t cumulative = 0;
+        int b = 0;
+        for (size_t i = 0; i < sizeof(exported_bounds) / sizeof(exported_bounds[0]); i++) {
+            for (; b < STATS_BUCKETS && stats_bucket_upper(b) <= exported_bounds[i]; b++) {
+                cumulative += snapshot->buckets[stage][b];
+            }
+            sink_printf(out, "walpulse_stage_duration_seconds_bucket{stage=\"%s\",le=\"%g\"} %llu\n",
+                        stage_names[stage], exported_bounds[i] / 1e9, (unsigned long long)cumulative);
+        }
+        for (; b < STATS_BUCKETS; b++) {
+            cumulative += snapshot->buckets[stage][b];
+        }
+        sink_printf(out, "walpulse_stage_duration_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %llu\n",
+                    stage_names[stage], (unsigned long long)cumulative);
+        sink_printf(out, "walpulse_stage_duration_seconds_sum{stage=\"%s\"} %.9f\n", stage_names[stage],
+                    snapshot->sum_ns[stage] / 1e9);
+        sink_printf(out, "walpulse_stage_duration_seconds_count{stage=\"%s\"} %llu\n", stage_names[stage],
+                    (unsigned long long)cumulative);
+    }
+
+    // Quantiles at full histogram resolution, for alerting on tails
+    sink_puts(out, "# HELP walpulse_stage_quantile_seconds Stage duration quantiles since start.\n"
+                   "# TYPE walpulse_stage_quantile_seconds gauge\n");
+    for (int stage = 0; stage < STATS_STAGE_COUNT; stage++) {
+        for (size_t i = 0; i < sizeof(exported_quantiles) / sizeof(exported_quantiles[0]); i++) {
+            sink_printf(out, "walpulse_stage_quantile_seconds{stage=\"%s\",quantile=\"%g\"} %.9f\n",
+                        stage_names[stage], exported_quantiles[i],
+                        stats_percentile(snapshot, stage, exported_quantiles[i]) / 1e9);
+        }
+    }
+}
+
+static int write_all(int fd, const char *data, size_t size) {
+    size_t written = 0;
+    while (written < size) {
+        ssize_t result = write(fd, data + written, size - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        written += (size_t)result;
+    }
+    return 0;
+}
+
+// Formats the current totals into a memory sink
+static int format_current(OutputSink *sink) {
+    StatsSnapshot *snapshot = malloc(sizeof(StatsSnapshot));
+    if (!snapshot) {
+        return report_error("Failed to allocate stats snapshot", 1);
+    }
+    if (sink_init(sink, -1, OUTPUT_TEXT) != 0) {
+        free(snapshot);
+        return -1;
+    }
+    stats_snapshot(snapshot);
+    stats_format(sink, snapshot);
+    free(snapshot);
+    return sink->failed ? -1 : 0;
+}
+
+// Replaces filename with the current totals. The file is written beside
+// it and renamed into place, so a scraper never sees half a file.
+int stats_write_file(const char *filename) {
+    OutputSink sink;
+    if (format_current(&sink) != 0) {
+        sink_free(&sink);
+        return -1;
+    }
+    size_t length = strlen(filename);
+    char *temporary = malloc(length + 5);
+    if (!temporary) {
+        sink_free(&sink);
+        return report_error("Failed to allocate stats file name", 1);
+    }
+    memcpy(temporary, filename, length);
+    memcpy(temporary + length, ".tmp", 5);
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    int status = fd < 0 ? -1 : write_all(fd, sink.data, sink.size);
+    if (fd >= 0 && close(fd) != 0) {
+        status = -1;
+    }
+    if (status == 0 && rename(temporary, filename) != 0) {
+        status = -1;
+    }
+    if (status != 0) {
+        report_error("Failed to write stats file", 1);
+        unlink(temporary);
+    }
+    free(temporary);
+    sink_free(&sink);
+    return status;
+}
+
+static void dump_to_stderr(void) {
+    OutputSink sink;
+    if (format_current(&sink) == 0) {
+        write_all(STDERR_FILENO, sink.data, sink.size);
+    }
+    sink_free(&sink);
+}
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Rewrites the stats file every interval and serves dump requests
+static void *reporter_main(void *arg) {
+    (void)arg;
+    // Signals are handled by the threads doing the work
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, NULL);
+
+    uint64_t interval_ns = (uint64_t)stats_interval * 1000000000ull;
+    uint64_t next_write = monotonic_ns() + interval_ns;
+    struct timespec tick = { 0, REPORTER_TICK_NS };
+    while (!reporter_stop) {
+        nanosleep(&tick, NULL);
+        if (dump_requested) {
+            dump_requested = 0;
+            dump_to_stderr();
+        }
+        if (stats_filename && monotonic_ns() >= next_write) {
+            stats_write_file(stats_filename);
+            next_write = monotonic_ns() + interval_ns;
+        }
+    }
+    return NULL;
+}
+
+// Enables instrumentation and starts the reporter thread, which rewrites
+// filename (if not NULL) every interval_seconds and dumps to stderr after
+// stats_request_dump()
+int stats_start(const char *filename, unsigned interval_seconds) {
+    if (filename && !(stats_filename = strdup(filename))) {
+        return report_error("Failed to allocate stats file name", 1);
+    }
+    stats_interval = interval_seconds ? interval_seconds : STATS_DEFAULT_INTERVAL;
+    reporter_stop = 0;
+    stats_enable(1);
+    if (pthread_create(&reporter, NULL, reporter_main, NULL) != 0) {
+        stats_enable(0);
+        free(stats_filename);
+        stats_filename = NULL;
+        report_error("Failed to start stats reporter", 0);
+        return -1;
+    }
+    reporter_running = 1;
+    return 0;
+}
+
+// Asks the reporter for a dump on stderr; safe to call from a signal handler
+void stats_request_dump(void) {
+    dump_requested = 1;
+}
+
+// Stops the reporter and writes the stats file one last time
+void stats_stop(void) {
+    if (!reporter_running) {
+        return;
+    }
+    reporter_stop = 1;
+    pthread_join(reporter, NULL);
+    reporter_running = 0;
+    if (dump_requested) {
+        dump_requested = 0;
+        dump_to_stderr();
+    }
+    if (stats_filename) {
+        stats_write_file(stats_filename);
+        free(stats_filename);
+        stats_filename = NULL;
+    }
+    release_thread_stats();
+    stats_enable(0);
+}
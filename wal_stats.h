@@ -0,0 +1,77 @@
+#ifndef WAL_STATS_H
+#define WAL_STATS_H
+
+#include "output_sink.h"
+#include <stdint.h>
+
+// Histogram resolution: each power of two of nanoseconds is split into
+// 2^STATS_SUB_BUCKET_BITS buckets, so a recorded value is off by at most 1/16
+#define STATS_SUB_BUCKET_BITS 4
+#define STATS_MAX_BITS 40           // ~18 minutes; longer durations land in the top bucket
+#define STATS_BUCKETS ((STATS_MAX_BITS - STATS_SUB_BUCKET_BITS + 2) << STATS_SUB_BUCKET_BITS)
+#define STATS_DEFAULT_INTERVAL 10   // Seconds between stats file rewrites
+
+typedef enum {
+    STATS_FRAMES = 0,           // Frames checksummed, by the decoder or a listener
+    STATS_WAL_BYTES,            // Frame headers and pages read
+    STATS_CHECKSUM_FAILURES,    // Frames whose salt or checksum did not match
+    STATS_CELLS,                // Table leaf cells parsed
+    STATS_TRANSACTIONS,         // Committed transactions delivered to listeners
+    STATS_OUTPUT_BYTES,         // Bytes written to output files
+    STATS_BACKPRESSURE_WAITS,   // Times a pipeline stage found the next stage's queue full
+    STATS_CACHE_HITS,           // Database page reads served by a page cache
+    STATS_CACHE_MISSES,         // Database pages read from the file into a page cache
+    STATS_CACHE_EVICTIONS,      // Cold pages replaced in a page cache
+    STATS_CACHE_INVALIDATIONS,  // Page caches emptied after a checkpoint
+    STATS_COUNTER_COUNT
+} StatsCounter;
+
+typedef enum {
+    STATS_DECODE_BACKLOG = 0,   // Decoded chunks waiting to be merged into the output
+    STATS_WAL_PENDING,          // WAL bytes past the last verified frame, as of the last pass
+    STATS_DECODE_QUEUE,         // Checked chunks waiting for a decoder
+    STATS_GAUGE_COUNT
+} StatsGauge;
+
+// Timed stages of the frame loop, each with its own latency histogram
+typedef enum {
+    STATS_CHECKSUM = 0,         // Checksum of one frame
+    STATS_LOOKUP,               // Page ownership update and lookup for one frame
+    STATS_DECODE,               // Decoding and formatting one frame
+    STATS_CELLS_PAGE,           // Parsing the cells of one table leaf
+    STATS_WRITE,                // One write of buffered output
+    STATS_STAGE_COUNT
+} StatsStage;
+
+// Totals across every thread. Threads count into their own shard without
+// locking; a snapshot sums the shards.
+typedef struct {
+    uint64_t counters[STATS_COUNTER_COUNT];
+    int64_t gauges[STATS_GAUGE_COUNT];
+    uint64_t buckets[STATS_STAGE_COUNT][STATS_BUCKETS];
+    uint64_t sum_ns[STATS_STAGE_COUNT];
+} StatsSnapshot;
+
+void stats_enable(int enabled);
+int stats_is_enabled(void);
+void stats_add(StatsCounter counter, uint64_t amount);
+void stats_gauge_set(StatsGauge gauge, int64_t value);
+void stats_gauge_add(StatsGauge gauge, int64_t amount);
+uint64_t stats_clock(void);
+void stats_record(StatsStage stage, uint64_t start);
+void stats_record_ns(StatsStage stage, uint64_t ns);
+void release_thread_stats(void);
+void stats_reset(void);
+
+uint32_t stats_bucket(uint64_t ns);
+uint64_t stats_bucket_upper(uint32_t bucket);
+void stats_snapshot(StatsSnapshot* snapshot);
+uint64_t stats_percentile(const StatsSnapshot* snapshot, StatsStage stage, double quantile);
+void stats_format(OutputSink* out, const StatsSnapshot* snapshot);
+int stats_write_file(const char* filename);
+
+int stats_start(const char* filename, unsigned interval_seconds);
+void stats_request_dump(void);
+void stats_stop(void);
+
+#endif
@@ -0,0 +1,49 @@
+#include "wal_transaction.h"
+#include <string.h>
+
+// Starts batching a new WAL generation; anything still open is not counted
+void transaction_batcher_init(TransactionBatcher *batcher, const WalHeader *header) {
+    memset(batcher, 0, sizeof(*batcher));
+    batcher->salt1 = header->salt1;
+    batcher->salt2 = header->salt2;
+}
+
+// Adds the next frame of the WAL, in order. verified is 0 when the frame
+// failed its checksum. Fills *transaction when the frame is a commit.
+BatchResult transaction_batcher_add(TransactionBatcher *batcher, const WalFrameView *frame, int verified,
+                                    WalTransaction *transaction) {
+    // As in SQLite, the log ends at the first frame that does not belong to it
+    if (!verified || frame->header.salt1 != batcher->salt1 || frame->header.salt2 != batcher->salt2) {
+        batcher->broken = 1;
+    }
+    if (batcher->broken) {
+        transaction_batcher_abandon(batcher);
+        batcher->dropped++;
+        return BATCH_DROPPED;
+    }
+
+    if (batcher->pending == 0) {
+        batcher->first_frame = frame->frame_number;
+    }
+    batcher->pending++;
+    if (frame->header.commit_size == 0) {
+        return BATCH_BUFFERED;
+    }
+    transaction->first_frame = batcher->first_frame;
+    transaction->commit_frame = frame->frame_number;
+    transaction->database_size = frame->header.commit_size;
+    batcher->first_frame = 0;
+    batcher->pending = 0;
+    batcher->committed++;
+    return BATCH_COMMITTED;
+}
+
+// Drops the open transaction, e.g. at the end of a WAL that a crashed
+// writer left without a commit. Returns the number of frames dropped.
+uint32_t transaction_batcher_abandon(TransactionBatcher *batcher) {
+    uint32_t pending = batcher->pending;
+    batcher->dropped += pending;
+    batcher->first_frame = 0;
+    batcher->pending = 0;
+    return pending;
+}
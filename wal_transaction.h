@@ -0,0 +1,42 @@
+#ifndef WAL_TRANSACTION_H
+#define WAL_TRANSACTION_H
+
+#include "wal_format.h"
+#include "wal_reader.h"
+#include <stdint.h>
+
+// One committed transaction: a run of consecutive frames ending in the
+// frame whose commit size is non-zero
+typedef struct {
+    uint32_t first_frame;
+    uint32_t commit_frame;
+    uint32_t database_size;     // Database size in pages after the commit
+} WalTransaction;
+
+// Groups frames into transactions. Frames are not copied: they stay in the
+// WAL until their commit frame arrives, and the batch is then handed on as
+// one frame range. Frames with the wrong salts, frames after one that
+// failed its checksum, and frames whose transaction never commits are
+// dropped. Plain data, so it can live in a resumable WalState.
+typedef struct {
+    uint32_t salt1;
+    uint32_t salt2;
+    uint32_t first_frame;       // First frame of the open transaction, 0 if none
+    uint32_t pending;           // Frames buffered in the open transaction
+    uint8_t broken;             // Set once a frame fails; the rest of the generation is dropped
+    uint64_t committed;         // Transactions handed on
+    uint64_t dropped;           // Frames discarded
+} TransactionBatcher;
+
+typedef enum {
+    BATCH_BUFFERED = 0,         // Frame joined the open transaction
+    BATCH_COMMITTED,            // Frame completed a transaction
+    BATCH_DROPPED               // Frame will never be published
+} BatchResult;
+
+void transaction_batcher_init(TransactionBatcher* batcher, const WalHeader* header);
+BatchResult transaction_batcher_add(TransactionBatcher* batcher, const WalFrameView* frame, int verified,
+                                    WalTransaction* transaction);
+uint32_t transaction_batcher_abandon(TransactionBatcher* batcher);
+
+#endif
@@ -0,0 +1,404 @@
+#include "walpulse.h"
+#include "arena.h"
+#include "frame_index.h"
+#include "page_analyzer.h"
+#include "page_owner.h"
+#include "page_source.h"
+#include "record_view.h"
+#include "row_changes.h"
+#include "row_diff.h"
+#include "subscription.h"
+#include "utils.h"
+#include "wal_listener.h"
+#include "wal_reader.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+_Static_assert(WALPULSE_DELETE == (int)ROW_DELETE, "WalpulseOperation must mirror RowChangeType");
+_Static_assert(WALPULSE_INVALID == (int)SERIAL_INVALID, "WalpulseType must mirror SerialClass");
+
+// A record handed out in a batch; the view points into cell's serial types
+typedef struct {
+    CellInfo cell;
+    RecordView view;
+} LibraryRecord;
+
+struct Walpulse {
+    char *wal_filename;
+    const char *wal_base;       // WAL name within its directory, in wal_filename
+    PageOwnerMap owners;
+    FrameIndex index;           // Frames delivered in the current generation
+    RowDiff diff;
+    Subscription subscription;
+    WalReader reader;
+    int reader_open;
+    WalState state;
+    Arena arena;                // Everything the pending batch points at
+    WalpulseChange *pending;
+    uint32_t pending_count;
+    uint32_t pending_complete;  // Pending changes of transactions queued in full
+    uint32_t pending_capacity;
+    WalpulseCallback callback;
+    void *context;
+    WalpulseOptions options;
+    int inotify_fd;
+    int stop_fd;                // eventfd written by walpulse_stop()
+    int failed;                 // A transaction could not be diffed during this poll
+    uint32_t delivered;         // Changes handed to the callback during this poll
+};
+
+// Hands the pending changes to the callback, then recycles the arena
+static void deliver_pending(Walpulse *pulse) {
+    if (pulse->pending_count && pulse->callback) {
+        pulse->callback(pulse->pending, pulse->pending_count, pulse->context);
+    }
+    pulse->delivered += pulse->pending_count;
+    pulse->pending_count = 0;
+    pulse->pending_complete = 0;
+    arena_reset(&pulse->arena);
+}
+
+// Copies a string into the arena; b-tree names can change before delivery
+static const char *arena_strdup(Arena *arena, const char *text) {
+    size_t length = strlen(text) + 1;
+    char *copy = arena_alloc(arena, length);
+    if (copy) {
+        memcpy(copy, text, length);
+    }
+    return copy;
+}
+
+// Builds a view of the record in a table leaf cell, or NULL
+static const WalpulseRecord *make_record(Walpulse *pulse, const uint8_t *page, uint16_t cell_offset,
+                                         const PageSource *source) {
+    if (!page) {
+        return NULL;
+    }
+    LibraryRecord *record = arena_alloc(&pulse->arena, sizeof(LibraryRecord));
+    if (!record || parse_cell(&record->cell, page, cell_offset, source->page_size, &pulse->arena) != 0 ||
+        record_view_init(&record->view, &record->cell, page, source->page_size, source, &pulse->arena) != 0) {
+        return NULL;
+    }
+    return &record->view;
+}
+
+// Queues one change; -1 if memory runs out
+static int add_pending(Walpulse *pulse, const WalpulseChange *change) {
+    if (pulse->pending_count == pulse->pending_capacity) {
+        uint32_t capacity = pulse->pending_capacity ? pulse->pending_capacity * 2 : 64;
+        WalpulseChange *pending = realloc(pulse->pending, capacity * sizeof(WalpulseChange));
+        if (!pending) {
+            report_error("Failed to allocate memory for pending changes", 0);
+            return -1;
+        }
+        pulse->pending = pending;
+        pulse->pending_capacity = capacity;
+    }
+    pulse->pending[pulse->pending_count++] = *change;
+    return 0;
+}
+
+// Diffs a committed transaction and queues its row changes. New records
+// read overflow pages as of the commit, old ones as of just before the
+// transaction.
+static void library_on_transaction(const WalReader *reader, const WalTransaction *transaction, void *context) {
+    Walpulse *pulse = context;
+    WalFrameView frame;
+    // Index the whole batch first; overflow pages may follow the leaf that uses them
+    for (uint32_t n = transaction->first_frame; n <= transaction->commit_frame; n++) {
+        if (wal_reader_frame(reader, n, &frame) == 0) {
+            frame_index_add(&pulse->index, n, frame.header.page_number, frame.header.commit_size);
+        }
+    }
+    PageSource *sources = arena_alloc(&pulse->arena, 2 * sizeof(PageSource));
+    if (!sources) {
+        report_error("Failed to allocate memory for page sources", 0);
+        pulse->failed = 1;
+        return;
+    }
+    page_source_init(&sources[0], reader, &pulse->index, &pulse->owners.cache, reader->page_size,
+                     pulse->owners.usable_size);
+    sources[0].max_frame = transaction->commit_frame;
+    sources[1] = sources[0];
+    sources[1].index = transaction->first_frame > 1 ? &pulse->index : NULL;
+    sources[1].max_frame = transaction->first_frame - 1;
+
+    const Subscription *subscription = pulse->subscription.count ? &pulse->subscription : NULL;
+    if (collect_row_changes(&pulse->diff, &pulse->owners, subscription, reader, transaction, &sources[0],
+                            &pulse->arena) != 0) {
+        pulse->failed = 1;
+        return;
+    }
+    for (uint32_t i = 0; i < pulse->diff.count; i++) {
+        const RowChange *row = &pulse->diff.changes[i];
+        WalpulseChange change = {
+            .table = row->table >= 0 ? arena_strdup(&pulse->arena, pulse->owners.btrees[row->table].name) : NULL,
+            .rowid = row->rowid,
+            .page_number = row->page_number,
+            .operation = row->type,
+            .commit_frame = transaction->commit_frame,
+            .record = make_record(pulse, row->new_page, row->new_cell, &sources[0]),
+            .old_record = make_record(pulse, row->old_page, row->old_cell, &sources[1])
+        };
+        if (add_pending(pulse, &change) != 0) {
+            pulse->failed = 1;
+            return;
+        }
+    }
+    pulse->pending_complete = pulse->pending_count;
+    if (pulse->options.max_changes && pulse->pending_count >= pulse->options.max_changes) {
+        deliver_pending(pulse);
+    }
+}
+
+// Starts a new WAL generation; checkpointed pages now live in the database
+static void library_on_reset(const WalHeader *header, void *context) {
+    Walpulse *pulse = context;
+    (void)header;
+    page_owner_reset_wal(&pulse->owners);
+    frame_index_reset(&pulse->index);
+}
+
+// Picks up again after the committed position, once a WAL truncated under
+// a poll has been reopened: the owner map and frame index are rebuilt from
+// the frames delivered before it, as if they had just been followed
+static void library_on_resume(const WalReader *reader, const WalResumePoint *point, void *context) {
+    Walpulse *pulse = context;
+    page_owner_reset_wal(&pulse->owners);
+    frame_index_reset(&pulse->index);
+    WalFrameView frame;
+    for (uint32_t n = 1; n <= point->commit_frame && wal_reader_frame(reader, n, &frame) == 0; n++) {
+        frame_index_add(&pulse->index, n, frame.header.page_number, frame.header.commit_size);
+        page_owner_apply_frame(&pulse->owners, reader, &frame);
+    }
+}
+
+// Opens a database for change delivery. The database file must exist; its
+// WAL may appear later. Returns NULL on failure.
+Walpulse *walpulse_open(const char *db_filename) {
+    Walpulse *pulse = calloc(1, sizeof(Walpulse));
+    if (!pulse) {
+        report_error("Failed to allocate memory for walpulse", 0);
+        return NULL;
+    }
+    pulse->inotify_fd = -1;
+    pulse->stop_fd = -1;
+    size_t length = strlen(db_filename);
+    if (!(pulse->wal_filename = malloc(length + 5))) {
+        report_error("Failed to allocate memory for WAL filename", 0);
+        free(pulse);
+        return NULL;
+    }
+    memcpy(pulse->wal_filename, db_filename, length);
+    memcpy(pulse->wal_filename + length, "-wal", 5);
+    const char *slash = strrchr(pulse->wal_filename, '/');
+    pulse->wal_base = slash ? slash + 1 : pulse->wal_filename;
+
+    if (page_owner_open(&pulse->owners, db_filename) != 0) {
+        free(pulse->wal_filename);
+        free(pulse);
+        return NULL;
+    }
+    frame_index_init(&pulse->index);
+    row_diff_init(&pulse->diff);
+    subscription_init(&pulse->subscription);
+    wal_state_init(&pulse->state);
+    arena_init(&pulse->arena, ARENA_BLOCK_SIZE);
+    int status = 0;
+
+    // Watching the directory keeps track of a WAL that is deleted and recreated
+    char *dir = slash ? strndup(pulse->wal_filename, (size_t)(slash - pulse->wal_filename)) : strdup(".");
+    uint32_t mask = IN_MODIFY | IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM;
+    if (status == 0 && (!dir || (pulse->inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK)) < 0 ||
+                        inotify_add_watch(pulse->inotify_fd, dir[0] ? dir : "/", mask) < 0)) {
+        status = report_error("Failed to watch WAL directory", 1);
+    }
+    free(dir);
+    if (status == 0 && (pulse->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+        status = report_error("Failed to create stop event", 1);
+    }
+    if (status != 0) {
+        walpulse_close(pulse);
+        return NULL;
+    }
+    return pulse;
+}
+
+// Restricts delivery to a table, in the form --table takes:
+// NAME[:rowid=FIRST..LAST][:columns=N,N,...]. Without any call every
+// table and index is delivered.
+int walpulse_watch(Walpulse *pulse, const char *spec) {
+    if (subscription_add(&pulse->subscription, spec) != 0) {
+        return -1;
+    }
+    return page_owner_watch(&pulse->owners, pulse->subscription.names, pulse->subscription.count);
+}
+
+// Sets where batches go; options may be NULL for one batch per poll
+void walpulse_set_callback(Walpulse *pulse, WalpulseCallback callback, void *context,
+                           const WalpulseOptions *options) {
+    pulse->callback = callback;
+    pulse->context = context;
+    memset(&pulse->options, 0, sizeof(pulse->options));
+    if (options) {
+        pulse->options = *options;
+    }
+}
+
+// Reads the pending inotify events; returns 1 if the WAL was replaced
+static int drain_events(Walpulse *pulse) {
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int replaced = 0;
+    ssize_t length;
+    while ((length = read(pulse->inotify_fd, buffer, sizeof(buffer))) > 0) {
+        for (char *p = buffer; p < buffer + length;) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            if (event->len > 0 && strcmp(event->name, pulse->wal_base) == 0 &&
+                (event->mask & (IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM))) {
+                replaced = 1;
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    return replaced;
+}
+
+// Delivers every transaction committed since the last poll, without
+// blocking. Batches reach the callback as max_changes fills up, and the
+// rest at the end of the poll. Returns the number of changes delivered, or
+// -1 if a transaction could not be diffed.
+int walpulse_poll(Walpulse *pulse) {
+    if (drain_events(pulse) && pulse->reader_open) {
+        wal_reader_close(&pulse->reader);
+        wal_state_init(&pulse->state);
+        pulse->reader_open = 0;
+    }
+    if (!pulse->reader_open && access(pulse->wal_filename, F_OK) == 0) {
+        pulse->reader_open = wal_reader_open(&pulse->reader, pulse->wal_filename) == 0;
+    }
+    if (!pulse->reader_open) {
+        return 0;
+    }
+    WalListener listener = {
+        .on_transaction = library_on_transaction,
+        .on_reset = library_on_reset,
+        .on_resume = library_on_resume,
+        .context = pulse
+    };
+    pulse->failed = 0;
+    pulse->delivered = 0;
+    int status = process_wal_changes(&pulse->state, &pulse->reader, &listener);
+    if (status < 0) {
+        // The WAL shrank or vanished under the map: a transaction it cut
+        // short is queued again by the rescan from the next poll's reopen
+        pulse->pending_count = pulse->pending_complete;
+        wal_reader_close(&pulse->reader);
+        pulse->reader_open = 0;
+    }
+    deliver_pending(pulse);
+    return pulse->failed ? -1 : (int)pulse->delivered;
+}
+
+// Returns a descriptor that becomes readable when the WAL changes, for an
+// event loop that calls walpulse_poll() itself
+int walpulse_fd(const Walpulse *pulse) {
+    return pulse->inotify_fd;
+}
+
+// Polls whenever the WAL changes until walpulse_stop(). After the first
+// change, max_latency_ms passes before the poll so that a burst of commits
+// is delivered together.
+int walpulse_run(Walpulse *pulse) {
+    int status = walpulse_poll(pulse) < 0 ? -1 : 0;
+    struct pollfd fds[2] = {
+        { .fd = pulse->stop_fd, .events = POLLIN },
+        { .fd = pulse->inotify_fd, .events = POLLIN }
+    };
+    while (status == 0) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            status = report_error("Failed to wait for WAL changes", 1);
+            break;
+        }
+        if (fds[0].revents) {
+            break;
+        }
+        if (pulse->options.max_latency_ms && poll(fds, 1, (int)pulse->options.max_latency_ms) > 0) {
+            break;
+        }
+        if (walpulse_poll(pulse) < 0) {
+            status = -1;
+        }
+    }
+    uint64_t count;
+    if (read(pulse->stop_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        report_error("Failed to clear stop event", 0);
+    }
+    return status;
+}
+
+// Makes walpulse_run() return; safe from another thread or a signal handler
+void walpulse_stop(Walpulse *pulse) {
+    uint64_t one = 1;
+    if (write(pulse->stop_fd, &one, sizeof(one)) < 0) {
+        report_error("Failed to signal stop event", 0);
+    }
+}
+
+// Closes the database and releases everything walpulse_open() set up
+void walpulse_close(Walpulse *pulse) {
+    if (!pulse) {
+        return;
+    }
+    if (pulse->reader_open) {
+        wal_reader_close(&pulse->reader);
+    }
+    if (pulse->stop_fd >= 0) {
+        close(pulse->stop_fd);
+    }
+    if (pulse->inotify_fd >= 0) {
+        close(pulse->inotify_fd);
+    }
+    arena_free(&pulse->arena);
+    free(pulse->pending);
+    subscription_free(&pulse->subscription);
+    row_diff_free(&pulse->diff);
+    frame_index_free(&pulse->index);
+    page_owner_close(&pulse->owners);
+    free(pulse->wal_filename);
+    free(pulse);
+}
+
+// Returns the number of columns in a record
+uint32_t walpulse_record_columns(const WalpulseRecord *record) {
+    return record->column_count;
+}
+
+// Returns the storage class of a column
+WalpulseType walpulse_record_type(const WalpulseRecord *record, uint32_t column) {
+    return (WalpulseType)record_column_class(record, column);
+}
+
+// Reads an integer column; -1 if it is not an integer
+int walpulse_record_int64(const WalpulseRecord *record, uint32_t column, int64_t *value) {
+    return record_column_int64(record, column, value);
+}
+
+// Reads a floating point column; -1 if it is not a float
+int walpulse_record_double(const WalpulseRecord *record, uint32_t column, double *value) {
+    return record_column_double(record, column, value);
+}
+
+// Points at a TEXT or BLOB column, following overflow pages if needed.
+// Text is not NUL-terminated.
+int walpulse_record_bytes(const WalpulseRecord *record, uint32_t column, const uint8_t **data,
+                          uint32_t *length) {
+    return record_column_fetch(record, column, data, length);
+}
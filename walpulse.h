@@ -0,0 +1,74 @@
+#ifndef WALPULSE_H
+#define WALPULSE_H
+
+// libwalpulse: row changes of a SQLite database in WAL mode, delivered to a
+// callback in batches as transactions commit. This header is the whole
+// public interface and only needs <stdint.h>; link with -lwalpulse.
+//
+// Changes are zero-copy: a change's records point straight into the
+// memory-mapped WAL, or into the library's arena for page images read from
+// the database file. Everything a batch points at stays valid until the
+// callback returns and must not be kept past it.
+
+#include <stdint.h>
+
+#define WALPULSE_API __attribute__((visibility("default")))
+
+typedef struct Walpulse Walpulse;
+
+// A row record; read it with the walpulse_record_* accessors
+typedef struct RecordView WalpulseRecord;
+
+typedef enum {
+    WALPULSE_INSERT = 0,
+    WALPULSE_UPDATE,
+    WALPULSE_DELETE
+} WalpulseOperation;
+
+typedef enum {
+    WALPULSE_NULL = 0,
+    WALPULSE_INTEGER,
+    WALPULSE_FLOAT,
+    WALPULSE_BLOB,
+    WALPULSE_TEXT,
+    WALPULSE_INVALID            // Reserved serial type, or no such column
+} WalpulseType;
+
+// One net row change of a committed transaction
+typedef struct {
+    const char* table;                  // NULL if the owning table is unknown
+    int64_t rowid;
+    uint32_t page_number;               // Page holding the row afterwards, or before for deletes
+    uint8_t operation;                  // WalpulseOperation
+    uint32_t commit_frame;              // WAL frame that committed the change
+    const WalpulseRecord* record;       // The row afterwards; NULL for deletes
+    const WalpulseRecord* old_record;   // The row before; NULL for inserts
+} WalpulseChange;
+
+// Receives changes in commit order, sorted by table and rowid within each
+// transaction. A batch always holds whole transactions.
+typedef void (*WalpulseCallback)(const WalpulseChange* changes, uint32_t count, void* context);
+
+typedef struct {
+    uint32_t max_changes;       // Deliver once this many changes are pending; 0 to deliver once per poll
+    uint32_t max_latency_ms;    // How long walpulse_run() lets WAL writes gather before a poll
+} WalpulseOptions;
+
+WALPULSE_API Walpulse* walpulse_open(const char* db_filename);
+WALPULSE_API int walpulse_watch(Walpulse* pulse, const char* spec);
+WALPULSE_API void walpulse_set_callback(Walpulse* pulse, WalpulseCallback callback, void* context,
+                                        const WalpulseOptions* options);
+WALPULSE_API int walpulse_poll(Walpulse* pulse);
+WALPULSE_API int walpulse_fd(const Walpulse* pulse);
+WALPULSE_API int walpulse_run(Walpulse* pulse);
+WALPULSE_API void walpulse_stop(Walpulse* pulse);
+WALPULSE_API void walpulse_close(Walpulse* pulse);
+
+WALPULSE_API uint32_t walpulse_record_columns(const WalpulseRecord* record);
+WALPULSE_API WalpulseType walpulse_record_type(const WalpulseRecord* record, uint32_t column);
+WALPULSE_API int walpulse_record_int64(const WalpulseRecord* record, uint32_t column, int64_t* value);
+WALPULSE_API int walpulse_record_double(const WalpulseRecord* record, uint32_t column, double* value);
+WALPULSE_API int walpulse_record_bytes(const WalpulseRecord* record, uint32_t column, const uint8_t** data,
+                                       uint32_t* length);
+
+#endif